@@ -0,0 +1,148 @@
+#include "Benchmark.h"
+
+#include <iostream>
+#include <map>
+
+//======================================================================================================================
+// Every heap allocation in the process goes through here, so a scenario can prove its steady state doesn't allocate.
+namespace AllocationCounter {
+
+static void* allocate(std::size_t size)
+{
+    count.fetch_add(1, std::memory_order_relaxed);
+
+    if (auto* p = std::malloc(size == 0 ? 1 : size))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+static void* allocateAligned(std::size_t size, std::align_val_t alignment)
+{
+    count.fetch_add(1, std::memory_order_relaxed);
+
+    const auto align = jmax(static_cast<std::size_t>(alignment), sizeof(void*));
+
+   #if JUCE_WINDOWS
+    if (auto* p = _aligned_malloc(size == 0 ? 1 : size, align))
+        return p;
+   #else
+    void* p = nullptr;
+
+    if (posix_memalign(&p, align, size == 0 ? 1 : size) == 0)
+        return p;
+   #endif
+
+    throw std::bad_alloc();
+}
+
+static void freeAligned(void* p)
+{
+   #if JUCE_WINDOWS
+    _aligned_free(p);
+   #else
+    std::free(p);
+   #endif
+}
+} // namespace AllocationCounter
+
+void* operator new(std::size_t size) { return AllocationCounter::allocate(size); }
+void* operator new[](std::size_t size) { return AllocationCounter::allocate(size); }
+void* operator new(std::size_t size, std::align_val_t a) { return AllocationCounter::allocateAligned(size, a); }
+void* operator new[](std::size_t size, std::align_val_t a) { return AllocationCounter::allocateAligned(size, a); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { AllocationCounter::freeAligned(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { AllocationCounter::freeAligned(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { AllocationCounter::freeAligned(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { AllocationCounter::freeAligned(p); }
+
+//======================================================================================================================
+namespace Bench {
+
+using Scenario = Result (*)(const Options&);
+
+static const std::map<String, Scenario>& getScenarios()
+{
+    static const std::map<String, Scenario> scenarios{
+            {"paced",      runPaced},
+            {"contention", runContention},
+            {"reconnect",  runReconnect},
+            {"recorder",   runRecorder},
+            {"replay",     runReplay},
+            {"blemidi",    runBleMidi},
+            {"offload",    runOffload},
+            {"fairness",   runFairness},
+            {"output",     runOutput},
+            {"fanout",     runFanout},
+            {"routing",    runRouting},
+            {"connections", runConnections},
+            {"enumeration", runEnumeration},
+            {"tracing",    runTracing},
+            {"stats",      runStats},
+            {"merge",      runMerge},
+            {"transfers",  runTransfers},
+    };
+
+    return scenarios;
+}
+} // namespace Bench
+
+//======================================================================================================================
+int main(int argc, char* argv[])
+{
+    const ArgumentList args(argc, argv);
+
+    if (args.containsOption("--help|-h"))
+    {
+        std::cout << "Usage: " << args.executableName << " [--scenario=NAME] [--devices=N] [--seconds=S] [--warmup=S]\n"
+                     "  [--midi-rate=HZ] [--ble-rate=HZ] [--jitter=F] [--sysex-fraction=F] [--sysex-size=BYTES]\n"
+                     "  [--ble-payload=BYTES] [--burst=N] [--older-link-share=F] [--drain-interval=S]\n"
+                     "  [--discovery-ms=MS] [--cached-discovery-ms=MS] [--capture-dir=DIR]\n"
+                     "  [--replay-speed=X] [--workers=N] [--worker-batch=N] [--first-core=N] [--realtime-workers]\n"
+                     "  [--sink-work-ns=NS] [--connection-interval-ms=MS] [--packets-per-event=N] [--att-mtu=BYTES]\n"
+                     "  [--flush-interval-us=US] [--connection-budget=HZ] [--flaps=N] [--trace=FILE]\n"
+                     "  [--stats-rate=HZ] [--readers=N] [--reorder-ms=MS] [--drift-ppm=PPM] [--transfer-size=BYTES]\n"
+                     "  [--assert-no-alloc] [--output=FILE]\n\nScenarios:";
+
+        for (const auto& [name, fn] : Bench::getScenarios())
+            std::cout << " " << name;
+
+        std::cout << std::endl;
+        return 0;
+    }
+
+    const auto options   = Bench::Options::parse(args);
+    const auto& scenarios = Bench::getScenarios();
+    const auto it        = scenarios.find(options.scenario);
+
+    if (it == scenarios.end())
+    {
+        std::cerr << "Unknown scenario: " << options.scenario << std::endl;
+        return 2;
+    }
+
+    const auto result = it->second(options);
+
+    auto* o = new DynamicObject();
+    o->setProperty("scenario", options.scenario);
+    o->setProperty("options", options.toVar());
+    o->setProperty("events", static_cast<int64>(result.events));
+    o->setProperty("seconds", result.seconds);
+    o->setProperty("events_per_sec", result.seconds > 0.0 ? static_cast<double>(result.events) / result.seconds : 0.0);
+    o->setProperty("allocations", static_cast<int64>(result.allocations));
+    o->setProperty("allocations_per_event", result.events > 0 ? static_cast<double>(result.allocations) / static_cast<double>(result.events) : 0.0);
+    o->setProperty("results", result.details);
+
+    const auto json = JSON::toString(var(o));
+
+    if (options.output.isNotEmpty())
+        File::getCurrentWorkingDirectory().getChildFile(options.output).replaceWithText(json);
+    else
+        std::cout << json << std::endl;
+
+    return options.assertNoAlloc && result.allocations > 0 ? 1 : 0;
+}
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "SimulatedBackend.h"
+
+#include <atomic>
+#include <thread>
+
+//======================================================================================================================
+// Counted by the global operator new in Benchmark.cpp, so a scenario can prove its steady state doesn't allocate.
+namespace AllocationCounter {
+inline std::atomic<uint64_t> count{0};
+} // namespace AllocationCounter
+
+//======================================================================================================================
+namespace Bench {
+
+inline void sleepFor(double seconds)
+{
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+}
+
+//======================================================================================================================
+struct Options
+{
+    String scenario          = "paced";
+    int    devices           = 4;
+    double seconds           = 5.0;
+    double warmup            = 0.5;
+    double midiRate          = 1000.0;
+    double bleRate           = 500.0;
+    double jitter            = 0.1;
+    double sysExFraction     = 0.0;
+    int    sysExSize         = 64;
+    int    blePayloadSize    = 20;
+    int    burstSize         = 1;
+    double olderLinkShare    = 1.0;
+    double drainInterval     = 0.001;
+    double discoveryMs       = 400.0;
+    double cachedDiscoveryMs = 40.0;
+    double replaySpeed       = 1.0;
+    int    workers           = 0; // 0 picks one per device, up to half the cores
+    int    workerBatch       = 256;
+    int    firstCore         = -1;
+    bool   realtimeWorkers   = false;
+    double sinkWorkNs        = 2000.0;
+    double connectionMs      = 7.5; // the connection interval
+    int    packetsPerEvent   = 6;
+    int    attMtu            = 185;
+    int    flushIntervalUs   = 0; // 0 flushes once per connection interval
+    double connectionBudget  = 250.0; // connection events per second the simulated radio can schedule
+    int    flaps             = 5;     // disconnects per BLE link, each followed by a reconnect
+    double statsRate         = 100.0; // stats segment publishes per second; the app does 4
+    int    readers           = 2;     // threads reading the stats segment
+    double reorderMs         = 10.0;  // the merge scenario's reorder window
+    double driftPpm          = 200.0; // the most a simulated device clock is off by in the merge scenario
+    int    transferSize      = 16384; // bytes per SysEx dump and per bulk transfer in the transfers scenario
+    bool   assertNoAlloc     = false;
+    String captureDirectory;
+    String traceFile;
+    String output;
+
+    static Options parse(const ArgumentList& args)
+    {
+        Options o;
+
+        const auto number = [&](const char* name, auto& value)
+        {
+            if (args.containsOption(name))
+                value = static_cast<std::remove_reference_t<decltype(value)>>(args.getValueForOption(name).getDoubleValue());
+        };
+
+        if (args.containsOption("--scenario"))
+            o.scenario = args.getValueForOption("--scenario");
+
+        if (args.containsOption("--output"))
+            o.output = args.getValueForOption("--output");
+
+        if (args.containsOption("--capture-dir"))
+            o.captureDirectory = args.getValueForOption("--capture-dir");
+
+        if (args.containsOption("--trace"))
+            o.traceFile = args.getValueForOption("--trace");
+
+        number("--devices", o.devices);
+        number("--seconds", o.seconds);
+        number("--warmup", o.warmup);
+        number("--midi-rate", o.midiRate);
+        number("--ble-rate", o.bleRate);
+        number("--jitter", o.jitter);
+        number("--sysex-fraction", o.sysExFraction);
+        number("--sysex-size", o.sysExSize);
+        number("--ble-payload", o.blePayloadSize);
+        number("--burst", o.burstSize);
+        number("--older-link-share", o.olderLinkShare);
+        number("--drain-interval", o.drainInterval);
+        number("--discovery-ms", o.discoveryMs);
+        number("--cached-discovery-ms", o.cachedDiscoveryMs);
+        number("--replay-speed", o.replaySpeed);
+        number("--workers", o.workers);
+        number("--worker-batch", o.workerBatch);
+        number("--first-core", o.firstCore);
+        number("--sink-work-ns", o.sinkWorkNs);
+        number("--connection-interval-ms", o.connectionMs);
+        number("--packets-per-event", o.packetsPerEvent);
+        number("--att-mtu", o.attMtu);
+        number("--flush-interval-us", o.flushIntervalUs);
+        number("--connection-budget", o.connectionBudget);
+        number("--flaps", o.flaps);
+        number("--stats-rate", o.statsRate);
+        number("--readers", o.readers);
+        number("--reorder-ms", o.reorderMs);
+        number("--drift-ppm", o.driftPpm);
+        number("--transfer-size", o.transferSize);
+
+        o.assertNoAlloc   = args.containsOption("--assert-no-alloc");
+        o.realtimeWorkers = args.containsOption("--realtime-workers");
+        o.devices       = jmax(1, o.devices);
+        return o;
+    }
+
+    [[nodiscard]] Simulation::DeviceSettings getDeviceSettings(int index) const
+    {
+        Simulation::DeviceSettings s;
+        s.name                  = "Device " + String(index);
+        s.midiMessagesPerSecond = midiRate;
+        s.blePacketsPerSecond   = bleRate;
+        s.jitter                = jitter;
+        s.blePayloadSize        = blePayloadSize;
+        s.sysExFraction         = sysExFraction;
+        s.sysExSize             = sysExSize;
+        s.burstSize             = burstSize;
+        s.discoveryMillis       = discoveryMs;
+        s.cachedDiscoveryMillis = cachedDiscoveryMs;
+        s.connectionIntervalMs  = connectionMs;
+        s.packetsPerEvent       = packetsPerEvent;
+        s.attMtu                = attMtu;
+        return s;
+    }
+
+    [[nodiscard]] var toVar() const
+    {
+        auto* o = new DynamicObject();
+        o->setProperty("devices", devices);
+        o->setProperty("seconds", seconds);
+        o->setProperty("warmup", warmup);
+        o->setProperty("midi_rate", midiRate);
+        o->setProperty("ble_rate", bleRate);
+        o->setProperty("jitter", jitter);
+        o->setProperty("sysex_fraction", sysExFraction);
+        o->setProperty("sysex_size", sysExSize);
+        o->setProperty("ble_payload", blePayloadSize);
+        o->setProperty("burst", burstSize);
+        o->setProperty("older_link_share", olderLinkShare);
+        o->setProperty("drain_interval", drainInterval);
+        o->setProperty("discovery_ms", discoveryMs);
+        o->setProperty("cached_discovery_ms", cachedDiscoveryMs);
+        o->setProperty("replay_speed", replaySpeed);
+        o->setProperty("workers", workers);
+        o->setProperty("worker_batch", workerBatch);
+        o->setProperty("first_core", firstCore);
+        o->setProperty("realtime_workers", realtimeWorkers);
+        o->setProperty("sink_work_ns", sinkWorkNs);
+        o->setProperty("connection_interval_ms", connectionMs);
+        o->setProperty("packets_per_event", packetsPerEvent);
+        o->setProperty("att_mtu", attMtu);
+        o->setProperty("flush_interval_us", flushIntervalUs);
+        o->setProperty("connection_budget", connectionBudget);
+        o->setProperty("flaps", flaps);
+        o->setProperty("stats_rate", statsRate);
+        o->setProperty("readers", readers);
+        o->setProperty("reorder_ms", reorderMs);
+        o->setProperty("drift_ppm", driftPpm);
+        o->setProperty("transfer_size", transferSize);
+        return var(o);
+    }
+};
+
+/** What every scenario reports besides its own numbers; allocations are counted over the measured window only. */
+struct Result
+{
+    var      details;
+    uint64_t events      = 0;
+    double   seconds     = 0.0;
+    uint64_t allocations = 0;
+};
+
+//======================================================================================================================
+/** A thread that keeps draining a set of channels until stopped, like the UI or a worker would. */
+class Drainer
+{
+public:
+    Drainer(std::vector<Ingest::MidiChannel*> midi, std::vector<Ingest::BleChannel*> ble, double intervalSeconds)
+            : thread([this, midi, ble, intervalSeconds]
+                     {
+                         while (!stop.load(std::memory_order_relaxed))
+                         {
+                             size_t n = 0;
+
+                             for (auto* c : midi)
+                                 n += c->drain([](const Ingest::MidiEvent&) {});
+
+                             for (auto* c : ble)
+                                 n += c->drain([](const Ingest::PacketView&) {});
+
+                             if (n == 0 && intervalSeconds > 0.0)
+                                 sleepFor(intervalSeconds);
+                         }
+                     })
+    {
+    }
+
+    ~Drainer()
+    {
+        stop = true;
+        thread.join();
+    }
+
+private:
+    std::atomic<bool> stop{false};
+    std::thread       thread;
+};
+
+//======================================================================================================================
+/** The scenarios, one per --scenario name, by the file they live in. Those that check a result do so before timing. */
+
+// BenchmarkPipeline.cpp: the ingest path, from callback to consumer
+Result runPaced(const Options& options);
+Result runContention(const Options& options);
+Result runOffload(const Options& options);
+Result runFanout(const Options& options);
+
+// BenchmarkBle.cpp: BLE connects, link fairness, output and connection parameters
+Result runReconnect(const Options& options);
+Result runFairness(const Options& options);
+Result runOutput(const Options& options);
+Result runConnections(const Options& options);
+
+// BenchmarkCapture.cpp: recording and replaying captures
+Result runRecorder(const Options& options);
+Result runReplay(const Options& options);
+
+// BenchmarkBleMidi.cpp: the BLE-MIDI decoder, checked against its reference
+Result runBleMidi(const Options& options);
+
+// BenchmarkRouting.cpp: the MIDI router, checked against a predicate chain
+Result runRouting(const Options& options);
+
+// BenchmarkDevices.cpp: the device table
+Result runEnumeration(const Options& options);
+
+// BenchmarkTracing.cpp: the tracer
+Result runTracing(const Options& options);
+
+// BenchmarkStats.cpp: the stats segment
+Result runStats(const Options& options);
+
+// BenchmarkMerge.cpp: the event merger, checked for order
+Result runMerge(const Options& options);
+
+// BenchmarkTransfers.cpp: the transfer assembler, checked byte for byte
+Result runTransfers(const Options& options);
+} // namespace Bench
@@ -0,0 +1,650 @@
+#include "Benchmark.h"
+
+#include "BleMidi.h"
+#include "ConnectionManager.h"
+#include "FairnessAnalyzer.h"
+#include "IngestConsumer.h"
+#include "MidiOutput.h"
+
+#include <thread>
+
+//======================================================================================================================
+namespace Bench {
+
+/**
+    Connects every device's BLE source at once, waits for each one's first notification, disconnects them all and
+    does the same again.
+
+    The first round pays for full GATT discovery, the second finds the handles cached, so the two rounds'
+    connect-to-first-notification times show what the cache saves. Issuing the connects together means the time
+    until the last device is up should track the slowest single connect, not the sum of them.
+*/
+Result runReconnect(const Options& options)
+{
+    std::vector<Simulation::DeviceSettings> settings;
+
+    for (int i = 0; i < options.devices; ++i)
+        settings.push_back(options.getDeviceSettings(i));
+
+    Simulation::SimulatedBackend backend(settings, {options.olderLinkShare});
+
+    std::vector<std::shared_ptr<Ingest::BleChannel>> channels;
+    std::vector<Ingest::BleChannel*>                 ble;
+
+    for (int i = 0; i < options.devices; ++i)
+    {
+        channels.push_back(std::make_shared<Ingest::BleChannel>(static_cast<uint16_t>(i), 1024));
+        ble.push_back(channels.back().get());
+    }
+
+    Drainer drainer({}, ble, options.drainInterval);
+
+    const auto timeout = static_cast<int64_t>((jmax(options.discoveryMs, options.cachedDiscoveryMs) + 5000.0) * 1.0e6);
+
+    const auto connect_all = [&]
+    {
+        std::vector<std::unique_ptr<Ingest::BlePacketSource>> sources;
+        std::vector<int64_t>                                  issued;
+
+        for (int i = 0; i < options.devices; ++i)
+        {
+            ble[static_cast<size_t>(i)]->resetFirstArrival();
+            issued.push_back(Ingest::hostNanos());
+            sources.push_back(backend.connectBleDevice(Simulation::SimulatedBackend::getBleDeviceId(i),
+                                                       channels[static_cast<size_t>(i)]));
+        }
+
+        const auto all_connected = [&]
+        {
+            return std::all_of(ble.begin(), ble.end(), [](auto* c) { return c->getFirstArrivalTime() != 0; });
+        };
+
+        while (!all_connected() && Ingest::hostNanos() - issued.front() < timeout)
+            sleepFor(0.001);
+
+        sources.clear();
+
+        var     devices = Array<var>();
+        int64_t sum = 0, slowest = 0, last = 0;
+        int     connected = 0;
+
+        for (size_t i = 0; i < ble.size(); ++i)
+        {
+            auto* d = new DynamicObject();
+            d->setProperty("index", static_cast<int>(i));
+
+            if (const auto first = ble[i]->getFirstArrivalTime(); first != 0)
+            {
+                const auto t = first - issued[i];
+                d->setProperty("connect_to_first_notification_ns", static_cast<int64>(t));
+
+                sum     += t;
+                slowest  = jmax(slowest, t);
+                last     = jmax(last, first - issued.front());
+                ++connected;
+            }
+
+            devices.append(var(d));
+        }
+
+        auto* r = new DynamicObject();
+        r->setProperty("connected", connected);
+        r->setProperty("mean_ns", connected > 0 ? static_cast<double>(sum) / connected : 0.0);
+        r->setProperty("slowest_ns", static_cast<int64>(slowest));
+        r->setProperty("all_connected_ns", static_cast<int64>(last));
+        r->setProperty("devices", devices);
+        return std::pair(var(r), connected > 0 ? static_cast<double>(sum) / connected : 0.0);
+    };
+
+    const auto start = Ingest::hostNanos();
+
+    const auto [cold, cold_mean] = connect_all();
+    const auto [warm, warm_mean] = connect_all();
+
+    Result result;
+    result.seconds = static_cast<double>(Ingest::hostNanos() - start) * 1.0e-9;
+    result.events  = static_cast<uint64_t>(options.devices) * 2;
+
+    auto* details = new DynamicObject();
+    details->setProperty("first_connect", cold);
+    details->setProperty("reconnect", warm);
+    details->setProperty("reconnect_speedup", warm_mean > 0.0 ? cold_mean / warm_mean : 0.0);
+    result.details = var(details);
+
+    return result;
+}
+
+//======================================================================================================================
+/**
+    The pipeline with a FairnessAnalyzer watching it, and the devices connecting one at a time, a window and a half
+    apart, so that under the radio model (--older-link-share below 1) each new connection starves the ones before it.
+
+    Reports every stream's rate and share as the analyzer last saw it, the fairness indices, the starvation events it
+    raised (one per older device and stream kind is the expected outcome), and what the analyzer's ticks cost.
+*/
+Result runFairness(const Options& options)
+{
+    std::vector<Simulation::DeviceSettings> settings;
+
+    for (int i = 0; i < options.devices; ++i)
+        settings.push_back(options.getDeviceSettings(i));
+
+    Simulation::SimulatedBackend backend(settings, {options.olderLinkShare});
+
+    Ingest::FairnessSettings fairness_settings;
+    fairness_settings.windowTicks = 10;
+
+    Ingest::DeviceRegistry   registry(static_cast<size_t>(options.devices));
+    Ingest::IngestConsumer   consumer(registry);
+    Ingest::FairnessAnalyzer analyzer(registry, fairness_settings);
+
+    for (int i = 0; i < options.devices; ++i)
+    {
+        const auto h = registry.intern(Simulation::SimulatedBackend::getContainerId(i));
+
+        registry.midiChannels[h]->setListener(&consumer);
+        registry.bleChannels[h]->setListener(&consumer);
+    }
+
+    consumer.start();
+    analyzer.start();
+
+    const auto window_seconds = static_cast<double>(fairness_settings.windowTicks) / fairness_settings.tickRateHz;
+    const auto start          = Ingest::hostNanos();
+
+    for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+    {
+        const auto i = static_cast<int>(h);
+
+        registry.midiSources[h] = backend.openMidiInput(registry.containerIds[h], Simulation::SimulatedBackend::getMidiPortId(i),
+                                                        registry.midiChannels[h], nullptr);
+        registry.bleSources[h]  = backend.connectBleDevice(Simulation::SimulatedBackend::getBleDeviceId(i), registry.bleChannels[h]);
+
+        sleepFor(static_cast<size_t>(h) + 1 < registry.size() ? window_seconds * 1.5 : options.seconds);
+    }
+
+    const auto elapsed = static_cast<double>(Ingest::hostNanos() - start) * 1.0e-9;
+
+    var starvation_events = Array<var>();
+
+    analyzer.drainEvents([&](const Ingest::StarvationEvent& e)
+    {
+        auto* o = new DynamicObject();
+        o->setProperty("seconds", static_cast<double>(e.hostTime - start) * 1.0e-9);
+        o->setProperty("device", static_cast<int>(e.device));
+        o->setProperty("kind", e.kind == Ingest::StreamKind::midi ? "midi" : "ble");
+        o->setProperty("starved", e.starved);
+        o->setProperty("events_per_sec", e.eventsPerSecond);
+        o->setProperty("baseline", e.baseline);
+        starvation_events.append(var(o));
+    });
+
+    var  devices  = Array<var>();
+    auto received = uint64_t{0};
+
+    for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+    {
+        auto* d = new DynamicObject();
+        d->setProperty("index", static_cast<int>(h));
+
+        for (const auto kind : {Ingest::StreamKind::midi, Ingest::StreamKind::ble})
+        {
+            const auto r = analyzer.getRates(h, kind);
+
+            auto* o = new DynamicObject();
+            o->setProperty("events_per_sec", r.eventsPerSecond);
+            o->setProperty("bytes_per_sec", r.bytesPerSecond);
+            o->setProperty("share", r.share);
+            o->setProperty("baseline", r.baseline);
+            o->setProperty("longest_gap_ns", static_cast<int64>(r.longestGap));
+            o->setProperty("median_tick_gap_ns", static_cast<int64>(r.medianTickGap));
+            o->setProperty("starved", r.starved);
+            d->setProperty(kind == Ingest::StreamKind::midi ? "midi" : "ble", var(o));
+        }
+
+        received += registry.midiChannels[h]->getReceivedCount() + registry.bleChannels[h]->getReceivedCount();
+        devices.append(var(d));
+    }
+
+    const auto summary = analyzer.getSummary();
+    const auto busy    = analyzer.getBusyFraction();
+
+    for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+    {
+        registry.midiSources[h].reset();
+        registry.bleSources[h].reset();
+    }
+
+    analyzer.stop();
+    consumer.stop();
+
+    Result result;
+    result.events  = received;
+    result.seconds = elapsed;
+
+    auto* details = new DynamicObject();
+    details->setProperty("midi_fairness_index", summary.midiIndex);
+    details->setProperty("ble_fairness_index", summary.bleIndex);
+    details->setProperty("starved_streams", summary.starvedStreams);
+    details->setProperty("starvations", static_cast<int64>(analyzer.getStarvationCount()));
+    details->setProperty("starvation_events_lost", static_cast<int64>(analyzer.getStarvationEventsLost()));
+    details->setProperty("starvation_events", starvation_events);
+    details->setProperty("analyzer_busy_fraction", busy);
+    details->setProperty("devices", devices);
+    result.details = var(details);
+
+    return result;
+}
+
+//======================================================================================================================
+/**
+    Sends --midi-rate note messages per second (in --burst sized chords) to each of --devices simulated BLE-MIDI
+    outputs, over links with --connection-interval-ms, --packets-per-event and --att-mtu, two ways: one write per
+    message straight from the sending thread, and through MidiOutPorts flushed by a MidiSender every
+    --flush-interval-us (one connection interval by default).
+
+    Each note carries a 14 bit sequence number in its data bytes, so the loopback side can tell exactly when each
+    one arrived. Reports messages per connection event and per packet, what a send costs the sending thread, and the
+    send latency up to the connection event that carried the message, and up to the flush that packed it.
+*/
+Result runOutput(const Options& options)
+{
+    static constexpr size_t sequenceSize = 1 << 14;
+
+    Result result;
+    var    runs = Array<var>();
+
+    std::vector<Simulation::DeviceSettings> settings;
+
+    for (int i = 0; i < options.devices; ++i)
+        settings.push_back(options.getDeviceSettings(i));
+
+    for (const auto batched : {false, true})
+    {
+        Simulation::SimulatedBackend backend(settings);
+
+        const auto num_devices = static_cast<size_t>(options.devices);
+        const auto flush_us    = options.flushIntervalUs > 0 ? options.flushIntervalUs : roundToInt(options.connectionMs * 1000.0);
+
+        std::vector<std::shared_ptr<Ingest::MidiChannel>>     loopbacks;
+        std::vector<Simulation::SimulatedBleMidiOutput*>      links;
+        std::vector<std::unique_ptr<Ingest::BlePacketWriter>> writers;
+        std::vector<std::unique_ptr<Ingest::MidiOutPort>>     ports;
+        std::vector<std::unique_ptr<std::atomic<int64_t>[]>>  sendTimes;
+        std::vector<Ingest::LatencyHistogram>                 delivery(num_devices);
+        std::vector<uint64_t>                                 sendCalls(num_devices), sendNanos(num_devices), rejected(num_devices);
+        Ingest::MidiSender                                    sender(flush_us);
+
+        for (size_t i = 0; i < num_devices; ++i)
+        {
+            loopbacks.push_back(std::make_shared<Ingest::MidiChannel>(static_cast<uint16_t>(i), 16384));
+
+            auto writer = backend.openBleMidiOutput(Simulation::SimulatedBackend::getBleDeviceId(static_cast<int>(i)), loopbacks.back());
+            links.push_back(dynamic_cast<Simulation::SimulatedBleMidiOutput*>(writer.get()));
+
+            if (batched)
+            {
+                ports.push_back(std::make_unique<Ingest::MidiOutPort>(std::move(writer)));
+                sender.add(*ports.back());
+            }
+            else
+            {
+                writers.push_back(std::move(writer));
+            }
+
+            sendTimes.push_back(std::make_unique<std::atomic<int64_t>[]>(sequenceSize));
+        }
+
+        sender.start();
+
+        std::atomic<bool> recording{false}, stop{false};
+
+        // The other side of each link: matches every note that arrives to when it was sent
+        std::thread receiver([&]
+        {
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                for (size_t i = 0; i < num_devices; ++i)
+                {
+                    loopbacks[i]->drain([&](const Ingest::MidiEvent& e)
+                    {
+                        const auto b        = e.getBytes();
+                        const auto sequence = (static_cast<size_t>(b[2]) << 7) | b[1];
+                        const auto sent     = sendTimes[i][sequence].load(std::memory_order_acquire);
+
+                        if (recording.load(std::memory_order_relaxed) && sent != 0)
+                            delivery[i].record(e.hostTime - sent);
+                    });
+                }
+
+                sleepFor(0.0005);
+            }
+        });
+
+        // One sending thread per output, like a sequencer track per device
+        std::vector<std::thread> senders;
+
+        for (size_t i = 0; i < num_devices; ++i)
+        {
+            senders.emplace_back([&, i]
+            {
+                using Clock = std::chrono::steady_clock;
+
+                const auto burst    = jmax(1, options.burstSize);
+                const auto interval = std::chrono::duration<double>(burst / jmax(1.0, options.midiRate));
+
+                Ingest::BleMidi::Encoder single(links[i]->getMaxPacketSize());
+                uint32_t                 sequence = 0;
+                auto                     next     = Clock::now();
+
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    next += std::chrono::duration_cast<Clock::duration>(interval);
+                    std::this_thread::sleep_until(next);
+
+                    for (int n = 0; n < burst; ++n, ++sequence)
+                    {
+                        const auto    s       = sequence % sequenceSize;
+                        const uint8_t note[3] = {static_cast<uint8_t>(0x90 | (i & 0x0f)), static_cast<uint8_t>(s & 0x7f),
+                                                 static_cast<uint8_t>(s >> 7)};
+
+                        const auto now = Ingest::hostNanos();
+                        sendTimes[i][s].store(now, std::memory_order_release);
+
+                        if (batched)
+                        {
+                            ports[i]->send(note, sizeof(note), now);
+                        }
+                        else
+                        {
+                            single.add(note, now, [&](std::span<const uint8_t> packet) { rejected[i] += writers[i]->write(packet) ? 0 : 1; });
+                            single.flush([&](std::span<const uint8_t> packet) { rejected[i] += writers[i]->write(packet) ? 0 : 1; });
+                        }
+
+                        if (recording.load(std::memory_order_relaxed))
+                        {
+                            sendNanos[i] += static_cast<uint64_t>(Ingest::hostNanos() - now);
+                            ++sendCalls[i];
+                        }
+                    }
+                }
+            });
+        }
+
+        const auto totals = [&]
+        {
+            uint64_t events = 0, packets = 0, messages = 0;
+
+            for (size_t i = 0; i < num_devices; ++i)
+            {
+                events   += links[i]->getStats().connectionEvents.load();
+                packets  += links[i]->getStats().packets.load();
+                messages += links[i]->getStats().messages.load();
+            }
+
+            return std::tuple(events, packets, messages);
+        };
+
+        sleepFor(options.warmup);
+
+        const auto [events_before, packets_before, messages_before] = totals();
+        const auto allocations_before                             = AllocationCounter::count.load();
+        const auto start                                          = Ingest::hostNanos();
+        recording = true;
+
+        sleepFor(options.seconds);
+
+        recording = false;
+        const auto elapsed                                       = static_cast<double>(Ingest::hostNanos() - start) * 1.0e-9;
+        const auto allocations                                   = AllocationCounter::count.load() - allocations_before;
+        const auto [events_after, packets_after, messages_after] = totals();
+
+        stop = true;
+
+        for (auto& t : senders)
+            t.join();
+
+        sender.stop();
+        receiver.join();
+
+        const auto messages = messages_after - messages_before;
+        const auto packets  = packets_after - packets_before;
+        const auto events   = events_after - events_before;
+
+        uint64_t dropped = 0, send_calls = 0, send_nanos = 0;
+        int64_t  p50 = 0, p99 = 0, packed_p99 = 0, wait_p99 = 0;
+
+        for (size_t i = 0; i < num_devices; ++i)
+        {
+            const auto d = delivery[i].getSummary();
+            p50        = jmax(p50, d.p50);
+            p99        = jmax(p99, d.p99);
+            wait_p99   = jmax(wait_p99, links[i]->getStats().packetWait.getSummary().p99);
+            send_calls += sendCalls[i];
+            send_nanos += sendNanos[i];
+            dropped    += rejected[i];
+
+            if (batched)
+            {
+                packed_p99  = jmax(packed_p99, ports[i]->getSendLatency().getSummary().p99);
+                dropped    += ports[i]->getDroppedCount() + ports[i]->getWriteFailures();
+            }
+        }
+
+        result.events      += messages;
+        result.seconds     += elapsed;
+        result.allocations += allocations;
+
+        const auto ratio = [](uint64_t a, uint64_t b) { return b == 0 ? 0.0 : static_cast<double>(a) / static_cast<double>(b); };
+
+        auto* r = new DynamicObject();
+        r->setProperty("mode", batched ? "batched" : "per_message");
+        r->setProperty("messages_per_sec", static_cast<double>(messages) / elapsed);
+        r->setProperty("messages_per_connection_event", ratio(messages, events));
+        r->setProperty("messages_per_packet", ratio(messages, packets));
+        r->setProperty("packets_per_connection_event", ratio(packets, events));
+        r->setProperty("dropped", static_cast<int64>(dropped));
+        r->setProperty("send_call_ns", ratio(send_nanos, send_calls));
+        r->setProperty("worst_delivery_p50_ns", static_cast<int64>(p50));
+        r->setProperty("worst_delivery_p99_ns", static_cast<int64>(p99));
+        r->setProperty("worst_packet_wait_p99_ns", static_cast<int64>(wait_p99));
+
+        if (batched)
+        {
+            r->setProperty("flush_interval_us", flush_us);
+            r->setProperty("worst_packed_p99_ns", static_cast<int64>(packed_p99));
+        }
+
+        runs.append(var(r));
+    }
+
+    auto* details = new DynamicObject();
+    details->setProperty("runs", runs);
+    result.details = var(details);
+
+    return result;
+}
+
+//======================================================================================================================
+/**
+    BLE links with very different loads on a radio that can't give all of them the fastest connection interval: it
+    schedules --connection-budget connection events per second, four notifications each. Device i only notifies, at
+    --ble-rate / 2^i.
+
+    The devices run for --seconds with every link left balanced, which is what the platform gives them, and then
+    reconnect with a ConnectionManager looking after them, which gets --seconds to settle before the same
+    measurement. Reports what each device delivered, against what it sent, both times; the profile it ended up
+    with; every change the manager made, with its effect; and how much of the radio's budget the links asked for.
+*/
+Result runConnections(const Options& options)
+{
+    std::vector<Simulation::DeviceSettings> settings;
+
+    for (int i = 0; i < options.devices; ++i)
+    {
+        auto s                  = options.getDeviceSettings(i);
+        s.midiMessagesPerSecond = 0.0;
+        s.blePacketsPerSecond   = options.bleRate / static_cast<double>(1 << jmin(i, 20));
+        s.discoveryMillis       = 0.0;
+        s.cachedDiscoveryMillis = 0.0;
+        settings.push_back(s);
+    }
+
+    Simulation::RadioSettings radio_settings;
+    radio_settings.olderLinkShare        = options.olderLinkShare;
+    radio_settings.connectionEventBudget = options.connectionBudget;
+
+    Ingest::ConnectionSettings connection_settings;
+    connection_settings.connectionEventBudget = options.connectionBudget;
+    connection_settings.tickIntervalSeconds   = 0.5;
+    connection_settings.settleSeconds         = 1.5;
+
+    struct Run
+    {
+        std::vector<double>                    rates;
+        std::vector<Ingest::ConnectionProfile> profiles;
+        double                                 connectionEventLoad = 0.0;
+        uint64_t                               received            = 0;
+        double                                 seconds             = 0.0;
+    };
+
+    var changes = Array<var>();
+
+    const auto run = [&](bool managed)
+    {
+        Simulation::SimulatedBackend backend(settings, radio_settings);
+
+        Ingest::FairnessSettings fairness_settings;
+        fairness_settings.windowTicks = 10;
+
+        Ingest::DeviceRegistry    registry(static_cast<size_t>(options.devices));
+        Ingest::IngestConsumer    consumer(registry);
+        Ingest::FairnessAnalyzer  analyzer(registry, fairness_settings);
+        Ingest::ConnectionManager manager(registry, analyzer, connection_settings);
+
+        for (int i = 0; i < options.devices; ++i)
+        {
+            const auto h = registry.intern(Simulation::SimulatedBackend::getContainerId(i));
+
+            registry.midiChannels[h]->setListener(&consumer);
+            registry.bleChannels[h]->setListener(&consumer);
+        }
+
+        consumer.start();
+        analyzer.start();
+
+        for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+        {
+            registry.bleSources[h] = backend.connectBleDevice(Simulation::SimulatedBackend::getBleDeviceId(h),
+                                                              registry.bleChannels[h]);
+            ++registry.bleConnections[h];
+        }
+
+        const auto start = Ingest::hostNanos();
+
+        const auto received = [&]
+        {
+            uint64_t n = 0;
+
+            for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+                n += registry.bleChannels[h]->getReceivedCount();
+
+            return n;
+        };
+
+        const auto run_until = [&](double seconds)
+        {
+            while (static_cast<double>(Ingest::hostNanos() - start) * 1.0e-9 < seconds)
+            {
+                sleepFor(0.05);
+
+                if (managed)
+                    manager.update();
+            }
+        };
+
+        // A rate window first, so the analyzer's rates are the links' own; the manager gets longer to settle
+        run_until(managed ? options.seconds : 1.0);
+
+        std::vector<uint64_t> before;
+
+        for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+            before.push_back(registry.bleChannels[h]->getReceivedCount());
+
+        const auto measure_start = Ingest::hostNanos();
+        const auto received_before = received();
+
+        run_until((managed ? options.seconds : 1.0) + options.seconds);
+
+        Run r;
+        r.seconds             = static_cast<double>(Ingest::hostNanos() - measure_start) * 1.0e-9;
+        r.received            = received() - received_before;
+        r.connectionEventLoad = backend.getRadio().getConnectionEventLoad();
+
+        for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+        {
+            r.rates.push_back(static_cast<double>(registry.bleChannels[h]->getReceivedCount() - before[h]) / r.seconds);
+            r.profiles.push_back(backend.getRadio().getConnectionProfile(h));
+        }
+
+        manager.drainChanges([&](const Ingest::ConnectionChange& c)
+        {
+            auto* o = new DynamicObject();
+            o->setProperty("seconds", static_cast<double>(c.hostTime - start) * 1.0e-9);
+            o->setProperty("device", static_cast<int>(c.device));
+            o->setProperty("from", Ingest::ConnectionManager::getName(c.from));
+            o->setProperty("to", Ingest::ConnectionManager::getName(c.to));
+            o->setProperty("events_per_sec_before", c.eventsPerSecondBefore);
+            o->setProperty("events_per_sec_after", c.eventsPerSecondAfter);
+            changes.append(var(o));
+        });
+
+        for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+            registry.bleSources[h].reset();
+
+        analyzer.stop();
+        consumer.stop();
+        return r;
+    };
+
+    const auto fixed   = run(false);
+    const auto managed = run(true);
+
+    double sent = 0.0;
+    var    devices = Array<var>();
+
+    for (size_t i = 0; i < settings.size(); ++i)
+    {
+        const auto rate = settings[i].blePacketsPerSecond;
+        sent           += rate;
+
+        auto* d = new DynamicObject();
+        d->setProperty("index", static_cast<int>(i));
+        d->setProperty("sent_per_sec", rate);
+        d->setProperty("balanced_per_sec", fixed.rates[i]);
+        d->setProperty("managed_per_sec", managed.rates[i]);
+        d->setProperty("profile", Ingest::ConnectionManager::getName(managed.profiles[i]));
+        devices.append(var(d));
+    }
+
+    const auto delivered = [&](const Run& r)
+    {
+        return sent > 0.0 ? static_cast<double>(r.received) / r.seconds / sent : 0.0;
+    };
+
+    Result result;
+    result.events  = managed.received;
+    result.seconds = managed.seconds;
+
+    auto* details = new DynamicObject();
+    details->setProperty("balanced_delivered_fraction", delivered(fixed));
+    details->setProperty("managed_delivered_fraction", delivered(managed));
+    details->setProperty("balanced_connection_events_per_sec", fixed.connectionEventLoad);
+    details->setProperty("managed_connection_events_per_sec", managed.connectionEventLoad);
+    details->setProperty("changes", changes);
+    details->setProperty("devices", devices);
+    result.details = var(details);
+
+    return result;
+}
+} // namespace Bench
@@ -0,0 +1,369 @@
+#include "Benchmark.h"
+
+#include "BleMidi.h"
+
+//======================================================================================================================
+namespace Bench {
+
+/**
+    A BLE-MIDI notification stream the way a device would send one: messages packed into packets of up to
+    --ble-payload bytes, flushed every connection interval, running status wherever the status repeats, SysEx split
+    across packets. The messages themselves, and the times they were stamped with, are kept to check a decoder's
+    output against. Now and then the device goes quiet for longer than the timestamps take to wrap.
+*/
+struct BleMidiStream
+{
+    std::vector<uint8_t>                   bytes;
+    std::vector<std::pair<size_t, size_t>> packets; // offset and size in bytes
+    std::vector<int64_t>                   hostTimes;
+
+    std::vector<uint8_t>                   messageBytes;
+    std::vector<std::pair<size_t, size_t>> messages; // offset and size in messageBytes
+    std::vector<int64_t>                   messageMillis;
+
+    [[nodiscard]] std::span<const uint8_t> getPacket(size_t i) const { return {bytes.data() + packets[i].first, packets[i].second}; }
+
+    static BleMidiStream generate(const Options& options, size_t numMessages)
+    {
+        static constexpr int64_t connectionIntervalMicros = 7500;
+
+        BleMidiStream                          s;
+        std::minstd_rand                       random(1);
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+        const auto payload = static_cast<size_t>(jlimit(5, static_cast<int>(Ingest::maxBlePayloadSize), options.blePayloadSize));
+        const auto sysex   = static_cast<size_t>(jmax(2, options.sysExSize));
+        int64_t    micros  = 0;
+        int64_t    send_at = connectionIntervalMicros;
+
+        std::vector<uint8_t> packet;
+        int64_t              block       = 0;
+        int                  last_low    = -1;
+        uint8_t              last_status = 0;
+        int64_t              last_millis = -1;
+
+        const auto flush = [&]
+        {
+            if (packet.size() > 1)
+            {
+                s.packets.emplace_back(s.bytes.size(), packet.size());
+                s.bytes.insert(s.bytes.end(), packet.begin(), packet.end());
+                s.hostTimes.push_back(1'000'000'000'000 + send_at * 1000 + static_cast<int64_t>(unit(random) * 2.0e6));
+            }
+
+            packet.clear();
+        };
+
+        const auto open = [&](int64_t millis)
+        {
+            flush();
+            packet.push_back(static_cast<uint8_t>(0x80 | ((millis >> 7) & 0x3f)));
+            block       = millis >> 7;
+            last_low    = -1;
+            last_status = 0;
+            last_millis = -1;
+        };
+
+        // Only one carry of the low seven bits per packet can be told apart, and only when the low part goes down
+        const auto fits = [&](int64_t millis, size_t needed)
+        {
+            if (packet.empty() || packet.size() + needed > payload)
+                return false;
+
+            const auto low = static_cast<int>(millis & 0x7f);
+            return (millis >> 7) == block || ((millis >> 7) == block + 1 && low < last_low);
+        };
+
+        const auto timestamp = [&](int64_t millis)
+        {
+            block       = millis >> 7;
+            last_low    = static_cast<int>(millis & 0x7f);
+            last_millis = millis;
+            packet.push_back(static_cast<uint8_t>(0x80 | last_low));
+        };
+
+        for (size_t n = 0; n < numMessages; ++n)
+        {
+            micros += static_cast<int64_t>(1.0e6 / options.midiRate * (1.0 + options.jitter * (2.0 * unit(random) - 1.0)));
+
+            if (n % 5000 == 4999)
+                micros += 9'000'000 + static_cast<int64_t>(unit(random) * 20.0e6);
+
+            if (micros >= send_at)
+            {
+                flush();
+                send_at = (micros / connectionIntervalMicros + 1) * connectionIntervalMicros;
+            }
+
+            const auto millis = micros / 1000;
+            const auto start  = s.messageBytes.size();
+            const auto pick   = unit(random);
+
+            if (pick < options.sysExFraction)
+            {
+                s.messageBytes.push_back(0xf0);
+                s.messageBytes.resize(start + sysex - 1, static_cast<uint8_t>(n & 0x7f));
+                s.messageBytes.push_back(0xf7);
+            }
+            else if (pick < 0.45)
+            {
+                s.messageBytes.insert(s.messageBytes.end(), {uint8_t{0xb0}, uint8_t{1}, static_cast<uint8_t>(n & 0x7f)});
+            }
+            else if (pick < 0.7)
+            {
+                s.messageBytes.insert(s.messageBytes.end(), {static_cast<uint8_t>(n & 1 ? 0x80 : 0x90), uint8_t{60}, uint8_t{100}});
+            }
+            else if (pick < 0.85)
+            {
+                s.messageBytes.insert(s.messageBytes.end(), {uint8_t{0xe0}, static_cast<uint8_t>(n & 0x7f), uint8_t{64}});
+            }
+            else if (pick < 0.92)
+            {
+                s.messageBytes.insert(s.messageBytes.end(), {uint8_t{0xc0}, static_cast<uint8_t>(n & 0x7f)});
+            }
+            else
+            {
+                s.messageBytes.push_back(0xf8);
+            }
+
+            const auto message = std::span<const uint8_t>(s.messageBytes).subspan(start);
+            const auto status  = message.front();
+
+            s.messages.emplace_back(start, message.size());
+            s.messageMillis.push_back(millis);
+
+            if (status == 0xf0)
+            {
+                if (!fits(millis, 2))
+                    open(millis);
+
+                timestamp(millis);
+                packet.push_back(0xf0);
+
+                for (const auto b : message.subspan(1, message.size() - 2))
+                {
+                    if (packet.size() == payload)
+                        open(millis);
+
+                    packet.push_back(b);
+                }
+
+                if (!fits(millis, 2))
+                    open(millis);
+
+                timestamp(millis);
+                packet.push_back(0xf7);
+                last_status = 0;
+                continue;
+            }
+
+            const auto running = status < 0xf0 && status == last_status;
+            const auto same_ts = running && millis == last_millis;
+            const auto needed  = (same_ts ? 0 : 1) + (running ? message.size() - 1 : message.size());
+
+            if (fits(millis, needed))
+            {
+                if (!same_ts)
+                    timestamp(millis);
+
+                packet.insert(packet.end(), message.begin() + (running ? 1 : 0), message.end());
+            }
+            else
+            {
+                open(millis);
+                timestamp(millis);
+                packet.insert(packet.end(), message.begin(), message.end());
+            }
+
+            if (status < 0xf0)
+                last_status = status;
+        }
+
+        flush();
+        return s;
+    }
+};
+
+/** Order-sensitive fingerprint of everything a decoder handed out. */
+struct DecodeDigest
+{
+    uint64_t messages = 0, hash = 14695981039346656037ull;
+
+    void add(std::span<const uint8_t> message, int64_t deviceTime)
+    {
+        for (const auto b : message)
+            mix(b);
+
+        for (int i = 0; i < 64; i += 8)
+            mix(static_cast<uint8_t>(static_cast<uint64_t>(deviceTime) >> i));
+
+        ++messages;
+    }
+
+    void mix(uint8_t b) { hash = (hash ^ b) * 1099511628211ull; }
+
+    bool operator==(const DecodeDigest&) const = default;
+};
+
+/**
+    Decodes a generated BLE-MIDI stream with both of BleMidi::Decoder's paths.
+
+    The bulk path has to agree with the byte at a time reference on the stream, and on random bytes, and what it
+    decodes from the stream has to be the messages that went in, with their timestamps unwrapped correctly across
+    every idle gap. Then each path decodes the stream over and over for half of --seconds.
+*/
+Result runBleMidi(const Options& options)
+{
+    const auto stream      = BleMidiStream::generate(options, 200000);
+    const auto max_sysex   = static_cast<size_t>(jmax(1024, options.sysExSize));
+    const auto num_packets = stream.packets.size();
+
+    // Correctness first: against what was encoded, and the two paths against each other
+    Ingest::BleMidi::Decoder fast(max_sysex), reference(max_sysex);
+    DecodeDigest             fast_digest, reference_digest;
+    size_t                   next   = 0;
+    int64_t                  origin = 0;
+    uint64_t                 wrong_messages = 0, wrong_times = 0;
+
+    for (size_t i = 0; i < num_packets; ++i)
+    {
+        fast.decode(stream.getPacket(i), stream.hostTimes[i], [&](std::span<const uint8_t> m, int64_t t)
+        {
+            fast_digest.add(m, t);
+
+            if (next >= stream.messages.size())
+            {
+                ++wrong_messages;
+                return;
+            }
+
+            const auto [offset, size] = stream.messages[next];
+
+            if (!std::equal(m.begin(), m.end(), stream.messageBytes.begin() + static_cast<std::ptrdiff_t>(offset),
+                            stream.messageBytes.begin() + static_cast<std::ptrdiff_t>(offset + size)))
+                ++wrong_messages;
+
+            const auto millis = t / 1000000 - stream.messageMillis[next];
+
+            if (next == 0)
+                origin = millis;
+            else if (millis != origin)
+                ++wrong_times;
+
+            ++next;
+        });
+
+        reference.decodeScalar(stream.getPacket(i), stream.hostTimes[i],
+                               [&](std::span<const uint8_t> m, int64_t t) { reference_digest.add(m, t); });
+    }
+
+    wrong_messages += stream.messages.size() - next;
+
+    std::minstd_rand                random(2);
+    std::uniform_int_distribution<> byte(0, 255), length(1, jlimit(2, static_cast<int>(Ingest::maxBlePayloadSize), options.blePayloadSize * 2));
+    Ingest::BleMidi::Decoder        fuzz_fast(max_sysex), fuzz_reference(max_sysex);
+    DecodeDigest                    fuzz_fast_digest, fuzz_reference_digest;
+    std::vector<uint8_t>            noise(Ingest::maxBlePayloadSize);
+    const int                       fuzz_packets = 200000;
+
+    for (int i = 0; i < fuzz_packets; ++i)
+    {
+        const auto size = static_cast<size_t>(length(random));
+
+        for (size_t j = 0; j < size; ++j)
+            noise[j] = static_cast<uint8_t>(byte(random));
+
+        if (byte(random) < 200)
+            noise[0] = static_cast<uint8_t>(0x80 | (noise[0] & 0x3f));
+
+        const auto packet = std::span<const uint8_t>(noise.data(), size);
+        const auto host   = static_cast<int64_t>(i) * 1'000'000;
+
+        fuzz_fast.decode(packet, host, [&](auto m, auto t) { fuzz_fast_digest.add(m, t); });
+        fuzz_reference.decodeScalar(packet, host, [&](auto m, auto t) { fuzz_reference_digest.add(m, t); });
+    }
+
+    const auto same_counters = [](const Ingest::BleMidi::Decoder& a, const Ingest::BleMidi::Decoder& b)
+    {
+        return a.getMessagesDecoded() == b.getMessagesDecoded() && a.getMalformedPackets() == b.getMalformedPackets()
+               && a.getMalformedBytes() == b.getMalformedBytes() && a.getSysExDropped() == b.getSysExDropped();
+    };
+
+    const auto matches = fast_digest == reference_digest && same_counters(fast, reference)
+                         && fuzz_fast_digest == fuzz_reference_digest && same_counters(fuzz_fast, fuzz_reference);
+
+    // Then throughput, each path on its own for half the measured time
+    struct Throughput
+    {
+        double   seconds = 0.0;
+        uint64_t messages = 0, packets = 0, bytes = 0, allocations = 0;
+
+        [[nodiscard]] var toVar() const
+        {
+            auto* r = new DynamicObject();
+            r->setProperty("ns_per_packet", seconds * 1.0e9 / static_cast<double>(packets));
+            r->setProperty("mb_per_sec", static_cast<double>(bytes) / seconds * 1.0e-6);
+            r->setProperty("messages_per_sec", static_cast<double>(messages) / seconds);
+            return var(r);
+        }
+    };
+
+    const auto measure = [&](bool bulk)
+    {
+        Ingest::BleMidi::Decoder decoder(max_sysex);
+        Throughput               t;
+
+        const auto count              = [&t](std::span<const uint8_t>, int64_t) { ++t.messages; };
+        const auto allocations_before = AllocationCounter::count.load();
+        const auto start              = Ingest::hostNanos();
+        const auto duration           = static_cast<int64_t>(options.seconds * 0.5e9);
+
+        do
+        {
+            decoder.reset();
+
+            for (size_t i = 0; i < num_packets; ++i)
+            {
+                if (bulk)
+                    decoder.decode(stream.getPacket(i), stream.hostTimes[i], count);
+                else
+                    decoder.decodeScalar(stream.getPacket(i), stream.hostTimes[i], count);
+            }
+
+            t.packets += num_packets;
+            t.bytes   += stream.bytes.size();
+        }
+        while (Ingest::hostNanos() - start < duration);
+
+        t.seconds     = static_cast<double>(Ingest::hostNanos() - start) * 1.0e-9;
+        t.allocations = AllocationCounter::count.load() - allocations_before;
+        return t;
+    };
+
+    const auto scalar = measure(false);
+    const auto bulk   = measure(true);
+
+    Result result;
+    result.events      = bulk.messages;
+    result.seconds     = bulk.seconds;
+    result.allocations = scalar.allocations + bulk.allocations;
+
+    auto* details = new DynamicObject();
+    details->setProperty("scan", Ingest::BleMidi::getScanImplementation());
+    details->setProperty("packets", static_cast<int64>(num_packets));
+    details->setProperty("messages", static_cast<int64>(stream.messages.size()));
+    details->setProperty("mean_packet_bytes", static_cast<double>(stream.bytes.size()) / static_cast<double>(num_packets));
+    details->setProperty("wrong_messages", static_cast<int64>(wrong_messages));
+    details->setProperty("wrong_timestamps", static_cast<int64>(wrong_times));
+    details->setProperty("malformed_bytes", static_cast<int64>(fast.getMalformedBytes()));
+    details->setProperty("fuzz_packets", fuzz_packets);
+    details->setProperty("matches_reference", matches);
+    details->setProperty("scalar", scalar.toVar());
+    details->setProperty("bulk", bulk.toVar());
+    details->setProperty("speedup", (static_cast<double>(bulk.messages) / bulk.seconds)
+                                    / jmax(1.0, static_cast<double>(scalar.messages) / scalar.seconds));
+    result.details = var(details);
+
+    return result;
+}
+} // namespace Bench
@@ -0,0 +1,249 @@
+#include "Benchmark.h"
+
+#include "CaptureRecorder.h"
+#include "CaptureReplayer.h"
+#include "IngestConsumer.h"
+#include "Subscription.h"
+
+#include <iostream>
+
+//======================================================================================================================
+namespace Bench {
+
+/**
+    The app's own pipeline (DeviceRegistry and IngestConsumer) with a CaptureRecorder on a lossless Subscription of
+    its own, at the configured load.
+
+    Keeping up means the recorder dropped nothing and neither did the channels in front of it. Afterwards the capture
+    is read back, and its record count is checked against what the recorder says it wrote.
+*/
+Result runRecorder(const Options& options)
+{
+    const auto directory = options.captureDirectory.isNotEmpty()
+                         ? File::getCurrentWorkingDirectory().getChildFile(options.captureDirectory)
+                         : File::getSpecialLocation(File::tempDirectory).getChildFile("WinRTMidiBench-capture");
+
+    directory.deleteRecursively();
+
+    std::vector<Simulation::DeviceSettings> settings;
+
+    for (int i = 0; i < options.devices; ++i)
+        settings.push_back(options.getDeviceSettings(i));
+
+    Simulation::SimulatedBackend backend(settings, {options.olderLinkShare});
+
+    Ingest::DeviceRegistry  registry(static_cast<size_t>(options.devices));
+    Ingest::IngestConsumer  consumer(registry);
+    Ingest::CaptureRecorder recorder(directory);
+
+    if (const auto r = recorder.start(); r.failed())
+    {
+        std::cerr << r.getErrorMessage() << std::endl;
+        return {};
+    }
+
+    for (int i = 0; i < options.devices; ++i)
+    {
+        const auto h = registry.intern(Simulation::SimulatedBackend::getContainerId(i));
+
+        registry.midiChannels[h]->setListener(&consumer);
+        registry.bleChannels[h]->setListener(&consumer);
+    }
+
+    Ingest::Subscription recording(registry, recorder, Ingest::Delivery::lossless);
+
+    consumer.start();
+    recording.start();
+
+    for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+    {
+        const auto i = static_cast<int>(h);
+
+        registry.midiSources[h] = backend.openMidiInput(registry.containerIds[h], Simulation::SimulatedBackend::getMidiPortId(i),
+                                                        registry.midiChannels[h], nullptr);
+        registry.bleSources[h]  = backend.connectBleDevice(Simulation::SimulatedBackend::getBleDeviceId(i), registry.bleChannels[h]);
+    }
+
+    const auto totals = [&]
+    {
+        uint64_t received = 0, dropped = 0;
+
+        for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+        {
+            received += registry.midiChannels[h]->getReceivedCount() + registry.bleChannels[h]->getReceivedCount();
+            dropped  += registry.midiChannels[h]->getDroppedCount() + registry.bleChannels[h]->getDroppedCount();
+        }
+
+        return std::pair(received, dropped);
+    };
+
+    sleepFor(options.warmup);
+
+    const auto [received_before, dropped_before] = totals();
+    const auto bytes_before                      = recorder.getBytesWritten();
+    const auto allocations_before                = AllocationCounter::count.load();
+    const auto start                             = Ingest::hostNanos();
+
+    sleepFor(options.seconds);
+
+    const auto elapsed                         = static_cast<double>(Ingest::hostNanos() - start) * 1.0e-9;
+    const auto allocations                     = AllocationCounter::count.load() - allocations_before;
+    const auto [received_after, dropped_after] = totals();
+    const auto bytes                           = recorder.getBytesWritten() - bytes_before;
+
+    for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+    {
+        registry.midiSources[h].reset();
+        registry.bleSources[h].reset();
+    }
+
+    consumer.stop();
+    recording.stop();
+    recorder.stop();
+
+    const auto read_back = Ingest::Capture::Reader(directory).forEachRecord([](const auto&, const auto&) {});
+
+    Result result;
+    result.events      = received_after - received_before;
+    result.seconds     = elapsed;
+    result.allocations = allocations;
+
+    auto* details = new DynamicObject();
+    details->setProperty("bytes_per_sec", static_cast<double>(bytes) / elapsed);
+    details->setProperty("channel_dropped", static_cast<int64>(dropped_after - dropped_before));
+    details->setProperty("records_written", static_cast<int64>(recorder.getRecordsWritten()));
+    details->setProperty("records_dropped", static_cast<int64>(recorder.getRecordsDropped()));
+    details->setProperty("records_read_back", static_cast<int64>(read_back));
+    details->setProperty("segments", static_cast<int64>(recorder.getNumSegments()));
+    details->setProperty("peak_buffer_fill", recorder.getPeakBufferFill());
+    details->setProperty("kept_up", recorder.getRecordsDropped() == 0 && dropped_after == dropped_before
+                                    && read_back == recorder.getRecordsWritten());
+    result.details = var(details);
+
+    if (options.captureDirectory.isEmpty())
+        directory.deleteRecursively();
+
+    return result;
+}
+
+//======================================================================================================================
+/**
+    Replays a capture through a fresh registry and IngestConsumer at --replay-speed (0 meaning as fast as possible).
+    Without --capture-dir, a capture of the configured simulated load is recorded first, the same way the recorder
+    scenario does, and thrown away afterwards.
+
+    Timed replay reports how far behind schedule records went in, and each device's inter-arrival p99 next to the
+    recorded one. Full speed replay is the ingest path's throughput test.
+*/
+Result runReplay(const Options& options)
+{
+    auto recording = options;
+
+    if (recording.captureDirectory.isEmpty())
+    {
+        recording.captureDirectory = File::getSpecialLocation(File::tempDirectory).getChildFile("WinRTMidiBench-replay").getFullPathName();
+        runRecorder(recording);
+    }
+
+    const auto directory = File::getCurrentWorkingDirectory().getChildFile(recording.captureDirectory);
+
+    // One pass up front for the handles in use, and the recorded timing to compare against
+    std::map<uint16_t, std::pair<Ingest::ArrivalTracker, Ingest::LatencyStats>> recorded_midi, recorded_ble;
+    int64_t                                                                       first = 0, last = 0;
+
+    const auto total = Ingest::Capture::Reader(directory).forEachRecord([&](const Ingest::Capture::RecordHeader& r, const auto&)
+    {
+        auto& [tracker, stats] = (r.kind == Ingest::Capture::RecordKind::midi ? recorded_midi : recorded_ble)[r.device];
+        tracker.arrived(stats, r.hostTime, r.deviceTime);
+
+        first = first == 0 ? r.hostTime : jmin(first, r.hostTime);
+        last  = jmax(last, r.hostTime);
+    });
+
+    size_t num_devices = 1;
+
+    for (const auto* m : {&recorded_midi, &recorded_ble})
+        if (!m->empty())
+            num_devices = jmax(num_devices, static_cast<size_t>(m->rbegin()->first) + 1);
+
+    Ingest::DeviceRegistry registry(num_devices);
+    Ingest::IngestConsumer consumer(registry);
+
+    for (size_t i = 0; i < num_devices; ++i)
+    {
+        const auto h = registry.intern("replay-" + String(static_cast<int>(i)));
+
+        registry.midiChannels[h]->setListener(&consumer);
+        registry.bleChannels[h]->setListener(&consumer);
+    }
+
+    consumer.start();
+
+    Ingest::CaptureReplayer replayer(directory, registry, options.replaySpeed);
+
+    const auto allocations_before = AllocationCounter::count.load();
+    const auto start              = Ingest::hostNanos();
+
+    replayer.start();
+
+    const auto recorded_seconds = static_cast<double>(last - first) * 1.0e-9;
+    const auto timeout          = options.replaySpeed > 0.0 ? recorded_seconds / options.replaySpeed + 10.0 : 600.0;
+
+    while (!replayer.isFinished() && static_cast<double>(Ingest::hostNanos() - start) * 1.0e-9 < timeout)
+        sleepFor(0.001);
+
+    const auto elapsed     = static_cast<double>(Ingest::hostNanos() - start) * 1.0e-9;
+    const auto allocations = AllocationCounter::count.load() - allocations_before;
+
+    replayer.stop();
+    consumer.stop();
+
+    var     devices = Array<var>();
+    int64_t dropped = 0;
+
+    for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+    {
+        const auto& midi = *registry.midiChannels[h];
+        const auto& ble  = *registry.bleChannels[h];
+
+        dropped += static_cast<int64_t>(midi.getDroppedCount() + ble.getDroppedCount());
+
+        auto* d = new DynamicObject();
+        d->setProperty("index", static_cast<int>(h));
+        d->setProperty("midi_events", static_cast<int64>(midi.getReceivedCount()));
+        d->setProperty("ble_packets", static_cast<int64>(ble.getReceivedCount()));
+
+        if (const auto it = recorded_midi.find(h); it != recorded_midi.end())
+            d->setProperty("recorded_midi_gap_p99_ns", static_cast<int64>(it->second.second.interArrival.getSummary().p99));
+
+        d->setProperty("replayed_midi_gap_p99_ns", static_cast<int64>(midi.getLatencyStats().interArrival.getSummary().p99));
+
+        if (const auto it = recorded_ble.find(h); it != recorded_ble.end())
+            d->setProperty("recorded_ble_gap_p99_ns", static_cast<int64>(it->second.second.interArrival.getSummary().p99));
+
+        d->setProperty("replayed_ble_gap_p99_ns", static_cast<int64>(ble.getLatencyStats().interArrival.getSummary().p99));
+        devices.append(var(d));
+    }
+
+    Result result;
+    result.events      = replayer.getRecordsReplayed();
+    result.seconds     = elapsed;
+    result.allocations = allocations;
+
+    auto* details = new DynamicObject();
+    details->setProperty("speed", options.replaySpeed);
+    details->setProperty("records", static_cast<int64>(total));
+    details->setProperty("replayed", static_cast<int64>(replayer.getRecordsReplayed()));
+    details->setProperty("skipped", static_cast<int64>(replayer.getRecordsSkipped()));
+    details->setProperty("channel_dropped", static_cast<int64>(dropped));
+    details->setProperty("recorded_seconds", recorded_seconds);
+    details->setProperty("lateness", replayer.getLateness().getSummary().toVar());
+    details->setProperty("devices", devices);
+    result.details = var(details);
+
+    if (options.captureDirectory.isEmpty())
+        directory.deleteRecursively();
+
+    return result;
+}
+} // namespace Bench
@@ -0,0 +1,178 @@
+#include "Benchmark.h"
+
+#include "DeviceTable.h"
+
+#include <thread>
+
+//======================================================================================================================
+namespace Bench {
+
+/**
+    The device table under a burst of watcher events: two watcher threads report --devices devices' MIDI ports
+    (disabled) and BLE devices (disconnected). Then every MIDI port is reported enabled, which opens it, while every
+    BLE link drops and comes back --flaps times, ending up connected, which reopens its MIDI port. A stand-in for paint() takes the registry's lock for 2 ms at 60 Hz
+    throughout. The simulated devices send nothing; this is about the bookkeeping.
+
+    Runs it twice: applying each event on the watcher's thread as it comes, taking the lock for each, as the app used
+    to; and through the DeviceTable's queue, in batches. Reports the time from the first event to a fully populated
+    table and to every device being connected and open, how long the painter waited for the lock, and how many
+    events were applied and coalesced.
+*/
+Result runEnumeration(const Options& options)
+{
+    std::vector<Simulation::DeviceSettings> settings;
+
+    for (int i = 0; i < options.devices; ++i)
+    {
+        auto s                  = options.getDeviceSettings(i);
+        s.midiMessagesPerSecond = 0.0;
+        s.blePacketsPerSecond   = 0.0;
+        s.discoveryMillis       = 0.0;
+        s.cachedDiscoveryMillis = 0.0;
+        settings.push_back(s);
+    }
+
+    const auto run = [&](bool batched)
+    {
+        Simulation::SimulatedBackend backend(settings);
+        Ingest::DeviceRegistry       registry(static_cast<size_t>(options.devices));
+        CriticalSection              lock;
+        Ingest::DeviceTable          table(registry, backend, lock, 2);
+
+        // Enumeration is only ever held back by the queue; applied directly, it's done when both watchers are
+        std::atomic<int>     enumerated{0};
+        std::atomic<int64_t> enumerated_at{0};
+
+        const auto deliver = [&](Ingest::DeviceEvent e)
+        {
+            if (batched)
+            {
+                table.post(std::move(e));
+                return;
+            }
+
+            if (e.kind == Ingest::DeviceEventKind::enumerationCompleted)
+            {
+                if (enumerated.fetch_add(1) + 1 == 2)
+                    enumerated_at.store(Ingest::hostNanos());
+
+                table.post(std::move(e)); // for the open completions, which always come through the queue
+                return;
+            }
+
+            table.applyDirectly(e);
+        };
+
+        std::atomic<bool>        painting{true};
+        Ingest::LatencyHistogram lock_wait;
+
+        std::thread painter([&]
+        {
+            while (painting.load())
+            {
+                {
+                    const auto start = Ingest::hostNanos();
+                    const ScopedLock sl(lock);
+                    lock_wait.record(Ingest::hostNanos() - start);
+
+                    sleepFor(0.002);
+                }
+
+                sleepFor(1.0 / 60.0 - 0.002);
+            }
+        });
+
+        table.start();
+        const auto start = Ingest::hostNanos();
+
+        std::thread midi_watcher([&]
+        {
+            for (int i = 0; i < options.devices; ++i)
+                deliver({.kind        = Ingest::DeviceEventKind::midiAdded,
+                         .id          = Simulation::SimulatedBackend::getMidiPortId(i),
+                         .containerId = Simulation::SimulatedBackend::getContainerId(i),
+                         .name        = "Device " + String(i),
+                         .flag        = false});
+
+            deliver({.kind = Ingest::DeviceEventKind::enumerationCompleted, .id = "midi"});
+
+            for (int i = 0; i < options.devices; ++i)
+                deliver({.kind = Ingest::DeviceEventKind::midiUpdated,
+                         .id   = Simulation::SimulatedBackend::getMidiPortId(i),
+                         .flag = true});
+        });
+
+        std::thread ble_watcher([&]
+        {
+            for (int i = 0; i < options.devices; ++i)
+                deliver({.kind        = Ingest::DeviceEventKind::bleAdded,
+                         .id          = Simulation::SimulatedBackend::getBleDeviceId(i),
+                         .containerId = Simulation::SimulatedBackend::getContainerId(i),
+                         .name        = "Device " + String(i),
+                         .flag        = false});
+
+            deliver({.kind = Ingest::DeviceEventKind::enumerationCompleted, .id = "ble"});
+
+            for (int f = 0; f < options.flaps * 2 + 1; ++f)
+                for (int i = 0; i < options.devices; ++i)
+                    deliver({.kind = Ingest::DeviceEventKind::bleUpdated,
+                             .id   = Simulation::SimulatedBackend::getBleDeviceId(i),
+                             .flag = f % 2 == 0});
+        });
+
+        midi_watcher.join();
+        ble_watcher.join();
+
+        const auto settled = [&]
+        {
+            const ScopedLock sl(lock);
+
+            for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+                if (registry.bleSources[h] == nullptr || registry.midiStates[h] != Ingest::PortState::open)
+                    return false;
+
+            return registry.size() == static_cast<size_t>(options.devices);
+        };
+
+        const auto timeout = start + static_cast<int64_t>(jmax(10.0, options.seconds) * 1.0e9);
+
+        while (!settled() && Ingest::hostNanos() < timeout)
+            sleepFor(0.001);
+
+        const auto settled_at = Ingest::hostNanos();
+
+        painting = false;
+        painter.join();
+
+        table.stop();
+        table.closeAll();
+
+        const auto populated = batched ? table.getTimeToPopulate().value_or(-1) : enumerated_at.load() - start;
+
+        auto* o = new DynamicObject();
+        o->setProperty("populated_ms", static_cast<double>(populated) * 1.0e-6);
+        o->setProperty("settled_ms", static_cast<double>(settled_at - start) * 1.0e-6);
+        o->setProperty("settled", settled_at < timeout);
+        o->setProperty("paint_lock_wait", lock_wait.getSummary().toVar());
+        o->setProperty("applied", static_cast<int64>(table.getAppliedCount()));
+        o->setProperty("coalesced", static_cast<int64>(table.getCoalescedCount()));
+        o->setProperty("batches", static_cast<int64>(table.getBatchCount()));
+        return std::pair(var(o), static_cast<double>(settled_at - start) * 1.0e-9);
+    };
+
+    const auto [direct, direct_seconds] = run(false);
+    const auto [batched, batched_seconds] = run(true);
+
+    Result result;
+    result.events  = static_cast<uint64_t>(options.devices) * static_cast<uint64_t>(3 + options.flaps * 2 + 1);
+    result.seconds = batched_seconds;
+
+    auto* details = new DynamicObject();
+    details->setProperty("direct", direct);
+    details->setProperty("batched", batched);
+    details->setProperty("direct_seconds", direct_seconds);
+    result.details = var(details);
+
+    return result;
+}
+} // namespace Bench
@@ -0,0 +1,365 @@
+#include "Benchmark.h"
+
+#include "EventMerger.h"
+#include "IngestConsumer.h"
+#include "Subscription.h"
+
+#include <numeric>
+
+//======================================================================================================================
+namespace Bench {
+
+/**
+    Checks what comes out of an EventMerger: that each stream's events come in the order they arrived in, how long
+    events were held, and, for the synthetic runs, that the sequence numbers in the payloads come intact and how often
+    a MIDI event came out after one that really happened later. now is the time events are passed on at; the live
+    runs leave it at 0 and use hostNanos().
+*/
+class MergeCheckSink : public Ingest::EventSink
+{
+public:
+    MergeCheckSink(size_t numDevices, const std::vector<std::vector<int64_t>>* midiTrueTimes)
+            : trueTimes(midiTrueTimes),
+              nextMidi(numDevices),
+              nextBle(numDevices),
+              lastMidi(numDevices, std::numeric_limits<int64_t>::min()),
+              lastBle(numDevices, std::numeric_limits<int64_t>::min())
+    {
+    }
+
+    void midiEvent(Ingest::DeviceHandle device, const Ingest::MidiEvent& e) override
+    {
+        const auto index = nextMidi[device]++;
+
+        if (trueTimes != nullptr)
+        {
+            const auto b = e.getBytes();
+
+            if (b.size() != 3 || static_cast<uint32_t>(b[1] | (b[2] << 7)) != (index & 0x3fff))
+                ++broken;
+
+            if (index < (*trueTimes)[device].size())
+            {
+                const auto t = (*trueTimes)[device][index];
+
+                if (t < latestTrueTime)
+                    misorder.record(latestTrueTime - t);
+                else
+                    latestTrueTime = t;
+            }
+        }
+
+        passed(lastMidi[device], e.hostTime);
+    }
+
+    void blePacket(Ingest::DeviceHandle device, const Ingest::PacketView& p) override
+    {
+        const auto index = nextBle[device]++;
+
+        if (trueTimes != nullptr)
+        {
+            uint32_t sequence = 0;
+            std::memcpy(&sequence, p.data, sizeof(sequence));
+
+            if (p.size < sizeof(sequence) || sequence != static_cast<uint32_t>(index))
+                ++broken;
+        }
+
+        passed(lastBle[device], p.hostTime);
+    }
+
+    var toVar() const
+    {
+        auto* o = new DynamicObject();
+        o->setProperty("events", static_cast<int64>(count));
+        o->setProperty("stream_reordered", static_cast<int64>(reordered));
+        o->setProperty("added_latency", held.getSummary().toVar());
+
+        if (trueTimes != nullptr)
+        {
+            const auto misordered = misorder.getSummary();
+            const auto midi       = std::accumulate(nextMidi.begin(), nextMidi.end(), uint64_t{0});
+
+            o->setProperty("broken", static_cast<int64>(broken));
+            o->setProperty("misordered_fraction",
+                           midi > 0 ? static_cast<double>(misordered.count) / static_cast<double>(midi) : 0.0);
+            o->setProperty("misordered_by", misordered.toVar());
+        }
+
+        return var(o);
+    }
+
+    int64_t now = 0;
+
+private:
+    void passed(int64_t& last, int64_t hostTime)
+    {
+        if (hostTime < last)
+            ++reordered;
+
+        last = std::max(last, hostTime);
+        held.record((now != 0 ? now : Ingest::hostNanos()) - hostTime);
+        ++count;
+    }
+
+    const std::vector<std::vector<int64_t>>* trueTimes;
+    std::vector<uint64_t>                    nextMidi, nextBle;
+    std::vector<int64_t>                     lastMidi, lastBle;
+    int64_t                                  latestTrueTime = std::numeric_limits<int64_t>::min();
+    Ingest::LatencyHistogram                 held, misorder;
+    uint64_t                                 count = 0, broken = 0, reordered = 0;
+};
+
+/**
+    EventMerger at 2, 8 and 32 devices, first on a synthetic stream and then live.
+
+    The synthetic devices send MIDI at --midi-rate with device timestamps, on clocks that are off by up to
+    --drift-ppm, and BLE packets at --ble-rate without. Both go out over the device's link at its connection events,
+    every --connection-interval-ms with a phase of its own, with one event in fifty retried at the next one and up
+    to half a millisecond of scheduling delay on top. That's --seconds of traffic, fed to the merger in arrival order
+    as fast as it takes it, with a --reorder-ms window and a release every millisecond in between, the way a
+    subscription's idle wake would: once with clock correction and once in plain arrival order.
+    Reports the merge cost per event, the time events were held back, how many MIDI events came out after a later
+    one (by the time they really happened) and by how much, and how far each device's drift estimate was off.
+
+    The live runs put the merger behind a lossless subscription on the simulated pipeline for --seconds, and report
+    the latency it added, from callback to leaving the merger, and the events it had to pass on late.
+*/
+Result runMerge(const Options& options)
+{
+    constexpr double retryChance = 0.02;
+    constexpr double osDelayNs   = 500000.0;
+
+    const auto window   = static_cast<int64_t>(options.reorderMs * 1.0e6);
+    const auto interval = static_cast<int64_t>(options.connectionMs * 1.0e6);
+    const auto duration = static_cast<int64_t>(options.seconds * 1.0e9);
+
+    Result result;
+    var    runs = Array<var>();
+
+    for (const int num_devices : {2, 8, 32})
+    {
+        const auto n = static_cast<size_t>(num_devices);
+
+        struct Synthetic
+        {
+            int64_t      hostTime = 0, deviceTime = Ingest::noDeviceTime;
+            uint32_t     sequence = 0;
+            uint16_t     device   = 0;
+            bool         isBle    = false;
+        };
+
+        std::minstd_rand                       random(static_cast<uint32_t>(num_devices));
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+        std::vector<Synthetic>            events;
+        std::vector<std::vector<int64_t>> true_times(n);
+        std::vector<double>               drift(n);
+
+        for (size_t d = 0; d < n; ++d)
+        {
+            drift[d] = (unit(random) * 2.0 - 1.0) * options.driftPpm;
+
+            const auto origin = static_cast<int64_t>(unit(random) * 1.0e12);
+            const auto phase  = static_cast<int64_t>(unit(random) * static_cast<double>(interval));
+
+            // Both streams' true times, in order, as the link sends them
+            std::vector<std::pair<int64_t, bool>> sent;
+
+            for (const auto& [rate, is_ble] : {std::pair{options.midiRate, false}, std::pair{options.bleRate, true}})
+            {
+                if (rate <= 0.0)
+                    continue;
+
+                const auto gap = 1.0e9 / rate;
+
+                for (auto t = unit(random) * gap; t < static_cast<double>(duration);
+                     t += gap * (1.0 + options.jitter * (unit(random) * 2.0 - 1.0)))
+                    sent.emplace_back(static_cast<int64_t>(t), is_ble);
+            }
+
+            std::sort(sent.begin(), sent.end());
+
+            int64_t  arrived = 0;
+            uint32_t midi = 0, ble = 0;
+
+            for (const auto& [t, is_ble] : sent)
+            {
+                auto at = phase + ((t - phase + interval - 1) / interval) * interval;
+
+                if (unit(random) < retryChance)
+                    at += interval;
+
+                // A link delivers in order, so nothing overtakes what was sent before it
+                arrived = std::max(arrived + 1, at + static_cast<int64_t>(unit(random) * osDelayNs));
+
+                Synthetic e;
+                e.hostTime = arrived;
+                e.device   = static_cast<uint16_t>(d);
+                e.isBle    = is_ble;
+
+                if (is_ble)
+                {
+                    e.sequence = ble++;
+                }
+                else
+                {
+                    e.sequence   = midi++;
+                    e.deviceTime = origin + static_cast<int64_t>(static_cast<double>(t) * (1.0 + drift[d] * 1.0e-6));
+                    true_times[d].push_back(t);
+                }
+
+                events.push_back(e);
+            }
+        }
+
+        std::stable_sort(events.begin(), events.end(), [](const Synthetic& a, const Synthetic& b)
+        {
+            return a.hostTime < b.hostTime;
+        });
+
+        const auto merge = [&](bool correct_clocks)
+        {
+            Ingest::MergeSettings settings;
+            settings.reorderWindow = window;
+            settings.correctClocks = correct_clocks;
+
+            MergeCheckSink      check(n, &true_times);
+            Ingest::EventMerger merger(check, n, settings);
+
+            std::vector<uint8_t> packet(static_cast<size_t>(jmax(4, options.blePayloadSize)));
+
+            const auto start = Ingest::hostNanos();
+
+            constexpr int64_t tick = 1000000;
+            int64_t           next_tick = events.empty() ? 0 : events.front().hostTime + tick;
+
+            for (const auto& e : events)
+            {
+                for (; next_tick < e.hostTime; next_tick += tick)
+                {
+                    check.now = next_tick;
+                    merger.release(next_tick);
+                }
+
+                check.now = e.hostTime;
+
+                if (e.isBle)
+                {
+                    std::memcpy(packet.data(), &e.sequence, sizeof(e.sequence));
+                    merger.add(e.device, Ingest::StreamKind::ble, packet, e.hostTime, e.deviceTime);
+                }
+                else
+                {
+                    const uint8_t note[] = {0x90, static_cast<uint8_t>(e.sequence & 0x7f),
+                                            static_cast<uint8_t>((e.sequence >> 7) & 0x7f)};
+                    merger.add(e.device, Ingest::StreamKind::midi, note, e.hostTime, e.deviceTime);
+                }
+
+                merger.release(e.hostTime);
+            }
+
+            check.now = events.empty() ? 0 : events.back().hostTime + window;
+            merger.release(check.now);
+            merger.flush();
+
+            const auto elapsed = Ingest::hostNanos() - start;
+
+            auto drift_error = 0.0;
+
+            for (size_t d = 0; d < n; ++d)
+            {
+                const auto h = static_cast<Ingest::DeviceHandle>(d);
+                drift_error  = jmax(drift_error, std::abs(merger.getDriftPpm(h, Ingest::StreamKind::midi) - drift[d]));
+            }
+
+            const auto num_events = static_cast<double>(jmax(size_t{1}, events.size()));
+
+            auto* o = new DynamicObject();
+            o->setProperty("ns_per_event", static_cast<double>(elapsed) / num_events);
+            o->setProperty("events_per_sec", num_events / (static_cast<double>(elapsed) * 1.0e-9));
+            o->setProperty("late", static_cast<int64>(merger.getLateCount()));
+            o->setProperty("forced", static_cast<int64>(merger.getForcedCount()));
+            o->setProperty("output", check.toVar());
+
+            if (correct_clocks)
+                o->setProperty("max_drift_error_ppm", drift_error);
+
+            return var(o);
+        };
+
+        auto* run = new DynamicObject();
+        run->setProperty("devices", num_devices);
+        run->setProperty("synthetic_events", static_cast<int64>(events.size()));
+        run->setProperty("merged", merge(true));
+        run->setProperty("arrival_order", merge(false));
+
+        //==============================================================================================================
+        std::vector<Simulation::DeviceSettings> settings;
+
+        for (int i = 0; i < num_devices; ++i)
+            settings.push_back(options.getDeviceSettings(i));
+
+        Simulation::SimulatedBackend backend(settings, {options.olderLinkShare});
+        Ingest::DeviceRegistry       registry(n);
+        Ingest::IngestConsumer       consumer(registry);
+
+        for (int i = 0; i < num_devices; ++i)
+        {
+            const auto h = registry.intern(Simulation::SimulatedBackend::getContainerId(i));
+
+            registry.midiChannels[h]->setListener(&consumer);
+            registry.bleChannels[h]->setListener(&consumer);
+        }
+
+        Ingest::MergeSettings merge_settings;
+        merge_settings.reorderWindow = window;
+
+        MergeCheckSink       check(n, nullptr);
+        Ingest::EventMerger  merger(check, n, merge_settings);
+        Ingest::Subscription subscription(registry, merger, Ingest::Delivery::lossless, 256, 1);
+
+        consumer.start();
+        subscription.start();
+
+        for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+        {
+            const auto i = static_cast<int>(h);
+
+            registry.midiSources[h] = backend.openMidiInput(registry.containerIds[h],
+                                                            Simulation::SimulatedBackend::getMidiPortId(i),
+                                                            registry.midiChannels[h], nullptr);
+            registry.bleSources[h]  = backend.connectBleDevice(Simulation::SimulatedBackend::getBleDeviceId(i),
+                                                               registry.bleChannels[h]);
+        }
+
+        const auto start = Ingest::hostNanos();
+        sleepFor(options.seconds);
+
+        for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+        {
+            registry.midiSources[h].reset();
+            registry.bleSources[h].reset();
+        }
+
+        subscription.stop();
+        consumer.stop();
+        merger.flush();
+
+        auto* live = new DynamicObject();
+        live->setProperty("late", static_cast<int64>(merger.getLateCount()));
+        live->setProperty("forced", static_cast<int64>(merger.getForcedCount()));
+        live->setProperty("output", check.toVar());
+        run->setProperty("live", var(live));
+
+        result.events  += merger.getPassedCount();
+        result.seconds += static_cast<double>(Ingest::hostNanos() - start) * 1.0e-9;
+        runs.append(var(run));
+    }
+
+    auto* details = new DynamicObject();
+    details->setProperty("runs", runs);
+    result.details = var(details);
+    return result;
+}
+} // namespace Bench
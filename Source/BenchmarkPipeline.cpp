@@ -0,0 +1,715 @@
+#include "Benchmark.h"
+
+#include "IngestConsumer.h"
+#include "Subscription.h"
+
+#include <thread>
+
+#if JUCE_WINDOWS
+ #include <windows.h>
+#else
+ #include <ctime>
+#endif
+
+//======================================================================================================================
+namespace Bench {
+
+static int64_t threadCpuNanos()
+{
+   #if JUCE_WINDOWS
+    FILETIME creation, exit, kernel, user;
+    GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+
+    const auto ticks = [](const FILETIME& t) { return (static_cast<int64_t>(t.dwHighDateTime) << 32) | t.dwLowDateTime; };
+    return (ticks(kernel) + ticks(user)) * 100;
+   #else
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+   #endif
+}
+
+//======================================================================================================================
+/**
+    Simulated devices at their configured rates, jitter and bursts, with the radio model applied, drained by one
+    consumer thread. Shows how the pipeline copes with realistic traffic, and what the callback path costs.
+*/
+Result runPaced(const Options& options)
+{
+    std::vector<Simulation::DeviceSettings> settings;
+
+    for (int i = 0; i < options.devices; ++i)
+        settings.push_back(options.getDeviceSettings(i));
+
+    Simulation::SimulatedBackend backend(settings, {options.olderLinkShare});
+
+    std::vector<std::shared_ptr<Ingest::MidiChannel>> midiChannels;
+    std::vector<std::shared_ptr<Ingest::BleChannel>>  bleChannels;
+    std::vector<std::unique_ptr<Ingest::MidiSource>>      midiSources;
+    std::vector<std::unique_ptr<Ingest::BlePacketSource>> bleSources;
+
+    for (int i = 0; i < options.devices; ++i)
+    {
+        midiChannels.push_back(std::make_shared<Ingest::MidiChannel>(static_cast<uint16_t>(i), 4096));
+        bleChannels.push_back(std::make_shared<Ingest::BleChannel>(static_cast<uint16_t>(i), 1024));
+    }
+
+    std::vector<Ingest::MidiChannel*> midi;
+    std::vector<Ingest::BleChannel*>  ble;
+
+    for (size_t i = 0; i < midiChannels.size(); ++i)
+    {
+        midi.push_back(midiChannels[i].get());
+        ble.push_back(bleChannels[i].get());
+    }
+
+    Drainer drainer(midi, ble, options.drainInterval);
+
+    std::vector<int64_t> open_issued;
+
+    // Connected in order, so with the radio model on the last device is the one that gets the full rate
+    for (int i = 0; i < options.devices; ++i)
+    {
+        const auto index = static_cast<size_t>(i);
+
+        open_issued.push_back(Ingest::hostNanos());
+        midiSources.push_back(backend.openMidiInput(Simulation::SimulatedBackend::getContainerId(i),
+                                                    Simulation::SimulatedBackend::getMidiPortId(i), midiChannels[index],
+                                                    nullptr));
+        bleSources.push_back(backend.connectBleDevice(Simulation::SimulatedBackend::getBleDeviceId(i), bleChannels[index]));
+    }
+
+    sleepFor(options.warmup);
+
+    const auto received_before = [&]
+    {
+        std::vector<std::pair<uint64_t, uint64_t>> r;
+
+        for (size_t i = 0; i < midi.size(); ++i)
+            r.emplace_back(midi[i]->getReceivedCount(), ble[i]->getReceivedCount());
+
+        return r;
+    }();
+
+    const auto allocations_before = AllocationCounter::count.load();
+    const auto start              = Ingest::hostNanos();
+
+    sleepFor(options.seconds);
+
+    const auto elapsed     = static_cast<double>(Ingest::hostNanos() - start) * 1.0e-9;
+    const auto allocations = AllocationCounter::count.load() - allocations_before;
+
+    std::vector<std::pair<uint64_t, uint64_t>> received_after;
+
+    for (size_t i = 0; i < midi.size(); ++i)
+        received_after.emplace_back(midi[i]->getReceivedCount(), ble[i]->getReceivedCount());
+
+    uint64_t emitted = 0, callback_nanos = 0;
+
+    const auto add_stats = [&](const auto& sources)
+    {
+        for (const auto& source : sources)
+        {
+            if (const auto* emitter = dynamic_cast<const Simulation::Emitter*>(source.get()))
+            {
+                emitted        += emitter->getStats().emitted.load();
+                callback_nanos += emitter->getStats().callbackNanos.load();
+            }
+        }
+    };
+
+    add_stats(midiSources);
+    add_stats(bleSources);
+
+    midiSources.clear();
+    bleSources.clear();
+
+    Result result;
+    result.seconds     = elapsed;
+    result.allocations = allocations;
+
+    var devices = Array<var>();
+
+    for (size_t i = 0; i < midi.size(); ++i)
+    {
+        const auto midi_events = received_after[i].first - received_before[i].first;
+        const auto ble_packets = received_after[i].second - received_before[i].second;
+
+        result.events += midi_events + ble_packets;
+
+        auto* d = new DynamicObject();
+        d->setProperty("index", static_cast<int>(i));
+        d->setProperty("midi_events_per_sec", static_cast<double>(midi_events) / elapsed);
+        d->setProperty("ble_packets_per_sec", static_cast<double>(ble_packets) / elapsed);
+        d->setProperty("midi_dropped", static_cast<int64>(midi[i]->getDroppedCount()));
+        d->setProperty("ble_dropped", static_cast<int64>(ble[i]->getDroppedCount()));
+
+        if (const auto first = midi[i]->getFirstArrivalTime(); first != 0)
+            d->setProperty("time_to_first_message_ns", static_cast<int64>(first - open_issued[i]));
+
+        d->setProperty("midi_latency", midi[i]->getLatencyStats().toVar());
+        d->setProperty("ble_latency", ble[i]->getLatencyStats().toVar());
+        devices.append(var(d));
+    }
+
+    auto* details = new DynamicObject();
+    details->setProperty("devices", devices);
+    details->setProperty("callback_ns_per_event", emitted == 0 ? 0.0 : static_cast<double>(callback_nanos) / static_cast<double>(emitted));
+    result.details = var(details);
+
+    return result;
+}
+
+//======================================================================================================================
+/**
+    One producer and one consumer thread per device, each pushing and draining as fast as it can, run at 1, 2, 4...
+    devices up to --devices. Devices share nothing, so the aggregate rate should grow linearly with the device count
+    (until the machine runs out of cores); scaling_efficiency is the per-device rate relative to the single-device run.
+*/
+Result runContention(const Options& options)
+{
+    Result result;
+    var    runs = Array<var>();
+
+    double single_device_rate = 0.0;
+
+    for (int n = 1; n <= options.devices; n *= 2)
+    {
+        std::vector<std::unique_ptr<Ingest::MidiChannel>> midi;
+        std::vector<std::unique_ptr<Ingest::BleChannel>>  ble;
+
+        for (int i = 0; i < n; ++i)
+        {
+            midi.push_back(std::make_unique<Ingest::MidiChannel>(static_cast<uint16_t>(i), 4096));
+            ble.push_back(std::make_unique<Ingest::BleChannel>(static_cast<uint16_t>(i), 1024));
+        }
+
+        std::atomic<bool>     running{true}, measuring{false};
+        std::atomic<int64_t>  producer_cpu{0};
+        std::atomic<uint64_t> pushed{0};
+        std::vector<std::thread> threads;
+
+        const auto ble_ratio = options.midiRate > 0.0 ? options.bleRate / options.midiRate : 0.0;
+
+        for (int i = 0; i < n; ++i)
+        {
+            auto* m = midi[static_cast<size_t>(i)].get();
+            auto* b = ble[static_cast<size_t>(i)].get();
+
+            threads.emplace_back([&, m, b, i]
+            {
+                Simulation::MessageMix     mix(i, options.sysExFraction, options.sysExSize);
+                const std::vector<uint8_t> payload(static_cast<size_t>(jlimit(1, 512, options.blePayloadSize)), uint8_t{0});
+
+                double   ble_due = 0.0;
+                uint64_t count   = 0;
+                int64_t  cpu     = 0;
+                bool     counted = false;
+
+                while (running.load(std::memory_order_relaxed))
+                {
+                    if (!counted && measuring.load(std::memory_order_relaxed))
+                    {
+                        counted = true;
+                        count   = 0;
+                        cpu     = threadCpuNanos();
+                    }
+
+                    const auto now   = Ingest::hostNanos();
+                    const auto bytes = mix.next();
+                    m->push(bytes.data(), bytes.size(), now);
+                    ++count;
+
+                    if ((ble_due += ble_ratio) >= 1.0)
+                    {
+                        ble_due -= 1.0;
+                        b->push(payload.data(), payload.size(), now);
+                        ++count;
+                    }
+                }
+
+                producer_cpu += threadCpuNanos() - cpu;
+                pushed += count;
+            });
+
+            threads.emplace_back([&, m, b]
+            {
+                while (running.load(std::memory_order_relaxed))
+                {
+                    m->drain([](const Ingest::MidiEvent&) {});
+                    b->drain([](const Ingest::PacketView&) {});
+                }
+            });
+        }
+
+        sleepFor(options.warmup);
+
+        uint64_t accepted_before = 0;
+        for (int i = 0; i < n; ++i)
+            accepted_before += midi[static_cast<size_t>(i)]->getReceivedCount() + ble[static_cast<size_t>(i)]->getReceivedCount();
+
+        const auto allocations_before = AllocationCounter::count.load();
+        const auto start              = Ingest::hostNanos();
+        measuring = true;
+
+        sleepFor(options.seconds);
+
+        const auto elapsed     = static_cast<double>(Ingest::hostNanos() - start) * 1.0e-9;
+        const auto allocations = AllocationCounter::count.load() - allocations_before;
+
+        uint64_t accepted_after = 0;
+        for (int i = 0; i < n; ++i)
+            accepted_after += midi[static_cast<size_t>(i)]->getReceivedCount() + ble[static_cast<size_t>(i)]->getReceivedCount();
+
+        running = false;
+
+        for (auto& t : threads)
+            t.join();
+
+        const auto accepted  = accepted_after - accepted_before;
+        const auto rate      = static_cast<double>(accepted) / elapsed;
+        const auto per_event = pushed.load() == 0 ? 0.0 : static_cast<double>(producer_cpu.load()) / static_cast<double>(pushed.load());
+
+        if (n == 1)
+            single_device_rate = rate;
+
+        auto* r = new DynamicObject();
+        r->setProperty("devices", n);
+        r->setProperty("events_per_sec", rate);
+        r->setProperty("producer_cpu_ns_per_event", per_event);
+        r->setProperty("scaling_efficiency", single_device_rate > 0.0 ? rate / (single_device_rate * n) : 0.0);
+        r->setProperty("allocations", static_cast<int64>(allocations));
+        runs.append(var(r));
+
+        result.events      += accepted;
+        result.seconds     += elapsed;
+        result.allocations += allocations;
+    }
+
+    auto* details = new DynamicObject();
+    details->setProperty("runs", runs);
+    result.details = var(details);
+
+    return result;
+}
+
+//======================================================================================================================
+/**
+    Stands in for whatever the app does with an event once it's ingested (decoding, routing, updating a view): busy
+    for a fixed time per event. Records, per channel, how long after its arrival each event was done with.
+*/
+class WorkSink : public Ingest::EventSink
+{
+public:
+    WorkSink(size_t numDevices, int64_t nanosPerEvent)
+            : work(nanosPerEvent),
+              midiDone(numDevices),
+              bleDone(numDevices)
+    {
+    }
+
+    void midiEvent(Ingest::DeviceHandle device, const Ingest::MidiEvent& event) override { process(midiDone[device], event.hostTime); }
+    void blePacket(Ingest::DeviceHandle device, const Ingest::PacketView& packet) override { process(bleDone[device], packet.hostTime); }
+
+    void startRecording() { recording = true; }
+
+    /** The worst channel's p50 and p99. */
+    [[nodiscard]] var getCompletionSummary() const
+    {
+        int64_t p50 = 0, p99 = 0;
+
+        for (const auto* histograms : {&midiDone, &bleDone})
+        {
+            for (const auto& h : *histograms)
+            {
+                const auto summary = h.getSummary();
+                p50 = jmax(p50, summary.p50);
+                p99 = jmax(p99, summary.p99);
+            }
+        }
+
+        auto* o = new DynamicObject();
+        o->setProperty("worst_p50_ns", static_cast<int64>(p50));
+        o->setProperty("worst_p99_ns", static_cast<int64>(p99));
+        return var(o);
+    }
+
+private:
+    void process(Ingest::LatencyHistogram& done, int64_t hostTime)
+    {
+        for (const auto until = Ingest::hostNanos() + work; Ingest::hostNanos() < until;)
+        {
+        }
+
+        if (recording.load(std::memory_order_relaxed))
+            done.record(Ingest::hostNanos() - hostTime);
+    }
+
+    const int64_t                         work;
+    std::vector<Ingest::LatencyHistogram> midiDone, bleDone; // each channel's events are only ever processed on one thread
+    std::atomic<bool>                     recording{false};
+};
+
+/** The alternative to a consumer: each channel is drained into the sink by whoever pushed, right there in the callback. */
+template<typename Channel>
+class InlineProcessing : public Ingest::ChannelListener
+{
+public:
+    InlineProcessing(Channel& c, Ingest::EventSink& s) : channel(c), sink(s) {}
+
+    void channelDataArrived(uint16_t source) override
+    {
+        channel.drain([this, source](const auto& e)
+        {
+            if constexpr (std::is_same_v<std::decay_t<decltype(e)>, Ingest::MidiEvent>)
+                sink.midiEvent(source, e);
+            else
+                sink.blePacket(source, e);
+        });
+    }
+
+private:
+    Channel&           channel;
+    Ingest::EventSink& sink;
+};
+
+/**
+    The same simulated load at 1, 4 and 16 devices, processed inline on the sources' callback threads and then
+    offloaded to IngestConsumer's worker pool (--workers, --worker-batch, --first-core, --realtime-workers). Every
+    event costs --sink-work-ns of processing either way.
+
+    Inline, the callback pays for the processing itself and one busy device holds up nothing but itself, yet the work
+    lands on threads we don't control. Offloaded, the callback is just the push, and the cost moves to how soon a
+    worker gets to the event, which is what completion measures: arrival to done with.
+*/
+Result runOffload(const Options& options)
+{
+    Result result;
+    var    runs = Array<var>();
+
+    for (const auto num_devices : {1, 4, 16})
+    {
+        for (const auto offloaded : {false, true})
+        {
+            std::vector<Simulation::DeviceSettings> settings;
+
+            for (int i = 0; i < num_devices; ++i)
+                settings.push_back(options.getDeviceSettings(i));
+
+            Simulation::SimulatedBackend backend(settings, {options.olderLinkShare});
+
+            Ingest::WorkerSettings workers;
+            workers.numWorkers       = options.workers > 0 ? options.workers : jlimit(1, jmax(1, SystemStats::getNumCpus() / 2), num_devices);
+            workers.batchSize        = static_cast<size_t>(jmax(1, options.workerBatch));
+            workers.firstCore        = options.firstCore;
+            workers.realtimePriority = options.realtimeWorkers;
+
+            Ingest::DeviceRegistry registry(static_cast<size_t>(num_devices));
+            Ingest::IngestConsumer consumer(registry, 30, workers);
+            WorkSink               sink(static_cast<size_t>(num_devices), static_cast<int64_t>(options.sinkWorkNs));
+
+            std::vector<std::unique_ptr<Ingest::ChannelListener>> inline_processing;
+
+            for (int i = 0; i < num_devices; ++i)
+            {
+                const auto h = registry.intern(Simulation::SimulatedBackend::getContainerId(i));
+
+                if (offloaded)
+                {
+                    registry.midiChannels[h]->setListener(&consumer);
+                    registry.bleChannels[h]->setListener(&consumer);
+                }
+                else
+                {
+                    inline_processing.push_back(std::make_unique<InlineProcessing<Ingest::MidiChannel>>(*registry.midiChannels[h], sink));
+                    registry.midiChannels[h]->setListener(inline_processing.back().get());
+
+                    inline_processing.push_back(std::make_unique<InlineProcessing<Ingest::BleChannel>>(*registry.bleChannels[h], sink));
+                    registry.bleChannels[h]->setListener(inline_processing.back().get());
+                }
+            }
+
+            if (offloaded)
+            {
+                consumer.setSink(&sink);
+                consumer.start();
+            }
+
+            for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+            {
+                const auto i = static_cast<int>(h);
+
+                registry.midiSources[h] = backend.openMidiInput(registry.containerIds[h], Simulation::SimulatedBackend::getMidiPortId(i),
+                                                                registry.midiChannels[h], nullptr);
+                registry.bleSources[h]  = backend.connectBleDevice(Simulation::SimulatedBackend::getBleDeviceId(i), registry.bleChannels[h]);
+            }
+
+            const auto totals = [&]
+            {
+                uint64_t received = 0, dropped = 0, emitted = 0, callback_nanos = 0;
+
+                for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+                {
+                    received += registry.midiChannels[h]->getReceivedCount() + registry.bleChannels[h]->getReceivedCount();
+                    dropped  += registry.midiChannels[h]->getDroppedCount() + registry.bleChannels[h]->getDroppedCount();
+
+                    for (const auto* emitter : {dynamic_cast<const Simulation::Emitter*>(registry.midiSources[h].get()),
+                                                dynamic_cast<const Simulation::Emitter*>(registry.bleSources[h].get())})
+                    {
+                        if (emitter != nullptr)
+                        {
+                            emitted        += emitter->getStats().emitted.load();
+                            callback_nanos += emitter->getStats().callbackNanos.load();
+                        }
+                    }
+                }
+
+                return std::tuple(received, dropped, emitted, callback_nanos);
+            };
+
+            sleepFor(options.warmup);
+            sink.startRecording();
+
+            const auto [received_before, dropped_before, emitted_before, callback_before] = totals();
+            const auto allocations_before                                               = AllocationCounter::count.load();
+            const auto start                                                            = Ingest::hostNanos();
+
+            sleepFor(options.seconds);
+
+            const auto elapsed                                                      = static_cast<double>(Ingest::hostNanos() - start) * 1.0e-9;
+            const auto allocations                                                  = AllocationCounter::count.load() - allocations_before;
+            const auto [received_after, dropped_after, emitted_after, callback_after] = totals();
+
+            const auto pinned   = consumer.getNumPinnedWorkers();
+            const auto realtime = consumer.getNumRealtimeWorkers();
+
+            for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+            {
+                registry.midiSources[h].reset();
+                registry.bleSources[h].reset();
+            }
+
+            consumer.stop();
+
+            const auto events  = received_after - received_before;
+            const auto emitted = emitted_after - emitted_before;
+
+            result.events      += events;
+            result.seconds     += elapsed;
+            result.allocations += allocations;
+
+            auto* r = new DynamicObject();
+            r->setProperty("devices", num_devices);
+            r->setProperty("mode", offloaded ? "offloaded" : "inline");
+            r->setProperty("events_per_sec", static_cast<double>(events) / elapsed);
+            r->setProperty("dropped", static_cast<int64>(dropped_after - dropped_before));
+            r->setProperty("callback_ns_per_event", emitted == 0 ? 0.0 : static_cast<double>(callback_after - callback_before) / static_cast<double>(emitted));
+            r->setProperty("completion", sink.getCompletionSummary());
+
+            if (offloaded)
+            {
+                r->setProperty("workers", consumer.getNumWorkers());
+                r->setProperty("pinned_workers", pinned);
+                r->setProperty("realtime_workers", realtime);
+            }
+
+            runs.append(var(r));
+        }
+    }
+
+    auto* details = new DynamicObject();
+    details->setProperty("runs", runs);
+    result.details = var(details);
+
+    return result;
+}
+
+//======================================================================================================================
+/**
+    Stands in for a subscriber that blocks rather than computes, on a socket or a stalled repaint: it sleeps for a
+    fixed time per event, so it falls behind without taking any CPU away from the rest.
+*/
+class BlockingSink : public Ingest::EventSink
+{
+public:
+    explicit BlockingSink(int64_t nanosPerEvent) : block(nanosPerEvent) {}
+
+    void midiEvent(Ingest::DeviceHandle, const Ingest::MidiEvent&) override { std::this_thread::sleep_for(block); }
+    void blePacket(Ingest::DeviceHandle, const Ingest::PacketView&) override { std::this_thread::sleep_for(block); }
+
+private:
+    const std::chrono::nanoseconds block;
+};
+
+/**
+    The configured load with more and more Subscriptions tapping the channels next to the consumer: none, one
+    lossless, three lossless, and three lossless plus three lossy ones that block for a millisecond per event and
+    can't keep up. The lossless ones do --sink-work-ns of work per event.
+
+    The callback's cost per event should only grow by the extra listener calls, since nothing is copied per
+    subscriber, and the lossless subscribers should see everything the channels took in. The slow lossy ones should
+    just miss events, which shows up in their own counts and not in anyone else's.
+*/
+Result runFanout(const Options& options)
+{
+    struct Tap
+    {
+        int lossless = 0, lossy = 0;
+    };
+
+    Result result;
+    var    runs = Array<var>();
+
+    for (const auto tap : {Tap{0, 0}, Tap{1, 0}, Tap{3, 0}, Tap{3, 3}})
+    {
+        std::vector<Simulation::DeviceSettings> settings;
+
+        for (int i = 0; i < options.devices; ++i)
+            settings.push_back(options.getDeviceSettings(i));
+
+        Simulation::SimulatedBackend backend(settings, {options.olderLinkShare});
+
+        const auto num_devices = static_cast<size_t>(options.devices);
+        const auto work        = static_cast<int64_t>(options.sinkWorkNs);
+
+        Ingest::DeviceRegistry registry(num_devices);
+        Ingest::IngestConsumer consumer(registry);
+
+        for (int i = 0; i < options.devices; ++i)
+        {
+            const auto h = registry.intern(Simulation::SimulatedBackend::getContainerId(i));
+
+            registry.midiChannels[h]->setListener(&consumer);
+            registry.bleChannels[h]->setListener(&consumer);
+        }
+
+        std::vector<std::unique_ptr<WorkSink>>             sinks;
+        std::vector<std::unique_ptr<BlockingSink>>         blocking;
+        std::vector<std::unique_ptr<Ingest::Subscription>> subscriptions;
+
+        for (int i = 0; i < tap.lossless; ++i)
+        {
+            sinks.push_back(std::make_unique<WorkSink>(num_devices, work));
+            subscriptions.push_back(std::make_unique<Ingest::Subscription>(registry, *sinks.back(), Ingest::Delivery::lossless));
+        }
+
+        for (int i = 0; i < tap.lossy; ++i)
+        {
+            blocking.push_back(std::make_unique<BlockingSink>(1000000));
+            subscriptions.push_back(std::make_unique<Ingest::Subscription>(registry, *blocking.back(), Ingest::Delivery::lossy));
+        }
+
+        consumer.start();
+
+        for (auto& s : subscriptions)
+            s->start();
+
+        for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+        {
+            const auto i = static_cast<int>(h);
+
+            registry.midiSources[h] = backend.openMidiInput(registry.containerIds[h], Simulation::SimulatedBackend::getMidiPortId(i),
+                                                            registry.midiChannels[h], nullptr);
+            registry.bleSources[h]  = backend.connectBleDevice(Simulation::SimulatedBackend::getBleDeviceId(i), registry.bleChannels[h]);
+        }
+
+        const auto totals = [&]
+        {
+            uint64_t received = 0, dropped = 0, emitted = 0, callback_nanos = 0;
+
+            for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+            {
+                received += registry.midiChannels[h]->getReceivedCount() + registry.bleChannels[h]->getReceivedCount();
+                dropped  += registry.midiChannels[h]->getDroppedCount() + registry.bleChannels[h]->getDroppedCount();
+
+                for (const auto* emitter : {dynamic_cast<const Simulation::Emitter*>(registry.midiSources[h].get()),
+                                            dynamic_cast<const Simulation::Emitter*>(registry.bleSources[h].get())})
+                {
+                    if (emitter != nullptr)
+                    {
+                        emitted        += emitter->getStats().emitted.load();
+                        callback_nanos += emitter->getStats().callbackNanos.load();
+                    }
+                }
+            }
+
+            return std::tuple(received, dropped, emitted, callback_nanos);
+        };
+
+        const auto delivered = [&]
+        {
+            std::vector<std::pair<uint64_t, uint64_t>> counts;
+
+            for (const auto& s : subscriptions)
+                counts.emplace_back(s->getDeliveredCount(), s->getDroppedCount());
+
+            return counts;
+        };
+
+        sleepFor(options.warmup);
+
+        for (auto& sink : sinks)
+            sink->startRecording();
+
+        const auto [received_before, dropped_before, emitted_before, callback_before] = totals();
+        const auto delivered_before                                                 = delivered();
+        const auto allocations_before                                               = AllocationCounter::count.load();
+        const auto start                                                            = Ingest::hostNanos();
+
+        sleepFor(options.seconds);
+
+        const auto elapsed                                                        = static_cast<double>(Ingest::hostNanos() - start) * 1.0e-9;
+        const auto allocations                                                    = AllocationCounter::count.load() - allocations_before;
+        const auto [received_after, dropped_after, emitted_after, callback_after] = totals();
+        const auto delivered_after                                                = delivered();
+
+        for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+        {
+            registry.midiSources[h].reset();
+            registry.bleSources[h].reset();
+        }
+
+        consumer.stop();
+
+        const auto events  = received_after - received_before;
+        const auto emitted = emitted_after - emitted_before;
+
+        result.events      += events;
+        result.seconds     += elapsed;
+        result.allocations += allocations;
+
+        var taps = Array<var>();
+
+        for (size_t i = 0; i < subscriptions.size(); ++i)
+        {
+            const auto count  = delivered_after[i].first - delivered_before[i].first;
+            const auto missed = delivered_after[i].second - delivered_before[i].second;
+
+            auto* t = new DynamicObject();
+            t->setProperty("delivery", i < sinks.size() ? "lossless" : "lossy");
+            t->setProperty("delivered_fraction", events == 0 ? 0.0 : static_cast<double>(count) / static_cast<double>(events));
+            t->setProperty("missed", static_cast<int64>(missed));
+
+            if (i < sinks.size())
+                t->setProperty("completion", sinks[i]->getCompletionSummary());
+
+            taps.append(var(t));
+        }
+
+        auto* r = new DynamicObject();
+        r->setProperty("lossless_subscriptions", tap.lossless);
+        r->setProperty("lossy_subscriptions", tap.lossy);
+        r->setProperty("events_per_sec", static_cast<double>(events) / elapsed);
+        r->setProperty("channel_dropped", static_cast<int64>(dropped_after - dropped_before));
+        r->setProperty("callback_ns_per_event", emitted == 0 ? 0.0 : static_cast<double>(callback_after - callback_before) / static_cast<double>(emitted));
+        r->setProperty("subscriptions", taps);
+        runs.append(var(r));
+    }
+
+    auto* details = new DynamicObject();
+    details->setProperty("runs", runs);
+    result.details = var(details);
+
+    return result;
+}
+} // namespace Bench
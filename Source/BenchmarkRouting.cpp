@@ -0,0 +1,253 @@
+#include "Benchmark.h"
+
+#include "IngestConsumer.h"
+#include "MidiRouter.h"
+
+#include <thread>
+
+//======================================================================================================================
+namespace Bench {
+
+/** Counts what's routed to it; the cheapest destination there is. */
+class CountingSink : public Ingest::EventSink
+{
+public:
+    void midiEvent(Ingest::DeviceHandle, const Ingest::MidiEvent&) override { ++count; }
+    void blePacket(Ingest::DeviceHandle, const Ingest::PacketView&) override {}
+
+    uint64_t count = 0;
+};
+
+/**
+    MidiRouter against the obvious alternative, a chain of std::function predicates evaluated per message, at 1, 16,
+    256 and 4096 random rules over --devices ports and eight destinations.
+
+    Both have to come to the same destinations for every message of a random stream, and a keyboard split has to
+    let pitch bend and clock through to both halves. Then each routes the stream over and over for an eighth of
+    --seconds per rule set size, and the router once more while another thread swaps rule sets in as fast as it can
+    compile them, which shouldn't slow the routing down or make it allocate.
+*/
+Result runRouting(const Options& options)
+{
+    constexpr int numDestinations = 8;
+
+    const auto num_ports = static_cast<size_t>(jmax(1, options.devices));
+
+    std::minstd_rand random(19);
+
+    // 0 to n - 1
+    const auto next = [&random](int n) { return std::uniform_int_distribution<>(0, n - 1)(random); };
+
+    const auto random_rule = [&]
+    {
+        Ingest::RouteRule r;
+        r.port         = next(4) == 0 ? Ingest::RouteRule::anyPort : next(static_cast<int>(num_ports));
+        r.channels     = static_cast<uint16_t>(next(4) == 0 ? 0xffff : next(0x10000));
+        r.types        = static_cast<uint8_t>(next(3) == 0 ? 0xff : next(0x100));
+        r.lowest       = static_cast<uint8_t>(next(128));
+        r.highest      = static_cast<uint8_t>(jmin(127, r.lowest + next(64)));
+        r.destinations = 1u << next(numDestinations);
+        r.block        = next(8) == 0;
+        return r;
+    };
+
+    std::vector<std::pair<Ingest::DeviceHandle, Ingest::MidiEvent>> stream(65536);
+
+    for (auto& [port, e] : stream)
+    {
+        static constexpr uint8_t statuses[] = {0x80, 0x90, 0x90, 0xa0, 0xb0, 0xb0, 0xc0, 0xd0, 0xe0, 0xf8};
+
+        const auto status = statuses[next(static_cast<int>(std::size(statuses)))];
+
+        port     = static_cast<Ingest::DeviceHandle>(next(static_cast<int>(num_ports)));
+        e.size   = status >= 0xf0 ? 1 : (status & 0xe0) == 0xc0 ? 2 : 3;
+        e.bytes[0] = static_cast<uint8_t>(status < 0xf0 ? status | next(16) : status);
+        e.bytes[1] = static_cast<uint8_t>(next(128));
+        e.bytes[2] = static_cast<uint8_t>(next(128));
+    }
+
+    // What the router replaces: every rule as a predicate, every one asked about every message
+    using Predicate = std::function<bool(Ingest::DeviceHandle, const Ingest::MidiEvent&)>;
+
+    const auto to_predicate = [](const Ingest::RouteRule& r) -> Predicate
+    {
+        return [r](Ingest::DeviceHandle port, const Ingest::MidiEvent& e)
+        {
+            const auto status = e.bytes[0];
+            const auto data1  = e.size > 1 ? e.bytes[1] : uint8_t{0};
+
+            return (r.port == Ingest::RouteRule::anyPort || r.port == port)
+                   && (r.types & (1 << ((status >> 4) - 8))) != 0
+                   && (status >= 0xf0 || (r.channels & (1 << (status & 0x0f))) != 0)
+                   && (status >= 0xc0 || (data1 >= r.lowest && data1 <= r.highest));
+        };
+    };
+
+    // A keyboard split, with every message type: pitch bend and clock go to both halves whatever their data1 reads as
+    const auto split_passes_everything_else = [&]
+    {
+        std::array<CountingSink, 2> halves;
+        Ingest::MidiRouter          split(1);
+
+        Ingest::RouteRule lower, upper;
+        lower.highest      = 59;
+        lower.destinations = 1u << split.addDestination(halves[0]);
+        upper.lowest       = 60;
+        upper.destinations = 1u << split.addDestination(halves[1]);
+
+        const Ingest::RouteRule split_rules[] = {lower, upper};
+        split.setRules(split_rules);
+
+        const auto reaches = [&](std::initializer_list<uint8_t> bytes)
+        {
+            Ingest::MidiEvent e;
+            e.size = static_cast<uint32_t>(bytes.size());
+            std::copy(bytes.begin(), bytes.end(), e.bytes);
+
+            const auto before = std::pair(halves[0].count, halves[1].count);
+            split.midiEvent(0, e);
+            return std::pair(halves[0].count != before.first, halves[1].count != before.second);
+        };
+
+        return reaches({0x90, 40, 100}) == std::pair(true, false)
+               && reaches({0x90, 80, 100}) == std::pair(false, true)
+               && reaches({0xe0, 0x10, 0x40}) == std::pair(true, true)
+               && reaches({0xe0, 0x70, 0x40}) == std::pair(true, true)
+               && reaches({0xf8}) == std::pair(true, true);
+    }();
+
+    Result result;
+    var    runs = Array<var>();
+
+    const auto slice = options.seconds / 8.0;
+
+    for (const auto num_rules : {1, 16, 256, 4096})
+    {
+        std::vector<Ingest::RouteRule> rules;
+
+        for (int i = 0; i < num_rules; ++i)
+            rules.push_back(random_rule());
+
+        std::vector<std::pair<Predicate, Ingest::RouteRule>> chain;
+
+        for (const auto& r : rules)
+            chain.emplace_back(to_predicate(r), r);
+
+        std::array<CountingSink, numDestinations> sinks;
+        Ingest::MidiRouter                        router(num_ports);
+
+        for (auto& sink : sinks)
+            router.addDestination(sink);
+
+        const auto compile_start = Ingest::hostNanos();
+        router.setRules(rules);
+        const auto compile_nanos = Ingest::hostNanos() - compile_start;
+
+        const auto chain_targets = [&](Ingest::DeviceHandle port, const Ingest::MidiEvent& e)
+        {
+            uint32_t targets = 0;
+
+            for (const auto& [predicate, rule] : chain)
+                if (predicate(port, e))
+                    targets = rule.block ? targets & ~rule.destinations : targets | rule.destinations;
+
+            return targets;
+        };
+
+        // Agreement: route each message on its own and compare the sinks it reached
+        size_t mismatches = 0;
+
+        for (const auto& [port, e] : stream)
+        {
+            std::array<uint64_t, numDestinations> before{};
+            std::transform(sinks.begin(), sinks.end(), before.begin(), [](const auto& x) { return x.count; });
+
+            router.midiEvent(port, e);
+
+            uint32_t reached = 0;
+
+            for (size_t i = 0; i < sinks.size(); ++i)
+                reached |= sinks[i].count != before[i] ? 1u << i : 0u;
+
+            mismatches += reached != chain_targets(port, e) ? 1 : 0;
+        }
+
+        // Both routing the stream over and over, to the same sinks
+        const auto time = [&](auto&& route)
+        {
+            uint64_t messages = 0;
+            const auto start  = Ingest::hostNanos();
+            const auto until  = start + static_cast<int64_t>(slice * 1.0e9);
+
+            while (Ingest::hostNanos() < until)
+            {
+                for (const auto& [port, e] : stream)
+                    route(port, e);
+
+                messages += stream.size();
+            }
+
+            return std::pair(messages, Ingest::hostNanos() - start);
+        };
+
+        const auto allocations_before         = AllocationCounter::count.load();
+        const auto [table_messages, table_ns] = time([&](auto port, const auto& e) { router.midiEvent(port, e); });
+        const auto allocations                = AllocationCounter::count.load() - allocations_before;
+
+        const auto [chain_messages, chain_ns] = time([&](auto port, const auto& e)
+        {
+            for (auto bits = chain_targets(port, e); bits != 0; bits &= bits - 1)
+                sinks[static_cast<size_t>(std::countr_zero(bits))].midiEvent(port, e);
+        });
+
+        // And the router again, with the rules being replaced underneath it all the while
+        std::atomic<bool>     swapping{true};
+        std::atomic<uint64_t> swaps{0};
+
+        std::thread writer([&]
+        {
+            auto alternate = rules;
+            std::reverse(alternate.begin(), alternate.end());
+
+            for (bool flip = false; swapping.load(); flip = !flip)
+            {
+                router.setRules(flip ? rules : alternate);
+                swaps.fetch_add(1);
+            }
+        });
+
+        const auto [swapped_messages, swapped_ns] = time([&](auto port, const auto& e) { router.midiEvent(port, e); });
+
+        swapping = false;
+        writer.join();
+
+        const auto per_message = [](uint64_t messages, int64_t nanos)
+        {
+            return messages == 0 ? 0.0 : static_cast<double>(nanos) / static_cast<double>(messages);
+        };
+
+        result.events      += table_messages;
+        result.seconds     += static_cast<double>(table_ns) * 1.0e-9;
+        result.allocations += allocations;
+
+        auto* r = new DynamicObject();
+        r->setProperty("rules", num_rules);
+        r->setProperty("tables", static_cast<int64>(router.getNumTables()));
+        r->setProperty("compile_ms", static_cast<double>(compile_nanos) * 1.0e-6);
+        r->setProperty("matches_chain", mismatches == 0);
+        r->setProperty("table_ns_per_message", per_message(table_messages, table_ns));
+        r->setProperty("chain_ns_per_message", per_message(chain_messages, chain_ns));
+        r->setProperty("speedup", per_message(chain_messages, chain_ns) / jmax(1.0e-9, per_message(table_messages, table_ns)));
+        r->setProperty("table_ns_per_message_while_swapping", per_message(swapped_messages, swapped_ns));
+        r->setProperty("swaps", static_cast<int64>(swaps.load()));
+        runs.append(var(r));
+    }
+
+    auto* details = new DynamicObject();
+    details->setProperty("split_passes_other_types", split_passes_everything_else);
+    details->setProperty("runs", runs);
+    result.details = var(details);
+
+    return result;
+}
+} // namespace Bench
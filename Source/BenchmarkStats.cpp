@@ -0,0 +1,199 @@
+#include "Benchmark.h"
+
+#include "ConnectionManager.h"
+#include "FairnessAnalyzer.h"
+#include "IngestConsumer.h"
+#include "StatsPublisher.h"
+
+#include <iostream>
+#include <thread>
+
+//======================================================================================================================
+namespace Bench {
+
+/**
+    The app's pipeline with a StatsPublisher publishing every device into a stats segment --stats-rate times a
+    second, while --readers threads each map the segment read-only and copy every slot out as fast as they can, the
+    way a monitor in another process would.
+
+    Every copy is checked: it has to carry the device's own name, and none of its counts may go backwards, which a
+    torn copy would sooner or later show. Once the sources are gone, a last publish has to match the channels' own
+    counts. Reports what a publish takes, how many slots it stored, how many copies the readers got and how often
+    they found a slot mid-store, and any inconsistent copies, of which there should be none.
+*/
+Result runStats(const Options& options)
+{
+    std::vector<Simulation::DeviceSettings> settings;
+
+    for (int i = 0; i < options.devices; ++i)
+        settings.push_back(options.getDeviceSettings(i));
+
+    Simulation::SimulatedBackend backend(settings, {options.olderLinkShare});
+
+    Ingest::DeviceRegistry    registry(static_cast<size_t>(options.devices));
+    Ingest::IngestConsumer    consumer(registry);
+    Ingest::FairnessAnalyzer  analyzer(registry);
+    Ingest::ConnectionManager connections(registry, analyzer);
+    Ingest::StatsPublisher    publisher(registry, analyzer, connections, roundToInt(options.statsRate));
+
+    const auto file = File::getSpecialLocation(File::tempDirectory).getChildFile("WinRTMidiBench.stats");
+
+    if (const auto r = publisher.open(file); r.failed())
+    {
+        std::cerr << r.getErrorMessage() << std::endl;
+        return {};
+    }
+
+    for (int i = 0; i < options.devices; ++i)
+    {
+        const auto h = registry.intern(Simulation::SimulatedBackend::getContainerId(i));
+        registry.names[h] = options.getDeviceSettings(i).name;
+
+        registry.midiChannels[h]->setListener(&consumer);
+        registry.bleChannels[h]->setListener(&consumer);
+    }
+
+    consumer.start();
+    analyzer.start();
+
+    for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+    {
+        const auto i = static_cast<int>(h);
+
+        registry.midiSources[h] = backend.openMidiInput(registry.containerIds[h], Simulation::SimulatedBackend::getMidiPortId(i),
+                                                        registry.midiChannels[h], nullptr);
+        registry.bleSources[h]  = backend.connectBleDevice(Simulation::SimulatedBackend::getBleDeviceId(i), registry.bleChannels[h]);
+    }
+
+    sleepFor(options.warmup);
+
+    //==================================================================================================================
+    struct ReaderCounts
+    {
+        uint64_t copies = 0, busy = 0, inconsistent = 0;
+    };
+
+    std::atomic<bool>         stop{false};
+    std::vector<ReaderCounts> counts(static_cast<size_t>(jmax(1, options.readers)));
+    std::vector<std::thread>  readers;
+
+    for (auto& c : counts)
+    {
+        readers.emplace_back([&, &c = c]
+        {
+            const Ingest::Stats::Reader reader(file);
+
+            std::vector<Ingest::Stats::DeviceSnapshot> last(registry.size());
+
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                for (size_t i = 0; i < reader.getNumDevices(); ++i)
+                {
+                    const auto s = reader.read(i, 1);
+
+                    if (!s.has_value())
+                    {
+                        ++c.busy;
+                        continue;
+                    }
+
+                    const auto& l = last[i];
+
+                    if (std::strcmp(s->name, registry.names[i].toRawUTF8()) != 0
+                        || s->midiReceived < l.midiReceived || s->bleReceived < l.bleReceived
+                        || s->midiDropped < l.midiDropped || s->bleDropped < l.bleDropped || s->updatedAt < l.updatedAt)
+                        ++c.inconsistent;
+
+                    last[i] = *s;
+                    ++c.copies;
+                }
+            }
+        });
+    }
+
+    Ingest::LatencyHistogram publishes;
+
+    const auto interval           = 1.0 / jmax(1.0, options.statsRate);
+    const auto allocations_before = AllocationCounter::count.load();
+    const auto start              = Ingest::hostNanos();
+
+    while (Ingest::hostNanos() - start < static_cast<int64_t>(options.seconds * 1.0e9))
+    {
+        const auto t = Ingest::hostNanos();
+        publisher.update(t);
+        publishes.record(Ingest::hostNanos() - t);
+
+        sleepFor(interval);
+    }
+
+    const auto elapsed     = static_cast<double>(Ingest::hostNanos() - start) * 1.0e-9;
+    const auto allocations = AllocationCounter::count.load() - allocations_before;
+
+    stop = true;
+
+    for (auto& t : readers)
+        t.join();
+
+    //==================================================================================================================
+    for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+    {
+        registry.midiSources[h].reset();
+        registry.bleSources[h].reset();
+    }
+
+    sleepFor(interval);
+    publisher.update();
+
+    const Ingest::Stats::Reader reader(file);
+    bool                        final_matches = reader.isValid() && reader.getNumDevices() == registry.size();
+    uint64_t                    received      = 0;
+
+    for (Ingest::DeviceHandle h = 0; h < registry.size() && final_matches; ++h)
+    {
+        const auto& midi = *registry.midiChannels[h];
+        const auto& ble  = *registry.bleChannels[h];
+        const auto  s    = reader.read(h);
+
+        final_matches = s.has_value() && s->midiReceived == midi.getReceivedCount()
+                        && s->bleReceived == ble.getReceivedCount() && s->midiDropped == midi.getDroppedCount()
+                        && s->bleDropped == ble.getDroppedCount();
+
+        received += midi.getReceivedCount() + ble.getReceivedCount();
+    }
+
+    analyzer.stop();
+    consumer.stop();
+    publisher.close();
+
+    const auto stopped = reader.isValid() && !reader.isWriterRunning();
+    file.deleteFile();
+
+    ReaderCounts total;
+
+    for (const auto& c : counts)
+    {
+        total.copies       += c.copies;
+        total.busy         += c.busy;
+        total.inconsistent += c.inconsistent;
+    }
+
+    auto* details = new DynamicObject();
+    details->setProperty("segment_bytes", static_cast<int64>(Ingest::Stats::getSegmentSize(registry.getCapacity())));
+    details->setProperty("publishes", static_cast<int64>(publishes.getSummary().count));
+    details->setProperty("publish", publishes.getSummary().toVar());
+    details->setProperty("slots_stored", static_cast<int64>(publisher.getStoreCount()));
+    details->setProperty("reader_copies", static_cast<int64>(total.copies));
+    details->setProperty("reader_copies_per_sec", static_cast<double>(total.copies) / elapsed);
+    details->setProperty("reader_busy", static_cast<int64>(total.busy));
+    details->setProperty("inconsistent_copies", static_cast<int64>(total.inconsistent));
+    details->setProperty("final_matches", final_matches);
+    details->setProperty("stopped_on_close", stopped);
+
+    Result result;
+    result.details     = var(details);
+    result.events      = received;
+    result.seconds     = elapsed;
+    result.allocations = allocations;
+    return result;
+}
+} // namespace Bench
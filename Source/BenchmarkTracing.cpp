@@ -0,0 +1,189 @@
+#include "Benchmark.h"
+
+#include "DeviceRegistry.h"
+#include "Tracer.h"
+
+//======================================================================================================================
+namespace Bench {
+
+/**
+    What tracing costs a callback, and what it captures.
+
+    First one thread pushes MIDI messages into a channel as fast as it can, as a callback would, four ways: with no
+    trace point, with a TraceScope while tracing is off, with it on, and formatting a String per message the way the
+    DBG logging did. Reports nanoseconds per callback for each.
+
+    Then the simulated devices run for --seconds with tracing on, and the trace is dumped: records and threads, what
+    the buffers lost, how long the dump and the Chrome export took, and each device's callback durations as the
+    trace saw them. With --trace=FILE the Chrome trace is kept there.
+
+    Last, 64 threads trace a record each, one after another, to check that each takes over the buffer the last one
+    left behind rather than adding one of its own: reports how many buffers they added, which should be at most 1.
+*/
+Result runTracing(const Options& options)
+{
+    constexpr int iterations = 2'000'000;
+
+    Ingest::MidiChannel channel(0, 4096);
+    const uint8_t       note[] = {0x90, 60, 100};
+    const String        name   = "Device 0";
+
+    const auto measure = [&](auto&& callback)
+    {
+        const auto start = Ingest::hostNanos();
+
+        for (int i = 0; i < iterations; ++i)
+        {
+            callback(Ingest::hostNanos());
+
+            if ((i & 1023) == 1023)
+                channel.drain([](const Ingest::MidiEvent&) {});
+        }
+
+        return static_cast<double>(Ingest::hostNanos() - start) / iterations;
+    };
+
+    const auto traced = [&](int64_t host_time)
+    {
+        Ingest::TraceScope trace(Ingest::TracePoint::midiCallback, 0, host_time);
+        trace.setArgs(3);
+        channel.push(note, 3, host_time);
+    };
+
+    Ingest::Tracer::setEnabled(false);
+
+    const auto untraced_ns = measure([&](int64_t host_time) { channel.push(note, 3, host_time); });
+    const auto off_ns      = measure(traced);
+
+    Ingest::Tracer::setEnabled(true);
+    const auto on_ns = measure(traced);
+    Ingest::Tracer::setEnabled(false);
+
+    const auto logged_ns = measure([&](int64_t host_time)
+    {
+        String line;
+        line << "Midi from " << name << ": " << String(static_cast<int>(note[0])) << " at "
+             << String(static_cast<int64>(host_time));
+        channel.push(note, 3, host_time);
+    });
+
+    auto* cost = new DynamicObject();
+    cost->setProperty("untraced_ns", untraced_ns);
+    cost->setProperty("tracing_off_ns", off_ns);
+    cost->setProperty("tracing_on_ns", on_ns);
+    cost->setProperty("string_log_ns", logged_ns);
+
+    //==================================================================================================================
+    std::vector<Simulation::DeviceSettings> settings;
+
+    for (int i = 0; i < options.devices; ++i)
+        settings.push_back(options.getDeviceSettings(i));
+
+    Simulation::SimulatedBackend backend(settings, {options.olderLinkShare});
+    Ingest::DeviceRegistry       registry(static_cast<size_t>(options.devices));
+
+    std::vector<Ingest::MidiChannel*>                     midi;
+    std::vector<Ingest::BleChannel*>                      ble;
+    std::vector<std::unique_ptr<Ingest::MidiSource>>      midiSources;
+    std::vector<std::unique_ptr<Ingest::BlePacketSource>> bleSources;
+
+    for (int i = 0; i < options.devices; ++i)
+    {
+        const auto h = registry.intern(Simulation::SimulatedBackend::getContainerId(i));
+        registry.names[h] = options.getDeviceSettings(i).name;
+
+        midi.push_back(registry.midiChannels[h].get());
+        ble.push_back(registry.bleChannels[h].get());
+    }
+
+    Drainer drainer(midi, ble, options.drainInterval);
+
+    for (int i = 0; i < options.devices; ++i)
+    {
+        const auto h = static_cast<size_t>(i);
+
+        midiSources.push_back(backend.openMidiInput(Simulation::SimulatedBackend::getContainerId(i),
+                                                    Simulation::SimulatedBackend::getMidiPortId(i),
+                                                    registry.midiChannels[h], nullptr));
+        bleSources.push_back(backend.connectBleDevice(Simulation::SimulatedBackend::getBleDeviceId(i),
+                                                      registry.bleChannels[h]));
+    }
+
+    sleepFor(options.warmup);
+
+    const auto allocations_before = AllocationCounter::count.load();
+    const auto start              = Ingest::hostNanos();
+
+    Ingest::Tracer::setEnabled(true);
+    sleepFor(options.seconds);
+    Ingest::Tracer::setEnabled(false);
+
+    const auto elapsed     = static_cast<double>(Ingest::hostNanos() - start) * 1.0e-9;
+    const auto allocations = AllocationCounter::count.load() - allocations_before;
+
+    midiSources.clear();
+    bleSources.clear();
+
+    const auto dump_start = Ingest::hostNanos();
+    const auto dump       = Ingest::Tracer::dump(start);
+    const auto dump_end   = Ingest::hostNanos();
+
+    std::vector<Ingest::LatencyHistogram> callbacks(static_cast<size_t>(options.devices));
+    uint64_t                              lost = 0;
+
+    for (const auto& t : dump.threads)
+    {
+        lost += t.lost;
+
+        for (const auto& r : t.records)
+            if (r.point == Ingest::TracePoint::midiCallback || r.point == Ingest::TracePoint::bleCallback)
+                if (r.device < callbacks.size())
+                    callbacks[r.device].record(r.duration);
+    }
+
+    auto* details = new DynamicObject();
+    details->setProperty("cost", var(cost));
+    details->setProperty("threads", static_cast<int>(dump.threads.size()));
+    details->setProperty("records", static_cast<int64>(dump.getNumRecords()));
+    details->setProperty("records_per_sec", static_cast<double>(dump.getNumRecords()) / elapsed);
+    details->setProperty("lost", static_cast<int64>(lost));
+    details->setProperty("dump_ms", static_cast<double>(dump_end - dump_start) * 1.0e-6);
+
+    if (options.traceFile.isNotEmpty())
+    {
+        const auto file         = File::getCurrentWorkingDirectory().getChildFile(options.traceFile);
+        const auto export_start = Ingest::hostNanos();
+        const auto written      = Ingest::Tracer::writeChromeTrace(dump, file, registry.names);
+
+        details->setProperty("export_ms", static_cast<double>(Ingest::hostNanos() - export_start) * 1.0e-6);
+        details->setProperty("trace_file", written.wasOk() ? file.getFullPathName() : written.getErrorMessage());
+    }
+
+    var devices = Array<var>();
+
+    for (size_t i = 0; i < callbacks.size(); ++i)
+        devices.append(callbacks[i].getSummary().toVar());
+
+    details->setProperty("callback_durations", devices);
+
+    //==================================================================================================================
+    const auto buffers_before = Ingest::Tracer::dump().threads.size();
+
+    Ingest::Tracer::setEnabled(true);
+
+    for (int i = 0; i < 64; ++i)
+        std::thread([] { Ingest::Tracer::instant(Ingest::TracePoint::repaintRequested); }).join();
+
+    Ingest::Tracer::setEnabled(false);
+
+    details->setProperty("short_lived_thread_buffers",
+                         static_cast<int>(Ingest::Tracer::dump().threads.size() - buffers_before));
+
+    Result result;
+    result.details     = var(details);
+    result.events      = dump.getNumRecords();
+    result.seconds     = elapsed;
+    result.allocations = allocations;
+    return result;
+}
+} // namespace Bench
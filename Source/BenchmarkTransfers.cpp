@@ -0,0 +1,465 @@
+#include "Benchmark.h"
+
+#include "IngestConsumer.h"
+#include "Subscription.h"
+#include "TransferAssembler.h"
+
+#include <thread>
+#include <utility>
+
+//======================================================================================================================
+namespace Bench {
+
+/**
+    What the transfers scenario's devices send: every byte follows from the transfer's sequence number and its
+    offset, so the receiving end can check each one wherever it lands.
+*/
+namespace TransferPattern {
+
+/** F0, the sequence number in two data bytes, data, F7. */
+static uint8_t sysExByte(uint32_t sequence, size_t i, size_t size)
+{
+    if (i == 0)
+        return 0xf0;
+
+    if (i + 1 == size)
+        return 0xf7;
+
+    if (i <= 2)
+        return static_cast<uint8_t>((sequence >> (7 * (i - 1))) & 0x7f);
+
+    return static_cast<uint8_t>((i + sequence) & 0x7f);
+}
+
+/** The sequence number in four bytes, then data. */
+static uint8_t bulkByte(uint32_t sequence, size_t i)
+{
+    if (i < 4)
+        return static_cast<uint8_t>(sequence >> (8 * i));
+
+    return static_cast<uint8_t>((i + sequence) & 0xff);
+}
+
+/** Checks a transfer as it comes in, piece by piece. */
+struct Check
+{
+    void feed(Ingest::TransferKind kind, std::span<const uint8_t> bytes, size_t size)
+    {
+        for (const auto b : bytes)
+        {
+            // The sequence number comes first, so it's known by the time it's needed
+            if (kind == Ingest::TransferKind::sysEx && (offset == 1 || offset == 2))
+                sequence |= static_cast<uint32_t>(b) << (7 * (offset - 1));
+            else if (kind == Ingest::TransferKind::bulk && offset < 4)
+                sequence |= static_cast<uint32_t>(b) << (8 * offset);
+
+            const auto expected = kind == Ingest::TransferKind::sysEx ? sysExByte(sequence, offset, size)
+                                                                      : bulkByte(sequence, offset);
+
+            if (b != expected)
+                ++wrong;
+
+            ++offset;
+        }
+    }
+
+    /** True if it was whole and right. */
+    bool finish(size_t size)
+    {
+        const auto ok = offset == size && wrong == 0;
+        *this         = {};
+        return ok;
+    }
+
+    size_t   offset   = 0;
+    uint32_t sequence = 0;
+    uint64_t wrong    = 0;
+};
+} // namespace TransferPattern
+
+/** Forwards to another sink and times it: BLE packets and SysEx fragments as transfer work, the rest as events. */
+class TimingSink : public Ingest::EventSink
+{
+public:
+    explicit TimingSink(Ingest::EventSink& sink) : inner(sink) {}
+
+    void midiEvent(Ingest::DeviceHandle device, const Ingest::MidiEvent& e) override
+    {
+        const auto start = Ingest::hostNanos();
+        inner.midiEvent(device, e);
+        (e.isSysExFragment() ? transferNanos : eventNanos) += Ingest::hostNanos() - start;
+    }
+
+    void blePacket(Ingest::DeviceHandle device, const Ingest::PacketView& p) override
+    {
+        const auto start = Ingest::hostNanos();
+        inner.blePacket(device, p);
+        transferNanos += Ingest::hostNanos() - start;
+    }
+
+    void drained() override { inner.drained(); }
+
+    Ingest::EventSink& inner;
+    int64_t            transferNanos = 0, eventNanos = 0;
+};
+
+/**
+    The transfers scenario's receiving end, both for the TransferAssembler and for its stand-in for how transfers
+    were taken in before: every fragment or packet copied into a std::vector of its own and appended to a growing
+    one, which is handed over once complete. Checks every transfer, and times the regular messages from callback to
+    here.
+*/
+class TransferCheckSink : public Ingest::EventSink,
+                          public Ingest::TransferSink
+{
+public:
+    TransferCheckSink(size_t numDevices, size_t sysExSize, size_t bulkSize, bool concatenate)
+            : checks(numDevices * 2),
+              buffers(numDevices * 2),
+              expectedBulk(numDevices),
+              bulkLeft(numDevices),
+              sizes{sysExSize, bulkSize},
+              concatenating(concatenate)
+    {
+    }
+
+    /** The stand-in's side of TransferAssembler::expectBulkTransfer(). */
+    void expectBulkTransfer(Ingest::DeviceHandle device, uint64_t size)
+    {
+        expectedBulk[device].store(size, std::memory_order_release);
+    }
+
+    //==================================================================================================================
+    void midiEvent(Ingest::DeviceHandle device, const Ingest::MidiEvent& e) override
+    {
+        if (!concatenating || !e.isSysExFragment())
+        {
+            latency.record(Ingest::hostNanos() - e.hostTime);
+            ++events;
+            return;
+        }
+
+        const auto bytes = e.getBytes();
+        std::vector<uint8_t> fragment(bytes.begin(), bytes.end());
+
+        auto& buffer = buffers[device * 2];
+
+        if (fragment.front() == 0xf0)
+            buffer.clear();
+
+        buffer.insert(buffer.end(), fragment.begin(), fragment.end());
+
+        if (fragment.back() == 0xf7)
+            concatenated(device, Ingest::TransferKind::sysEx, std::exchange(buffer, {}));
+    }
+
+    void blePacket(Ingest::DeviceHandle device, const Ingest::PacketView& p) override
+    {
+        if (!concatenating)
+            return;
+
+        if (const auto size = expectedBulk[device].exchange(0, std::memory_order_acquire); size != 0)
+            bulkLeft[device] = size;
+
+        std::vector<uint8_t> packet(p.data, p.data + p.size);
+
+        auto& buffer = buffers[device * 2 + 1];
+        buffer.insert(buffer.end(), packet.begin(), packet.end());
+
+        if (buffer.size() >= bulkLeft[device])
+            concatenated(device, Ingest::TransferKind::bulk, std::exchange(buffer, {}));
+    }
+
+    //==================================================================================================================
+    void transferCompleted(const Ingest::Transfer& t) override
+    {
+        const auto start = Ingest::hostNanos();
+        auto&      check = checks[index(t)];
+
+        t.data.forEachSegment([&](std::span<const uint8_t> s) { check.feed(t.kind, s, sizes[kind(t)]); });
+        finished(t.device, t.kind, check.finish(sizes[kind(t)]));
+        segments   += t.data.getNumSegments();
+        checkNanos += Ingest::hostNanos() - start;
+    }
+
+    void transferProgressed(const Ingest::Transfer& t, const Ingest::ScatterView& piece) override
+    {
+        const auto start = Ingest::hostNanos();
+
+        piece.forEachSegment([&](std::span<const uint8_t> s) { checks[index(t)].feed(t.kind, s, sizes[kind(t)]); });
+        segments   += piece.getNumSegments();
+        checkNanos += Ingest::hostNanos() - start;
+    }
+
+    void transferAborted(const Ingest::Transfer& t) override
+    {
+        checks[index(t)] = {};
+        ++aborted;
+        done(t.device, t.kind);
+    }
+
+    //==================================================================================================================
+    /** What the producers wait for before announcing the next bulk transfer. */
+    [[nodiscard]] uint64_t getFinishedBulk(Ingest::DeviceHandle device) const
+    {
+        return finishedBulk[device].load(std::memory_order_acquire);
+    }
+
+    std::array<std::atomic<uint64_t>, 64> finishedBulk{};
+    Ingest::LatencyHistogram              latency;
+    uint64_t events = 0, completed = 0, broken = 0, aborted = 0, segments = 0;
+    uint64_t transferBytes = 0;
+    int64_t  checkNanos    = 0; // spent checking, which isn't part of taking the transfers in
+
+private:
+    static size_t index(const Ingest::Transfer& t) { return size_t{t.device} * 2 + kind(t); }
+    static size_t kind(const Ingest::Transfer& t) { return static_cast<size_t>(t.kind); }
+
+    void concatenated(Ingest::DeviceHandle device, Ingest::TransferKind k, std::vector<uint8_t> transfer)
+    {
+        const auto start = Ingest::hostNanos();
+        const auto size  = sizes[static_cast<size_t>(k)];
+
+        TransferPattern::Check check;
+        check.feed(k, transfer, size);
+        finished(device, k, check.finish(size));
+        ++segments;
+        checkNanos += Ingest::hostNanos() - start;
+    }
+
+    void finished(Ingest::DeviceHandle device, Ingest::TransferKind k, bool ok)
+    {
+        ++(ok ? completed : broken);
+        transferBytes += sizes[static_cast<size_t>(k)];
+        done(device, k);
+    }
+
+    void done(Ingest::DeviceHandle device, Ingest::TransferKind k)
+    {
+        if (k == Ingest::TransferKind::bulk)
+            finishedBulk[device].fetch_add(1, std::memory_order_release);
+    }
+
+    std::vector<TransferPattern::Check> checks;
+    std::vector<std::vector<uint8_t>>   buffers;
+    std::vector<std::atomic<uint64_t>>  expectedBulk;
+    std::vector<uint64_t>               bulkLeft;
+    const std::array<size_t, 2>         sizes;
+    const bool                          concatenating;
+};
+
+/**
+    Large transfers next to regular traffic. Every device sends notes at --midi-rate; a --transfer-size SysEx dump
+    four times a second, which its MidiChannel splits into slot-sized fragments and which has a clock message halfway
+    through, as MIDI allows; and, back to back, --transfer-size bulk transfers over BLE, --packets-per-event packets
+    of --att-mtu less 3 bytes per --connection-interval-ms. A lossless subscription takes it all in, for --seconds per
+    way of doing so:
+
+    - no transfers at all, for the notes' baseline latency
+    - the stand-in for how it was done before: every fragment or packet into a vector of its own, appended to a
+      growing one
+    - the TransferAssembler, handing over whole transfers as views over its chunks
+    - the TransferAssembler in streaming mode, a chunk at a time
+
+    Every transfer is checked byte for byte. Reports the transfers completed, broken and aborted, the time the
+    subscription spent per transfer byte and per note, the notes' latency, heap allocations, and the bulk throughput
+    the assembler measured against what the link model allows.
+*/
+Result runTransfers(const Options& options)
+{
+    constexpr int64_t sysExInterval = 250000000;
+
+    const auto n           = static_cast<size_t>(jmin(64, options.devices));
+    const auto size        = static_cast<size_t>(jmax(16, options.transferSize));
+    const auto packet_size = static_cast<size_t>(jlimit(4, static_cast<int>(Ingest::maxBlePayloadSize), options.attMtu - 3));
+    const auto interval    = static_cast<int64_t>(options.connectionMs * 1.0e6);
+    const auto note_gap    = static_cast<int64_t>(1.0e9 / jmax(1.0, options.midiRate));
+
+    enum class Mode
+    {
+        none,
+        concatenate,
+        assemble,
+        stream
+    };
+
+    Result result;
+    var    runs = Array<var>();
+
+    for (const auto mode : {Mode::none, Mode::concatenate, Mode::assemble, Mode::stream})
+    {
+        const auto transfers = mode != Mode::none;
+
+        Ingest::DeviceRegistry registry(n);
+        Ingest::IngestConsumer consumer(registry);
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            const auto h = registry.intern(Simulation::SimulatedBackend::getContainerId(static_cast<int>(i)));
+
+            registry.midiChannels[h]->setListener(&consumer);
+            registry.bleChannels[h]->setListener(&consumer);
+        }
+
+        Ingest::TransferSettings settings;
+        settings.streaming = mode == Mode::stream;
+
+        TransferCheckSink         check(n, size, size, mode == Mode::concatenate);
+        Ingest::TransferAssembler assembler(check, check, n, settings);
+        TimingSink                timing(mode == Mode::concatenate ? static_cast<Ingest::EventSink&>(check)
+                                                                   : static_cast<Ingest::EventSink&>(assembler));
+        Ingest::Subscription      subscription(registry, timing, Ingest::Delivery::lossless, 256, 1);
+
+        consumer.start();
+        subscription.start();
+
+        const auto announce = [&](Ingest::DeviceHandle h, uint64_t bytes)
+        {
+            if (mode == Mode::concatenate)
+                check.expectBulkTransfer(h, bytes);
+            else
+                assembler.expectBulkTransfer(h, bytes);
+        };
+
+        std::atomic<bool>        stop{false};
+        std::vector<std::thread> producers;
+
+        const auto allocations_before = AllocationCounter::count.load();
+        const auto start              = Ingest::hostNanos();
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            producers.emplace_back([&, i]
+            {
+                const auto h     = static_cast<Ingest::DeviceHandle>(i);
+                auto&      midi  = *registry.midiChannels[h];
+                auto&      ble   = *registry.bleChannels[h];
+                const auto phase = static_cast<int64_t>(i) * 1000;
+
+                std::vector<uint8_t> sysex(size), packet(packet_size);
+
+                auto     next_note = start + phase, next_sysex = start + phase, next_event = start + phase;
+                uint32_t sysex_sequence = 0, bulk_sequence = 0;
+                uint64_t announced = 0;
+                size_t   bulk_sent = size;
+
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    const auto now = Ingest::hostNanos();
+
+                    for (; next_note <= now; next_note += note_gap)
+                    {
+                        const uint8_t note[] = {0x90, 60, 100};
+                        midi.push(note, sizeof(note), now);
+                    }
+
+                    for (; transfers && next_sysex <= now; next_sysex += sysExInterval)
+                    {
+                        for (size_t b = 0; b < size; ++b)
+                            sysex[b] = TransferPattern::sysExByte(sysex_sequence, b, size);
+
+                        // With a clock in the middle, as from a device that keeps its clock running while it dumps
+                        const uint8_t clock[] = {0xf8};
+
+                        ++sysex_sequence;
+                        midi.push(sysex.data(), size / 2, now);
+                        midi.push(clock, sizeof(clock), now);
+                        midi.push(sysex.data() + size / 2, size - size / 2, now);
+                    }
+
+                    for (; transfers && next_event <= now; next_event += interval)
+                    {
+                        if (bulk_sent == size && check.getFinishedBulk(h) == announced)
+                        {
+                            announce(h, size);
+                            ++announced;
+                            ++bulk_sequence;
+                            bulk_sent = 0;
+                        }
+
+                        for (int p = 0; p < options.packetsPerEvent && bulk_sent < size; ++p)
+                        {
+                            const auto count = jmin(packet_size, size - bulk_sent);
+
+                            for (size_t b = 0; b < count; ++b)
+                                packet[b] = TransferPattern::bulkByte(bulk_sequence - 1, bulk_sent + b);
+
+                            ble.push(packet.data(), count, now);
+                            bulk_sent += count;
+                        }
+                    }
+
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+            });
+        }
+
+        sleepFor(options.seconds);
+        stop = true;
+
+        for (auto& t : producers)
+            t.join();
+
+        subscription.stop();
+        consumer.stop();
+
+        const auto elapsed     = static_cast<double>(Ingest::hostNanos() - start) * 1.0e-9;
+        const auto allocations = AllocationCounter::count.load() - allocations_before;
+
+        static const char* const names[] = {"none", "concatenate", "assemble", "stream"};
+
+        auto* run = new DynamicObject();
+        run->setProperty("mode", names[static_cast<int>(mode)]);
+        run->setProperty("events", static_cast<int64>(check.events));
+        run->setProperty("transfers", static_cast<int64>(check.completed));
+        run->setProperty("broken", static_cast<int64>(check.broken));
+        run->setProperty("aborted", static_cast<int64>(check.aborted));
+        run->setProperty("segments_per_transfer",
+                         check.completed > 0 ? static_cast<double>(check.segments) / static_cast<double>(check.completed)
+                                             : 0.0);
+        run->setProperty("ns_per_transfer_byte",
+                         check.transferBytes > 0 ? static_cast<double>(timing.transferNanos - check.checkNanos)
+                                                   / static_cast<double>(check.transferBytes)
+                                                 : 0.0);
+        run->setProperty("ns_per_event",
+                         check.events > 0 ? static_cast<double>(timing.eventNanos) / static_cast<double>(check.events)
+                                          : 0.0);
+        run->setProperty("event_latency", check.latency.getSummary().toVar());
+        run->setProperty("allocations", static_cast<int64>(allocations));
+
+        uint64_t midi_dropped = 0, ble_dropped = 0;
+
+        for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+        {
+            midi_dropped += registry.midiChannels[h]->getDroppedCount();
+            ble_dropped  += registry.bleChannels[h]->getDroppedCount();
+        }
+
+        run->setProperty("midi_dropped", static_cast<int64>(midi_dropped));
+        run->setProperty("ble_dropped", static_cast<int64>(ble_dropped));
+
+        if (mode == Mode::assemble || mode == Mode::stream)
+        {
+            const auto nominal = static_cast<double>(options.packetsPerEvent * packet_size) * 1.0e9
+                                 / static_cast<double>(jmax(int64_t{1}, interval));
+            auto       measured = 0.0;
+
+            for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
+                measured += assembler.getStats(h, Ingest::TransferKind::bulk).lastBytesPerSecond;
+
+            run->setProperty("bulk_bytes_per_sec", measured / static_cast<double>(jmax(size_t{1}, registry.size())));
+            run->setProperty("link_bytes_per_sec", nominal);
+        }
+
+        result.events  += check.events + check.completed;
+        result.seconds += elapsed;
+        runs.append(var(run));
+    }
+
+    auto* details = new DynamicObject();
+    details->setProperty("transfer_size", static_cast<int>(size));
+    details->setProperty("runs", runs);
+    result.details = var(details);
+    return result;
+}
+} // namespace Bench
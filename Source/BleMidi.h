@@ -0,0 +1,703 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "Guid128.h"
+#include "HostClock.h"
+#include "PacketPool.h"
+
+#include <bit>
+#include <span>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+ #include <emmintrin.h>
+ #define INGEST_BLE_MIDI_SSE2 1
+#elif defined(__ARM_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+ #include <arm_neon.h>
+ #define INGEST_BLE_MIDI_NEON 1
+#endif
+
+//======================================================================================================================
+namespace Ingest::BleMidi {
+
+/** The MIDI over Bluetooth LE service and its one characteristic. */
+constexpr auto serviceUuid        = Guid128::fromString("03b80e5a-ede8-4b33-a751-6ce34ec4c700");
+constexpr auto characteristicUuid = Guid128::fromString("7772e5db-3868-4112-a1a9-f2669d106bf3");
+
+/** How many bytes the message a status byte starts has, or 0 for SysEx, which runs until its F7. */
+constexpr int getMessageLength(uint8_t status)
+{
+    if (status < 0xf0)
+        return (status & 0xe0) == 0xc0 ? 2 : 3;
+
+    switch (status)
+    {
+        case 0xf0: return 0;
+        case 0xf1:
+        case 0xf3: return 2;
+        case 0xf2: return 3;
+        default:   return 1;
+    }
+}
+
+/** Which bulk scan Decoder::decode() was built with. */
+constexpr const char* getScanImplementation()
+{
+   #if INGEST_BLE_MIDI_SSE2
+    return "sse2";
+   #elif INGEST_BLE_MIDI_NEON
+    return "neon";
+   #else
+    return "scalar";
+   #endif
+}
+
+//======================================================================================================================
+/**
+    Turns BLE-MIDI notifications into complete MIDI messages, each with the time the device stamped it with.
+
+    A packet is a header byte carrying the top six bits of a 13 bit millisecond timestamp, followed by messages that
+    each start with a timestamp byte holding the low seven bits. Running status may drop the status byte, and the
+    timestamp too, for as long as the status stays the same. SysEx can span any number of packets; a continuation
+    packet carries its data straight after the header. Running status is expanded, so every message handed out is
+    complete.
+
+    Timestamps wrap every 8.192 seconds. Each one is unwrapped to whichever wrap lies closest to where the previous
+    one plus the host time elapsed since then says it should be, so idle gaps of any length come out right. The
+    result is in nanoseconds, on the device's own clock and from an arbitrary origin, like any other deviceTime.
+
+    decode() first marks every byte with its top bit set (header, timestamp and status bytes; MIDI data never has it)
+    sixteen at a time with SSE2 or NEON, then hops from mark to mark, taking the data bytes in between as a run. A
+    channel message that's complete in the packet is handed out in place, without being copied.
+    decodeScalar() is the byte at a time reference it has to agree with, malformed input included. Malformed bytes
+    are counted and skipped, and an unfinished message at the end of a packet is dropped.
+
+    One decoder per characteristic, only ever called from its notification callback. Nothing allocates after
+    construction; SysEx longer than maxSysExSize is counted as dropped.
+*/
+class Decoder
+{
+public:
+    explicit Decoder(size_t maxSysExSize = 1024) : sysEx(maxSysExSize) {}
+
+    /** Calls fn(std::span<const uint8_t> message, int64_t deviceTime) for every message the packet completes. */
+    template<typename Fn>
+    void decode(std::span<const uint8_t> packet, int64_t hostTime, Fn&& fn)
+    {
+        if (packet.size() > maxBlePayloadSize)
+        {
+            decodeScalar(packet, hostTime, fn);
+            return;
+        }
+
+        if (!beginPacket(packet, hostTime))
+            return;
+
+        uint64_t marks[maxBlePayloadSize / 64] = {};
+        markStatusBytes(packet, marks);
+
+        const auto* data = packet.data();
+        const auto  size = packet.size();
+        size_t      pos  = 1;
+
+        for (size_t word = 0; word * 64 < size; ++word)
+        {
+            for (auto bits = marks[word]; bits != 0; bits &= bits - 1)
+            {
+                const auto next = word * 64 + static_cast<size_t>(std::countr_zero(bits));
+
+                // The header, or a status byte already taken along with its message
+                if (next < pos)
+                    continue;
+
+                if (next > pos)
+                    dataRun(data + pos, next - pos, fn);
+
+                pos = next + 1;
+
+                // The common case, a whole channel message right there in the packet, is handed out in place
+                if (const auto status = data[next]; state == State::afterTimestamp && status < 0xf0)
+                {
+                    const auto length = static_cast<size_t>(getMessageLength(status));
+
+                    if (next + length <= size && ((data[next + 1] | data[next + length - 1]) & 0x80) == 0)
+                    {
+                        runningStatus = status;
+                        emit(fn, data + next, length);
+                        state = State::afterMessage;
+                        pos   = next + length;
+                        continue;
+                    }
+                }
+
+                step(data[next], fn);
+            }
+        }
+
+        if (pos < size)
+            dataRun(data + pos, size - pos, fn);
+
+        endPacket();
+    }
+
+    /** The reference decode() is checked against. */
+    template<typename Fn>
+    void decodeScalar(std::span<const uint8_t> packet, int64_t hostTime, Fn&& fn)
+    {
+        if (!beginPacket(packet, hostTime))
+            return;
+
+        for (const auto b : packet.subspan(1))
+            step(b, fn);
+
+        endPacket();
+    }
+
+    /** Forgets running status, any SysEx in progress and the timestamp history, e.g. after a reconnect. */
+    void reset()
+    {
+        state         = State::timestamp;
+        runningStatus = 0;
+        inSysEx       = false;
+        hasTimestamp  = false;
+    }
+
+    //==================================================================================================================
+    [[nodiscard]] uint64_t getMessagesDecoded() const { return messagesDecoded; }
+    [[nodiscard]] uint64_t getMalformedPackets() const { return malformedPackets; }
+    [[nodiscard]] uint64_t getMalformedBytes() const { return malformedBytes; }
+    [[nodiscard]] uint64_t getSysExDropped() const { return sysExDropped; }
+
+private:
+    //==================================================================================================================
+    enum class State : uint8_t
+    {
+        timestamp,          // only a timestamp may come next
+        afterTimestamp,     // a status byte, or data under running status
+        message,            // collecting a message's data bytes
+        afterMessage,       // a timestamp, or data under running status with the same timestamp
+        sysEx,              // SysEx data, or the timestamp in front of its F7 or a real-time message
+        sysExAfterTimestamp
+    };
+
+    bool beginPacket(std::span<const uint8_t> packet, int64_t hostTime)
+    {
+        if (packet.size() < 2 || (packet[0] & 0xc0) != 0x80)
+        {
+            ++malformedPackets;
+            return false;
+        }
+
+        timestampHigh  = packet[0] & 0x3f;
+        timestampLow   = 0;
+        packetHostTime = hostTime;
+        state          = inSysEx ? State::sysEx : State::timestamp;
+        return true;
+    }
+
+    void endPacket()
+    {
+        if (state == State::message)
+            malformedBytes += static_cast<uint64_t>(messageSize);
+        else if (state == State::afterTimestamp || state == State::sysExAfterTimestamp)
+            ++malformedBytes;
+    }
+
+    //==================================================================================================================
+    template<typename Fn>
+    void step(uint8_t b, Fn& fn)
+    {
+        const auto marked = (b & 0x80) != 0;
+
+        switch (state)
+        {
+            case State::timestamp:
+                if (marked)
+                    timestampByte(b, State::afterTimestamp);
+                else
+                    ++malformedBytes;
+                break;
+
+            case State::afterTimestamp:
+                if (marked)
+                    statusByte(b, fn);
+                else
+                    runningStatusByte(b, fn);
+                break;
+
+            case State::message:
+                if (marked)
+                {
+                    malformedBytes += static_cast<uint64_t>(messageSize);
+                    timestampByte(b, State::afterTimestamp);
+                }
+                else
+                {
+                    dataByte(b, fn);
+                }
+                break;
+
+            case State::afterMessage:
+                if (marked)
+                    timestampByte(b, State::afterTimestamp);
+                else
+                    runningStatusByte(b, fn);
+                break;
+
+            case State::sysEx:
+                if (marked)
+                    timestampByte(b, State::sysExAfterTimestamp);
+                else
+                    appendSysEx(&b, 1);
+                break;
+
+            case State::sysExAfterTimestamp:
+                if (!marked)
+                {
+                    ++malformedBytes;
+                    appendSysEx(&b, 1);
+                    state = State::sysEx;
+                }
+                else if (b == 0xf7)
+                {
+                    appendSysEx(&b, 1);
+                    finishSysEx(fn);
+                }
+                else if (b >= 0xf8)
+                {
+                    emit(fn, &b, 1);
+                    state = State::sysEx;
+                }
+                else
+                {
+                    ++sysExDropped;
+                    inSysEx = false;
+                    statusByte(b, fn);
+                }
+                break;
+        }
+    }
+
+    /** Exactly what feeding the run to step() one byte at a time would do, given none of it is marked. */
+    template<typename Fn>
+    void dataRun(const uint8_t* data, size_t count, Fn& fn)
+    {
+        while (count > 0)
+        {
+            switch (state)
+            {
+                case State::message:
+                {
+                    const auto take = std::min(count, static_cast<size_t>(messageLength - messageSize));
+
+                    std::memcpy(message + messageSize, data, take);
+                    messageSize += static_cast<int>(take);
+                    data        += take;
+                    count       -= take;
+
+                    if (messageSize == messageLength)
+                    {
+                        emit(fn, message, static_cast<size_t>(messageSize));
+                        state = State::afterMessage;
+                    }
+
+                    break;
+                }
+
+                case State::afterTimestamp:
+                case State::afterMessage:
+                    if (runningStatus == 0)
+                    {
+                        malformedBytes += count;
+                        return;
+                    }
+
+                    startMessage(runningStatus, fn);
+                    break;
+
+                case State::sysEx:
+                    appendSysEx(data, count);
+                    return;
+
+                case State::sysExAfterTimestamp:
+                    ++malformedBytes;
+                    appendSysEx(data, 1);
+                    state = State::sysEx;
+                    ++data;
+                    --count;
+                    break;
+
+                case State::timestamp:
+                    malformedBytes += count;
+                    return;
+            }
+        }
+    }
+
+    //==================================================================================================================
+    void timestampByte(uint8_t b, State next)
+    {
+        const auto low = b & 0x7f;
+
+        // The header only carries the high bits for the packet's first timestamp; a smaller low part means they moved on
+        if (low < timestampLow)
+            timestampHigh = (timestampHigh + 1) & 0x3f;
+
+        timestampLow = low;
+        messageTime  = unwrap((timestampHigh << 7) | low) * 1000000;
+        state        = next;
+    }
+
+    int64_t unwrap(int64_t millis13)
+    {
+        constexpr int64_t period = 8192;
+
+        if (!hasTimestamp)
+        {
+            hasTimestamp = true;
+            lastMillis   = millis13;
+        }
+        else
+        {
+            const auto expected = lastMillis + (packetHostTime - lastHostTime) / 1000000;
+            const auto offset   = expected - millis13 + period / 2;
+            const auto wraps    = offset >= 0 ? offset / period : -((period - 1 - offset) / period);
+
+            lastMillis = millis13 + wraps * period;
+        }
+
+        lastHostTime = packetHostTime;
+        return lastMillis;
+    }
+
+    template<typename Fn>
+    void statusByte(uint8_t b, Fn& fn)
+    {
+        if (b >= 0xf8)
+        {
+            emit(fn, &b, 1);
+            state = State::afterMessage;
+        }
+        else if (b == 0xf0)
+        {
+            runningStatus = 0;
+            inSysEx       = true;
+            sysExOverflow = false;
+            sysExSize     = 0;
+            appendSysEx(&b, 1);
+            state = State::sysEx;
+        }
+        else if (b == 0xf7)
+        {
+            ++malformedBytes;
+            state = State::afterMessage;
+        }
+        else
+        {
+            runningStatus = b < 0xf0 ? b : 0;
+            startMessage(b, fn);
+        }
+    }
+
+    template<typename Fn>
+    void runningStatusByte(uint8_t b, Fn& fn)
+    {
+        if (runningStatus == 0)
+        {
+            ++malformedBytes;
+            return;
+        }
+
+        startMessage(runningStatus, fn);
+        dataByte(b, fn);
+    }
+
+    template<typename Fn>
+    void startMessage(uint8_t status, Fn& fn)
+    {
+        message[0]    = status;
+        messageSize   = 1;
+        messageLength = getMessageLength(status);
+
+        if (messageLength == 1)
+        {
+            emit(fn, message, 1);
+            state = State::afterMessage;
+        }
+        else
+        {
+            state = State::message;
+        }
+    }
+
+    template<typename Fn>
+    void dataByte(uint8_t b, Fn& fn)
+    {
+        message[messageSize++] = b;
+
+        if (messageSize == messageLength)
+        {
+            emit(fn, message, static_cast<size_t>(messageSize));
+            state = State::afterMessage;
+        }
+    }
+
+    void appendSysEx(const uint8_t* data, size_t count)
+    {
+        if (sysExOverflow || sysExSize + count > sysEx.size())
+        {
+            sysExOverflow = true;
+            return;
+        }
+
+        std::memcpy(sysEx.data() + sysExSize, data, count);
+        sysExSize += count;
+    }
+
+    template<typename Fn>
+    void finishSysEx(Fn& fn)
+    {
+        if (sysExOverflow)
+            ++sysExDropped;
+        else
+            emit(fn, sysEx.data(), sysExSize);
+
+        inSysEx = false;
+        state   = State::afterMessage;
+    }
+
+    template<typename Fn>
+    void emit(Fn& fn, const uint8_t* data, size_t size)
+    {
+        ++messagesDecoded;
+        fn(std::span<const uint8_t>(data, size), messageTime);
+    }
+
+    //==================================================================================================================
+    static void markStatusBytes(std::span<const uint8_t> packet, uint64_t* marks)
+    {
+        const auto* data = packet.data();
+        const auto  size = packet.size();
+        size_t      i    = 0;
+
+       #if INGEST_BLE_MIDI_SSE2
+        for (; i + 16 <= size; i += 16)
+        {
+            const auto bits = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+            marks[i / 64] |= static_cast<uint64_t>(static_cast<uint32_t>(bits)) << (i % 64);
+        }
+       #elif INGEST_BLE_MIDI_NEON
+        static constexpr uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+        const auto               w           = vld1q_u8(weights);
+
+        for (; i + 16 <= size; i += 16)
+        {
+            const auto top  = vmulq_u8(vshrq_n_u8(vld1q_u8(data + i), 7), w);
+            const auto bits = static_cast<uint64_t>(vaddv_u8(vget_low_u8(top)))
+                              | (static_cast<uint64_t>(vaddv_u8(vget_high_u8(top))) << 8);
+            marks[i / 64] |= bits << (i % 64);
+        }
+       #endif
+
+        for (; i < size; ++i)
+            marks[i / 64] |= static_cast<uint64_t>(data[i] >> 7) << (i % 64);
+    }
+
+    //==================================================================================================================
+    State   state         = State::timestamp;
+    uint8_t runningStatus = 0;
+    uint8_t message[3]    = {};
+    int     messageSize = 0, messageLength = 0;
+
+    std::vector<uint8_t> sysEx;
+    size_t               sysExSize = 0;
+    bool                 inSysEx = false, sysExOverflow = false;
+
+    int     timestampHigh = 0, timestampLow = 0;
+    bool    hasTimestamp  = false;
+    int64_t lastMillis = 0, lastHostTime = 0, packetHostTime = 0, messageTime = 0;
+
+    uint64_t messagesDecoded = 0, malformedPackets = 0, malformedBytes = 0, sysExDropped = 0;
+};
+//======================================================================================================================
+/**
+    Packs MIDI messages into as few BLE-MIDI packets as a given packet size allows: the inverse of Decoder.
+
+    Messages share their packet's header, a message stamped with the same millisecond as the one before it under the
+    same status goes in as bare data bytes, and one with a new millisecond needs just a timestamp byte in front of
+    them. Running status doesn't carry over from one packet to the next, so any packet can be decoded on its own.
+    SysEx is split across as many packets as it takes.
+
+    Timestamps are the sender's own clock, hostNanos() in milliseconds, and a packet only ever spans 127 of them; a
+    message that's further out, or earlier, starts a new packet. Messages that aren't well formed (a channel or system
+    common message of the wrong length, SysEx not framed by F0 and F7, a data byte with its top bit set) are counted
+    and left out, since they'd throw the receiver's decoder off.
+
+    Packets are handed to a callback as soon as they're full, and the one in progress when flush() is called.
+    Nothing allocates.
+*/
+class Encoder
+{
+public:
+    static constexpr size_t minPacketSize = 5; // a header, a timestamp and a three byte message
+
+    explicit Encoder(size_t maxPacketSize = 20) { setMaxPacketSize(maxPacketSize); }
+
+    /** Typically the negotiated ATT MTU less three; takes effect from the next packet on. */
+    void setMaxPacketSize(size_t maxPacketSize) { limit = std::clamp(maxPacketSize, minPacketSize, maxBlePayloadSize); }
+
+    [[nodiscard]] size_t getMaxPacketSize() const { return limit; }
+
+    /** Calls write(std::span<const uint8_t>) for every packet the message fills up. Returns false if it was left out. */
+    template<typename Fn>
+    bool add(std::span<const uint8_t> message, int64_t hostTime, Fn&& write)
+    {
+        if (!isWellFormed(message))
+        {
+            ++invalidMessages;
+            return false;
+        }
+
+        auto millis = hostTime / 1000000;
+
+        if (size > 0 && (millis < packetMillis || millis - packetMillis > 127))
+            flush(write);
+
+        if (size > 0)
+            millis = std::max(millis, packetMillis);
+
+        if (message[0] == 0xf0)
+            addSysEx(message, millis, write);
+        else
+            addShort(message, millis, write);
+
+        ++messagesEncoded;
+        return true;
+    }
+
+    /** Hands out the packet in progress, if there is one. */
+    template<typename Fn>
+    void flush(Fn&& write)
+    {
+        if (size > 1)
+        {
+            write(std::span<const uint8_t>(packet, size));
+            ++packetsEncoded;
+        }
+
+        size          = 0;
+        runningStatus = 0;
+    }
+
+    //==================================================================================================================
+    [[nodiscard]] uint64_t getMessagesEncoded() const { return messagesEncoded; }
+    [[nodiscard]] uint64_t getPacketsEncoded() const { return packetsEncoded; }
+    [[nodiscard]] uint64_t getInvalidMessages() const { return invalidMessages; }
+
+private:
+    //==================================================================================================================
+    static bool isWellFormed(std::span<const uint8_t> message)
+    {
+        if (message.empty() || message[0] < 0x80 || message[0] == 0xf7)
+            return false;
+
+        if (message[0] == 0xf0 ? message.size() < 2 || message.back() != 0xf7
+                               : message.size() != static_cast<size_t>(getMessageLength(message[0])))
+            return false;
+
+        const auto data = message.subspan(1, message.size() - (message[0] == 0xf0 ? 2 : 1));
+
+        return std::none_of(data.begin(), data.end(), [](uint8_t b) { return b >= 0x80; });
+    }
+
+    /** Makes sure the given number of bytes fit, flushing first if they don't, and starts a packet if there's none. */
+    template<typename Fn>
+    void reserve(size_t bytes, int64_t millis, Fn& write)
+    {
+        if (size + bytes > limit)
+            flush(write);
+
+        if (size == 0)
+        {
+            packet[size++] = static_cast<uint8_t>(0x80 | ((millis >> 7) & 0x3f));
+            packetMillis   = millis;
+        }
+    }
+
+    void timestamp(int64_t millis)
+    {
+        packet[size++] = static_cast<uint8_t>(0x80 | (millis & 0x7f));
+        packetMillis   = millis;
+    }
+
+    void append(const uint8_t* data, size_t count)
+    {
+        std::memcpy(packet + size, data, count);
+        size += count;
+    }
+
+    template<typename Fn>
+    void addShort(std::span<const uint8_t> message, int64_t millis, Fn& write)
+    {
+        const auto status = message[0];
+
+        // Under running status, the data alone if the millisecond hasn't moved on, or behind a timestamp if it has
+        if (status < 0xf0 && status == runningStatus)
+        {
+            const auto same_time = millis == packetMillis;
+
+            if (size + message.size() - (same_time ? 1 : 0) <= limit)
+            {
+                if (!same_time)
+                    timestamp(millis);
+
+                append(message.data() + 1, message.size() - 1);
+                return;
+            }
+
+            flush(write);
+        }
+
+        reserve(message.size() + 1, millis, write);
+        timestamp(millis);
+        append(message.data(), message.size());
+
+        // Real-time messages leave running status alone, system common ones cancel it
+        if (status < 0xf0)
+            runningStatus = status;
+        else if (status < 0xf8)
+            runningStatus = 0;
+    }
+
+    template<typename Fn>
+    void addSysEx(std::span<const uint8_t> message, int64_t millis, Fn& write)
+    {
+        reserve(3, millis, write);
+        timestamp(millis);
+        packet[size++] = 0xf0;
+        runningStatus  = 0;
+
+        // Continuation packets carry the data straight after their header
+        for (auto data = message.subspan(1, message.size() - 2); !data.empty();)
+        {
+            reserve(1, millis, write);
+
+            const auto take = std::min(data.size(), limit - size);
+            append(data.data(), take);
+            data = data.subspan(take);
+        }
+
+        reserve(2, millis, write);
+        timestamp(millis);
+        packet[size++] = 0xf7;
+    }
+
+    //==================================================================================================================
+    uint8_t packet[maxBlePayloadSize] = {};
+    size_t  size = 0, limit = 20;
+    uint8_t runningStatus = 0;
+    int64_t packetMillis  = 0; // the packet's latest timestamp
+
+    uint64_t messagesEncoded = 0, packetsEncoded = 0, invalidMessages = 0;
+};
+} // namespace Ingest::BleMidi
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "SeqLock.h"
+#include "SpscRing.h"
+
+//======================================================================================================================
+namespace Ingest {
+
+/** How a reader of a BroadcastRing is treated when it falls behind. */
+enum class Delivery : uint8_t
+{
+    lossless, // holds the producer back; once it's a whole ring behind, new items are dropped for every reader
+    lossy     // holds nobody back; items it was too slow for are skipped and counted against it alone
+};
+
+//======================================================================================================================
+/**
+    A single-producer ring that up to maxReaders readers consume independently, each at a cursor of its own, in the
+    manner of a disruptor: an item is written once, and every reader reads it where it lies.
+
+    The producer only checks the lossless readers' cursors, and only when its cached view of the slowest of them
+    says the ring is full, so an extra reader costs it nothing per item. A lossy reader that gets lapped notices from
+    the sequence number each slot is stamped with (the slots are SeqLocks, so the copy it takes is never torn), skips
+    to the oldest item still there and counts what it missed.
+
+    Once no lossless reader needs an item any more, it's retired, on the producer's thread, through the callback
+    push() and reserve() take; that's where anything the item points into (a pool slot) gets handed back. Items are
+    only retired when their slot is needed again or when the producer asks, so lossy readers get as long as possible
+    to look at them; one that copies a payload out checks isRetired() afterwards to know whether the copy is good.
+
+    Reader 0 is open, lossless, from the start. Others are opened and closed only while nothing is pushing.
+*/
+template<typename T>
+class BroadcastRing
+{
+public:
+    static constexpr int maxReaders = 8;
+
+    explicit BroadcastRing(size_t minCapacity)
+            : slots(roundUpToPowerOfTwo(minCapacity)),
+              mask(slots.size() - 1)
+    {
+        readers[0].delivery.store(static_cast<uint8_t>(Delivery::lossless), std::memory_order_relaxed);
+    }
+
+    //==================================================================================================================
+    /** Producer side. Returns false, retiring whatever it can, if a lossless reader is a whole ring behind. */
+    template<typename Retire>
+    bool reserve(Retire&& retire)
+    {
+        const auto h = head.load(std::memory_order_relaxed);
+
+        if (h - retired == slots.size())
+            retireFinished(retire);
+
+        return h - retired < slots.size();
+    }
+
+    /** Producer side. Items that have to make room are retired first. */
+    template<typename Retire>
+    bool push(const T& item, Retire&& retire)
+    {
+        if (!reserve(retire))
+            return false;
+
+        const auto h = head.load(std::memory_order_relaxed);
+
+        slots[h & mask].store({h, item});
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Producer side. Retires everything no lossless reader needs any more, e.g. when a payload pool runs dry. */
+    template<typename Retire>
+    void retireFinished(Retire&& retire)
+    {
+        const auto limit = getSlowestLosslessPosition();
+
+        for (; retired < limit; ++retired)
+            retire(slots[retired & mask].load().item);
+
+        // Published ahead of any reuse of what was just retired; see isRetired()
+        retiredPosition.store(retired, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    //==================================================================================================================
+    /** Only while nothing is pushing. The reader starts at the next item pushed. */
+    void open(int reader, Delivery delivery)
+    {
+        auto& r = readers[static_cast<size_t>(reader)];
+
+        r.position.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        r.delivery.store(static_cast<uint8_t>(delivery), std::memory_order_release);
+    }
+
+    /** Only while nothing is pushing. */
+    void close(int reader)
+    {
+        readers[static_cast<size_t>(reader)].delivery.store(closed, std::memory_order_release);
+    }
+
+    [[nodiscard]] bool isOpen(int reader) const
+    {
+        return readers[static_cast<size_t>(reader)].delivery.load(std::memory_order_acquire) != closed;
+    }
+
+    /**
+        Reader side, one thread per reader. Calls fn(const T&, uint64_t sequence) for every item the reader hasn't
+        seen, up to maxItems, and returns how many it was handed. For a lossy reader fn may return a bool, and false
+        counts the item as dropped after all.
+    */
+    template<typename Fn>
+    size_t read(int reader, Fn&& fn, size_t maxItems = std::numeric_limits<size_t>::max())
+    {
+        auto&      r      = readers[static_cast<size_t>(reader)];
+        auto       p      = r.position.load(std::memory_order_relaxed);
+        const auto h      = head.load(std::memory_order_acquire);
+        const auto lossy  = r.delivery.load(std::memory_order_relaxed) == static_cast<uint8_t>(Delivery::lossy);
+        size_t     n      = 0;
+        uint64_t   missed = 0;
+
+        if (lossy && h - p > slots.size())
+        {
+            missed += h - slots.size() - p;
+            p       = h - slots.size();
+        }
+
+        while (p < h && n < maxItems)
+        {
+            Stamped s;
+
+            if (!lossy)
+            {
+                s = slots[p & mask].load();
+                fn(s.item, p++);
+                ++n;
+                continue;
+            }
+
+            // Lapped: the slot already holds a later item, or is being written with one
+            if (!slots[p & mask].tryLoad(s) || s.sequence != p)
+            {
+                const auto oldest = head.load(std::memory_order_acquire) - slots.size();
+                missed           += jmax<uint64_t>(1, oldest - p);
+                p                 = jmax(p + 1, oldest);
+                continue;
+            }
+
+            if constexpr (std::is_void_v<std::invoke_result_t<Fn&, const T&, uint64_t>>)
+                fn(s.item, p++);
+            else if (!fn(s.item, p++))
+                ++missed;
+
+            ++n;
+        }
+
+        r.position.store(p, std::memory_order_release);
+
+        if (missed > 0)
+            r.dropped.fetch_add(missed, std::memory_order_relaxed);
+
+        return n;
+    }
+
+    /** Reader side: whether anything the item pointed to may have been reused by now. */
+    [[nodiscard]] bool isRetired(uint64_t sequence) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return sequence < retiredPosition.load(std::memory_order_relaxed);
+    }
+
+    //==================================================================================================================
+    [[nodiscard]] size_t getCapacity() const { return slots.size(); }
+
+    /** Items a lossy reader skipped, or whose payload was gone by the time it got to them. */
+    [[nodiscard]] uint64_t getDroppedCount(int reader) const
+    {
+        return readers[static_cast<size_t>(reader)].dropped.load(std::memory_order_relaxed);
+    }
+
+    /** Only a snapshot. */
+    [[nodiscard]] size_t getBacklog(int reader) const
+    {
+        return static_cast<size_t>(head.load(std::memory_order_acquire)
+                                   - readers[static_cast<size_t>(reader)].position.load(std::memory_order_acquire));
+    }
+
+private:
+    //==================================================================================================================
+    struct Stamped
+    {
+        uint64_t sequence = 0;
+        T        item{};
+    };
+
+    struct alignas(cacheLineSize) Reader
+    {
+        std::atomic<uint64_t> position{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<uint8_t>  delivery{closed};
+    };
+
+    static constexpr uint8_t closed = 0xff;
+
+    static size_t roundUpToPowerOfTwo(size_t n)
+    {
+        size_t p = 1;
+        while (p < n)
+            p <<= 1;
+
+        return p;
+    }
+
+    /** Producer side. With no lossless reader open, everything pushed is finished with. */
+    uint64_t getSlowestLosslessPosition() const
+    {
+        auto slowest = head.load(std::memory_order_relaxed);
+
+        for (const auto& r : readers)
+            if (r.delivery.load(std::memory_order_acquire) == static_cast<uint8_t>(Delivery::lossless))
+                slowest = jmin(slowest, r.position.load(std::memory_order_acquire));
+
+        return slowest;
+    }
+
+    //==================================================================================================================
+    std::vector<SeqLock<Stamped>> slots;
+    const size_t                  mask;
+
+    alignas(cacheLineSize) std::atomic<uint64_t> head{0};
+    uint64_t retired = 0; // producer only
+
+    alignas(cacheLineSize) std::atomic<uint64_t> retiredPosition{0};
+
+    std::array<Reader, maxReaders> readers;
+};
+} // namespace Ingest
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "HostClock.h"
+
+#include <span>
+
+//======================================================================================================================
+namespace Ingest::Capture {
+
+/**
+    The on-disk layout of a capture.
+
+    A capture is a directory of numbered segment files (capture-000000.wrmcap, capture-000001.wrmcap, ...). Each one
+    starts with a SegmentHeader, followed by usedBytes worth of records. A record is a RecordHeader followed by its
+    payload, padded to a multiple of eight bytes so every header stays aligned. Records never straddle segments.
+
+    Everything is little-endian, in host order, and stamped with hostNanos(); it's a field-debugging format, not an
+    interchange one.
+*/
+constexpr char     magic[8]      = {'W', 'R', 'M', 'C', 'A', 'P', '0', '1'};
+constexpr uint32_t formatVersion = 1;
+
+struct SegmentHeader
+{
+    char     magic[8]        = {};
+    uint32_t version         = 0;
+    uint32_t headerSize      = 0;
+    uint64_t index           = 0;
+    uint64_t usedBytes       = 0; // kept up to date while the segment is being written
+    int64_t  createdHostTime = 0;
+    uint64_t reserved[3]     = {};
+};
+
+static_assert(sizeof(SegmentHeader) == 64);
+
+enum class RecordKind : uint8_t
+{
+    midi = 1,
+    ble  = 2
+};
+
+struct RecordHeader
+{
+    int64_t    hostTime   = 0;
+    int64_t    deviceTime = noDeviceTime;
+    uint32_t   size       = 0;
+    uint16_t   device     = 0;
+    RecordKind kind       = RecordKind::midi;
+    uint8_t    reserved   = 0;
+};
+
+static_assert(sizeof(RecordHeader) == 24);
+
+/** Header plus payload plus padding. */
+constexpr size_t getRecordLength(size_t payloadSize) { return sizeof(RecordHeader) + ((payloadSize + 7) & ~size_t{7}); }
+
+inline File getSegmentFile(const File& directory, uint64_t index)
+{
+    return directory.getChildFile("capture-" + String(static_cast<int64>(index)).paddedLeft('0', 6) + ".wrmcap");
+}
+
+//======================================================================================================================
+/** Walks the records of a finished (or crashed) capture, in order, straight out of the mapped segment files. */
+class Reader
+{
+public:
+    explicit Reader(const File& captureDirectory)
+    {
+        segments = captureDirectory.findChildFiles(File::findFiles, false, "capture-*.wrmcap");
+        segments.sort();
+    }
+
+    [[nodiscard]] int getNumSegments() const { return segments.size(); }
+
+    /**
+        Calls fn(const RecordHeader&, std::span<const uint8_t>) for every record, and returns how many it was called
+        for. If fn returns a bool, returning false stops the walk there.
+    */
+    template<typename Fn>
+    uint64_t forEachRecord(Fn&& fn) const
+    {
+        uint64_t n = 0;
+
+        for (const auto& file : segments)
+        {
+            const MemoryMappedFile map(file, MemoryMappedFile::readOnly);
+            const auto*            base = static_cast<const uint8_t*>(map.getData());
+
+            if (base == nullptr || map.getSize() < sizeof(SegmentHeader))
+                continue;
+
+            SegmentHeader header;
+            std::memcpy(&header, base, sizeof(header));
+
+            if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != formatVersion)
+            {
+                jassertfalse;
+                continue;
+            }
+
+            const auto end = std::min(static_cast<size_t>(header.headerSize + header.usedBytes), map.getSize());
+
+            for (size_t pos = header.headerSize; pos + sizeof(RecordHeader) <= end;)
+            {
+                RecordHeader r;
+                std::memcpy(&r, base + pos, sizeof(r));
+
+                const auto length = getRecordLength(r.size);
+
+                if (pos + length > end)
+                    break;
+
+                const std::span<const uint8_t> payload(base + pos + sizeof(r), r.size);
+
+                pos += length;
+                ++n;
+
+                if constexpr (std::is_same_v<std::invoke_result_t<Fn, const RecordHeader&, std::span<const uint8_t>>, bool>)
+                {
+                    if (!fn(r, payload))
+                        return n;
+                }
+                else
+                {
+                    fn(r, payload);
+                }
+            }
+        }
+
+        return n;
+    }
+
+private:
+    Array<File> segments;
+};
+} // namespace Ingest::Capture
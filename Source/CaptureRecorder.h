@@ -0,0 +1,301 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "CaptureFormat.h"
+#include "IngestConsumer.h"
+
+#include <cstddef>
+
+//======================================================================================================================
+namespace Ingest {
+
+/**
+    Streams every drained MIDI event and BLE notification into a capture directory (see Capture::Reader for the
+    format).
+
+    The sink's thread only encodes each record into a preallocated byte ring; a writer thread of its own copies them
+    from there into memory-mapped segment files, which are created at their full size up front and trimmed to what was
+    used once they're done with. So neither the device callbacks nor the consumer ever wait for the disk. If the
+    writer falls behind far enough to fill the ring, records are counted as dropped rather than holding anyone up.
+
+    The ring has a single producer, so the recorder has to be the sink of a Subscription, or of a consumer with just
+    the one worker.
+*/
+class CaptureRecorder : public EventSink,
+                        private Thread
+{
+public:
+    explicit CaptureRecorder(const File& captureDirectory,
+                             size_t segmentBytes = 64 * 1024 * 1024,
+                             size_t bufferBytes = 8 * 1024 * 1024)
+            : Thread("Capture writer"),
+              directory(captureDirectory),
+              segmentSize(segmentBytes),
+              buffer(nextPowerOfTwo(bufferBytes)),
+              mask(buffer.size() - 1)
+    {
+        jassert(segmentSize > sizeof(Capture::SegmentHeader) + Capture::getRecordLength(maxRecordPayload));
+    }
+
+    ~CaptureRecorder() override { stop(); }
+
+    //==================================================================================================================
+    /** Opens the first segment, so a directory that can't be written to is reported up front. */
+    Result start()
+    {
+        if (const auto r = directory.createDirectory(); r.failed())
+            return r;
+
+        if (!openSegment())
+            return Result::fail("Couldn't create " + Capture::getSegmentFile(directory, segmentIndex).getFullPathName());
+
+        startThread();
+        return Result::ok();
+    }
+
+    /** Writes out whatever is still buffered, and trims the last segment. */
+    void stop()
+    {
+        if (!isThreadRunning())
+            return;
+
+        stopThread(5000);
+        writeBuffered();
+        closeSegment();
+    }
+
+    //==================================================================================================================
+    void midiEvent(DeviceHandle device, const MidiEvent& event) override
+    {
+        append(Capture::RecordKind::midi, device, event.hostTime, event.deviceTime, event.getBytes());
+    }
+
+    void blePacket(DeviceHandle device, const PacketView& packet) override
+    {
+        append(Capture::RecordKind::ble, device, packet.hostTime, packet.deviceTime, packet.bytes());
+    }
+
+    //==================================================================================================================
+    [[nodiscard]] uint64_t getRecordsWritten() const { return recordsWritten.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t getBytesWritten() const { return bytesWritten.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t getRecordsDropped() const { return recordsDropped.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t getNumSegments() const { return segmentsOpened.load(std::memory_order_relaxed); }
+
+    /** The largest backlog the writer has found in the ring, as a fraction of the ring's size. */
+    [[nodiscard]] double getPeakBufferFill() const
+    {
+        return static_cast<double>(peakFill.load(std::memory_order_relaxed)) / static_cast<double>(buffer.size());
+    }
+
+private:
+    //==================================================================================================================
+    static constexpr size_t maxRecordPayload = 64 * 1024;
+
+    static size_t nextPowerOfTwo(size_t n)
+    {
+        size_t p = 1;
+
+        while (p < n)
+            p <<= 1;
+
+        return p;
+    }
+
+    /** Consumer side. */
+    void append(Capture::RecordKind kind, DeviceHandle device, int64_t hostTime, int64_t deviceTime,
+                std::span<const uint8_t> payload)
+    {
+        const auto length = Capture::getRecordLength(payload.size());
+        const auto h      = head.load(std::memory_order_relaxed);
+
+        if (buffer.size() - (h - cachedTail) < length)
+            cachedTail = tail.load(std::memory_order_acquire);
+
+        if (payload.size() > maxRecordPayload || buffer.size() - (h - cachedTail) < length)
+        {
+            recordsDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        Capture::RecordHeader r;
+        r.hostTime   = hostTime;
+        r.deviceTime = deviceTime;
+        r.size       = static_cast<uint32_t>(payload.size());
+        r.device     = device;
+        r.kind       = kind;
+
+        static constexpr uint8_t padding[8] = {};
+
+        copyIn(h, &r, sizeof(r));
+        copyIn(h + sizeof(r), payload.data(), payload.size());
+        copyIn(h + sizeof(r) + payload.size(), padding, length - sizeof(r) - payload.size());
+
+        head.store(h + length, std::memory_order_release);
+
+        if (!writerSignalled.exchange(true, std::memory_order_acq_rel))
+            notify();
+    }
+
+    void copyIn(uint64_t position, const void* src, size_t size)
+    {
+        const auto offset = static_cast<size_t>(position) & mask;
+        const auto first  = std::min(size, buffer.size() - offset);
+
+        std::memcpy(buffer.data() + offset, src, first);
+        std::memcpy(buffer.data(), static_cast<const uint8_t*>(src) + first, size - first);
+    }
+
+    void copyOut(uint64_t position, void* dest, size_t size) const
+    {
+        const auto offset = static_cast<size_t>(position) & mask;
+        const auto first  = std::min(size, buffer.size() - offset);
+
+        std::memcpy(dest, buffer.data() + offset, first);
+        std::memcpy(static_cast<uint8_t*>(dest) + first, buffer.data(), size - first);
+    }
+
+    //==================================================================================================================
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            wait(10);
+            writerSignalled.store(false, std::memory_order_release);
+            writeBuffered();
+        }
+    }
+
+    /** Writer side. */
+    void writeBuffered()
+    {
+        auto       t = tail.load(std::memory_order_relaxed);
+        const auto h = head.load(std::memory_order_acquire);
+
+        if (h - t > peakFill.load(std::memory_order_relaxed))
+            peakFill.store(h - t, std::memory_order_relaxed);
+
+        uint64_t records = 0, bytes = 0;
+
+        while (t != h)
+        {
+            Capture::RecordHeader r;
+            copyOut(t, &r, sizeof(r));
+
+            const auto length = Capture::getRecordLength(r.size);
+
+            if (segment != nullptr && segmentUsed + length > segmentCapacity)
+            {
+                closeSegment();
+                ++segmentIndex;
+                openSegment();
+            }
+
+            if (segment == nullptr)
+            {
+                recordsDropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                copyOut(t, segmentData + segmentUsed, length);
+                segmentUsed += length;
+                bytes       += length;
+                ++records;
+            }
+
+            t += length;
+        }
+
+        tail.store(t, std::memory_order_release);
+
+        if (segment != nullptr)
+            setUsedBytes(segmentUsed);
+
+        recordsWritten.fetch_add(records, std::memory_order_relaxed);
+        bytesWritten.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    //==================================================================================================================
+    bool openSegment()
+    {
+        const auto file = Capture::getSegmentFile(directory, segmentIndex);
+
+        file.deleteFile();
+
+        {
+            FileOutputStream out(file);
+
+            if (!out.openedOk() || !out.setPosition(static_cast<int64>(segmentSize) - 1) || !out.writeByte(0))
+            {
+                DBG("Failed to preallocate capture segment: " << file.getFullPathName());
+                return false;
+            }
+        }
+
+        segment = std::make_unique<MemoryMappedFile>(file, MemoryMappedFile::readWrite);
+
+        if (segment->getData() == nullptr || segment->getSize() < segmentSize)
+        {
+            DBG("Failed to map capture segment: " << file.getFullPathName());
+            segment.reset();
+            return false;
+        }
+
+        auto* base = static_cast<uint8_t*>(segment->getData());
+
+        Capture::SegmentHeader header;
+        std::memcpy(header.magic, Capture::magic, sizeof(header.magic));
+        header.version         = Capture::formatVersion;
+        header.headerSize      = sizeof(header);
+        header.index           = segmentIndex;
+        header.createdHostTime = hostNanos();
+        std::memcpy(base, &header, sizeof(header));
+
+        segmentData     = base + sizeof(header);
+        segmentCapacity = segmentSize - sizeof(header);
+        segmentUsed     = 0;
+
+        segmentsOpened.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void closeSegment()
+    {
+        if (segment == nullptr)
+            return;
+
+        setUsedBytes(segmentUsed);
+        segment.reset();
+
+        FileOutputStream out(Capture::getSegmentFile(directory, segmentIndex));
+
+        if (out.openedOk() && out.setPosition(static_cast<int64>(sizeof(Capture::SegmentHeader) + segmentUsed)))
+            out.truncate();
+    }
+
+    void setUsedBytes(uint64_t used)
+    {
+        std::memcpy(static_cast<uint8_t*>(segment->getData()) + offsetof(Capture::SegmentHeader, usedBytes), &used, sizeof(used));
+    }
+
+    //==================================================================================================================
+    const File   directory;
+    const size_t segmentSize;
+
+    std::vector<uint8_t> buffer;
+    const size_t         mask;
+
+    alignas(cacheLineSize) std::atomic<uint64_t> head{0};
+    uint64_t cachedTail = 0; // consumer only
+    alignas(cacheLineSize) std::atomic<uint64_t> tail{0};
+
+    alignas(cacheLineSize) std::atomic<bool> writerSignalled{false};
+    std::atomic<uint64_t> recordsWritten{0}, bytesWritten{0}, recordsDropped{0}, peakFill{0}, segmentsOpened{0};
+
+    // Writer only, apart from start() and stop()
+    std::unique_ptr<MemoryMappedFile> segment;
+    uint8_t*                          segmentData     = nullptr;
+    uint64_t                          segmentIndex    = 0;
+    size_t                            segmentCapacity = 0, segmentUsed = 0;
+};
+} // namespace Ingest
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "CaptureFormat.h"
+#include "DeviceRegistry.h"
+
+//======================================================================================================================
+namespace Ingest {
+
+/**
+    Plays a capture back into a DeviceRegistry's channels, through the same push() calls the platform callbacks make.
+
+    Records are replayed in the order they were recorded, from a single thread, so two runs over the same capture
+    deliver exactly the same sequence to each channel. With a speed above zero, each record is held back until its
+    original hostTime (relative to the first record), divided by the speed, so per-device inter-arrival timing,
+    stalls and bursts included, is reproduced. A speed of zero replays as fast as the channels accept it.
+
+    Events are stamped with the replay's own hostNanos() on the way in, so the pipeline's latency measurements
+    reflect the replay; the original deviceTime is passed through untouched. Records for handles the registry
+    doesn't have are skipped. The replayer is the channels' only producer while it runs.
+*/
+class CaptureReplayer : private Thread
+{
+public:
+    CaptureReplayer(const File& captureDirectory, DeviceRegistry& deviceRegistry, double replaySpeed = 1.0)
+            : Thread("Capture replay"),
+              reader(captureDirectory),
+              registry(deviceRegistry),
+              speed(jmax(0.0, replaySpeed))
+    {
+    }
+
+    ~CaptureReplayer() override { stop(); }
+
+    void start() { startThread(); }
+    void stop() { stopThread(1000); }
+
+    [[nodiscard]] bool isFinished() const { return finished.load(std::memory_order_acquire); }
+
+    //==================================================================================================================
+    [[nodiscard]] uint64_t getRecordsReplayed() const { return replayed.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t getRecordsSkipped() const { return skipped.load(std::memory_order_relaxed); }
+
+    /** How late each record went in relative to its schedule; empty when replaying at full speed. */
+    [[nodiscard]] const LatencyHistogram& getLateness() const { return lateness; }
+
+private:
+    //==================================================================================================================
+    void run() override
+    {
+        const auto start = hostNanos();
+        int64_t    first = 0;
+        bool       timed = false;
+
+        reader.forEachRecord([&](const Capture::RecordHeader& r, std::span<const uint8_t> payload)
+        {
+            if (threadShouldExit())
+                return false;
+
+            if (r.device >= registry.size())
+            {
+                skipped.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+
+            if (speed > 0.0)
+            {
+                if (!timed)
+                {
+                    first = r.hostTime;
+                    timed = true;
+                }
+
+                const auto due = start + static_cast<int64_t>(static_cast<double>(r.hostTime - first) / speed);
+
+                if (!waitUntil(due))
+                    return false;
+
+                lateness.record(hostNanos() - due);
+            }
+
+            const auto now = hostNanos();
+
+            if (r.kind == Capture::RecordKind::midi)
+                registry.midiChannels[r.device]->push(payload.data(), payload.size(), now, r.deviceTime);
+            else
+                registry.bleChannels[r.device]->push(payload.data(), payload.size(), now, r.deviceTime);
+
+            replayed.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        });
+
+        finished.store(true, std::memory_order_release);
+    }
+
+    /**
+        Sleeps (interruptibly) until about a millisecond before the deadline, then yields its way up to it, which
+        keeps the schedule to within a few microseconds without burning a core through the long gaps.
+    */
+    bool waitUntil(int64_t deadline)
+    {
+        for (auto remaining = deadline - hostNanos(); remaining > 0; remaining = deadline - hostNanos())
+        {
+            if (threadShouldExit())
+                return false;
+
+            if (remaining > 2000000)
+                wait(static_cast<int>(jmin<int64_t>(remaining / 1000000 - 1, 100)));
+            else
+                std::this_thread::yield();
+        }
+
+        return true;
+    }
+
+    //==================================================================================================================
+    const Capture::Reader reader;
+    DeviceRegistry&       registry;
+    const double          speed;
+
+    std::atomic<bool>     finished{false};
+    std::atomic<uint64_t> replayed{0}, skipped{0};
+    LatencyHistogram      lateness;
+};
+} // namespace Ingest
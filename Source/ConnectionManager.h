@@ -0,0 +1,332 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "FairnessAnalyzer.h"
+
+#include <numeric>
+
+//======================================================================================================================
+namespace Ingest {
+
+/** What a ConnectionPolicy is told about one BLE link. */
+struct LinkLoad
+{
+    double            eventsPerSecond = 0.0; // MIDI messages and notifications together, since they share the link
+    uint64_t          backlog         = 0;   // received but not yet consumed
+    ConnectionProfile profile         = ConnectionProfile::balanced;
+    bool              starved         = false;
+    bool              connected       = true;
+    bool              settled         = true; // false for a while after its last change, which can't be judged yet
+};
+
+struct ConnectionSettings
+{
+    /** What each profile is taken to give, slowest first; the peripheral and the platform may settle on others. */
+    std::array<double, numConnectionProfiles> intervalMs{90.0, 30.0, 7.5};
+
+    double eventsPerConnectionEvent = 4.0;
+    double connectionEventBudget    = 400.0; // per second, that the central is taken to schedule over all its links
+    double raiseAbove               = 0.8;   // of its profile's capacity: a link carrying more gets a faster one
+    double lowerBelow               = 0.3;   // of the next slower profile's capacity: a link carrying less gets that
+    size_t backlogLimit             = 512;   // a consumer this far behind is the bottleneck, not the link
+    double tickIntervalSeconds      = 1.0;
+    double settleSeconds            = 3.0;   // after a change, before the link is judged again (a rate window or so)
+};
+
+//======================================================================================================================
+/**
+    Decides which connection profile each BLE link should have, from what the links carry. Has no state, so it can be
+    driven with made-up loads as well as measured ones.
+
+    A link that's close to what its profile can carry, or starving, is moved to the next faster profile, unless its
+    consumer is behind (a faster link would only make that worse). One that would fit comfortably into the next
+    slower profile is moved to that, which gives its radio time back. The radio's time is the budget: a faster
+    profile is only handed out if the connection events it adds still fit, if need be by slowing down a link that
+    can afford it. Starving links go first, then the busiest. Links that aren't settled are left alone, and nothing
+    moves by more than one step at a time.
+*/
+class ConnectionPolicy
+{
+public:
+    explicit ConnectionPolicy(ConnectionSettings connectionSettings = {}) : settings(connectionSettings) {}
+
+    [[nodiscard]] const ConnectionSettings& getSettings() const { return settings; }
+
+    [[nodiscard]] double getConnectionEventRate(ConnectionProfile p) const
+    {
+        return 1000.0 / settings.intervalMs[static_cast<size_t>(p)];
+    }
+
+    /** Events per second a link with the profile is taken to be able to carry. */
+    [[nodiscard]] double getCapacity(ConnectionProfile p) const
+    {
+        return getConnectionEventRate(p) * settings.eventsPerConnectionEvent;
+    }
+
+    /** wanted is the same size as links; every link ends up with the profile it should have, changed or not. */
+    void decide(std::span<const LinkLoad> links, std::span<ConnectionProfile> wanted) const
+    {
+        jassert(links.size() == wanted.size());
+
+        std::transform(links.begin(), links.end(), wanted.begin(), [](const LinkLoad& l) { return l.profile; });
+
+        const auto step = [](ConnectionProfile p, int by)
+        {
+            return static_cast<ConnectionProfile>(static_cast<int>(p) + by);
+        };
+
+        const auto fits_slower = [&](const LinkLoad& l, ConnectionProfile p, double ratio)
+        {
+            return p != ConnectionProfile::power && !l.starved
+                   && l.eventsPerSecond < ratio * getCapacity(step(p, -1));
+        };
+
+        std::vector<size_t> raises;
+
+        for (size_t i = 0; i < links.size(); ++i)
+        {
+            const auto& l = links[i];
+
+            if (!l.connected || !l.settled)
+                continue;
+
+            if (fits_slower(l, l.profile, settings.lowerBelow))
+                wanted[i] = step(l.profile, -1);
+            else if (l.profile != ConnectionProfile::throughput && l.backlog < settings.backlogLimit
+                     && (l.starved || l.eventsPerSecond > settings.raiseAbove * getCapacity(l.profile)))
+                raises.push_back(i);
+        }
+
+        std::sort(raises.begin(), raises.end(), [&](size_t a, size_t b)
+        {
+            if (links[a].starved != links[b].starved)
+                return links[a].starved;
+
+            return links[a].eventsPerSecond / getCapacity(links[a].profile)
+                 > links[b].eventsPerSecond / getCapacity(links[b].profile);
+        });
+
+        auto used = std::accumulate(links.begin(), links.end(), 0.0, [this](double sum, const LinkLoad& l)
+        {
+            return l.connected ? sum + getConnectionEventRate(l.profile) : sum;
+        });
+
+        for (size_t i = 0; i < links.size(); ++i)
+            used -= getConnectionEventRate(links[i].profile) - getConnectionEventRate(wanted[i]);
+
+        for (const auto i : raises)
+        {
+            const auto faster = step(wanted[i], 1);
+            const auto extra  = getConnectionEventRate(faster) - getConnectionEventRate(wanted[i]);
+
+            // Over budget: slow down whichever settled links would be least squeezed by it, if that makes room
+            auto slowed = std::vector<ConnectionProfile>(wanted.begin(), wanted.end());
+            auto freed  = 0.0;
+
+            while (used - freed + extra > settings.connectionEventBudget)
+            {
+                auto donor = links.size();
+
+                for (size_t j = 0; j < links.size(); ++j)
+                {
+                    if (j == i || !links[j].connected || !links[j].settled || slowed[j] != links[j].profile
+                        || !fits_slower(links[j], slowed[j], settings.raiseAbove)
+                        || std::find(raises.begin(), raises.end(), j) != raises.end())
+                        continue;
+
+                    if (donor == links.size() || load(links[j], slowed[j]) < load(links[donor], slowed[donor]))
+                        donor = j;
+                }
+
+                if (donor == links.size())
+                    break;
+
+                freed         += getConnectionEventRate(slowed[donor]) - getConnectionEventRate(step(slowed[donor], -1));
+                slowed[donor]  = step(slowed[donor], -1);
+            }
+
+            if (used - freed + extra <= settings.connectionEventBudget)
+            {
+                std::copy(slowed.begin(), slowed.end(), wanted.begin());
+                used      += extra - freed;
+                wanted[i]  = faster;
+            }
+        }
+    }
+
+private:
+    /** How full the link would be a step slower. */
+    double load(const LinkLoad& l, ConnectionProfile p) const
+    {
+        return l.eventsPerSecond / getCapacity(static_cast<ConnectionProfile>(static_cast<int>(p) - 1));
+    }
+
+    const ConnectionSettings settings;
+};
+
+//======================================================================================================================
+/** A profile change the ConnectionManager made, with what the link carried before it and once it had settled. */
+struct ConnectionChange
+{
+    int64_t           hostTime = 0;
+    DeviceHandle      device   = invalidDeviceHandle;
+    ConnectionProfile from     = ConnectionProfile::balanced, to = ConnectionProfile::balanced;
+    double            eventsPerSecondBefore = 0.0, eventsPerSecondAfter = 0.0;
+};
+
+//======================================================================================================================
+/**
+    Balances the radio's time across the BLE links: every tick it measures each connected device's rate (from a
+    FairnessAnalyzer) and consumer backlog (from its channels), asks a ConnectionPolicy what each link's connection
+    profile should be, and requests the changes from the devices' BlePacketSources.
+
+    Every change is logged, once the link has had settleSeconds to show what it made of it, with the rate before and
+    after; drainChanges() hands those out. A source that can't take requests at all (an older platform) is left
+    alone until it's replaced. A new source, i.e. a (re)connect, starts over from balanced, which is what a new
+    connection gets, and is left alone for settleSeconds too. Sources are told apart by the registry's connection
+    count rather than their address, since a reconnect's source is often allocated where the old one was.
+
+    Has no thread of its own: update() is called by whoever owns the registry's sources, with whatever guards them
+    held, and does nothing until the next tick is due.
+*/
+class ConnectionManager
+{
+public:
+    ConnectionManager(DeviceRegistry& deviceRegistry, const FairnessAnalyzer& fairnessAnalyzer,
+                      ConnectionSettings settings = {})
+            : registry(deviceRegistry),
+              fairness(fairnessAnalyzer),
+              policy(settings),
+              links(deviceRegistry.getCapacity()),
+              loads(links.size()),
+              wanted(links.size())
+    {
+    }
+
+    void update(int64_t now = hostNanos())
+    {
+        if (now < nextTick)
+            return;
+
+        const auto& settings = policy.getSettings();
+        const auto  settle   = static_cast<int64_t>(settings.settleSeconds * 1.0e9);
+        const auto  n        = registry.size();
+
+        nextTick = now + static_cast<int64_t>(settings.tickIntervalSeconds * 1.0e9);
+
+        for (DeviceHandle h = 0; h < n; ++h)
+        {
+            auto&       link       = links[h];
+            const auto* source     = registry.bleSources[h].get();
+            const auto  connection = source != nullptr ? registry.bleConnections[h] : 0u;
+
+            // A new connection isn't judged before its rates have had time to build up
+            if (connection != link.connection)
+                link = {connection, ConnectionProfile::balanced, true, now + settle, std::nullopt};
+
+            const auto midi = fairness.getRates(h, StreamKind::midi);
+            const auto ble  = fairness.getRates(h, StreamKind::ble);
+
+            auto& l           = loads[h];
+            l.eventsPerSecond = midi.eventsPerSecond + ble.eventsPerSecond;
+            l.starved         = midi.starved || ble.starved;
+            l.profile         = link.profile;
+            l.connected       = source != nullptr;
+            l.settled         = link.managed && now >= link.settledAt;
+            l.backlog         = backlog(*registry.midiChannels[h]) + backlog(*registry.bleChannels[h]);
+
+            if (l.connected && l.settled && link.pending.has_value())
+            {
+                link.pending->eventsPerSecondAfter = l.eventsPerSecond;
+                changes.push_back(*link.pending);
+                link.pending.reset();
+            }
+        }
+
+        policy.decide({loads.data(), n}, {wanted.data(), n});
+
+        for (DeviceHandle h = 0; h < n; ++h)
+        {
+            auto& link = links[h];
+
+            if (wanted[h] == link.profile)
+                continue;
+
+            if (!registry.bleSources[h]->requestConnectionProfile(wanted[h]))
+            {
+                DBG("Connection parameters can't be requested for " << registry.names[h]);
+                link.managed = false;
+                continue;
+            }
+
+            link.pending   = ConnectionChange{now, h, link.profile, wanted[h], loads[h].eventsPerSecond, 0.0};
+            link.profile   = wanted[h];
+            link.settledAt = now + settle;
+            ++numRequests;
+        }
+    }
+
+    //==================================================================================================================
+    /** What was last asked for, for the device's current source. */
+    [[nodiscard]] ConnectionProfile getProfile(DeviceHandle h) const { return links[h].profile; }
+
+    /** Changes whose effect has been measured since the last call. */
+    template<typename Fn>
+    size_t drainChanges(Fn&& fn)
+    {
+        for (const auto& c : changes)
+            fn(c);
+
+        const auto n = changes.size();
+        changes.clear();
+        return n;
+    }
+
+    [[nodiscard]] uint64_t getRequestCount() const { return numRequests; }
+
+    [[nodiscard]] const ConnectionPolicy& getPolicy() const { return policy; }
+
+    static const char* getName(ConnectionProfile p)
+    {
+        switch (p)
+        {
+            case ConnectionProfile::power:      return "power";
+            case ConnectionProfile::throughput: return "throughput";
+            case ConnectionProfile::balanced:   break;
+        }
+
+        return "balanced";
+    }
+
+private:
+    struct Link
+    {
+        uint32_t                        connection = 0; // DeviceRegistry::bleConnections, 0 while disconnected
+        ConnectionProfile               profile    = ConnectionProfile::balanced;
+        bool                            managed    = true;
+        int64_t                         settledAt  = 0;
+        std::optional<ConnectionChange> pending;
+    };
+
+    template<typename Channel>
+    static uint64_t backlog(const Channel& c)
+    {
+        const auto consumed = c.getConsumedCount();
+        const auto received = c.getReceivedCount();
+        return received > consumed ? received - consumed : 0;
+    }
+
+    DeviceRegistry&         registry;
+    const FairnessAnalyzer& fairness;
+    const ConnectionPolicy  policy;
+
+    std::vector<Link>              links;
+    std::vector<LinkLoad>          loads;
+    std::vector<ConnectionProfile> wanted;
+    std::vector<ConnectionChange>  changes;
+
+    int64_t  nextTick    = 0;
+    uint64_t numRequests = 0;
+};
+} // namespace Ingest
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "BleMidi.h"
+#include "Guid128.h"
+#include "IngestChannel.h"
+
+//======================================================================================================================
+namespace Ingest {
+
+/** How the characteristic's values are pushed to us. */
+enum class GattDelivery : uint8_t
+{
+    notify,
+    indicate
+};
+
+/** What a characteristic's values hold, which decides how they're handled on the way into the BleChannel. */
+enum class PayloadFormat : uint8_t
+{
+    raw,    // opaque; stamped with the platform's receive time
+    bleMidi // BLE-MIDI packets; stamped with the device's own clock
+};
+
+/** A kind of peripheral we know how to read: the service and characteristic to subscribe to, and what they carry. */
+struct DeviceProfile
+{
+    Guid128       service, characteristic;
+    GattDelivery  delivery     = GattDelivery::notify;
+    PayloadFormat format       = PayloadFormat::raw;
+    double        expectedRate = 0.0; // values per second a busy device sends, which the link must carry; 0 if unknown
+};
+
+//======================================================================================================================
+/**
+    Every peripheral the app can read, in the order they're preferred if a device has more than one of their
+    services.
+
+    Adding hardware means adding a line here (and a PayloadHandler, for a new format); discovery only ever goes
+    through findDeviceProfile().
+
+    The standard BLE-MIDI service isn't here on purpose. The system's BLE-MIDI driver already reads it, and the
+    device's messages reach the app through its MIDI port; subscribing to it as well would make a second GATT client
+    next to the driver's, for packets the app already has.
+*/
+inline constexpr DeviceProfile deviceProfiles[] = {
+        {Guid128::fromString("65e9296c-8dfb-11ea-bc55-0242ac130003"),
+         Guid128::fromString("65e92bb0-8dfb-11ea-bc55-0242ac130003"),
+         GattDelivery::notify, PayloadFormat::raw, 0.0},
+        {Guid128::fromString("0e5a1523-ede8-4b33-a751-6ce34ec47c00"),
+         Guid128::fromString("0e5a1525-ede8-4b33-a751-6ce34ec47c00"),
+         GattDelivery::notify, PayloadFormat::raw, 0.0},
+};
+
+constexpr size_t numDeviceProfiles = std::size(deviceProfiles);
+
+/** The index in deviceProfiles of the profile for a service, or -1. */
+constexpr int findDeviceProfile(const Guid128& service)
+{
+    for (size_t i = 0; i < numDeviceProfiles; ++i)
+        if (deviceProfiles[i].service == service)
+            return static_cast<int>(i);
+
+    return -1;
+}
+
+static_assert([]
+{
+    for (size_t i = 0; i < numDeviceProfiles; ++i)
+        if (findDeviceProfile(deviceProfiles[i].service) != static_cast<int>(i))
+            return false;
+
+    return true;
+}(), "two device profiles share a service");
+
+//======================================================================================================================
+/**
+    Takes one characteristic's values into its BleChannel, on the notification callback. There's one specialisation
+    per PayloadFormat, and withPayloadHandler() picks it once, at subscription time, so the callback itself never
+    looks at the format.
+*/
+template<PayloadFormat Format>
+class PayloadHandler;
+
+template<>
+class PayloadHandler<PayloadFormat::raw>
+{
+public:
+    void operator()(BleChannel& channel, std::span<const uint8_t> value, int64_t hostTime, int64_t platformTime)
+    {
+        channel.push(value.data(), value.size(), hostTime, platformTime);
+    }
+};
+
+/**
+    For a characteristic whose values are framed as BLE-MIDI packets: a timestamp source, not a MIDI one. Decodes
+    each packet only to find the device's timestamp of its first message, which gives the channel's delivery latency
+    the device's clock rather than the platform's. The packet itself goes in as it came; a packet that completes no
+    message (a SysEx continuation, or a malformed one) goes in without a device time.
+
+    The decoded messages are dropped: MIDI reaches the app through MIDI ports only, each with the one producer thread
+    its MidiChannel allows. Every packet is still decoded in full, since the decoder needs the running status,
+    timestamp and any SysEx in progress to read the next one.
+*/
+template<>
+class PayloadHandler<PayloadFormat::bleMidi>
+{
+public:
+    void operator()(BleChannel& channel, std::span<const uint8_t> value, int64_t hostTime, int64_t)
+    {
+        auto device_time = noDeviceTime;
+
+        decoder.decode(value, hostTime, [&](std::span<const uint8_t>, int64_t t)
+        {
+            if (device_time == noDeviceTime)
+                device_time = t;
+        });
+
+        channel.push(value.data(), value.size(), hostTime, device_time);
+    }
+
+private:
+    BleMidi::Decoder decoder;
+};
+
+/** Calls fn.template operator()<Format>() for the profile's format. */
+template<typename Fn>
+decltype(auto) withPayloadHandler(PayloadFormat format, Fn&& fn)
+{
+    switch (format)
+    {
+        case PayloadFormat::bleMidi: return fn.template operator()<PayloadFormat::bleMidi>();
+        case PayloadFormat::raw:     break;
+    }
+
+    return fn.template operator()<PayloadFormat::raw>();
+}
+} // namespace Ingest
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "IngestSource.h"
+
+#include <unordered_map>
+
+//======================================================================================================================
+namespace Ingest {
+
+/** A dense index for one physical device (one ContainerId), stable for the lifetime of the registry. */
+using DeviceHandle = uint16_t;
+
+constexpr DeviceHandle invalidDeviceHandle = std::numeric_limits<DeviceHandle>::max();
+
+/**
+    Where a device's MIDI input port is in its life.
+
+    absent      no port is known (yet, or any more)
+    discovered  the watcher has reported the port, nothing is open
+    opening     an open has been issued and hasn't completed
+    open        the backend has reported the port open
+    closing     the source is being torn down
+*/
+enum class PortState : uint8_t
+{
+    absent,
+    discovered,
+    opening,
+    open,
+    closing
+};
+
+//======================================================================================================================
+/**
+    Everything known about each physical device, in flat columns indexed by DeviceHandle.
+
+    A device is given the next handle the first time any watcher reports its ContainerId, and keeps it even if it
+    disappears and comes back, so its channels (and their counts) survive reconnects. The channels are created right
+    there, at discovery time, with the handle as their source index. Every column is sized to the fixed capacity at
+    construction, so a handle lookup is a plain index and the columns never move underneath a reader.
+
+    Each MIDI port's PortState lives here as well, though the registry only sets the ends of its life (discovered and
+    absent); the owner, which has the backend, drives the transitions in between.
+
+    The String-keyed maps are only consulted when a watcher reports a platform id, never per event or per repaint.
+    The registry does no locking of its own: its owner serialises changes (and reads that need a consistent view).
+    The exception is draining, which only needs size() and the channels, and can happen on any one thread.
+*/
+class DeviceRegistry
+{
+public:
+    explicit DeviceRegistry(size_t capacity = 64, ChannelListener* channelListener = nullptr,
+                            size_t midiRingSize = 4096, size_t blePoolSize = 1024)
+            : containerIds(capacity),
+              names(capacity),
+              midiPortIds(capacity),
+              bleDeviceIds(capacity),
+              midiEnabled(capacity, false),
+              bleConnected(capacity, false),
+              midiStates(capacity, PortState::absent),
+              midiOpenIssued(capacity, 0),
+              midiOpenCompleted(capacity, 0),
+              bleConnectIssued(capacity, 0),
+              bleConnections(capacity, 0),
+              midiChannels(capacity),
+              bleChannels(capacity),
+              midiSources(capacity),
+              bleSources(capacity),
+              listener(channelListener),
+              midiRingCapacity(midiRingSize),
+              blePoolCapacity(blePoolSize)
+    {
+        jassert(capacity < invalidDeviceHandle);
+    }
+
+    //==================================================================================================================
+    /** Returns the device's handle, assigning the next free one the first time a ContainerId is seen. */
+    DeviceHandle intern(const String& containerId)
+    {
+        if (const auto h = find(byContainerId, containerId); h != invalidDeviceHandle)
+            return h;
+
+        if (size() == containerIds.size())
+        {
+            jassertfalse; // out of slots; construct the registry with a larger capacity
+            return invalidDeviceHandle;
+        }
+
+        const auto h = static_cast<DeviceHandle>(numDevices.load(std::memory_order_relaxed));
+        containerIds[h] = containerId;
+        byContainerId.emplace(containerId, h);
+
+        midiChannels[h] = std::make_shared<MidiChannel>(h, midiRingCapacity);
+        bleChannels[h]  = std::make_shared<BleChannel>(h, blePoolCapacity);
+        midiChannels[h]->setListener(listener);
+        bleChannels[h]->setListener(listener);
+
+        for (int r = 1; r < maxReaders; ++r)
+        {
+            if (const auto& sub = subscribers[static_cast<size_t>(r)]; sub.has_value())
+            {
+                midiChannels[h]->subscribe(r, sub->delivery, sub->listener);
+                bleChannels[h]->subscribe(r, sub->delivery, sub->listener);
+            }
+        }
+
+        numDevices.store(h + 1u, std::memory_order_release);
+        return h;
+    }
+
+    [[nodiscard]] DeviceHandle findByContainerId(const String& id) const { return find(byContainerId, id); }
+    [[nodiscard]] DeviceHandle findByMidiPortId(const String& id) const { return find(byMidiPortId, id); }
+    [[nodiscard]] DeviceHandle findByBleDeviceId(const String& id) const { return find(byBleDeviceId, id); }
+
+    //==================================================================================================================
+    void setMidiPort(DeviceHandle h, const String& portId, const String& name, bool isEnabled)
+    {
+        clearMidiPort(h);
+
+        midiPortIds[h] = portId;
+        names[h]       = name;
+        midiEnabled[h] = isEnabled;
+        midiStates[h]  = PortState::discovered;
+        byMidiPortId.emplace(portId, h);
+    }
+
+    /** The port's source must have been closed already. */
+    void clearMidiPort(DeviceHandle h)
+    {
+        jassert(midiSources[h] == nullptr);
+
+        byMidiPortId.erase(midiPortIds[h]);
+        midiPortIds[h] = {};
+        midiEnabled[h] = false;
+        midiStates[h]  = PortState::absent;
+    }
+
+    void setBleDevice(DeviceHandle h, const String& deviceId, bool isConnected)
+    {
+        clearBleDevice(h);
+
+        bleDeviceIds[h] = deviceId;
+        bleConnected[h] = isConnected;
+        byBleDeviceId.emplace(deviceId, h);
+    }
+
+    void clearBleDevice(DeviceHandle h)
+    {
+        byBleDeviceId.erase(bleDeviceIds[h]);
+        bleDeviceIds[h] = {};
+        bleConnected[h] = false;
+    }
+
+    //==================================================================================================================
+    /**
+        Opens another reader on every device's channels, including those of devices discovered later, and returns its
+        index for the channels' read(); -1 if they're all taken. Only while no source is attached, like the channels'
+        own subscribe().
+    */
+    int subscribe(Delivery delivery, ChannelListener* l)
+    {
+        for (int r = 1; r < maxReaders; ++r)
+        {
+            auto& sub = subscribers[static_cast<size_t>(r)];
+
+            if (sub.has_value())
+                continue;
+
+            sub = Subscriber{delivery, l};
+
+            for (DeviceHandle h = 0; h < size(); ++h)
+            {
+                midiChannels[h]->subscribe(r, delivery, l);
+                bleChannels[h]->subscribe(r, delivery, l);
+            }
+
+            return r;
+        }
+
+        jassertfalse; // every reader is taken
+        return -1;
+    }
+
+    /** Only while no source is attached. */
+    void unsubscribe(int reader)
+    {
+        subscribers[static_cast<size_t>(reader)].reset();
+
+        for (DeviceHandle h = 0; h < size(); ++h)
+        {
+            midiChannels[h]->unsubscribe(reader);
+            bleChannels[h]->unsubscribe(reader);
+        }
+    }
+
+    //==================================================================================================================
+    /** Safe from any thread: the channels of every handle below size() exist and are never replaced. */
+    [[nodiscard]] size_t size() const { return numDevices.load(std::memory_order_acquire); }
+    [[nodiscard]] size_t getCapacity() const { return containerIds.size(); }
+
+    [[nodiscard]] bool hasMidiPort(DeviceHandle h) const { return midiPortIds[h].isNotEmpty(); }
+    [[nodiscard]] bool hasBleDevice(DeviceHandle h) const { return bleDeviceIds[h].isNotEmpty(); }
+
+    /** Nanoseconds from issuing the port's open to its first message, if both have happened. */
+    [[nodiscard]] auto getTimeToFirstMessage(DeviceHandle h) const -> std::optional<int64_t>
+    {
+        const auto first = midiChannels[h] != nullptr ? midiChannels[h]->getFirstArrivalTime() : 0;
+
+        if (midiOpenIssued[h] == 0 || first == 0)
+            return std::nullopt;
+
+        return first - midiOpenIssued[h];
+    }
+
+    /** Nanoseconds from issuing the BLE connect to the first notification, if both have happened. */
+    [[nodiscard]] auto getTimeToFirstPacket(DeviceHandle h) const -> std::optional<int64_t>
+    {
+        const auto first = bleChannels[h] != nullptr ? bleChannels[h]->getFirstArrivalTime() : 0;
+
+        if (bleConnectIssued[h] == 0 || first == 0)
+            return std::nullopt;
+
+        return first - bleConnectIssued[h];
+    }
+
+    //==================================================================================================================
+    std::vector<String> containerIds, names, midiPortIds, bleDeviceIds;
+    std::vector<bool>   midiEnabled, bleConnected; // as the watchers last reported them
+
+    std::vector<PortState> midiStates;
+    std::vector<int64_t>   midiOpenIssued, midiOpenCompleted; // hostNanos(), 0 until it happens
+    std::vector<int64_t>   bleConnectIssued;
+    std::vector<uint32_t>  bleConnections; // bumped for every new BLE source, which may reuse the last one's address
+
+    std::vector<std::shared_ptr<MidiChannel>> midiChannels;
+    std::vector<std::shared_ptr<BleChannel>>  bleChannels;
+
+    std::vector<std::unique_ptr<MidiSource>>      midiSources;
+    std::vector<std::unique_ptr<BlePacketSource>> bleSources;
+
+private:
+    static constexpr int maxReaders = BroadcastRing<MidiEvent>::maxReaders;
+
+    struct Subscriber
+    {
+        Delivery         delivery;
+        ChannelListener* listener;
+    };
+
+    struct StringHash
+    {
+        size_t operator()(const String& s) const { return static_cast<size_t>(s.hashCode64()); }
+    };
+
+    using Index = std::unordered_map<String, DeviceHandle, StringHash>;
+
+    static DeviceHandle find(const Index& index, const String& id)
+    {
+        const auto it = index.find(id);
+        return it == index.end() ? invalidDeviceHandle : it->second;
+    }
+
+    ChannelListener* const listener;
+    const size_t           midiRingCapacity, blePoolCapacity;
+
+    std::atomic<size_t> numDevices{0};
+    Index               byContainerId, byMidiPortId, byBleDeviceId;
+
+    std::array<std::optional<Subscriber>, maxReaders> subscribers; // reader 0 is the listener's
+};
+} // namespace Ingest
@@ -0,0 +1,447 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "DeviceRegistry.h"
+#include "Tracer.h"
+
+#include <unordered_map>
+
+//======================================================================================================================
+namespace Ingest {
+
+enum class DeviceEventKind : uint8_t
+{
+    midiAdded,
+    midiUpdated,
+    midiRemoved,
+    bleAdded,
+    bleUpdated,
+    bleRemoved,
+    midiOpened,          // a MidiSource has finished opening, successfully or not
+    enumerationCompleted // a watcher has reported everything that was there when it started, or has stopped
+};
+
+/** A device watcher's (or the backend's) notification, with the properties it carried already read out. */
+struct DeviceEvent
+{
+    DeviceEventKind     kind        = DeviceEventKind::midiAdded;
+    String              id          = {};      // port or device id; ContainerId (midiOpened); watcher (enumeration)
+    String              containerId = {};      // added events only
+    String              name        = {};
+    std::optional<bool> flag        = {};      // enabled (MIDI), connected (BLE) or succeeded (midiOpened), if reported
+    const MidiSource*   source      = nullptr; // midiOpened only
+};
+
+//======================================================================================================================
+/**
+    Keeps a DeviceRegistry in step with the device watchers, opening each device's MIDI port and connecting its BLE
+    device as they come and go.
+
+    The watchers only post() what they saw; everything is applied on the table's own thread, in batches that take
+    the registry's lock once. A burst, such as a link that keeps dropping and coming back, ends up in one batch, and
+    of its updates to a port or device only the last disconnect and the last reconnect are applied. The initial
+    enumeration is held back until every watcher has reported EnumerationCompleted, or Stopped if it gave up or was
+    aborted before getting that far, and then applied as a single batch; getTimeToPopulate() says how long that took
+    from start().
+
+    The table is its sources' SourceListener, so the backend's open completions come through the same queue, and
+    the table's thread is the only one that changes the registry while it runs.
+*/
+class DeviceTable : private Thread,
+                    private SourceListener
+{
+public:
+    DeviceTable(DeviceRegistry& deviceRegistry, Backend& deviceBackend, CriticalSection& registryLock,
+                int numWatchers, int batchMillis = 10)
+            : Thread("Device table"),
+              registry(deviceRegistry),
+              backend(deviceBackend),
+              lock(registryLock),
+              watchers(numWatchers),
+              gatherMillis(batchMillis)
+    {
+    }
+
+    ~DeviceTable() override { stop(); }
+
+    void start()
+    {
+        startTime = hostNanos();
+        startThread();
+    }
+
+    /** Anything still queued is dropped. */
+    void stop() { stopThread(1000); }
+
+    /** Any thread. */
+    void post(DeviceEvent e)
+    {
+        {
+            const ScopedLock sl(queueLock);
+            pending.push_back(std::move(e));
+        }
+
+        notify();
+    }
+
+    /** Once the table has stopped: closes every source. */
+    void closeAll()
+    {
+        const ScopedLock sl(lock);
+
+        for (DeviceHandle h = 0; h < registry.size(); ++h)
+        {
+            closeMidiPort(h);
+            registry.bleSources[h].reset();
+        }
+    }
+
+    /**
+        Applies a single event on the calling thread, taking the lock just for it, which is how the watchers'
+        callbacks used to do it. For comparison only; it bypasses the queue, and the enumeration isn't held back.
+    */
+    void applyDirectly(const DeviceEvent& e) { apply({&e, 1}); }
+
+    //==================================================================================================================
+    /** Bumped whenever a port opens or closes. */
+    [[nodiscard]] uint64_t getVersion() const { return version.load(std::memory_order_acquire); }
+
+    /** Nanoseconds from start() to the initial enumeration having been applied, once it has. */
+    [[nodiscard]] auto getTimeToPopulate() const -> std::optional<int64_t>
+    {
+        const auto t = populatedTime.load(std::memory_order_acquire);
+        return t == 0 ? std::nullopt : std::optional(t - startTime);
+    }
+
+    [[nodiscard]] uint64_t getBatchCount() const { return batches.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t getAppliedCount() const { return applied.load(std::memory_order_relaxed); }
+
+    /** Updates that a later update reporting the same state of the same port or device in the batch made pointless. */
+    [[nodiscard]] uint64_t getCoalescedCount() const { return coalesced.load(std::memory_order_relaxed); }
+
+private:
+    //==================================================================================================================
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            wait(-1);
+
+            if (threadShouldExit())
+                break;
+
+            // Whatever else a burst brings goes into the same batch
+            Thread::sleep(gatherMillis);
+
+            {
+                const ScopedLock sl(queueLock);
+                std::swap(batch, pending);
+            }
+
+            if (!batch.empty())
+                process();
+
+            batch.clear();
+        }
+    }
+
+    void process()
+    {
+        // A watcher that completes and then stops reports twice, so count watchers rather than reports
+        for (const auto& e : batch)
+            if (e.kind == DeviceEventKind::enumerationCompleted)
+                enumerated.addIfNotAlreadyThere(e.id);
+
+        if (populatedTime.load(std::memory_order_relaxed) != 0)
+        {
+            apply(batch);
+            return;
+        }
+
+        std::move(batch.begin(), batch.end(), std::back_inserter(initial));
+
+        if (enumerated.size() < watchers)
+            return;
+
+        apply(initial);
+        populatedTime.store(hostNanos(), std::memory_order_release);
+
+        const auto millis = static_cast<double>(populatedTime.load() - startTime) * 1.0e-6;
+        DBG("Device table populated in " << String(millis, 1) << " ms, " << static_cast<int>(registry.size()) << " devices");
+
+        initial = {};
+    }
+
+    /** Takes the lock once for all of them. */
+    void apply(std::span<const DeviceEvent> events)
+    {
+        const auto skip = findSuperseded(events);
+        const auto dups = std::count(skip.begin(), skip.end(), true);
+        size_t     n    = 0;
+
+        TraceScope             trace(TracePoint::deviceBatch);
+        const TracedScopedLock sl(lock);
+
+        for (size_t i = 0; i < events.size(); ++i)
+        {
+            if (skip[i])
+                continue;
+
+            switch (const auto& e = events[i]; e.kind)
+            {
+                case DeviceEventKind::midiAdded:            midiAdded(e); break;
+                case DeviceEventKind::midiUpdated:          midiUpdated(e); break;
+                case DeviceEventKind::midiRemoved:          midiRemoved(e); break;
+                case DeviceEventKind::bleAdded:             bleAdded(e); break;
+                case DeviceEventKind::bleUpdated:           bleUpdated(e); break;
+                case DeviceEventKind::bleRemoved:           bleRemoved(e); break;
+                case DeviceEventKind::midiOpened:           midiOpened(e); break;
+                case DeviceEventKind::enumerationCompleted: continue;
+            }
+
+            ++n;
+        }
+
+        trace.setArgs(static_cast<int64_t>(n), dups);
+
+        batches.fetch_add(1, std::memory_order_relaxed);
+        applied.fetch_add(n, std::memory_order_relaxed);
+        coalesced.fetch_add(static_cast<uint64_t>(dups), std::memory_order_relaxed);
+    }
+
+    /**
+        An update is superseded by a later one of the same kind and id that reports the same state, unless the id is
+        added or removed in between. Updates reporting the other state are never folded into each other: a
+        disconnect followed by a reconnect has to close and reopen, even though it ends where it started.
+    */
+    static std::vector<bool> findSuperseded(std::span<const DeviceEvent> events)
+    {
+        struct StringHash
+        {
+            size_t operator()(const String& s) const { return static_cast<size_t>(s.hashCode64()); }
+        };
+
+        // By id: the kind of the next event, and the states the updates from there on up to an add or remove report
+        struct Later
+        {
+            DeviceEventKind kind;
+            bool            reportsOn = false, reportsOff = false;
+        };
+
+        std::vector<bool>                             skip(events.size(), false);
+        std::unordered_map<String, Later, StringHash> later;
+
+        for (auto i = events.size(); i-- > 0;)
+        {
+            const auto& e = events[i];
+
+            const auto update = e.kind == DeviceEventKind::midiUpdated || e.kind == DeviceEventKind::bleUpdated;
+
+            // Updates that don't carry the property are no-ops, and the rest have no watcher id to go by
+            if ((update && !e.flag.has_value())
+                || e.kind == DeviceEventKind::enumerationCompleted || e.kind == DeviceEventKind::midiOpened)
+                continue;
+
+            auto [it, inserted] = later.try_emplace(e.id, Later{e.kind});
+            auto& l             = it->second;
+
+            if (!update || inserted || l.kind != e.kind)
+            {
+                l = {e.kind};
+            }
+            else if (*e.flag ? l.reportsOn : l.reportsOff)
+            {
+                skip[i] = true;
+                continue;
+            }
+
+            if (update)
+                (*e.flag ? l.reportsOn : l.reportsOff) = true;
+        }
+
+        return skip;
+    }
+
+    //==================================================================================================================
+    void midiAdded(const DeviceEvent& e)
+    {
+        DBG("Added MIDI device: " << e.id << " " << e.containerId << " " << e.name
+                                  << (e.flag.value_or(true) ? "" : " (disabled)"));
+
+        if (const auto h = registry.intern(e.containerId); h != invalidDeviceHandle)
+        {
+            closeMidiPort(h);
+            registry.setMidiPort(h, e.id, e.name, e.flag.value_or(true));
+
+            // A disabled port stays discovered until the watcher reports it enabled
+            if (registry.midiEnabled[h])
+                openMidiPort(h);
+        }
+    }
+
+    void midiUpdated(const DeviceEvent& e)
+    {
+        if (!e.flag.has_value())
+            return;
+
+        if (const auto h = registry.findByMidiPortId(e.id); h != invalidDeviceHandle)
+        {
+            registry.midiEnabled[h] = *e.flag;
+
+            if (*e.flag)
+                openMidiPort(h);
+            else
+                closeMidiPort(h);
+        }
+    }
+
+    void midiRemoved(const DeviceEvent& e)
+    {
+        DBG("Removing MIDI device: " << e.id);
+
+        if (const auto h = registry.findByMidiPortId(e.id); h != invalidDeviceHandle)
+        {
+            closeMidiPort(h);
+            registry.clearMidiPort(h);
+        }
+    }
+
+    void bleAdded(const DeviceEvent& e)
+    {
+        DBG("Adding BLE device: " << e.id << " " << e.containerId << ", name: " << e.name << " "
+                                  << (e.flag.value_or(false) ? "connected" : "disconnected"));
+
+        if (const auto h = registry.intern(e.containerId); h != invalidDeviceHandle)
+            registry.setBleDevice(h, e.id, e.flag.value_or(false));
+    }
+
+    void bleRemoved(const DeviceEvent& e)
+    {
+        DBG("Removing BLE device: " << e.id);
+
+        if (const auto h = registry.findByBleDeviceId(e.id); h != invalidDeviceHandle)
+            registry.clearBleDevice(h);
+    }
+
+    void bleUpdated(const DeviceEvent& e)
+    {
+        if (!e.flag.has_value())
+            return;
+
+        const auto h = registry.findByBleDeviceId(e.id);
+
+        if (h == invalidDeviceHandle || registry.bleConnected[h] == *e.flag)
+            return;
+
+        if (*e.flag)
+        {
+            if (registry.bleSources[h] == nullptr)
+            {
+                registry.bleConnectIssued[h] = hostNanos();
+                ++registry.bleConnections[h];
+                registry.bleChannels[h]->resetFirstArrival();
+                registry.bleSources[h] = backend.connectBleDevice(e.id, registry.bleChannels[h]);
+            }
+
+            // A port the MIDI watcher has reported disabled is left for its midiUpdated to open
+            if (registry.midiEnabled[h])
+                openMidiPort(h);
+        }
+        else if (registry.bleSources[h] != nullptr)
+        {
+            registry.bleSources[h].reset();
+            closeMidiPort(h);
+        }
+
+        registry.bleConnected[h] = *e.flag;
+    }
+
+    void midiOpened(const DeviceEvent& e)
+    {
+        const auto h = registry.findByContainerId(e.id);
+
+        // A source that completes synchronously does so before openMidiPort() has stored it
+        if (h == invalidDeviceHandle
+            || registry.midiStates[h] != PortState::opening
+            || (registry.midiSources[h] != nullptr && registry.midiSources[h].get() != e.source))
+            return;
+
+        const auto succeeded = e.flag.value_or(false);
+
+        registry.midiOpenCompleted[h] = hostNanos();
+        registry.midiStates[h]        = succeeded ? PortState::open : PortState::discovered;
+
+        const auto millis = static_cast<double>(registry.midiOpenCompleted[h] - registry.midiOpenIssued[h]) * 1.0e-6;
+        DBG("Midi device " << registry.names[h] << (succeeded ? " opened in " : " failed to open after ")
+                           << String(millis, 1) << " ms");
+
+        version.fetch_add(1, std::memory_order_release);
+    }
+
+    //==================================================================================================================
+    /** Issues the open straight away if the port is known and idle; the backend reports back in midiSourceOpened(). */
+    void openMidiPort(DeviceHandle h)
+    {
+        if (registry.midiStates[h] != PortState::discovered)
+            return;
+
+        DBG("Opening midi device: " << registry.containerIds[h] << " " << registry.names[h]);
+
+        registry.midiStates[h]        = PortState::opening;
+        registry.midiOpenIssued[h]    = hostNanos();
+        registry.midiOpenCompleted[h] = 0;
+        registry.midiChannels[h]->resetFirstArrival();
+
+        auto source = backend.openMidiInput(registry.containerIds[h], registry.midiPortIds[h],
+                                            registry.midiChannels[h], this);
+
+        if (source == nullptr)
+            registry.midiStates[h] = PortState::discovered;
+
+        registry.midiSources[h] = std::move(source);
+    }
+
+    void closeMidiPort(DeviceHandle h)
+    {
+        if (registry.midiSources[h] == nullptr)
+            return;
+
+        DBG("Closing midi device: " << registry.containerIds[h]);
+
+        registry.midiStates[h] = PortState::closing;
+        registry.midiSources[h].reset();
+        registry.midiStates[h] = PortState::discovered;
+
+        version.fetch_add(1, std::memory_order_release);
+    }
+
+    void midiSourceOpened(const MidiSource& source, bool succeeded) override
+    {
+        DeviceEvent e;
+        e.kind   = DeviceEventKind::midiOpened;
+        e.id     = source.getIdentifier();
+        e.flag   = succeeded;
+        e.source = &source;
+        post(std::move(e));
+    }
+
+    //==================================================================================================================
+    DeviceRegistry&  registry;
+    Backend&         backend;
+    CriticalSection& lock;
+    const int        watchers;
+    const int        gatherMillis;
+
+    CriticalSection          queueLock;
+    std::vector<DeviceEvent> pending;
+
+    // Table thread only
+    std::vector<DeviceEvent> batch, initial;
+    StringArray              enumerated; // the watchers that have completed or stopped
+
+    int64_t               startTime = 0;
+    std::atomic<int64_t>  populatedTime{0};
+    std::atomic<uint64_t> version{0}, batches{0}, applied{0}, coalesced{0};
+};
+} // namespace Ingest
@@ -0,0 +1,409 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "FairnessAnalyzer.h"
+#include "IngestConsumer.h"
+
+#include <array>
+
+//======================================================================================================================
+namespace Ingest {
+
+/**
+    Relates one device's clock to hostNanos(), so its events can be put on the host's time line by their own
+    timestamps rather than by when they happened to arrive.
+
+    An event's host-minus-device difference is the clocks' offset plus however long the event took to get here,
+    which is never negative. So the smallest difference seen over a stretch of time is the best estimate of the offset
+    during it, plus the shortest possible trip. The smallest one of every period of device time is kept, and a line
+    is fitted through the last numPeriods of them, which follows the drift between the two clocks (a BLE peripheral's
+    sleep clock is allowed to be off by hundreds of ppm). Until two periods are in, the smallest difference so far
+    stands in.
+
+    toHostTime() is never later than the event's own host time: it can't have happened after it arrived.
+*/
+class ClockEstimator
+{
+public:
+    static constexpr size_t numPeriods = 16;
+
+    explicit ClockEstimator(int64_t periodNanos = 1'000'000'000) : period(periodNanos) {}
+
+    /** Feeds an event and returns where it goes on the host's time line. */
+    int64_t toHostTime(int64_t hostTime, int64_t deviceTime)
+    {
+        const auto difference = hostTime - deviceTime;
+
+        if (!started)
+        {
+            origin  = periodStart = deviceTime;
+            started = true;
+        }
+
+        if (difference < periodMinimum)
+        {
+            periodMinimum  = difference;
+            periodMinimumX = deviceTime - origin;
+        }
+
+        lowest = std::min(lowest, difference);
+
+        if (deviceTime - periodStart >= period)
+        {
+            points[numPoints++ % numPeriods] = {static_cast<double>(periodMinimumX),
+                                                static_cast<double>(periodMinimum)};
+            periodStart   = deviceTime;
+            periodMinimum = noMinimum;
+            fit();
+        }
+
+        const auto x      = static_cast<double>(deviceTime - origin);
+        const auto offset = numPoints >= 2 ? static_cast<int64_t>(intercept + slope * x) : lowest;
+
+        return std::min(hostTime, deviceTime + offset);
+    }
+
+    /** How much faster the device's clock runs than the host's, in ppm; 0 until there's enough to tell. */
+    [[nodiscard]] double getDriftPpm() const { return numPoints >= 2 ? -slope * 1.0e6 : 0.0; }
+
+private:
+    static constexpr int64_t noMinimum = std::numeric_limits<int64_t>::max();
+
+    struct Point
+    {
+        double x = 0.0, y = 0.0;
+    };
+
+    /** Least squares over the kept minima, relative to their means so the sums stay well conditioned. */
+    void fit()
+    {
+        const auto n = std::min(numPoints, numPeriods);
+
+        double mean_x = 0.0, mean_y = 0.0;
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            mean_x += points[i].x;
+            mean_y += points[i].y;
+        }
+
+        mean_x /= static_cast<double>(n);
+        mean_y /= static_cast<double>(n);
+
+        double sxx = 0.0, sxy = 0.0;
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            sxx += (points[i].x - mean_x) * (points[i].x - mean_x);
+            sxy += (points[i].x - mean_x) * (points[i].y - mean_y);
+        }
+
+        slope     = sxx > 0.0 ? sxy / sxx : 0.0;
+        intercept = mean_y - slope * mean_x;
+    }
+
+    int64_t period;
+    bool    started = false;
+    int64_t origin = 0, periodStart = 0;
+    int64_t periodMinimum = noMinimum, periodMinimumX = 0;
+    int64_t lowest        = noMinimum;
+
+    std::array<Point, numPeriods> points{};
+    size_t                        numPoints = 0;
+    double                        slope = 0.0, intercept = 0.0;
+};
+
+//======================================================================================================================
+struct MergeSettings
+{
+    int64_t reorderWindow   = 10'000'000;    // how long an event is held back for earlier ones from other devices
+    size_t  eventsPerDevice = 1024;          // held back at most, per device
+    size_t  bytesPerDevice  = 64 * 1024;     // of payload held back at most, per device
+    bool    correctClocks   = true;          // order by device timestamps, where there are any, rather than arrival
+    int64_t clockPeriod     = 1'000'000'000; // see ClockEstimator
+};
+
+//======================================================================================================================
+/**
+    Turns every device's events into one stream in time order: an EventSink that holds the events back for the
+    reorder window and passes them on to another EventSink, oldest first, over all devices.
+
+    Each device's MIDI and BLE events are two streams, which arrive through different callbacks and may be stamped
+    by different clocks (or not at all). An event's place in time is its timestamp, put on the host's time line by
+    its stream's ClockEstimator, or its arrival time if it has no timestamp (or correctClocks is off). A stream's own
+    events always keep their order. Every stream has a bounded queue of its own, and a winner tree over the queues'
+    heads finds the oldest in log2(streams) steps, touching one small contiguous array. The window is the trade: an
+    event that turns up more than the window after one from another stream that it should have preceded is passed
+    on late (out of order) and counted. A queue that fills up pushes the oldest events out early, which keeps the
+    order but not the window, and is counted as well.
+
+    Payloads are copied into each stream's own ring, since the channel's copy is gone after the call, so the events
+    passed on (spilled SysEx and BLE packets included) point into the merger; as usual, only for the duration of the
+    call. getCurrentTime() is the merged time line's time of the event being passed on.
+
+    Like any EventSink, it's called from one thread: a Subscription's, or a single-worker IngestConsumer's. Held back
+    events go out as later ones come in, or when drained() says there's nothing more for now, so the Subscription's
+    idle wake-up should be well within the window. flush() sends whatever's left.
+*/
+class EventMerger : public EventSink
+{
+public:
+    EventMerger(EventSink& downstream, size_t numDevices, MergeSettings mergeSettings = {})
+            : sink(downstream),
+              settings(mergeSettings),
+              leaves(static_cast<size_t>(nextPowerOfTwo(static_cast<int>(jmax(size_t{1}, numDevices) * 2)))),
+              keys(leaves, empty),
+              tree(2 * leaves)
+    {
+        for (size_t i = 0; i < numDevices * 2; ++i)
+            queues.push_back(std::make_unique<Queue>(settings));
+
+        for (size_t i = 0; i < leaves; ++i)
+            tree[leaves + i] = static_cast<uint16_t>(i);
+
+        for (auto n = leaves - 1; n > 0; --n)
+            tree[n] = earlier(tree[2 * n], tree[2 * n + 1]);
+    }
+
+    //==================================================================================================================
+    void midiEvent(DeviceHandle device, const MidiEvent& event) override
+    {
+        add(device, StreamKind::midi, event.getBytes(), event.hostTime, event.deviceTime);
+        release(hostNanos());
+    }
+
+    void blePacket(DeviceHandle device, const PacketView& packet) override
+    {
+        add(device, StreamKind::ble, packet.bytes(), packet.hostTime, packet.deviceTime);
+        release(hostNanos());
+    }
+
+    void drained() override { release(hostNanos()); }
+
+    //==================================================================================================================
+    /** Queues an event without passing anything on; release() does that. */
+    void add(DeviceHandle device, StreamKind kind, std::span<const uint8_t> bytes, int64_t hostTime, int64_t deviceTime)
+    {
+        const auto stream = getStream(device, kind);
+        auto&      q      = *queues[stream];
+
+        while (!q.fits(bytes.size()))
+        {
+            if (!q.fitsAtAll(bytes.size()))
+            {
+                ++numOversized;
+                return;
+            }
+
+            ++numForced;
+            pop();
+        }
+
+        auto key = hostTime;
+
+        if (settings.correctClocks && deviceTime != noDeviceTime)
+            key = q.clock.toHostTime(hostTime, deviceTime);
+
+        key = std::max(key, q.lastKey);
+        q.lastKey = key;
+
+        const auto was_empty = q.isEmpty();
+        q.push(key, bytes, hostTime, deviceTime);
+
+        if (was_empty)
+            update(stream, key);
+    }
+
+    /** Passes on everything that has been held back for the window by now, oldest first. */
+    void release(int64_t now)
+    {
+        const auto due = now - settings.reorderWindow;
+
+        while (keys[tree[1]] <= due)
+            pop();
+    }
+
+    /** Passes on everything held back. */
+    void flush()
+    {
+        while (keys[tree[1]] != empty)
+            pop();
+    }
+
+    //==================================================================================================================
+    /**
+        The merged time of the event being passed on; only meaningful inside the downstream sink's call. It never goes
+        backwards: a late event gets the time of the one before it.
+    */
+    [[nodiscard]] int64_t getCurrentTime() const { return currentTime; }
+
+    [[nodiscard]] uint64_t getPassedCount() const { return numPassed; }
+
+    /** Passed on after a later event already had been: they arrived more than the window too late. */
+    [[nodiscard]] uint64_t getLateCount() const { return numLate; }
+
+    /** Pushed out before their window was up, to make room in a full queue. */
+    [[nodiscard]] uint64_t getForcedCount() const { return numForced; }
+
+    /** Dropped because they'd never fit into their stream's payload ring. */
+    [[nodiscard]] uint64_t getOversizedCount() const { return numOversized; }
+
+    [[nodiscard]] size_t getHeldCount() const
+    {
+        size_t n = 0;
+
+        for (const auto& q : queues)
+            n += q->size();
+
+        return n;
+    }
+
+    [[nodiscard]] double getDriftPpm(DeviceHandle device, StreamKind kind) const
+    {
+        return queues[getStream(device, kind)]->clock.getDriftPpm();
+    }
+
+private:
+    static constexpr int64_t empty = std::numeric_limits<int64_t>::max();
+
+    //==================================================================================================================
+    static size_t getStream(DeviceHandle device, StreamKind kind)
+    {
+        return size_t{device} * 2 + static_cast<size_t>(kind);
+    }
+
+    /** One stream's held back events, in order, with their payloads in a byte ring of their own. */
+    struct Queue
+    {
+        struct Entry
+        {
+            int64_t  key = 0, hostTime = 0, deviceTime = noDeviceTime;
+            uint64_t begin = 0;
+            uint32_t size  = 0;
+        };
+
+        explicit Queue(const MergeSettings& s)
+                : entries(static_cast<size_t>(nextPowerOfTwo(static_cast<int>(jmax(size_t{1}, s.eventsPerDevice))))),
+                  bytes(jmax(maxBlePayloadSize, s.bytesPerDevice)),
+                  clock(s.clockPeriod)
+        {
+        }
+
+        [[nodiscard]] bool   isEmpty() const { return head == tail; }
+        [[nodiscard]] size_t size() const { return static_cast<size_t>(tail - head); }
+
+        [[nodiscard]] bool fitsAtAll(size_t n) const { return n <= bytes.size(); }
+
+        [[nodiscard]] bool fits(size_t n) const
+        {
+            return size() < entries.size() && placeFor(n) + n - bytesHead <= bytes.size();
+        }
+
+        void push(int64_t key, std::span<const uint8_t> payload, int64_t hostTime, int64_t deviceTime)
+        {
+            const auto at = placeFor(payload.size());
+
+            std::memcpy(bytes.data() + at % bytes.size(), payload.data(), payload.size());
+            entries[tail++ & (entries.size() - 1)] = {key, hostTime, deviceTime, at,
+                                                      static_cast<uint32_t>(payload.size())};
+            bytesTail = at + payload.size();
+        }
+
+        [[nodiscard]] const Entry& front() const { return entries[head & (entries.size() - 1)]; }
+
+        [[nodiscard]] const uint8_t* getBytes(const Entry& e) const { return bytes.data() + e.begin % bytes.size(); }
+
+        void pop()
+        {
+            bytesHead = front().begin + front().size;
+
+            // Nothing points into an empty ring, so it can start over at the beginning, where anything fits
+            if (++head == tail)
+                bytesHead = bytesTail = 0;
+        }
+
+        /** Where n bytes would go: next in the ring, or at its start if they'd run over its end. */
+        [[nodiscard]] uint64_t placeFor(size_t n) const
+        {
+            const auto offset = bytesTail % bytes.size();
+            return offset + n > bytes.size() ? bytesTail + (bytes.size() - offset) : bytesTail;
+        }
+
+        std::vector<Entry>   entries;
+        std::vector<uint8_t> bytes;
+        uint64_t             head = 0, tail = 0;           // entries
+        uint64_t             bytesHead = 0, bytesTail = 0; // payload bytes, monotonic like the entries
+        int64_t              lastKey = std::numeric_limits<int64_t>::min();
+        ClockEstimator       clock;
+    };
+
+    //==================================================================================================================
+    [[nodiscard]] uint16_t earlier(uint16_t a, uint16_t b) const { return keys[b] < keys[a] ? b : a; }
+
+    /** Replays the matches on the way from a stream's leaf to the root, after its head changed. */
+    void update(size_t stream, int64_t key)
+    {
+        keys[stream] = key;
+
+        for (auto n = (leaves + stream) / 2; n > 0; n /= 2)
+            tree[n] = earlier(tree[2 * n], tree[2 * n + 1]);
+    }
+
+    /** Passes on the oldest event of all. */
+    void pop()
+    {
+        const auto stream = tree[1];
+        const auto device = static_cast<DeviceHandle>(stream / 2);
+        auto&      q      = *queues[stream];
+        const auto e      = q.front();
+        const auto data   = q.getBytes(e);
+
+        if (e.key < currentTime)
+            ++numLate;
+
+        currentTime = std::max(currentTime, e.key);
+
+        if (static_cast<StreamKind>(stream % 2) == StreamKind::ble)
+        {
+            PacketView p;
+            p.data       = data;
+            p.size       = e.size;
+            p.hostTime   = e.hostTime;
+            p.deviceTime = e.deviceTime;
+            sink.blePacket(device, p);
+        }
+        else
+        {
+            MidiEvent m;
+            m.hostTime   = e.hostTime;
+            m.deviceTime = e.deviceTime;
+            m.size       = e.size;
+            m.source     = device;
+
+            if (m.isSpilled())
+                m.spilled = data;
+            else
+                std::memcpy(m.bytes, data, e.size);
+
+            sink.midiEvent(device, m);
+        }
+
+        q.pop();
+        update(stream, q.isEmpty() ? empty : q.front().key);
+        ++numPassed;
+    }
+
+    //==================================================================================================================
+    EventSink&          sink;
+    const MergeSettings settings;
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    const size_t                        leaves;
+    std::vector<int64_t>                keys; // each stream's oldest held back event, or empty
+    std::vector<uint16_t>               tree; // tree[1] holds the stream with the oldest event of all
+
+    int64_t  currentTime = std::numeric_limits<int64_t>::min();
+    uint64_t numPassed = 0, numLate = 0, numForced = 0, numOversized = 0;
+};
+} // namespace Ingest
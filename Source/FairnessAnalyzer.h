@@ -0,0 +1,343 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "DeviceRegistry.h"
+#include "SeqLock.h"
+
+//======================================================================================================================
+namespace Ingest {
+
+enum class StreamKind : uint8_t
+{
+    midi,
+    ble
+};
+
+/** One stream's (a device's MIDI or its BLE traffic) rates over the analyzer's sliding window. */
+struct StreamRates
+{
+    double  eventsPerSecond = 0.0, bytesPerSecond = 0.0;
+    double  share           = 0.0; // of all devices' events of the same kind
+    double  baseline        = 0.0; // the events per second this stream is judged against
+    int64_t longestGap      = 0;   // nanoseconds, over the window
+    int64_t medianTickGap   = 0;   // the median of each tick's longest gap
+    bool    starved         = false;
+};
+
+/** Jain's fairness index over every active stream's rate relative to its own baseline: 1 is perfectly even. */
+struct FairnessSummary
+{
+    double midiIndex = 1.0, bleIndex = 1.0;
+    int    starvedStreams = 0;
+};
+
+/** A stream collapsing while the others held steady, or coming back from that. */
+struct StarvationEvent
+{
+    int64_t      hostTime        = 0;
+    DeviceHandle device          = invalidDeviceHandle;
+    StreamKind   kind            = StreamKind::midi;
+    bool         starved         = false; // false means it recovered
+    double       eventsPerSecond = 0.0, baseline = 0.0;
+};
+
+struct FairnessSettings
+{
+    int    tickRateHz    = 10;
+    int    windowTicks   = 20;   // the sliding window, in ticks
+    double collapseRatio = 0.25; // a stream below this fraction of its baseline has collapsed...
+    double steadyRatio   = 0.75; // ...which is starvation if most others are still above this fraction of theirs
+    double recoverRatio  = 0.5;
+    double minimumRate   = 5.0;  // events per second; a stream whose baseline is below this is idle, not starved
+};
+
+//======================================================================================================================
+/**
+    Watches every device's MIDI and BLE streams for the starvation the README describes: older connections falling
+    behind while the newest one keeps its rate.
+
+    A thread of its own samples the channels' counters a few times a second and keeps a fixed window of those
+    samples per stream: events, bytes and the longest inter-arrival gap per tick. From that it publishes each
+    stream's rates, its share of the traffic, and a fairness index across devices. Devices are allowed different
+    nominal rates, so each stream is judged against its own baseline: the highest rate it has held over a window,
+    slowly forgotten (but not while it's starved) so a device that has legitimately slowed down becomes the new normal.
+
+    A stream that stops altogether, e.g. because its port was closed, looks starved too; the registry knows which
+    ports are open.
+
+    Nothing is added to the ingest path but a byte count and a longest-gap update, both on lines the callback already
+    owns. The window is allocated once, and a tick touches a few hundred bytes per device. Snapshots are SeqLocks and
+    the events go through an SpscRing, so a view reads everything without locking (the events from one thread).
+*/
+class FairnessAnalyzer : private Thread
+{
+public:
+    explicit FairnessAnalyzer(const DeviceRegistry& deviceRegistry, FairnessSettings fairnessSettings = {})
+            : Thread("Fairness analyzer"),
+              registry(deviceRegistry),
+              settings(fairnessSettings),
+              window(static_cast<size_t>(jlimit(2, maxWindowTicks, settings.windowTicks))),
+              tickInterval(1000 / jlimit(1, 1000, settings.tickRateHz)),
+              baselineDecay(std::pow(0.5, 1.0 / (baselineHalfLifeSeconds * jlimit(1, 1000, settings.tickRateHz)))),
+              streams(deviceRegistry.getCapacity() * 2),
+              samples(streams.size() * window),
+              tickNanos(window),
+              ratios(streams.size()),
+              rates(streams.size()),
+              events(256)
+    {
+    }
+
+    ~FairnessAnalyzer() override { stop(); }
+
+    void start() { startThread(); }
+    void stop() { stopThread(1000); }
+
+    //==================================================================================================================
+    [[nodiscard]] StreamRates getRates(DeviceHandle h, StreamKind kind) const { return rates[getIndex(h, kind)].load(); }
+
+    [[nodiscard]] FairnessSummary getSummary() const { return summary.load(); }
+
+    /** Moves on with every tick. */
+    [[nodiscard]] uint64_t getVersion() const { return summary.getVersion(); }
+
+    /** From one thread only. Events that found the queue full are counted in getStarvationEventsLost(). */
+    template<typename Fn>
+    size_t drainEvents(Fn&& fn)
+    {
+        return events.drain(std::forward<Fn>(fn));
+    }
+
+    [[nodiscard]] uint64_t getStarvationCount() const { return starvations.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t getStarvationEventsLost() const { return eventsLost.load(std::memory_order_relaxed); }
+
+    /** The fraction of wall time the analyzer has spent working since it started. */
+    [[nodiscard]] double getBusyFraction() const
+    {
+        const auto started = startTime.load(std::memory_order_relaxed);
+        const auto elapsed = started == 0 ? 0 : hostNanos() - started;
+
+        if (elapsed <= 0)
+            return 0.0;
+
+        return static_cast<double>(busyNanos.load(std::memory_order_relaxed)) / static_cast<double>(elapsed);
+    }
+
+private:
+    //==================================================================================================================
+    static constexpr int    maxWindowTicks          = 256;
+    static constexpr double baselineHalfLifeSeconds = 30.0;
+
+    struct Stream
+    {
+        uint64_t lastCount = 0, lastBytes = 0;
+        uint64_t windowCount = 0, windowBytes = 0;
+        double   baseline = 0.0;
+        bool     starved  = false;
+    };
+
+    struct Sample
+    {
+        uint64_t count = 0, bytes = 0;
+        int64_t  longestGap = 0;
+    };
+
+    static size_t getIndex(DeviceHandle h, StreamKind kind)
+    {
+        return static_cast<size_t>(h) * 2 + static_cast<size_t>(kind);
+    }
+
+    //==================================================================================================================
+    void run() override
+    {
+        auto last = hostNanos();
+        startTime.store(last, std::memory_order_relaxed);
+
+        while (!wait(tickInterval))
+        {
+            const auto now = hostNanos();
+            tick(now, now - last);
+            last = now;
+
+            busyNanos.fetch_add(static_cast<uint64_t>(hostNanos() - now), std::memory_order_relaxed);
+        }
+    }
+
+    void tick(int64_t now, int64_t elapsed)
+    {
+        const auto slot = static_cast<size_t>(ticks++ % window);
+        const auto n    = registry.size();
+
+        windowNanos     += elapsed - tickNanos[slot];
+        tickNanos[slot]  = elapsed;
+
+        const auto window_seconds = static_cast<double>(windowNanos) * 1.0e-9;
+
+        // A device's first tick only establishes where its counters stand
+        for (auto h = static_cast<DeviceHandle>(primed); h < n; ++h)
+        {
+            for (const auto kind : {StreamKind::midi, StreamKind::ble})
+            {
+                auto& st = streams[getIndex(h, kind)];
+                std::tie(st.lastCount, st.lastBytes, std::ignore) = takeCounters(h, kind);
+            }
+        }
+
+        primed = n;
+
+        FairnessSummary s;
+
+        for (const auto kind : {StreamKind::midi, StreamKind::ble})
+        {
+            double total  = 0.0, sum = 0.0, sum_of_squares = 0.0;
+            int    active = 0, steady = 0;
+
+            // Rates first; whether a stream is starving depends on how all the others are doing
+            for (DeviceHandle h = 0; h < n; ++h)
+            {
+                const auto i     = getIndex(h, kind);
+                auto&      st    = streams[i];
+                auto&      entry = samples[i * window + slot];
+
+                const auto [count, bytes, gap] = takeCounters(h, kind);
+
+                st.windowCount += (count - st.lastCount) - entry.count;
+                st.windowBytes += (bytes - st.lastBytes) - entry.bytes;
+                entry           = {count - st.lastCount, bytes - st.lastBytes, gap};
+                st.lastCount    = count;
+                st.lastBytes    = bytes;
+
+                const auto rate = static_cast<double>(st.windowCount) / window_seconds;
+
+                st.baseline = st.starved ? st.baseline : jmax(rate, st.baseline * baselineDecay);
+                total      += rate;
+
+                if (st.baseline < settings.minimumRate)
+                {
+                    ratios[i] = -1.0;
+                    continue;
+                }
+
+                ratios[i]       = rate / st.baseline;
+                sum            += ratios[i];
+                sum_of_squares += ratios[i] * ratios[i];
+                ++active;
+
+                if (ratios[i] >= settings.steadyRatio)
+                    ++steady;
+            }
+
+            (kind == StreamKind::midi ? s.midiIndex : s.bleIndex) = active < 2 || sum_of_squares <= 0.0
+                                                                      ? 1.0
+                                                                      : (sum * sum) / (active * sum_of_squares);
+
+            for (DeviceHandle h = 0; h < n; ++h)
+            {
+                const auto i     = getIndex(h, kind);
+                auto&      st    = streams[i];
+                const auto ratio = ratios[i];
+
+                if (!st.starved && ratio >= 0.0 && ratio < settings.collapseRatio)
+                {
+                    // "The others hold steady": most of them are still near their own baselines
+                    const auto others        = active - 1;
+                    const auto others_steady = steady - (ratio >= settings.steadyRatio ? 1 : 0);
+
+                    if (others > 0 && others_steady * 2 >= others)
+                    {
+                        st.starved = true;
+                        starvations.fetch_add(1, std::memory_order_relaxed);
+                        report(now, h, kind, st);
+                    }
+                }
+                else if (st.starved && (ratio < 0.0 || ratio >= settings.recoverRatio))
+                {
+                    st.starved = false;
+                    report(now, h, kind, st);
+                }
+
+                s.starvedStreams += st.starved ? 1 : 0;
+                publish(h, kind, st, total, window_seconds);
+            }
+        }
+
+        summary.store(s);
+    }
+
+    std::tuple<uint64_t, uint64_t, int64_t> takeCounters(DeviceHandle h, StreamKind kind)
+    {
+        if (kind == StreamKind::midi)
+        {
+            auto& c = *registry.midiChannels[h];
+            return {c.getReceivedCount(), c.getReceivedBytes(), c.takeLongestGap()};
+        }
+
+        auto& c = *registry.bleChannels[h];
+        return {c.getReceivedCount(), c.getReceivedBytes(), c.takeLongestGap()};
+    }
+
+    void publish(DeviceHandle h, StreamKind kind, const Stream& st, double total, double windowSeconds)
+    {
+        const auto i     = getIndex(h, kind);
+        const auto first = samples.begin() + static_cast<std::ptrdiff_t>(i * window);
+        const auto used  = static_cast<std::ptrdiff_t>(jmin<uint64_t>(ticks, window));
+
+        std::array<int64_t, maxWindowTicks> gaps;
+        std::transform(first, first + used, gaps.begin(), [](const Sample& x) { return x.longestGap; });
+
+        const auto longest = *std::max_element(gaps.begin(), gaps.begin() + used);
+
+        const auto middle = gaps.begin() + used / 2;
+        std::nth_element(gaps.begin(), middle, gaps.begin() + used);
+
+        StreamRates r;
+        r.eventsPerSecond = static_cast<double>(st.windowCount) / windowSeconds;
+        r.bytesPerSecond  = static_cast<double>(st.windowBytes) / windowSeconds;
+        r.share           = total > 0.0 ? r.eventsPerSecond / total : 0.0;
+        r.baseline        = st.baseline;
+        r.longestGap      = longest;
+        r.medianTickGap   = *middle;
+        r.starved         = st.starved;
+
+        rates[i].store(r);
+    }
+
+    void report(int64_t now, DeviceHandle h, StreamKind kind, const Stream& st)
+    {
+        StarvationEvent e;
+        e.hostTime        = now;
+        e.device          = h;
+        e.kind            = kind;
+        e.starved         = st.starved;
+        e.eventsPerSecond = static_cast<double>(st.windowCount) / (static_cast<double>(windowNanos) * 1.0e-9);
+        e.baseline        = st.baseline;
+
+        if (!events.push(e))
+            eventsLost.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    //==================================================================================================================
+    const DeviceRegistry&  registry;
+    const FairnessSettings settings;
+    const size_t           window;
+    const int              tickInterval;
+    const double           baselineDecay;
+
+    // Analyzer thread only
+    std::vector<Stream>  streams;
+    std::vector<Sample>  samples; // window per stream, one ring slot per tick
+    std::vector<int64_t> tickNanos;
+    std::vector<double>  ratios;
+    uint64_t             ticks       = 0;
+    int64_t              windowNanos = 0;
+    size_t               primed      = 0;
+
+    std::vector<SeqLock<StreamRates>> rates;
+    SeqLock<FairnessSummary>          summary;
+    SpscRing<StarvationEvent>         events;
+
+    std::atomic<uint64_t> starvations{0}, eventsLost{0}, busyNanos{0};
+    std::atomic<int64_t>  startTime{0};
+};
+} // namespace Ingest
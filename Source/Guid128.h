@@ -0,0 +1,90 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <cstdint>
+#include <string_view>
+
+//======================================================================================================================
+namespace Ingest {
+
+/**
+    A 128 bit UUID as two integers, so comparing and hashing one is a couple of instructions instead of formatting
+    and comparing strings.
+
+    fromString() is constexpr, which lets well-known UUIDs be written in their usual form and still end up as
+    constants. It takes the canonical 36 character form, with or without surrounding braces.
+*/
+struct Guid128
+{
+    uint64_t hi = 0, lo = 0;
+
+    //==================================================================================================================
+    static constexpr Guid128 fromString(std::string_view s)
+    {
+        if (s.size() == 38 && s.front() == '{' && s.back() == '}')
+            s = s.substr(1, 36);
+
+        if (s.size() != 36 || s[8] != '-' || s[13] != '-' || s[18] != '-' || s[23] != '-')
+            throw std::invalid_argument("malformed UUID");
+
+        Guid128 g;
+        int     nibbles = 0;
+
+        for (const auto c : s)
+        {
+            if (c == '-')
+                continue;
+
+            auto& half = nibbles < 16 ? g.hi : g.lo;
+            half       = (half << 4) | hexValue(c);
+            ++nibbles;
+        }
+
+        return g;
+    }
+
+    /** The Data1/Data2/Data3/Data4 layout used by the Windows GUID struct. */
+    static constexpr Guid128 fromFields(uint32_t d1, uint16_t d2, uint16_t d3, const uint8_t (&d4)[8])
+    {
+        Guid128 g;
+        g.hi = (static_cast<uint64_t>(d1) << 32) | (static_cast<uint64_t>(d2) << 16) | d3;
+
+        for (const auto b : d4)
+            g.lo = (g.lo << 8) | b;
+
+        return g;
+    }
+
+    //==================================================================================================================
+    [[nodiscard]] String toString() const
+    {
+        const auto h = String::toHexString(static_cast<int64>(hi)).paddedLeft('0', 16);
+        const auto l = String::toHexString(static_cast<int64>(lo)).paddedLeft('0', 16);
+
+        return h.substring(0, 8) + "-" + h.substring(8, 12) + "-" + h.substring(12) + "-"
+               + l.substring(0, 4) + "-" + l.substring(4);
+    }
+
+    [[nodiscard]] constexpr bool isNull() const { return hi == 0 && lo == 0; }
+
+    constexpr bool operator==(const Guid128&) const = default;
+
+    struct Hash
+    {
+        size_t operator()(const Guid128& g) const { return static_cast<size_t>(g.hi ^ (g.lo * 0x9e3779b97f4a7c15ull)); }
+    };
+
+private:
+    static constexpr uint64_t hexValue(char c)
+    {
+        if (c >= '0' && c <= '9') return static_cast<uint64_t>(c - '0');
+        if (c >= 'a' && c <= 'f') return static_cast<uint64_t>(c - 'a' + 10);
+        if (c >= 'A' && c <= 'F') return static_cast<uint64_t>(c - 'A' + 10);
+
+        throw std::invalid_argument("malformed UUID");
+    }
+};
+
+static_assert(Guid128::fromString("{00000000-0000-0000-0000-000000000001}").lo == 1);
+} // namespace Ingest
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+//======================================================================================================================
+namespace Ingest {
+
+/**
+    The single clock every event is stamped with at callback entry: monotonic, high resolution (QueryPerformanceCounter
+    on Windows, CLOCK_MONOTONIC elsewhere), in nanoseconds.
+*/
+inline int64_t hostNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/** Marks an event for which the platform didn't supply a timestamp of its own. */
+constexpr int64_t noDeviceTime = std::numeric_limits<int64_t>::min();
+} // namespace Ingest
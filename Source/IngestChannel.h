@@ -0,0 +1,492 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "BroadcastRing.h"
+#include "LatencyHistogram.h"
+#include "MidiEvent.h"
+#include "PacketPool.h"
+#include "SpscRing.h"
+
+//======================================================================================================================
+namespace Ingest {
+
+/**
+    Per-device counters, written by the device callback and read by anyone.
+
+    Each sits on its own cache line so a reader polling one device never bounces the line another device's callback
+    is writing; received and bytes are always written together, so they share one.
+*/
+struct DeviceCounters
+{
+    alignas(cacheLineSize) std::atomic<uint64_t> received{0}, bytes{0};
+    alignas(cacheLineSize) std::atomic<uint64_t> dropped{0};
+    alignas(cacheLineSize) std::atomic<uint64_t> consumed{0};
+};
+
+//======================================================================================================================
+/**
+    Told (on the producer's thread) that a channel has new events, along with the channel's source index. Must be
+    cheap and must not block.
+*/
+struct ChannelListener
+{
+    virtual ~ChannelListener() = default;
+
+    virtual void channelDataArrived(uint16_t source) = 0;
+};
+
+//======================================================================================================================
+/**
+    The path from one source's callback to the consumers: a BroadcastRing plus counters.
+
+    The producer side never blocks and never takes a lock; if a lossless reader falls behind far enough to fill the
+    ring, the event is counted as dropped instead. Reader 0 is the primary one, which drain() and setListener() refer
+    to; subscribe() opens the others, each with its own listener, and they don't add anything to push() but the
+    listener calls.
+
+    Events are retired through the Retire callback push() is given, on the producer's thread, once no lossless reader
+    needs them any more; see BroadcastRing.
+*/
+template<typename Event>
+class Channel
+{
+public:
+    static constexpr int maxReaders = BroadcastRing<Event>::maxReaders;
+
+    Channel(uint16_t sourceIndex, size_t capacity) : ring(capacity), source(sourceIndex) {}
+
+    /** Set before the channel is handed to a source. */
+    void setListener(ChannelListener* l)
+    {
+        listeners[0] = l;
+        updateListenerCount();
+    }
+
+    /** Only while no source is feeding the channel. reader is 1 to maxReaders - 1. */
+    void subscribe(int reader, Delivery delivery, ChannelListener* l)
+    {
+        jassert(reader > 0 && reader < maxReaders);
+
+        ring.open(reader, delivery);
+        listeners[static_cast<size_t>(reader)] = l;
+        updateListenerCount();
+    }
+
+    /** Only while no source is feeding the channel. */
+    void unsubscribe(int reader)
+    {
+        jassert(reader > 0 && reader < maxReaders);
+
+        ring.close(reader);
+        listeners[static_cast<size_t>(reader)] = nullptr;
+        updateListenerCount();
+    }
+
+    //==================================================================================================================
+    /** bytes is the payload size, for the byte count. */
+    template<typename Retire>
+    bool push(const Event& event, size_t bytes, Retire&& retire)
+    {
+        if (!ring.push(event, retire))
+        {
+            noteDropped();
+            return false;
+        }
+
+        counters.received.fetch_add(1, std::memory_order_relaxed);
+        counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+        for (size_t i = 0; i < numListeners; ++i)
+            if (auto* l = listeners[i]; l != nullptr)
+                l->channelDataArrived(source);
+
+        return true;
+    }
+
+    void noteDropped() { counters.dropped.fetch_add(1, std::memory_order_relaxed); }
+
+    /** Producer side only. Once this returns true, the next push() is guaranteed to succeed. */
+    template<typename Retire>
+    [[nodiscard]] bool reserve(Retire&& retire)
+    {
+        return ring.reserve(retire);
+    }
+
+    /** Producer side only; see BroadcastRing::retireFinished(). */
+    template<typename Retire>
+    void retireFinished(Retire&& retire)
+    {
+        ring.retireFinished(retire);
+    }
+
+    /** The primary reader. */
+    template<typename Fn>
+    size_t drain(Fn&& fn, size_t maxItems = std::numeric_limits<size_t>::max())
+    {
+        const auto n = ring.read(0, [&](const Event& e, uint64_t) { fn(e); }, maxItems);
+        counters.consumed.fetch_add(n, std::memory_order_relaxed);
+        return n;
+    }
+
+    /** A subscribed reader; see BroadcastRing::read(). */
+    template<typename Fn>
+    size_t read(int reader, Fn&& fn, size_t maxItems = std::numeric_limits<size_t>::max())
+    {
+        return ring.read(reader, std::forward<Fn>(fn), maxItems);
+    }
+
+    [[nodiscard]] bool isRetired(uint64_t sequence) const { return ring.isRetired(sequence); }
+
+    //==================================================================================================================
+    [[nodiscard]] uint64_t getReceivedCount() const { return counters.received.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t getReceivedBytes() const { return counters.bytes.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t getDroppedCount() const { return counters.dropped.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t getConsumedCount() const { return counters.consumed.load(std::memory_order_relaxed); }
+
+    /** What a lossy reader missed; see BroadcastRing::getDroppedCount(). */
+    [[nodiscard]] uint64_t getDroppedCount(int reader) const { return ring.getDroppedCount(reader); }
+
+private:
+    /** So push() only looks as far as the last reader with a listener. */
+    void updateListenerCount()
+    {
+        numListeners = 0;
+
+        for (size_t i = 0; i < listeners.size(); ++i)
+            if (listeners[i] != nullptr)
+                numListeners = i + 1;
+    }
+
+    BroadcastRing<Event> ring;
+    DeviceCounters       counters;
+    const uint16_t       source;
+
+    std::array<ChannelListener*, maxReaders> listeners{};
+    size_t                                   numListeners = 0;
+};
+
+//======================================================================================================================
+/**
+    A MIDI input's channel. Messages are written as MidiEvent records; SysEx payloads go into a small pool of larger
+    slots. A SysEx message bigger than a slot goes in as a run of slot-sized fragments, back to back (see
+    MidiEvent::isSysExFragment()); if one of them can't go in, neither can the rest, so a reader sees a message
+    either whole or cut short, but never with a hole in it. Each fragment counts as an event received. Slots go back
+    to the pool on the producer's thread, once every lossless reader has passed their message.
+
+    Both ends feed the channel's LatencyStats: push() the arrival and delivery timing, drain() the queueing delay
+    (measured against the time the batch drain started). The channel also remembers when its first message arrived,
+    which is how long a port took to go from being opened to actually delivering.
+*/
+class MidiChannel
+{
+public:
+    MidiChannel(uint16_t sourceIndex, size_t capacity, size_t sysExSlots = 64, size_t sysExSlotSize = 1024)
+            : source(sourceIndex),
+              events(sourceIndex, capacity),
+              sysExPool(sysExSlots, sysExSlotSize)
+    {
+        jassert(sysExSlots <= std::numeric_limits<uint16_t>::max());
+    }
+
+    void setListener(ChannelListener* l) { events.setListener(l); }
+
+    /**
+        Only while no source is feeding the channel. A lossy reader gets a buffer of its own here to copy SysEx
+        payloads into, since their slots can go back to the pool while it's still reading them.
+    */
+    void subscribe(int reader, Delivery delivery, ChannelListener* l)
+    {
+        events.subscribe(reader, delivery, l);
+
+        auto& buffer = scratch[static_cast<size_t>(reader)];
+        buffer.assign(delivery == Delivery::lossy ? sysExPool.getSlotSize() : 0, 0);
+        lossy[static_cast<size_t>(reader)] = delivery == Delivery::lossy;
+    }
+
+    void unsubscribe(int reader) { events.unsubscribe(reader); }
+
+    [[nodiscard]] uint16_t getSourceIndex() const { return source; }
+
+    //==================================================================================================================
+    void push(const uint8_t* data, size_t size, int64_t hostTime, int64_t deviceTime = noDeviceTime)
+    {
+        arrivals.arrived(latency, hostTime, deviceTime);
+
+        if (firstArrival.load(std::memory_order_relaxed) == 0)
+            firstArrival.store(hostTime, std::memory_order_relaxed);
+
+        const auto retire = [this](const MidiEvent& x) { releaseSlot(x); };
+
+        MidiEvent e;
+        e.hostTime   = hostTime;
+        e.deviceTime = deviceTime;
+        e.source     = source;
+
+        const auto slot_size = sysExPool.getSlotSize();
+
+        for (size_t offset = 0; offset < size; offset += slot_size)
+            if (!pushMessage(e, data + offset, jmin(size - offset, slot_size), retire))
+                return;
+    }
+
+    /** The primary reader. Spilled payloads are only valid inside fn. */
+    template<typename Fn>
+    size_t drain(Fn&& fn, size_t maxItems = std::numeric_limits<size_t>::max())
+    {
+        const auto now = hostNanos();
+
+        return events.drain([&](const MidiEvent& e)
+        {
+            latency.queueing.record(now - e.hostTime);
+            fn(e);
+        }, maxItems);
+    }
+
+    /**
+        A subscribed reader, from one thread. Spilled payloads are only valid inside fn; a lossy reader is handed a
+        copy, and a SysEx message whose slot was reused while it was being copied is counted as dropped instead.
+    */
+    template<typename Fn>
+    size_t read(int reader, Fn&& fn, size_t maxItems = std::numeric_limits<size_t>::max())
+    {
+        if (!lossy[static_cast<size_t>(reader)])
+            return events.read(reader, [&](const MidiEvent& e, uint64_t) { fn(e); }, maxItems);
+
+        auto& buffer = scratch[static_cast<size_t>(reader)];
+
+        return events.read(reader, [&](const MidiEvent& e, uint64_t sequence)
+        {
+            if (!e.isSpilled())
+            {
+                fn(e);
+                return true;
+            }
+
+            std::memcpy(buffer.data(), e.spilled, jmin<size_t>(e.size, buffer.size()));
+
+            if (events.isRetired(sequence))
+                return false;
+
+            auto copy    = e;
+            copy.spilled = buffer.data();
+            fn(copy);
+            return true;
+        }, maxItems);
+    }
+
+    //==================================================================================================================
+    [[nodiscard]] uint64_t getReceivedCount() const { return events.getReceivedCount(); }
+    [[nodiscard]] uint64_t getReceivedBytes() const { return events.getReceivedBytes(); }
+    [[nodiscard]] uint64_t getDroppedCount() const { return events.getDroppedCount(); }
+    [[nodiscard]] uint64_t getConsumedCount() const { return events.getConsumedCount(); }
+    [[nodiscard]] uint64_t getDroppedCount(int reader) const { return events.getDroppedCount(reader); }
+
+    [[nodiscard]] const LatencyStats& getLatencyStats() const { return latency; }
+
+    /** See LatencyStats::takeLongestGap(). */
+    int64_t takeLongestGap() { return latency.takeLongestGap(); }
+
+    /** The hostTime of the first message pushed since the last reset, or 0 if there hasn't been one. */
+    [[nodiscard]] int64_t getFirstArrivalTime() const { return firstArrival.load(std::memory_order_relaxed); }
+
+    /** Only while no source is feeding the channel, i.e. before handing it to a new one. */
+    void resetFirstArrival() { firstArrival.store(0, std::memory_order_relaxed); }
+
+private:
+    static constexpr auto maxReaders = static_cast<size_t>(Channel<MidiEvent>::maxReaders);
+
+    /** Producer side. A message, or a fragment of one, of at most a slot's size. */
+    template<typename Retire>
+    bool pushMessage(MidiEvent e, const uint8_t* data, size_t size, Retire& retire)
+    {
+        e.size = static_cast<uint32_t>(size);
+
+        if (size <= MidiEvent::maxInlineSize)
+        {
+            std::memcpy(e.bytes, data, size);
+            return events.push(e, size, retire);
+        }
+
+        // Only take a slot once the ring is known to have room, so a slot is never stranded on this thread.
+        if (!events.reserve(retire))
+        {
+            events.noteDropped();
+            return false;
+        }
+
+        auto packet = sysExPool.acquire(data, size);
+
+        if (!packet.has_value())
+        {
+            events.retireFinished(retire);
+            packet = sysExPool.acquire(data, size);
+        }
+
+        if (!packet.has_value())
+        {
+            events.noteDropped();
+            return false;
+        }
+
+        e.spilled = packet->data;
+        e.slot    = static_cast<uint16_t>(packet->slot);
+        return events.push(e, size, retire);
+    }
+
+    /** Producer side. */
+    void releaseSlot(const MidiEvent& e)
+    {
+        if (e.isSpilled())
+            sysExPool.release({e.spilled, e.size, e.slot});
+    }
+
+    const uint16_t     source;
+    Channel<MidiEvent> events;
+    PacketPool         sysExPool;
+
+    std::array<bool, maxReaders>                 lossy{};
+    std::array<std::vector<uint8_t>, maxReaders> scratch; // lossy readers' SysEx copies
+
+    LatencyStats         latency;
+    ArrivalTracker       arrivals; // producer only
+    std::atomic<int64_t> firstArrival{0};
+};
+
+//======================================================================================================================
+/**
+    A BLE notification channel: payloads are copied once, straight out of the platform buffer into a pooled slot,
+    and only the slot's view travels through the ring.
+
+    The pool is what bounds the backlog: a slot only goes back to it, on the producer's thread, once every lossless
+    reader has passed its packet, so the ring is the pool's size and a packet that got a slot always gets a ring
+    entry too.
+
+    Timing, including the first arrival, is tracked the same way as for a MidiChannel.
+*/
+class BleChannel
+{
+public:
+    BleChannel(uint16_t sourceIndex, size_t capacity)
+            : source(sourceIndex),
+              packets(sourceIndex, capacity),
+              pool(capacity)
+    {
+    }
+
+    void setListener(ChannelListener* l) { packets.setListener(l); }
+
+    /** See MidiChannel::subscribe(). */
+    void subscribe(int reader, Delivery delivery, ChannelListener* l)
+    {
+        packets.subscribe(reader, delivery, l);
+
+        auto& buffer = scratch[static_cast<size_t>(reader)];
+        buffer.assign(delivery == Delivery::lossy ? pool.getSlotSize() : 0, 0);
+        lossy[static_cast<size_t>(reader)] = delivery == Delivery::lossy;
+    }
+
+    void unsubscribe(int reader) { packets.unsubscribe(reader); }
+
+    [[nodiscard]] uint16_t getSourceIndex() const { return source; }
+
+    //==================================================================================================================
+    void push(const uint8_t* data, size_t size, int64_t hostTime, int64_t deviceTime = noDeviceTime)
+    {
+        arrivals.arrived(latency, hostTime, deviceTime);
+
+        if (firstArrival.load(std::memory_order_relaxed) == 0)
+            firstArrival.store(hostTime, std::memory_order_relaxed);
+
+        const auto retire = [this](const PacketView& p) { pool.release(p); };
+
+        auto packet = pool.acquire(data, size);
+
+        if (!packet.has_value())
+        {
+            packets.retireFinished(retire);
+            packet = pool.acquire(data, size);
+        }
+
+        if (!packet.has_value())
+        {
+            packets.noteDropped();
+            return;
+        }
+
+        packet->hostTime   = hostTime;
+        packet->deviceTime = deviceTime;
+
+        [[maybe_unused]] const auto pushed = packets.push(*packet, size, retire);
+        jassert(pushed);
+    }
+
+    /** The primary reader. The view is only valid inside fn. */
+    template<typename Fn>
+    size_t drain(Fn&& fn, size_t maxItems = std::numeric_limits<size_t>::max())
+    {
+        const auto now = hostNanos();
+
+        return packets.drain([&](const PacketView& p)
+        {
+            latency.queueing.record(now - p.hostTime);
+            fn(p);
+        }, maxItems);
+    }
+
+    /** A subscribed reader; see MidiChannel::read(). */
+    template<typename Fn>
+    size_t read(int reader, Fn&& fn, size_t maxItems = std::numeric_limits<size_t>::max())
+    {
+        if (!lossy[static_cast<size_t>(reader)])
+            return packets.read(reader, [&](const PacketView& p, uint64_t) { fn(p); }, maxItems);
+
+        auto& buffer = scratch[static_cast<size_t>(reader)];
+
+        return packets.read(reader, [&](const PacketView& p, uint64_t sequence)
+        {
+            std::memcpy(buffer.data(), p.data, jmin<size_t>(p.size, buffer.size()));
+
+            if (packets.isRetired(sequence))
+                return false;
+
+            auto copy = p;
+            copy.data = buffer.data();
+            fn(copy);
+            return true;
+        }, maxItems);
+    }
+
+    //==================================================================================================================
+    [[nodiscard]] uint64_t getReceivedCount() const { return packets.getReceivedCount(); }
+    [[nodiscard]] uint64_t getReceivedBytes() const { return packets.getReceivedBytes(); }
+    [[nodiscard]] uint64_t getDroppedCount() const { return packets.getDroppedCount(); }
+    [[nodiscard]] uint64_t getConsumedCount() const { return packets.getConsumedCount(); }
+    [[nodiscard]] uint64_t getDroppedCount(int reader) const { return packets.getDroppedCount(reader); }
+
+    [[nodiscard]] const LatencyStats& getLatencyStats() const { return latency; }
+
+    /** See LatencyStats::takeLongestGap(). */
+    int64_t takeLongestGap() { return latency.takeLongestGap(); }
+
+    /** See MidiChannel::getFirstArrivalTime(). */
+    [[nodiscard]] int64_t getFirstArrivalTime() const { return firstArrival.load(std::memory_order_relaxed); }
+
+    /** See MidiChannel::resetFirstArrival(). */
+    void resetFirstArrival() { firstArrival.store(0, std::memory_order_relaxed); }
+
+private:
+    static constexpr auto maxReaders = static_cast<size_t>(Channel<PacketView>::maxReaders);
+
+    const uint16_t      source;
+    Channel<PacketView> packets;
+    PacketPool          pool;
+
+    std::array<bool, maxReaders>                 lossy{};
+    std::array<std::vector<uint8_t>, maxReaders> scratch; // lossy readers' packet copies
+
+    LatencyStats         latency;
+    ArrivalTracker       arrivals; // producer only
+    std::atomic<int64_t> firstArrival{0};
+};
+} // namespace Ingest
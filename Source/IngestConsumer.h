@@ -0,0 +1,273 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "DeviceRegistry.h"
+#include "SeqLock.h"
+#include "ThreadPlacement.h"
+
+//======================================================================================================================
+namespace Ingest {
+
+/** What the UI shows for a device, published as one value so a reader never sees half an update. */
+struct DeviceStats
+{
+    uint64_t midiReceived = 0, midiDropped = 0;
+    uint64_t bleReceived = 0, bleDropped = 0;
+    int64_t  midiGapP99 = 0, bleGapP99 = 0;
+};
+
+//======================================================================================================================
+/** Sees every drained event, on the consumer's thread, tagged with its device. Must keep up and must not block. */
+struct EventSink
+{
+    virtual ~EventSink() = default;
+
+    virtual void midiEvent(DeviceHandle device, const MidiEvent& event) = 0;
+    virtual void blePacket(DeviceHandle device, const PacketView& packet) = 0;
+
+    /** After every pass over the channels, whether it found anything or not; for a sink that holds events back. */
+    virtual void drained() {}
+};
+
+//======================================================================================================================
+/** How IngestConsumer's worker threads are set up. */
+struct WorkerSettings
+{
+    int    numWorkers       = 1;
+    size_t batchSize        = 256;   // per channel and pass, so a flooding device can't hold the others up for long
+    int    firstCore        = -1;    // worker i is pinned to core firstCore + i; -1 leaves placement to the OS
+    bool   realtimePriority = false; // see ScopedRealtimePriority
+};
+
+//======================================================================================================================
+/**
+    Drains every device's channels on a small pool of threads of its own, and publishes each device's DeviceStats at
+    a fixed rate.
+
+    Sources only ever tell the consumer that there's something to drain, so the platform callback's work ends at the
+    channel push; nothing on the ingest path touches the message thread or any lock. Each device belongs to one
+    worker (handle modulo the number of workers), which keeps every channel single-consumer, and the first push after
+    that worker's drain is the only one that actually signals it. A worker drains its channels in batches of at most
+    batchSize, round robin, until they're all empty. Workers can be pinned to cores and run at real-time priority.
+
+    An EventSink, if there is one, sees each event as it's drained, on the worker that owns its device. With more
+    than one worker the sink is therefore called from several threads at once, for different devices.
+
+    The snapshots are read without locking, from any thread; each worker publishes its own devices'. getVersion()
+    changes whenever any of them does, so a view can skip its refresh when nothing changed. Devices whose counts
+    didn't move since the last publish are left alone, which also saves the percentile calculation.
+*/
+class IngestConsumer : public ChannelListener
+{
+public:
+    explicit IngestConsumer(const DeviceRegistry& deviceRegistry, int publishRateHz = 30, WorkerSettings settings = {})
+            : registry(deviceRegistry),
+              snapshots(deviceRegistry.getCapacity()),
+              publishInterval(1000000000 / jmax(1, publishRateHz)),
+              batchSize(jmax(size_t{1}, settings.batchSize))
+    {
+        const auto n = jlimit(1, 64, settings.numWorkers);
+
+        for (int i = 0; i < n; ++i)
+            workers.push_back(std::make_unique<Worker>(*this, i, n, settings));
+    }
+
+    ~IngestConsumer() override { stop(); }
+
+    /** Only while stopped. The sink has to outlive the time the consumer runs, and cope with every worker at once. */
+    void setSink(EventSink* s) { sink = s; }
+
+    void start()
+    {
+        for (auto& w : workers)
+            w->start();
+    }
+
+    void stop()
+    {
+        for (auto& w : workers)
+            w->stop();
+    }
+
+    /** May be called while running; takes effect from the next publish. */
+    void setPublishRate(int hz) { publishInterval.store(1000000000 / jmax(1, hz), std::memory_order_relaxed); }
+
+    //==================================================================================================================
+    [[nodiscard]] DeviceStats getStats(DeviceHandle h) const { return snapshots[h].load(); }
+
+    [[nodiscard]] uint64_t getVersion() const { return version.load(std::memory_order_acquire); }
+
+    [[nodiscard]] int getNumWorkers() const { return static_cast<int>(workers.size()); }
+
+    /** How many workers are running pinned to their core, and at real-time priority; both are only tried if asked. */
+    [[nodiscard]] int getNumPinnedWorkers() const { return pinned.load(std::memory_order_relaxed); }
+    [[nodiscard]] int getNumRealtimeWorkers() const { return realtime.load(std::memory_order_relaxed); }
+
+    //==================================================================================================================
+    void channelDataArrived(uint16_t source) override
+    {
+        workers[source % workers.size()]->dataArrived();
+    }
+
+private:
+    //==================================================================================================================
+    class Worker : private Thread
+    {
+    public:
+        Worker(IngestConsumer& c, int workerIndex, int numWorkers, const WorkerSettings& s)
+                : Thread("Ingest worker " + String(workerIndex)),
+                  consumer(c),
+                  index(static_cast<size_t>(workerIndex)),
+                  stride(static_cast<size_t>(numWorkers)),
+                  core(s.firstCore < 0 ? -1 : s.firstCore + workerIndex),
+                  realtimePriority(s.realtimePriority)
+        {
+        }
+
+        ~Worker() override { stop(); }
+
+        void start() { startThread(); }
+        void stop() { stopThread(1000); }
+
+        void dataArrived()
+        {
+            if (!pending.exchange(true, std::memory_order_acq_rel))
+                wakeUp.signal();
+        }
+
+    private:
+        void run() override
+        {
+            const bool pinnedOk = core >= 0 && pinCurrentThreadToCore(core);
+
+            if (pinnedOk)
+                consumer.pinned.fetch_add(1, std::memory_order_relaxed);
+
+            std::optional<ScopedRealtimePriority> priority;
+
+            if (realtimePriority && priority.emplace().isEngaged())
+                consumer.realtime.fetch_add(1, std::memory_order_relaxed);
+
+            int64_t last_publish = 0;
+            bool    more         = false;
+
+            while (!threadShouldExit())
+            {
+                const auto interval = consumer.publishInterval.load(std::memory_order_relaxed);
+
+                // Time out at the publish interval, so the last few events of a burst still make it to the view.
+                // Channels that still had more after a batch get their next one straight away.
+                if (!more)
+                    wakeUp.wait(static_cast<int>(jmax<int64_t>(1, interval / 1000000)));
+
+                pending.store(false, std::memory_order_release);
+
+                const auto n = consumer.registry.size();
+                more         = drainBatch(n);
+
+                if (auto* sink = consumer.sink; sink != nullptr)
+                    sink->drained();
+
+                if (const auto now = hostNanos(); now - last_publish >= interval)
+                {
+                    consumer.publish(index, stride, n);
+                    last_publish = now;
+                }
+            }
+
+            if (priority.has_value() && priority->isEngaged())
+                consumer.realtime.fetch_sub(1, std::memory_order_relaxed);
+
+            if (pinnedOk)
+                consumer.pinned.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        /** One batch from each of this worker's channels; true if any of them had more than that. */
+        bool drainBatch(size_t numDevices)
+        {
+            const auto& registry = consumer.registry;
+            const auto  batch    = consumer.batchSize;
+            auto*       sink     = consumer.sink;
+            bool        more     = false;
+
+            for (auto h = static_cast<DeviceHandle>(index); h < numDevices; h = static_cast<DeviceHandle>(h + stride))
+            {
+                size_t n = 0;
+
+                if (sink != nullptr)
+                {
+                    n = jmax(registry.midiChannels[h]->drain([sink, h](const MidiEvent& e) { sink->midiEvent(h, e); }, batch),
+                             registry.bleChannels[h]->drain([sink, h](const PacketView& p) { sink->blePacket(h, p); }, batch));
+                }
+                else
+                {
+                    n = jmax(registry.midiChannels[h]->drain([](const MidiEvent&) {}, batch),
+                             registry.bleChannels[h]->drain([](const PacketView&) {}, batch));
+                }
+
+                more = more || n == batch;
+            }
+
+            return more;
+        }
+
+        IngestConsumer& consumer;
+        const size_t    index, stride;
+        const int       core;
+        const bool      realtimePriority;
+
+        alignas(cacheLineSize) std::atomic<bool> pending{false};
+        WaitableEvent wakeUp;
+    };
+
+    //==================================================================================================================
+    /** Publishes the devices first, first + stride, ...; each worker does its own. */
+    void publish(size_t first, size_t stride, size_t numDevices)
+    {
+        bool changed = false;
+
+        for (auto h = static_cast<DeviceHandle>(first); h < numDevices; h = static_cast<DeviceHandle>(h + stride))
+        {
+            const auto& midi = *registry.midiChannels[h];
+            const auto& ble  = *registry.bleChannels[h];
+
+            DeviceStats s;
+            s.midiReceived = midi.getReceivedCount();
+            s.midiDropped  = midi.getDroppedCount();
+            s.bleReceived  = ble.getReceivedCount();
+            s.bleDropped   = ble.getDroppedCount();
+
+            auto& snapshot = snapshots[h];
+            auto  previous = snapshot.load(); // only this thread writes, so this never spins
+
+            if (s.midiReceived == previous.midiReceived && s.midiDropped == previous.midiDropped
+                && s.bleReceived == previous.bleReceived && s.bleDropped == previous.bleDropped)
+                continue;
+
+            s.midiGapP99 = midi.getLatencyStats().interArrival.getSummary().p99;
+            s.bleGapP99  = ble.getLatencyStats().interArrival.getSummary().p99;
+
+            snapshot.store(s);
+            changed = true;
+        }
+
+        if (changed)
+            version.fetch_add(1, std::memory_order_release);
+    }
+
+    //==================================================================================================================
+    const DeviceRegistry& registry;
+    EventSink*            sink = nullptr;
+
+    std::vector<SeqLock<DeviceStats>> snapshots;
+
+    std::atomic<int64_t>  publishInterval;
+    std::atomic<uint64_t> version{0};
+    const size_t          batchSize;
+
+    std::atomic<int> pinned{0}, realtime{0};
+
+    std::vector<std::unique_ptr<Worker>> workers;
+};
+} // namespace Ingest
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "IngestChannel.h"
+
+#include <span>
+
+//======================================================================================================================
+namespace Ingest {
+
+/** A MIDI input port, independent of the platform API (or simulation) that delivers its messages into a MidiChannel. */
+class MidiSource
+{
+public:
+    virtual ~MidiSource() = default;
+
+    [[nodiscard]] virtual const String& getIdentifier() const = 0;
+};
+
+//======================================================================================================================
+/**
+    Told when a MidiSource has finished opening, successfully or not.
+
+    This can happen on any thread, including the one that's still inside Backend::openMidiInput() if the platform
+    completes the open synchronously.
+*/
+struct SourceListener
+{
+    virtual ~SourceListener() = default;
+
+    virtual void midiSourceOpened(const MidiSource& source, bool succeeded) = 0;
+};
+
+//======================================================================================================================
+/**
+    The sets of connection parameters a central can ask a BLE link for, slowest connection interval first: a faster
+    one gives the link more connection events, and so more throughput, for more of the radio's time.
+*/
+enum class ConnectionProfile : uint8_t
+{
+    power,
+    balanced,
+    throughput
+};
+
+constexpr size_t numConnectionProfiles = 3;
+
+/** The notification stream of a single GATT characteristic on a BLE peripheral, written straight into a BleChannel. */
+class BlePacketSource
+{
+public:
+    virtual ~BlePacketSource() = default;
+
+    [[nodiscard]] virtual const String& getIdentifier() const = 0;
+
+    /**
+        Asks for the link to be given another connection profile; false if that can't be asked for (yet). The
+        peripheral has the last word, so whether it made a difference only shows in the measured rate. Only from the
+        thread that owns the source.
+    */
+    virtual bool requestConnectionProfile(ConnectionProfile) { return false; }
+};
+
+//======================================================================================================================
+/** The BLE-MIDI characteristic of a peripheral, written to without response. */
+class BlePacketWriter
+{
+public:
+    virtual ~BlePacketWriter() = default;
+
+    [[nodiscard]] virtual const String& getIdentifier() const = 0;
+
+    /** The negotiated ATT MTU less the three bytes of write header, or 0 while the characteristic isn't writable yet. */
+    [[nodiscard]] virtual size_t getMaxPacketSize() const = 0;
+
+    /** Queues the packet for the next connection event and returns straight away; false if the link can't take it. */
+    virtual bool write(std::span<const uint8_t> packet) = 0;
+};
+
+//======================================================================================================================
+/**
+    Creates the MIDI and BLE sources for a physical device.
+
+    The identifiers passed in are the ones the backend itself handed out during discovery: a ContainerId plus a
+    MIDI port id for MIDI inputs, and an association endpoint id for BLE devices.
+
+    BLE-MIDI outputs are opened the same way, by association endpoint id; the writer reports a packet size of 0 until
+    its characteristic has been found.
+
+    Opening a MIDI input doesn't wait for the port: the source is returned straight away and the listener, if there
+    is one, hears about it once it's actually open. Several opens can therefore be in flight at once.
+*/
+class Backend
+{
+public:
+    virtual ~Backend() = default;
+
+    virtual auto openMidiInput(const String& identifier, const String& portId, std::shared_ptr<MidiChannel> channel,
+                               SourceListener* listener) -> std::unique_ptr<MidiSource> = 0;
+
+    virtual auto connectBleDevice(const String& deviceId, std::shared_ptr<BleChannel> channel)
+        -> std::unique_ptr<BlePacketSource> = 0;
+
+    virtual auto openBleMidiOutput(const String& deviceId) -> std::unique_ptr<BlePacketWriter> = 0;
+};
+} // namespace Ingest
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "HostClock.h"
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+
+//======================================================================================================================
+namespace Ingest {
+
+/**
+    An HDR-style log-linear histogram of nanosecond durations.
+
+    Values are bucketed by their highest set bit and then linearly into 2^subBucketBits sub-buckets, so every recorded
+    value is resolved to within about 3% regardless of magnitude, from nanoseconds up to minutes, in a fixed ~10 kB.
+
+    record() must only be called from one thread at a time, and costs a relaxed load/store pair and a compare.
+    Any thread can read percentiles at any time without blocking the writer; a reader racing a writer just sees a
+    count or two that's about to land.
+*/
+class LatencyHistogram
+{
+public:
+    static constexpr int subBucketBits  = 5;
+    static constexpr int subBucketCount = 1 << subBucketBits;
+    static constexpr int maxExponent    = 42; // ~73 minutes; anything longer is clamped into the last bucket
+    static constexpr int numBuckets     = (maxExponent - subBucketBits + 2) * subBucketCount;
+
+    //==================================================================================================================
+    void record(int64_t nanos)
+    {
+        const auto value = static_cast<uint64_t>(std::max<int64_t>(nanos, 0));
+        auto&      b     = buckets[static_cast<size_t>(bucketIndex(value))];
+
+        b.store(b.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        if (value > maximum.load(std::memory_order_relaxed))
+            maximum.store(value, std::memory_order_relaxed);
+    }
+
+    //==================================================================================================================
+    struct Summary
+    {
+        uint64_t count = 0;
+        int64_t  p50 = 0, p99 = 0, p999 = 0, max = 0;
+
+        [[nodiscard]] var toVar() const
+        {
+            auto* o = new DynamicObject();
+            o->setProperty("count", static_cast<int64>(count));
+            o->setProperty("p50_ns", static_cast<int64>(p50));
+            o->setProperty("p99_ns", static_cast<int64>(p99));
+            o->setProperty("p999_ns", static_cast<int64>(p999));
+            o->setProperty("max_ns", static_cast<int64>(max));
+            return var(o);
+        }
+    };
+
+    [[nodiscard]] Summary getSummary() const
+    {
+        std::array<uint64_t, numBuckets> counts;
+        uint64_t                         n = 0;
+
+        for (size_t i = 0; i < counts.size(); ++i)
+            n += (counts[i] = buckets[i].load(std::memory_order_relaxed));
+
+        Summary s;
+        s.count = n;
+        s.max   = static_cast<int64_t>(maximum.load(std::memory_order_relaxed));
+
+        if (n == 0)
+            return s;
+
+        const auto at = [&](double quantile)
+        {
+            const auto rank = static_cast<uint64_t>(std::ceil(quantile * static_cast<double>(n)));
+            uint64_t   seen = 0;
+
+            for (size_t i = 0; i < counts.size(); ++i)
+                if ((seen += counts[i]) >= std::max<uint64_t>(rank, 1))
+                    return std::min(static_cast<int64_t>(bucketUpperBound(static_cast<int>(i))), s.max);
+
+            return s.max;
+        };
+
+        s.p50  = at(0.5);
+        s.p99  = at(0.99);
+        s.p999 = at(0.999);
+        return s;
+    }
+
+private:
+    //==================================================================================================================
+    static int bucketIndex(uint64_t v)
+    {
+        if (v < static_cast<uint64_t>(subBucketCount))
+            return static_cast<int>(v);
+
+        const auto exponent = static_cast<int>(std::bit_width(v)) - 1;
+
+        if (exponent > maxExponent)
+            return numBuckets - 1;
+
+        const auto shift = exponent - subBucketBits;
+        const auto sub   = static_cast<int>((v >> shift) & (subBucketCount - 1));
+
+        return (shift + 1) * subBucketCount + sub;
+    }
+
+    static uint64_t bucketUpperBound(int index)
+    {
+        if (index < subBucketCount)
+            return static_cast<uint64_t>(index);
+
+        const auto shift = index / subBucketCount - 1;
+        const auto sub   = static_cast<uint64_t>(index % subBucketCount + subBucketCount);
+
+        return ((sub + 1) << shift) - 1;
+    }
+
+    //==================================================================================================================
+    std::array<std::atomic<uint64_t>, numBuckets> buckets{};
+    std::atomic<uint64_t>                         maximum{0};
+};
+
+//======================================================================================================================
+/**
+    The timing picture of one device.
+
+    interArrival is the gap between consecutive callbacks, which is where OS or radio starvation shows up. queueing is
+    the time from callback entry until a consumer drained the event, i.e. our own pipeline's delay. delivery is how
+    much later than usual the platform handed over an event it timestamped itself (its host-minus-device offset above
+    the smallest one seen so far); it's only fed when the platform supplies a timestamp.
+*/
+struct LatencyStats
+{
+    LatencyHistogram interArrival, queueing, delivery;
+
+    /** The longest interArrival gap since a FairnessAnalyzer last took it; see takeLongestGap(). */
+    std::atomic<int64_t> longestGap{0};
+
+    /** A gap racing the reset may be lost or carried into the next period, which a windowed view can live with. */
+    int64_t takeLongestGap() { return longestGap.exchange(0, std::memory_order_relaxed); }
+
+    [[nodiscard]] var toVar() const
+    {
+        auto* o = new DynamicObject();
+        o->setProperty("inter_arrival", interArrival.getSummary().toVar());
+        o->setProperty("queueing", queueing.getSummary().toVar());
+        o->setProperty("delivery", delivery.getSummary().toVar());
+        return var(o);
+    }
+};
+
+/** Producer-side bookkeeping for LatencyStats::interArrival and LatencyStats::delivery. */
+class ArrivalTracker
+{
+public:
+    void arrived(LatencyStats& stats, int64_t hostTime, int64_t deviceTime)
+    {
+        if (lastHostTime != 0)
+        {
+            const auto gap = hostTime - lastHostTime;
+            stats.interArrival.record(gap);
+
+            if (gap > stats.longestGap.load(std::memory_order_relaxed))
+                stats.longestGap.store(gap, std::memory_order_relaxed);
+        }
+
+        lastHostTime = hostTime;
+
+        if (deviceTime == noDeviceTime)
+            return;
+
+        const auto offset = hostTime - deviceTime;
+        minOffset         = std::min(minOffset, offset);
+
+        stats.delivery.record(offset - minOffset);
+    }
+
+private:
+    int64_t lastHostTime = 0;
+    int64_t minOffset    = std::numeric_limits<int64_t>::max();
+};
+} // namespace Ingest
@@ -16,7 +16,20 @@ public:
     //==============================================================================
     void initialise (const String&) override
     {
-        mainWindow.reset (new MainAppWindow (getApplicationName()));
+        // --record=DIR captures everything received into DIR, for looking into dropouts afterwards;
+        // --trace=FILE traces the callbacks and writes a Chrome trace to FILE on exit;
+        // --stats=FILE publishes the live statistics there instead of the default location
+        const ArgumentList args (getApplicationName(), getCommandLineParameterArray());
+
+        const auto file_option = [&args] (const char* option)
+        {
+            return args.containsOption (option)
+                   ? File::getCurrentWorkingDirectory().getChildFile (args.getValueForOption (option))
+                   : File();
+        };
+
+        mainWindow.reset (new MainAppWindow (getApplicationName(), file_option ("--record"), file_option ("--trace"),
+                                              file_option ("--stats")));
     }
 
     void shutdown() override             { mainWindow = nullptr; }
@@ -29,7 +42,7 @@ private:
     class MainAppWindow    : public DocumentWindow
     {
     public:
-        MainAppWindow (const String& name)
+        MainAppWindow (const String& name, const File& captureDirectory, const File& traceFile, const File& statsFile)
                 : DocumentWindow (name, Desktop::getInstance().getDefaultLookAndFeel()
                         .findColour (ResizableWindow::backgroundColourId),
                 DocumentWindow::allButtons)
@@ -38,9 +51,9 @@ private:
             setResizable (true, false);
             setResizeLimits (400, 400, 10000, 10000);
 
-            setContentOwned (new MainComponent(), false);
+            setContentOwned (new MainComponent (captureDirectory, traceFile, statsFile), false);
             setVisible (true);
-            setSize(600, 200);
+            setSize(1080, 200);
         }
 
         void closeButtonPressed() override    { JUCEApplication::getInstance()->systemRequestedQuit(); }
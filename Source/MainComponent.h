@@ -2,533 +2,333 @@
 
 #include <JuceHeader.h>
 
-#include <combaseapi.h>
-#include <winrt/Windows.Foundation.Collections.h>
-#include <winrt/Windows.Storage.Streams.h>
-#include <winrt/Windows.Devices.Bluetooth.h>
-#include <winrt/Windows.Devices.Bluetooth.Advertisement.h>
-#include <winrt/Windows.Devices.Bluetooth.GenericAttributeProfile.h>
-#include <winrt/Windows.Devices.Enumeration.h>
-#include <winrt/Windows.Devices.Midi.h>
-
-using namespace winrt;
-using namespace winrt::Windows::Foundation;
-using namespace winrt::Windows::Storage;
-using namespace winrt::Windows::Devices;
-using namespace winrt::Windows::Devices::Enumeration;
-using namespace winrt::Windows::Devices::Radios;
-using namespace winrt::Windows::Devices::Midi;
-using namespace winrt::Windows::Devices::Bluetooth;
-using namespace winrt::Windows::Devices::Bluetooth::Advertisement;
-using namespace winrt::Windows::Devices::Bluetooth::GenericAttributeProfile;
+#include "CaptureRecorder.h"
+#include "ConnectionManager.h"
+#include "DeviceRegistry.h"
+#include "DeviceTable.h"
+#include "FairnessAnalyzer.h"
+#include "IngestConsumer.h"
+#include "StatsPublisher.h"
+#include "Subscription.h"
+#include "Tracer.h"
+#include "WinRTBackend.h"
 
 //======================================================================================================================
-namespace Util {
-using PropertyStore = Collections::IMapView<winrt::hstring, IInspectable>;
-
-template<typename T>
-static auto getProperty(const PropertyStore& map, const winrt::hstring& key) -> std::optional<T>
-{
-    return map.HasKey(key)
-           ? std::optional(winrt::unbox_value<T>(map.Lookup(key)))
-           : std::nullopt;
-}
-
-template<typename T>
-static auto getPropertyOr(const PropertyStore& map, const winrt::hstring& key, T def) -> T
-{
-    const auto p = getProperty<T>(map, key);
-
-    return p.has_value() ? *p : def;
-}
-} // namespace Util
-
-//======================================================================================================================
-class WinRTMidiInput
+class MainComponent : public Component,
+                      private Timer
 {
 public:
-    using Callback = std::function<void(const MidiMessage&)>;
-
-    explicit WinRTMidiInput(String id, const String& winrtId, Callback cb)
-            : identifier(std::move(id)),
-              callback(std::move(cb))
-    {
-        MidiInPort::FromIdAsync(winrt::to_hstring(winrtId.toStdString())).Completed(
-                [this, winrtId](const IAsyncOperation<MidiInPort>& op, AsyncStatus status)
-                {
-                    if (op.Status() != AsyncStatus::Completed)
-                    {
-                        DBG("Failed to open midi port: " << winrtId);
-                    }
-                    else if (port = op.GetResults(); port != nullptr)
-                    {
-                        DBG("Midi port opened successfully " << String(winrt::to_string(port.DeviceId())));
-
-                        port.MessageReceived(
-                                [this](const MidiInPort&, const MidiMessageReceivedEventArgs& args)
-                                {
-                                    const auto bytes = args.Message().RawData();
-                                    const auto msg   = MidiMessage(bytes.data(), bytes.Length());
-
-                                    if (callback)
-                                        callback(msg);
-                                }
-                        );
-                    }
-                }
-        );
-    }
-
-    ~WinRTMidiInput()
-    {
-        if (port != nullptr)
-            port.Close();
-    }
-
-    [[nodiscard]] const String& getIdentifier() const { return identifier; }
-
-private:
-    const String identifier;
-
-    MidiInPort port{nullptr};
-
-    Callback callback;
-};
-
-//======================================================================================================================
-struct BleDevice
-{
-    using Callback = std::function<void(std::vector<uint8_t>)>;
-
-    explicit BleDevice(const String& id, Callback cb) : callback(std::move(cb))
-    {
-        jassert(callback != nullptr);
-
-        DBG("Connecting to BLE device: " << id);
-
-        BluetoothLEDevice::FromIdAsync(winrt::to_hstring(id.toStdString())).Completed(
-                [this, id](const IAsyncOperation<BluetoothLEDevice>& sender, AsyncStatus status)
-                {
-                    if (status != AsyncStatus::Completed || sender.GetResults() == nullptr)
-                    {
-                        DBG("Failed to connect to device: " << id);
-                        return;
-                    }
-
-                    device = sender.GetResults();
-                    device.GetGattServicesAsync().Completed({this, &BleDevice::getGattServicesCompleted});
-                }
-        );
-    }
-
-private:
     //==================================================================================================================
-    void getGattServicesCompleted(const IAsyncOperation<GattDeviceServicesResult>& sender, AsyncStatus status)
+    /**
+        Everything received is also recorded into captureDirectory, unless it's File(). With a traceFile, tracing
+        starts right away, T turns it off and on again, and the trace is written to the file on the way out.
+
+        The per-device statistics are published into a stats segment at statsFile, or at Stats::getDefaultFile()
+        if that's File(), for WinRTMidiStats or anything else to read without a window.
+    */
+    explicit MainComponent(const File& captureDirectory = {}, const File& traceFile = {}, const File& statsFile = {})
+            : traceDestination(traceFile),
+              midiInputWatcher(createMidiDeviceWatcher()),
+              bleDeviceWatcher(createBleDeviceWatcher())
     {
-        if (status != AsyncStatus::Completed)
+        Ingest::Tracer::nameCurrentThread("Message thread");
+
+        if (traceDestination != File())
         {
-            DBG("Failed to get services");
-            return;
+            Ingest::Tracer::setEnabled(true);
+            setWantsKeyboardFocus(true);
         }
 
-        const auto uuids = {
-                L"{65e9296c-8dfb-11ea-bc55-0242ac130003}",
-                L"{0e5a1523-ede8-4b33-a751-6ce34ec47c00}",
-        };
-
-        const auto services = sender.GetResults().Services();
-        const auto it       = std::find_if(begin(services), end(services),
-                [&](const GattDeviceService& s)
-                {
-                    return std::any_of(uuids.begin(), uuids.end(), [&](const auto& u) { return winrt::to_hstring(s.Uuid()) == u; });
-                });
-
-        if (it == end(services))
+        if (captureDirectory != File())
         {
-            DBG("Failed to find service, available services: ");
-            for (const auto& s : services)
-                DBG("  " << String(winrt::to_string(winrt::to_hstring(s.Uuid()))));
+            recorder = std::make_unique<Ingest::CaptureRecorder>(captureDirectory);
 
-            return;
+            // A subscription of its own, so the consumer's workers don't do the encoding and can be more than one
+            if (const auto r = recorder->start(); r.wasOk())
+                recording = std::make_unique<Ingest::Subscription>(registry, *recorder, Ingest::Delivery::lossless);
+            else
+                DBG("Not recording: " << r.getErrorMessage());
         }
 
-        service = *it;
-        service.GetCharacteristicsAsync().Completed({this, &BleDevice::getCharacteristicsCompleted});
-    }
+        if (const auto r = stats.open(statsFile != File() ? statsFile : Ingest::Stats::getDefaultFile()); r.failed())
+            DBG("Not publishing stats: " << r.getErrorMessage());
 
-    void getCharacteristicsCompleted(const IAsyncOperation<GattCharacteristicsResult>& sender, AsyncStatus status)
-    {
-        if (status != AsyncStatus::Completed)
-        {
-            DBG("Failed to get characteristics");
-            return;
-        }
-
-        const auto uuids = {
-                L"{65e92bb0-8dfb-11ea-bc55-0242ac130003}",
-                L"{0e5a1525-ede8-4b33-a751-6ce34ec47c00}",
-        };
+        midiInputWatcher.Added({this, &MainComponent::midiDeviceAdded});
+        midiInputWatcher.Updated({this, &MainComponent::midiDeviceUpdated});
+        midiInputWatcher.Removed({this, &MainComponent::midiDeviceRemoved});
 
-        const auto chars = sender.GetResults().Characteristics();
-        const auto it    = std::find_if(begin(chars), end(chars),
-                [&](const GattCharacteristic& c)
-                {
-                    return std::any_of(uuids.begin(), uuids.end(), [&](const auto& u) { return winrt::to_hstring(c.Uuid()) == u; });
-                });
+        bleDeviceWatcher.Added({this, &MainComponent::bleDeviceAdded});
+        bleDeviceWatcher.Updated({this, &MainComponent::bleDeviceUpdated});
+        bleDeviceWatcher.Removed({this, &MainComponent::bleDeviceRemoved});
 
-        if (it == end(chars))
+        // A watcher that stops or aborts before completing would otherwise hold the table's enumeration back forever
+        for (auto [w, name, stopped] : {std::tuple{&midiInputWatcher, "midi", &midiWatcherStopped},
+                                        std::tuple{&bleDeviceWatcher, "ble", &bleWatcherStopped}})
         {
-            DBG("Failed to find characteristic, available characteristics:");
-            for (const auto& c : chars)
-                DBG("  " << String(winrt::to_string(winrt::to_hstring(c.Uuid()))));
+            const auto completed = [this, watcher = String(name)](const DeviceWatcher&, const IInspectable&)
+            {
+                Ingest::TraceScope trace(Ingest::TracePoint::watcherCallback);
+                trace.setArgs(static_cast<int64_t>(Ingest::DeviceEventKind::enumerationCompleted));
 
-            return;
+                devices.post({.kind = Ingest::DeviceEventKind::enumerationCompleted, .id = watcher});
+            };
+
+            w->EnumerationCompleted(completed);
+            *stopped = w->Stopped(winrt::auto_revoke, completed);
         }
 
-        charact = *it;
-        charact.ValueChanged({this, &BleDevice::characteristicValueChanged});
+        devices.start();
+
+        for (auto* w : {&midiInputWatcher, &bleDeviceWatcher})
+            w->Start();
 
-        DBG("Got charcteristic successfully: " << String(winrt::to_string(winrt::to_hstring(charact.Uuid()))));
+        consumer.start();
+        fairness.start();
 
-        const auto notify_type = GattClientCharacteristicConfigurationDescriptorValue::Notify;
-        charact.WriteClientCharacteristicConfigurationDescriptorWithResultAsync(notify_type).Completed(
-                [this](const IAsyncOperation<GattWriteResult>& sender, AsyncStatus status)
-                {
-                    if (status != AsyncStatus::Completed || sender.GetResults())
-                    {
-                        DBG("Failed to enable notifications");
-                        return;
-                    }
+        if (recording != nullptr)
+            recording->start();
 
-                    DBG("Notifications enabled successfully for characteristic: " << String(winrt::to_string(winrt::to_hstring(charact.Uuid()))));
-                }
-        );
+        setRefreshRate(defaultRefreshRateHz);
     }
 
-    void characteristicValueChanged(const GattCharacteristic& c, const GattValueChangedEventArgs& args)
+    ~MainComponent() override
     {
-        const auto buf = args.CharacteristicValue();
+        // Stopped only comes after Stop() has returned, by which time this may be gone
+        midiWatcherStopped.revoke();
+        bleWatcherStopped.revoke();
 
-        std::vector<uint8_t> packet(buf.Length());
-        std::copy(buf.data(), buf.data() + buf.Length(), packet.begin());
-
-        if (callback)
-            callback(std::move(packet));
-    }
+        for (auto* w : {&midiInputWatcher, &bleDeviceWatcher})
+            w->Stop();
 
-    //==================================================================================================================
-    BluetoothLEDevice  device{nullptr};
-    GattDeviceService  service{nullptr};
-    GattCharacteristic charact{nullptr};
+        // The sources talk to the consumer, so they go first
+        devices.stop();
+        devices.closeAll();
 
-    //==================================================================================================================
-    Callback callback;
-};
+        fairness.stop();
+        consumer.stop();
+        stats.close();
+        recording.reset();
 
-//======================================================================================================================
-class MainComponent : public Component,
-                      private Timer,
-                      private AsyncUpdater
-{
-public:
-    //==================================================================================================================
-    MainComponent()
-            : midiInputWatcher(createMidiDeviceWatcher()),
-              bleDeviceWatcher(createBleDeviceWatcher())
-    {
-        midiInputWatcher.Added({this, &MainComponent::midiDeviceAdded});
-        midiInputWatcher.Removed({this, &MainComponent::midiDeviceRemoved});
+        if (recorder != nullptr)
+            recorder->stop();
 
-        bleDeviceWatcher.Added({this, &MainComponent::bleDeviceAdded});
-        bleDeviceWatcher.Updated({this, &MainComponent::bleDeviceUpdated});
-        bleDeviceWatcher.Removed({this, &MainComponent::bleDeviceRemoved});
+        if (traceDestination != File())
+        {
+            Ingest::Tracer::setEnabled(false);
 
-        for (auto* w : {&midiInputWatcher, &bleDeviceWatcher})
-            w->Start();
+            const auto r = Ingest::Tracer::writeChromeTrace(Ingest::Tracer::dump(), traceDestination, registry.names);
 
-        startTimer(1000);
+            if (r.failed())
+                DBG(r.getErrorMessage());
+        }
     }
 
-    ~MainComponent() override = default;
+    /** How often the view (and the stats snapshots behind it) may refresh. */
+    void setRefreshRate(int hz)
+    {
+        consumer.setPublishRate(hz);
+        startTimerHz(hz);
+    }
 
     //==================================================================================================================
     void paint(Graphics& g) override
     {
         //==============================================================================================================
-        const auto get_name = [this](const String& identifier)
+        // The 99th percentile gap between consecutive events is where starvation shows first
+        const auto format_gap = [](int64_t p99) -> String
         {
-            const auto it = std::find_if(midiDeviceInfos.cbegin(), midiDeviceInfos.cend(),
-                    [&](const auto& md) { return identifier == md.containerID; });
-
-            return it == midiDeviceInfos.cend() ? "()" : it->name;
+            return String(static_cast<double>(p99) * 1.0e-6, 1) + " ms";
         };
 
-        const auto get_midi_count = [this](const String& identifier)
+        const auto format_first = [](std::optional<int64_t> t) -> String
         {
-            const auto it = midiMessageCount.find(identifier);
-
-            return it == midiMessageCount.end() ? 0 : it->second;
+            return t.has_value() ? String(static_cast<double>(*t) * 1.0e-6, 1) + " ms" : "-";
         };
 
-        const auto get_ble_count = [this](const String& identifier)
+        const auto format_share = [](const Ingest::StreamRates& midi, const Ingest::StreamRates& ble) -> String
         {
-            const auto it = std::find_if(bleDeviceInfos.cbegin(), bleDeviceInfos.cend(),
-                    [&](const auto& kv) { return kv.second.containerID == identifier; });
-
-            if (it != bleDeviceInfos.cend())
-            {
-                const auto c_it = blePacketCount.find(it->first);
-
-                return c_it == blePacketCount.end() ? 0 : c_it->second;
-            }
-
-            return 0;
+            return String(roundToInt(midi.share * 100.0)) + "% / " + String(roundToInt(ble.share * 100.0)) + "%";
         };
 
         //==============================================================================================================
         g.fillAll(getLookAndFeel().findColour(ResizableWindow::backgroundColourId));
 
         auto       r = getLocalBounds();
-        const auto w = r.proportionOfWidth(1.0 / 3.0);
+        const auto w = r.proportionOfWidth(1.0 / 8.0);
 
         g.setColour(Colours::white);
         auto hdr = r.removeFromTop(30);
-        for (const auto* t : {"Name", "Midi messages", "BLE packets"})
+        for (const auto* t : {"Name", "Midi messages", "BLE packets", "Midi gap p99", "BLE gap p99", "First message", "First packet",
+                                 "Share (Midi / BLE)"})
             g.drawText(t, hdr.removeFromLeft(w), Justification::left);
 
-        const ScopedLock deviceLock(deviceChanges);
-        const ScopedLock messageLock(midiMessageLock);
-        const ScopedLock packetLock(blePacketLock);
+        Ingest::TraceScope             trace(Ingest::TracePoint::paint);
+        const Ingest::TracedScopedLock deviceLock(deviceChanges);
+        int                            rows = 0;
 
-        for (const auto& p : midiPorts)
+        for (Ingest::DeviceHandle h = 0; h < registry.size(); ++h)
         {
+            if (registry.midiStates[h] != Ingest::PortState::open)
+                continue;
+
+            ++rows;
+
             auto row = r.removeFromTop(30);
 
-            const auto& identifier = p->getIdentifier();
-            const auto name       = get_name(identifier);
-            const auto midi_count = String(get_midi_count(identifier));
-            const auto ble_count  = String(get_ble_count(identifier));
+            const auto stats     = consumer.getStats(h);
+            const auto midi_rate = fairness.getRates(h, Ingest::StreamKind::midi);
+            const auto ble_rate  = fairness.getRates(h, Ingest::StreamKind::ble);
+
+            const auto& name       = registry.names[h];
+            const auto  midi_count = String(stats.midiReceived);
+            const auto  ble_count  = String(stats.bleReceived);
+            const auto  midi_gap   = format_gap(stats.midiGapP99);
+            const auto  ble_gap    = format_gap(stats.bleGapP99);
+            const auto  first_midi = format_first(registry.getTimeToFirstMessage(h));
+            const auto  first_ble  = format_first(registry.getTimeToFirstPacket(h));
+            const auto  share      = format_share(midi_rate, ble_rate);
 
-            for (const auto* s : {&name, &midi_count, &ble_count})
+            // A starved device keeps its row, in a colour that stands out
+            g.setColour(midi_rate.starved || ble_rate.starved ? Colours::orange : Colours::white);
+
+            for (const auto* s : {&name, &midi_count, &ble_count, &midi_gap, &ble_gap, &first_midi, &first_ble, &share})
                 g.drawText(*s, row.removeFromLeft(w), Justification::left);
         }
+
+        trace.setArgs(rows);
     }
 
     void resized() override {}
 
+    bool keyPressed(const KeyPress& key) override
+    {
+        if (traceDestination == File() || key != KeyPress('t'))
+            return false;
+
+        Ingest::Tracer::setEnabled(!Ingest::Tracer::isEnabled());
+        return true;
+    }
+
     //==================================================================================================================
+    // The watchers' callbacks only read out what they need, and leave the rest to the device table's thread
     void midiDeviceAdded(const DeviceWatcher&, const DeviceInformation& added)
     {
-        const auto get_winrt_device_info = [](const DeviceInformation& info) -> WinRTMidiDeviceInfo
-        {
-            String device_id = winrt::to_string(info.Id());
+        Ingest::TraceScope trace(Ingest::TracePoint::watcherCallback);
+        trace.setArgs(static_cast<int64_t>(Ingest::DeviceEventKind::midiAdded));
+
+        const auto container_id = Util::getPropertyOr<winrt::guid>(added.Properties(), L"System.Devices.ContainerId", {});
+
+        Ingest::DeviceEvent e;
+        e.kind        = Ingest::DeviceEventKind::midiAdded;
+        e.id          = winrt::to_string(added.Id());
+        e.containerId = winrt::to_string(winrt::to_hstring(container_id));
+        e.name        = winrt::to_string(added.Name());
+        e.flag        = added.IsEnabled();
+        devices.post(std::move(e));
+    }
 
-            if (info.IsEnabled())
-            {
-                const auto container_id = Util::getPropertyOr<winrt::guid>(info.Properties(), L"System.Devices.ContainerId", {});
-
-                return {
-                        .deviceID = std::move(device_id),
-                        .containerID = winrt::to_string(winrt::to_hstring(container_id)),
-                        .name = winrt::to_string(info.Name()),
-                        .isDefault = info.IsDefault(),
-                };
-            }
-            else
-            {
-                return {.deviceID = std::move(device_id)};
-            }
-        };
+    void midiDeviceUpdated(const DeviceWatcher&, const DeviceInformationUpdate& updated)
+    {
+        Ingest::TraceScope trace(Ingest::TracePoint::watcherCallback);
+        trace.setArgs(static_cast<int64_t>(Ingest::DeviceEventKind::midiUpdated));
 
-        const ScopedLock lock(deviceChanges);
-        const auto& info = midiDeviceInfos.emplace_back(get_winrt_device_info(added));
+        const auto enabled = Util::getProperty<bool>(updated.Properties(), L"System.Devices.InterfaceEnabled");
+
+        if (!enabled.has_value())
+            return;
 
-        DBG("Added MIDI device: " << info.deviceID << " " << info.containerID << " " << info.name);
+        devices.post({.kind = Ingest::DeviceEventKind::midiUpdated, .id = winrt::to_string(updated.Id()), .flag = enabled});
     }
 
     void midiDeviceRemoved(const DeviceWatcher&, const DeviceInformationUpdate& removed)
     {
-        const String removedDeviceId(winrt::to_string(removed.Id()));
+        Ingest::TraceScope trace(Ingest::TracePoint::watcherCallback);
+        trace.setArgs(static_cast<int64_t>(Ingest::DeviceEventKind::midiRemoved));
 
-        DBG ("Removing MIDI device: " << removedDeviceId);
-
-        const ScopedLock lock(deviceChanges);
-        const auto       it = std::remove_if(midiDeviceInfos.begin(), midiDeviceInfos.end(),
-                [&](const auto& d) { return d.deviceID == removedDeviceId; });
-
-        midiDeviceInfos.erase(it, midiDeviceInfos.end());
+        devices.post({.kind = Ingest::DeviceEventKind::midiRemoved, .id = winrt::to_string(removed.Id())});
     }
 
     //==================================================================================================================
     void bleDeviceAdded(const DeviceWatcher&, const DeviceInformation& added)
     {
-        const String deviceID(winrt::to_string(added.Id()));
-        const String deviceName(winrt::to_string(added.Name()));
-
-        DBG("Detected paired BLE device: " << deviceID << ", " << deviceName);
+        Ingest::TraceScope trace(Ingest::TracePoint::watcherCallback);
+        trace.setArgs(static_cast<int64_t>(Ingest::DeviceEventKind::bleAdded));
 
         const auto props = added.Properties();
+        const auto id    = Util::getProperty<winrt::guid>(props, L"System.Devices.Aep.ContainerId");
 
-        if (const auto id = Util::getProperty<winrt::guid>(props, L"System.Devices.Aep.ContainerId"); id.has_value())
-        {
-            if (const String id_str = winrt::to_string(winrt::to_hstring(*id)); id_str.isNotEmpty())
-            {
-                const BleDeviceInfo info = {
-                        .containerID = id_str,
-                        .isConnected = Util::getPropertyOr<bool>(props, L"System.Devices.Aep.IsConnected", {})
-                };
+        if (!id.has_value())
+            return;
 
-                DBG("Adding BLE device: " << deviceID << " " << info.containerID << ", name: " << deviceName
-                                          << " " << (info.isConnected ? "connected" : "disconnected"));
+        Ingest::DeviceEvent e;
+        e.kind        = Ingest::DeviceEventKind::bleAdded;
+        e.id          = winrt::to_string(added.Id());
+        e.containerId = winrt::to_string(winrt::to_hstring(*id));
+        e.name        = winrt::to_string(added.Name());
+        e.flag        = Util::getPropertyOr<bool>(props, L"System.Devices.Aep.IsConnected", {});
 
-                const ScopedLock lock(deviceChanges);
-                bleDeviceInfos.insert_or_assign(deviceID, info);
-            }
-        }
+        if (e.containerId.isNotEmpty())
+            devices.post(std::move(e));
     }
 
     void bleDeviceRemoved(const DeviceWatcher&, const DeviceInformationUpdate& removed)
     {
-        const auto removedDeviceId = String(winrt::to_string(removed.Id()));
-
-        DBG("Removing BLE device: " << removedDeviceId);
+        Ingest::TraceScope trace(Ingest::TracePoint::watcherCallback);
+        trace.setArgs(static_cast<int64_t>(Ingest::DeviceEventKind::bleRemoved));
 
-        const ScopedLock lock(deviceChanges);
-        if (bleDeviceInfos.contains(removedDeviceId))
-            bleDeviceInfos.erase(removedDeviceId);
+        devices.post({.kind = Ingest::DeviceEventKind::bleRemoved, .id = winrt::to_string(removed.Id())});
     }
 
     void bleDeviceUpdated(const DeviceWatcher&, const DeviceInformationUpdate& updated)
     {
-        DBG("Device updated: " << String(winrt::to_string(updated.Id())));
+        Ingest::TraceScope trace(Ingest::TracePoint::watcherCallback);
+        trace.setArgs(static_cast<int64_t>(Ingest::DeviceEventKind::bleUpdated));
 
-        const auto updatedDeviceId = String(winrt::to_string(updated.Id()));
-
-        if (const auto opt = Util::getProperty<bool>(updated.Properties(), L"System.Devices.Aep.IsConnected"); opt.has_value())
-        {
-            const bool is_connected = *opt;
+        const auto connected = Util::getProperty<bool>(updated.Properties(), L"System.Devices.Aep.IsConnected");
 
-            DBG("Is connected? " << (is_connected ? "Yes" : "No"));
-
-            const ScopedLock lock(deviceChanges);
-
-            if (bleDeviceInfos.contains(updatedDeviceId))
-            {
-                auto& info = bleDeviceInfos.at(updatedDeviceId);
-
-                if (info.isConnected != is_connected)
-                {
-                    DBG("BLE device connection status change: " << updatedDeviceId << " " << info.containerID << " " << (is_connected ? "connected" : "disconnected"));
-
-                    if (is_connected)
-                    {
-                        if (const auto it = bleDevices.find(updatedDeviceId); it == bleDevices.end())
-                        {
-                            const auto callback = [wr = WeakReference(this), updatedDeviceId](auto bytes)
-                            {
-                                if (auto* p = wr.get())
-                                    p->handleIncomingBlePacket(updatedDeviceId, bytes);
-                            };
-
-                            bleDevices.emplace(std::make_pair(updatedDeviceId, std::make_unique<BleDevice>(updatedDeviceId, callback)));
-                        }
-                    }
-                    else if (const auto it = bleDevices.find(updatedDeviceId); it != bleDevices.end())
-                    {
-                        bleDevices.erase(it);
-
-                        const auto& id      = info.containerID;
-
-                        const ScopedLock midiLock(deviceChanges);
-                        const auto       mp = std::find_if(midiPorts.begin(), midiPorts.end(),
-                                [&](const auto& mp) { return mp->getIdentifier() == id; });
-
-                        DBG("Closing midi device: " << id);
-                        midiPorts.erase(mp);
-                    }
-                }
-
-                info.isConnected = is_connected;
-            }
-        }
-    }
-
-    void handleIncomingMidiMessage(const String& deviceIdentifier, const MidiMessage& msg)
-    {
-        {
-            const ScopedLock lock(midiMessageLock);
-
-            if (const auto it = midiMessageCount.find(deviceIdentifier); it != midiMessageCount.end())
-                it->second++;
-            else
-                midiMessageCount.insert(std::make_pair(deviceIdentifier, 1));
-        }
-
-        triggerAsyncUpdate();
-    }
-
-    void handleIncomingBlePacket(const String& deviceId, const std::vector<uint8_t>&)
-    {
-        {
-            const ScopedLock lock(blePacketLock);
-
-            if (const auto it = blePacketCount.find(deviceId); it != blePacketCount.end())
-                it->second++;
-            else
-                blePacketCount.insert(std::make_pair(deviceId, 1));
-        }
+        if (!connected.has_value())
+            return;
 
-        triggerAsyncUpdate();
+        devices.post({.kind = Ingest::DeviceEventKind::bleUpdated, .id = winrt::to_string(updated.Id()), .flag = connected});
     }
 
 private:
     //==================================================================================================================
-    void handleAsyncUpdate() override { repaint(); }
-
+    /** Repaints when the published stats, the shares or the device list moved since the last frame, and not otherwise. */
     void timerCallback() override
     {
-        const ScopedLock lock(deviceChanges);
-
-        lastQueriedAvailableDevices.resize(midiDeviceInfos.size());
-        std::transform(midiDeviceInfos.cbegin(), midiDeviceInfos.cend(), lastQueriedAvailableDevices.begin(),
-                [](const auto& d) { return MidiDeviceInfo{d.name, d.containerID}; });
-
-        for (const auto&[name, id] : lastQueriedAvailableDevices)
+        fairness.drainEvents([](const Ingest::StarvationEvent& e)
         {
-            const auto it = std::find_if(midiPorts.begin(), midiPorts.end(), [id = id](const auto& mp)
-            {
-                return mp->getIdentifier() == id;
-            });
-
-            if (it == midiPorts.end())
-            {
-                DBG("Opening midi device: " << id << " " << name << ", num open ports: " << String(midiPorts.size()));
-
-                const auto callback = [wr = WeakReference(this), id = id](const MidiMessage& msg)
-                {
-                    if (auto* p = wr.get())
-                        p->handleIncomingMidiMessage(id, msg);
-                };
+            Ingest::Tracer::instant(e.starved ? Ingest::TracePoint::streamStarved : Ingest::TracePoint::streamRecovered,
+                                    e.device, e.kind == Ingest::StreamKind::ble, roundToInt(e.eventsPerSecond));
+        });
 
-                if (auto port = openWinRTMidiInput(id, callback); port != nullptr)
-                    midiPorts.push_back(std::move(port));
-            }
+        {
+            const Ingest::TracedScopedLock lock(deviceChanges);
+            connections.update();
+            stats.update();
         }
-    }
-
-    //==================================================================================================================
-    auto openWinRTMidiInput(const String& identifier, const WinRTMidiInput::Callback& callback) const -> std::unique_ptr<WinRTMidiInput>
-    {
-        const ScopedLock lock(deviceChanges);
 
-        const auto it = std::find_if(midiDeviceInfos.cbegin(), midiDeviceInfos.cend(), [&](const auto& d)
+        connections.drainChanges([](const Ingest::ConnectionChange& c)
         {
-            return d.containerID == identifier;
+            Ingest::Tracer::instant(Ingest::TracePoint::connectionChanged, c.device, static_cast<int64_t>(c.from),
+                                    static_cast<int64_t>(c.to));
         });
 
-        jassert(it != midiDeviceInfos.cend());
+        const auto stats_version    = consumer.getVersion();
+        const auto fairness_version = fairness.getVersion();
+        const auto device_version   = devices.getVersion();
 
-        return std::make_unique<WinRTMidiInput>(identifier, it->deviceID, callback);
+        if (stats_version == paintedStatsVersion && fairness_version == paintedFairnessVersion
+            && device_version == paintedDeviceVersion)
+            return;
+
+        paintedStatsVersion    = stats_version;
+        paintedFairnessVersion = fairness_version;
+        paintedDeviceVersion   = device_version;
+
+        Ingest::Tracer::instant(Ingest::TracePoint::repaintRequested);
+        repaint();
     }
 
     //==================================================================================================================
@@ -550,6 +350,7 @@ private:
     {
         const std::vector<winrt::hstring> props{
                 L"System.Devices.ContainerId",
+                L"System.Devices.InterfaceEnabled",
                 L"System.Devices.Aep.ContainerId",
                 L"System.Devices.Aep.IsConnected"
         };
@@ -558,36 +359,27 @@ private:
     }
 
     //==================================================================================================================
-    struct WinRTMidiDeviceInfo
-    {
-        String deviceID{}, containerID{}, name{};
-        bool   isDefault = false;
-    };
-
-    struct BleDeviceInfo
-    {
-        String containerID;
-        bool   isConnected;
-    };
-
-    //==================================================================================================================
-    CriticalSection                  deviceChanges;
-    std::vector<WinRTMidiDeviceInfo> midiDeviceInfos;
-    std::map<String, BleDeviceInfo>  bleDeviceInfos;
-
-    std::vector<MidiDeviceInfo> lastQueriedAvailableDevices;
+    CriticalSection deviceChanges;
+    const File      traceDestination;
 
-    std::vector<std::unique_ptr<WinRTMidiInput>> midiPorts;
-    std::map<String, std::unique_ptr<BleDevice>> bleDevices;
+    WinRTBackend                             backend;
+    std::unique_ptr<Ingest::CaptureRecorder> recorder;
+    Ingest::DeviceRegistry                   registry{64, &consumer};
+    Ingest::IngestConsumer                   consumer{registry};
+    Ingest::FairnessAnalyzer                 fairness{registry};
+    Ingest::ConnectionManager                connections{registry, fairness};
+    Ingest::StatsPublisher                   stats{registry, fairness, connections};
+    Ingest::DeviceTable                      devices{registry, backend, deviceChanges, 2};
+    std::unique_ptr<Ingest::Subscription>    recording;
 
-    CriticalSection                   midiMessageLock, blePacketLock;
-    std::vector<MidiMessage>          incomingMidiMessages;
-    std::vector<std::vector<uint8_t>> incomingBlePackets;
+    // The stats are versioned by the consumer, the shares by the analyzer, the open ports by the device table
+    uint64_t paintedStatsVersion = 0, paintedFairnessVersion = 0, paintedDeviceVersion = 0;
 
-    std::map<String, int> midiMessageCount, blePacketCount;
+    static constexpr int defaultRefreshRateHz = 30;
 
     //==================================================================================================================
-    DeviceWatcher midiInputWatcher, bleDeviceWatcher;
+    DeviceWatcher                  midiInputWatcher, bleDeviceWatcher;
+    DeviceWatcher::Stopped_revoker midiWatcherStopped, bleWatcherStopped;
 
     //==================================================================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MainComponent)
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "HostClock.h"
+
+#include <span>
+
+//======================================================================================================================
+namespace Ingest {
+
+/**
+    A received MIDI message in a fixed 32 byte record.
+
+    Anything up to eight bytes (every channel-voice and system-common message, and the shortest SysEx) is stored
+    inline. Longer SysEx is spilled into the channel's pool, in which case spilled points at the payload for as long
+    as the record is being drained, or split into fragments if it's too long for that. Consumers that need a
+    juce::MidiMessage build one with toMidiMessage(); nothing on the receive path does.
+
+    hostTime is hostNanos() at callback entry. deviceTime is the platform's own timestamp for the message, in
+    nanoseconds, or noDeviceTime if it didn't supply one.
+*/
+struct MidiEvent
+{
+    int64_t hostTime   = 0;
+    int64_t deviceTime = noDeviceTime;
+
+    union
+    {
+        uint8_t        bytes[8] = {};
+        const uint8_t* spilled;
+    };
+
+    uint32_t size   = 0;
+    uint16_t slot   = 0;
+    uint16_t source = 0;
+
+    static constexpr size_t maxInlineSize = sizeof(bytes);
+
+    //==================================================================================================================
+    [[nodiscard]] bool isSpilled() const { return size > maxInlineSize; }
+
+    [[nodiscard]] std::span<const uint8_t> getBytes() const
+    {
+        return {isSpilled() ? spilled : bytes, size};
+    }
+
+    /**
+        Part of a SysEx message too long for one of its channel's slots: the first of the run starts with F0 but
+        doesn't end with F7, the others start with a data byte (or are the lone F7). See TransferAssembler.
+    */
+    [[nodiscard]] bool isSysExFragment() const
+    {
+        const auto b = getBytes();
+        return !b.empty() && (b[0] < 0x80 || b[0] == 0xf7 || (b[0] == 0xf0 && b.back() != 0xf7));
+    }
+
+    [[nodiscard]] MidiMessage toMidiMessage() const
+    {
+        const auto b = getBytes();
+        return MidiMessage(b.data(), static_cast<int>(b.size()), static_cast<double>(hostTime) * 1.0e-9);
+    }
+};
+
+static_assert(sizeof(MidiEvent) == 32);
+static_assert(std::is_trivially_copyable_v<MidiEvent>);
+} // namespace Ingest
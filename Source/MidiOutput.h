@@ -0,0 +1,215 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "BleMidi.h"
+#include "IngestSource.h"
+#include "LatencyHistogram.h"
+#include "MidiEvent.h"
+
+//======================================================================================================================
+namespace Ingest {
+
+/**
+    A BLE-MIDI output: a send queue in front of a BlePacketWriter.
+
+    send() only copies the message into a wait-free queue, the same fixed records and SysEx pool a MidiChannel uses,
+    so it can be called from a real-time thread. flush(), on the MidiSender's thread, then drains everything queued
+    through a BleMidi::Encoder sized to the writer's current packet size, so a burst of messages goes out in a
+    handful of full packets instead of a write (and a connection event) each.
+
+    One thread sends and one thread flushes. Messages queued before the writer knows its packet size wait in the
+    queue; once it's full, further sends are dropped and counted.
+*/
+class MidiOutPort
+{
+public:
+    explicit MidiOutPort(std::unique_ptr<BlePacketWriter> packetWriter, size_t capacity = 1024,
+                         size_t sysExSlots = 16, size_t sysExSlotSize = 1024)
+            : writer(std::move(packetWriter)),
+              queue(capacity),
+              sysExPool(sysExSlots, sysExSlotSize)
+    {
+        jassert(writer != nullptr);
+        jassert(sysExSlots <= std::numeric_limits<uint16_t>::max());
+    }
+
+    [[nodiscard]] const String& getIdentifier() const { return writer->getIdentifier(); }
+
+    //==================================================================================================================
+    /** Sender side. hostTime is what the message is stamped with on the wire, to the millisecond. */
+    bool send(const uint8_t* data, size_t size, int64_t hostTime = hostNanos())
+    {
+        MidiEvent e;
+        e.hostTime = hostTime;
+        e.size     = static_cast<uint32_t>(size);
+
+        if (size <= MidiEvent::maxInlineSize)
+        {
+            std::memcpy(e.bytes, data, size);
+            return enqueue(e);
+        }
+
+        // Only take a slot once the queue is known to have room, so a slot is never stranded on this thread
+        if (size > sysExPool.getSlotSize() || queue.isFull())
+            return enqueue(std::nullopt);
+
+        const auto packet = sysExPool.acquire(data, size);
+
+        if (!packet.has_value())
+            return enqueue(std::nullopt);
+
+        e.spilled = packet->data;
+        e.slot    = static_cast<uint16_t>(packet->slot);
+        return enqueue(e);
+    }
+
+    bool send(const MidiMessage& m, int64_t hostTime = hostNanos())
+    {
+        return send(m.getRawData(), static_cast<size_t>(m.getRawDataSize()), hostTime);
+    }
+
+    /** Flusher side. Packs everything queued so far and writes it out; returns the number of packets written. */
+    size_t flush()
+    {
+        const auto max_packet_size = writer->getMaxPacketSize();
+
+        if (max_packet_size == 0)
+            return 0;
+
+        encoder.setMaxPacketSize(max_packet_size);
+
+        const auto now     = hostNanos();
+        size_t     packets = 0;
+
+        const auto write = [&](std::span<const uint8_t> packet)
+        {
+            ++packets;
+
+            if (!writer->write(packet))
+                writeFailures.fetch_add(1, std::memory_order_relaxed);
+        };
+
+        const auto n = queue.drain([&](const MidiEvent& e)
+        {
+            sendLatency.record(now - e.hostTime);
+            encoder.add(e.getBytes(), e.hostTime, write);
+
+            if (e.isSpilled())
+                sysExPool.release({e.spilled, e.size, e.slot});
+        });
+
+        encoder.flush(write);
+
+        if (n > 0)
+        {
+            sent.fetch_add(n, std::memory_order_relaxed);
+            packetsWritten.fetch_add(packets, std::memory_order_relaxed);
+            flushes.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        return packets;
+    }
+
+    //==================================================================================================================
+    [[nodiscard]] uint64_t getSentCount() const { return sent.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t getDroppedCount() const { return dropped.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t getPacketsWritten() const { return packetsWritten.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t getWriteFailures() const { return writeFailures.load(std::memory_order_relaxed); }
+
+    /** Flushes that found something to send. */
+    [[nodiscard]] uint64_t getFlushCount() const { return flushes.load(std::memory_order_relaxed); }
+
+    /** From send() to the flush that packed it. */
+    [[nodiscard]] const LatencyHistogram& getSendLatency() const { return sendLatency; }
+
+private:
+    bool enqueue(std::optional<MidiEvent> e)
+    {
+        if (e.has_value() && queue.push(*e))
+            return true;
+
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    //==================================================================================================================
+    std::unique_ptr<BlePacketWriter> writer;
+
+    SpscRing<MidiEvent> queue;
+    PacketPool          sysExPool;
+
+    // Flusher only
+    BleMidi::Encoder encoder;
+    LatencyHistogram sendLatency;
+
+    std::atomic<uint64_t> sent{0}, dropped{0}, packetsWritten{0}, writeFailures{0}, flushes{0};
+
+    JUCE_DECLARE_NON_COPYABLE (MidiOutPort)
+};
+
+//======================================================================================================================
+/**
+    Flushes a set of MidiOutPorts on a fixed schedule, normally once per BLE connection interval (7.5 ms, or a
+    multiple of 1.25 ms above that), so everything sent in between goes out together in the next connection event.
+
+    Flushes are scheduled on a fixed grid rather than a fixed gap, so a slow flush doesn't push the next one back.
+    Ports can be added and removed while it runs.
+*/
+class MidiSender : private Thread
+{
+public:
+    explicit MidiSender(int flushIntervalMicros = 7500)
+            : Thread("MIDI sender"),
+              interval(static_cast<int64_t>(jmax(250, flushIntervalMicros)) * 1000)
+    {
+    }
+
+    ~MidiSender() override { stop(); }
+
+    void start() { startThread(); }
+    void stop() { stopThread(1000); }
+
+    void add(MidiOutPort& port)
+    {
+        const ScopedLock sl(portChanges);
+        ports.push_back(&port);
+    }
+
+    /** Once this returns, the port isn't being flushed any more. */
+    void remove(MidiOutPort& port)
+    {
+        const ScopedLock sl(portChanges);
+        ports.erase(std::remove(ports.begin(), ports.end(), &port), ports.end());
+    }
+
+    [[nodiscard]] int64_t getFlushInterval() const { return interval; }
+
+private:
+    void run() override
+    {
+        for (auto next = hostNanos() + interval; !threadShouldExit(); next += interval)
+        {
+            const auto remaining = next - hostNanos();
+
+            // Rounded up, so a flush never goes out ahead of its slot
+            if (remaining > 0 && wait(static_cast<int>((remaining + 999999) / 1000000)))
+                return;
+
+            const ScopedLock sl(portChanges);
+
+            for (auto* p : ports)
+                p->flush();
+
+            // Slots already missed are skipped rather than flushed back to back
+            if (const auto now = hostNanos(); now - next > interval)
+                next = now - (now - next) % interval;
+        }
+    }
+
+    const int64_t interval;
+
+    CriticalSection           portChanges;
+    std::vector<MidiOutPort*> ports;
+};
+} // namespace Ingest
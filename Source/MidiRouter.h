@@ -0,0 +1,255 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "IngestConsumer.h"
+#include "MidiOutput.h"
+
+//======================================================================================================================
+namespace Ingest {
+
+/** The kinds of MIDI message a RouteRule can select, one bit per status nibble from 8 to F. */
+namespace MessageTypes {
+constexpr uint8_t noteOff         = 1 << 0;
+constexpr uint8_t noteOn          = 1 << 1;
+constexpr uint8_t polyPressure    = 1 << 2;
+constexpr uint8_t controlChange   = 1 << 3;
+constexpr uint8_t programChange   = 1 << 4;
+constexpr uint8_t channelPressure = 1 << 5;
+constexpr uint8_t pitchBend       = 1 << 6;
+constexpr uint8_t system          = 1 << 7; // SysEx, system common and real-time
+constexpr uint8_t all             = 0xff;
+} // namespace MessageTypes
+
+/**
+    Selects messages and sends them to a set of destinations (or, for a blocking rule, stops them going there).
+
+    Channels don't apply to system messages.
+*/
+struct RouteRule
+{
+    static constexpr int anyPort = -1;
+
+    int      port         = anyPort; // a DeviceHandle
+    uint16_t channels     = 0xffff;  // bit n is MIDI channel n + 1
+    uint8_t  types        = MessageTypes::all;
+
+    /**
+        The data1 range, inclusive: the note for notes and poly pressure, the controller for control changes. Every
+        other message matches whatever its data1, which is a program, a pressure, a pitch bend's low bits or a
+        manufacturer id, so a keyboard split still passes pitch bend, aftertouch, SysEx and clock.
+    */
+    uint8_t  lowest       = 0, highest = 127;
+    uint32_t destinations = 0;     // bits from MidiRouter::addDestination()
+    bool     block        = false; // clears the destinations a match has collected so far, rather than adding them
+};
+
+//======================================================================================================================
+/**
+    Routes incoming MIDI to MidiOutPorts and EventSinks by rules: by port, channel, message type and data1 range.
+
+    The rules are never looked at per message. setRules() compiles them, in order, into one dense table per port,
+    status byte by data1, of destination bits; a message costs a table lookup and a walk over the bits that are set.
+    Ports without rules of their own share the table the rules for any port make.
+
+    A new rule set is swapped in with a single atomic store, RCU style: the router keeps reading whichever set it
+    picked up last, and announces it as its hazard pointer, so a set that's been replaced is only freed once the
+    router has moved on from it. Routing therefore never locks, waits or allocates, whatever setRules() is doing.
+    SysEx too long to reach the router in one piece (see MidiChannel) isn't routed.
+
+    As a sink it has to be called from one thread, since it feeds MidiOutPorts (single producer) directly: a
+    Subscription's, or a consumer with just the one worker. Destinations are added before it's first called;
+    setRules() can be called from any thread, at any time.
+*/
+class MidiRouter : public EventSink
+{
+public:
+    static constexpr int maxDestinations = 32;
+
+    explicit MidiRouter(size_t portCount) : numPorts(portCount)
+    {
+        current.store(compile({}).release(), std::memory_order_release);
+    }
+
+    ~MidiRouter() override { delete current.load(std::memory_order_acquire); }
+
+    //==================================================================================================================
+    /** Returns the destination's bit for RouteRule::destinations, or -1 if they're all taken. */
+    int addDestination(MidiOutPort& port) { return addDestination(Destination{&port, nullptr}); }
+    int addDestination(EventSink& sink) { return addDestination(Destination{nullptr, &sink}); }
+
+    /** Compiles the rules on the calling thread and swaps them in. */
+    void setRules(std::span<const RouteRule> rules)
+    {
+        auto compiled = compile(rules);
+
+        const ScopedLock sl(ruleChanges);
+
+        retired.emplace_back(current.exchange(compiled.release(), std::memory_order_seq_cst));
+
+        // Anything the router isn't holding is no longer reachable
+        const auto* in_use = hazard.load(std::memory_order_seq_cst);
+        std::erase_if(retired, [in_use](const auto& r) { return r.get() != in_use; });
+    }
+
+    //==================================================================================================================
+    void midiEvent(DeviceHandle device, const MidiEvent& event) override
+    {
+        const auto bytes = event.getBytes();
+
+        if (bytes.empty() || event.isSysExFragment() || device >= numPorts)
+            return;
+
+        const auto targets = acquire().lookup(device, bytes[0], bytes.size() > 1 ? bytes[1] : uint8_t{0});
+
+        if (targets == 0)
+        {
+            ++filtered;
+            return;
+        }
+
+        ++routed;
+
+        for (auto bits = targets; bits != 0; bits &= bits - 1)
+        {
+            const auto& d = destinations[static_cast<size_t>(std::countr_zero(bits))];
+
+            if (d.port != nullptr)
+                d.port->send(bytes.data(), bytes.size(), event.hostTime);
+            else if (d.sink != nullptr)
+                d.sink->midiEvent(device, event);
+        }
+    }
+
+    void blePacket(DeviceHandle, const PacketView&) override {}
+
+    //==================================================================================================================
+    /** Router thread only, or once it's stopped. */
+    [[nodiscard]] uint64_t getRoutedCount() const { return routed; }
+    [[nodiscard]] uint64_t getFilteredCount() const { return filtered; }
+
+    /** How many distinct port tables the current rules compiled to; from the thread that sets them. */
+    [[nodiscard]] size_t getNumTables() const
+    {
+        const ScopedLock sl(ruleChanges);
+        return current.load(std::memory_order_acquire)->tables.size();
+    }
+
+private:
+    //==================================================================================================================
+    struct Destination
+    {
+        MidiOutPort* port = nullptr;
+        EventSink*   sink = nullptr;
+    };
+
+    /** Status bytes 0x80 to 0xff by data1. */
+    using Table = std::array<uint32_t, 128 * 128>;
+
+    struct CompiledRules
+    {
+        std::vector<std::unique_ptr<Table>> tables; // the first is the one for ports without rules of their own
+        std::vector<const Table*>           byPort;
+
+        [[nodiscard]] uint32_t lookup(DeviceHandle port, uint8_t status, uint8_t data1) const
+        {
+            return (*byPort[port])[static_cast<size_t>(status - 0x80) * 128 + (data1 & 0x7f)];
+        }
+    };
+
+    int addDestination(Destination d)
+    {
+        if (numDestinations == maxDestinations)
+        {
+            jassertfalse;
+            return -1;
+        }
+
+        destinations[static_cast<size_t>(numDestinations)] = d;
+        return numDestinations++;
+    }
+
+    /** Router side. Announces the current rules as its hazard before touching them. */
+    const CompiledRules& acquire()
+    {
+        for (auto* r = current.load(std::memory_order_acquire); r != held; r = current.load(std::memory_order_seq_cst))
+        {
+            hazard.store(r, std::memory_order_seq_cst);
+            held = r;
+        }
+
+        return *held;
+    }
+
+    //==================================================================================================================
+    std::unique_ptr<CompiledRules> compile(std::span<const RouteRule> rules) const
+    {
+        auto compiled = std::make_unique<CompiledRules>();
+
+        const auto build = [&](int port)
+        {
+            auto& table = *compiled->tables.emplace_back(std::make_unique<Table>());
+
+            for (const auto& rule : rules)
+                if (rule.port == RouteRule::anyPort || rule.port == port)
+                    apply(table, rule);
+
+            return &table;
+        };
+
+        const auto* shared = build(RouteRule::anyPort);
+        compiled->byPort.assign(numPorts, shared);
+
+        for (const auto& rule : rules)
+        {
+            if (rule.port == RouteRule::anyPort || rule.port < 0 || static_cast<size_t>(rule.port) >= numPorts)
+                continue;
+
+            if (auto& slot = compiled->byPort[static_cast<size_t>(rule.port)]; slot == shared)
+                slot = build(rule.port);
+        }
+
+        return compiled;
+    }
+
+    static void apply(Table& table, const RouteRule& rule)
+    {
+        const auto lowest  = static_cast<size_t>(jmin<uint8_t>(rule.lowest, 127));
+        const auto highest = static_cast<size_t>(jmin<uint8_t>(rule.highest, 127));
+
+        for (size_t status = 0x80; status <= 0xff; ++status)
+        {
+            const auto type   = static_cast<uint8_t>(1 << ((status >> 4) - 8));
+            const auto ranged = status < 0xc0; // notes, poly pressure and control changes
+
+            if ((rule.types & type) == 0)
+                continue;
+
+            if (status < 0xf0 && (rule.channels & (1 << (status & 0x0f))) == 0)
+                continue;
+
+            auto* row = table.data() + (status - 0x80) * 128;
+
+            for (auto data1 = ranged ? lowest : 0; data1 <= (ranged ? highest : 127); ++data1)
+                row[data1] = rule.block ? row[data1] & ~rule.destinations : row[data1] | rule.destinations;
+        }
+    }
+
+    //==================================================================================================================
+    const size_t numPorts;
+
+    std::array<Destination, maxDestinations> destinations{};
+    int                                       numDestinations = 0;
+
+    std::atomic<CompiledRules*>       current{nullptr};
+    std::atomic<const CompiledRules*> hazard{nullptr};
+
+    // Router thread only
+    const CompiledRules* held     = nullptr;
+    uint64_t             routed   = 0;
+    uint64_t             filtered = 0;
+
+    CriticalSection                             ruleChanges;
+    std::vector<std::unique_ptr<CompiledRules>> retired; // replaced, and possibly still held by the router
+};
+} // namespace Ingest
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "HostClock.h"
+#include "SpscRing.h"
+
+#include <span>
+
+//======================================================================================================================
+namespace Ingest {
+
+/** An ATT attribute value never exceeds 512 bytes, so neither does a notification, whatever MTU gets negotiated. */
+constexpr size_t maxBlePayloadSize = 512;
+
+/**
+    A packet living in a PacketPool slot. It stays valid until it's handed back with PacketPool::release().
+
+    The timestamps follow MidiEvent's conventions; the pool itself leaves them alone.
+*/
+struct PacketView
+{
+    const uint8_t* data       = nullptr;
+    uint32_t       size       = 0;
+    uint32_t       slot       = 0;
+    int64_t        hostTime   = 0;
+    int64_t        deviceTime = noDeviceTime;
+
+    [[nodiscard]] std::span<const uint8_t> bytes() const { return {data, size}; }
+};
+
+//======================================================================================================================
+/**
+    One device's fixed slab of equally sized packet slots.
+
+    The slab is allocated once, up front. Its free list is an SpscRing of slot indices: the device callback takes
+    slots, and whichever one thread is finished with them gives them back (a channel's own producer, once its
+    readers are done; an output's flusher). Both ends are therefore wait-free and the steady state never touches the
+    heap.
+*/
+class PacketPool
+{
+public:
+    PacketPool(size_t numSlots, size_t slotSizeBytes = maxBlePayloadSize)
+            : slotSize(slotSizeBytes),
+              storage(numSlots * slotSizeBytes),
+              freeSlots(numSlots)
+    {
+        for (uint32_t i = 0; i < static_cast<uint32_t>(numSlots); ++i)
+            freeSlots.push(i);
+    }
+
+    //==================================================================================================================
+    /** Producer side. Copies the payload into a free slot; returns nothing if the pool is exhausted. */
+    auto acquire(const uint8_t* data, size_t size) -> std::optional<PacketView>
+    {
+        jassert(size <= slotSize);
+
+        uint32_t slot;
+
+        if (!freeSlots.pop(slot))
+            return std::nullopt;
+
+        auto* dest = storage.data() + static_cast<size_t>(slot) * slotSize;
+        const auto n = std::min(size, slotSize);
+
+        std::memcpy(dest, data, n);
+
+        return PacketView{dest, static_cast<uint32_t>(n), slot};
+    }
+
+    /** The releasing side. */
+    void release(const PacketView& packet)
+    {
+        [[maybe_unused]] const auto ok = freeSlots.push(packet.slot);
+        jassert(ok);
+    }
+
+    //==================================================================================================================
+    [[nodiscard]] size_t getSlotSize() const { return slotSize; }
+    [[nodiscard]] size_t getNumSlots() const { return storage.size() / slotSize; }
+
+private:
+    const size_t         slotSize;
+    std::vector<uint8_t> storage;
+    SpscRing<uint32_t>   freeSlots;
+};
+} // namespace Ingest
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+//======================================================================================================================
+namespace Ingest {
+
+/**
+    A single-writer sequence lock around a small trivially copyable value.
+
+    The writer never waits: it bumps the sequence to odd, copies the value in and bumps it back to even. Readers copy
+    the value out and retry if the sequence moved underneath them, so they never block the writer either. The value
+    is kept as relaxed atomic words, which keeps the racing copy well defined.
+
+    The sequence doubles as a version: it only changes when a new value is published.
+*/
+template<typename T>
+class SeqLock
+{
+public:
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    SeqLock() { store(T{}); }
+
+    //==================================================================================================================
+    /** Writer side. */
+    void store(const T& value)
+    {
+        const auto seq = sequence.load(std::memory_order_relaxed);
+
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        std::array<uint64_t, numWords> w{};
+        std::memcpy(w.data(), &value, sizeof(T));
+
+        for (size_t i = 0; i < numWords; ++i)
+            words[i].store(w[i], std::memory_order_relaxed);
+
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    /** Reader side. Returns false, leaving out alone, if the writer was busy. */
+    bool tryLoad(T& out) const
+    {
+        const auto before = sequence.load(std::memory_order_acquire);
+
+        if ((before & 1) != 0)
+            return false;
+
+        std::array<uint64_t, numWords> w{};
+
+        for (size_t i = 0; i < numWords; ++i)
+            w[i] = words[i].load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (sequence.load(std::memory_order_relaxed) != before)
+            return false;
+
+        std::memcpy(static_cast<void*>(&out), w.data(), sizeof(T));
+        return true;
+    }
+
+    /** Reader side. Spins until it gets a consistent copy, which is immediate unless a store is in progress. */
+    [[nodiscard]] T load() const
+    {
+        T value{};
+
+        while (!tryLoad(value))
+            std::this_thread::yield();
+
+        return value;
+    }
+
+    [[nodiscard]] uint64_t getVersion() const { return sequence.load(std::memory_order_acquire) / 2; }
+
+private:
+    static constexpr size_t numWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<uint64_t>                        sequence{0};
+    std::array<std::atomic<uint64_t>, numWords> words{};
+};
+} // namespace Ingest
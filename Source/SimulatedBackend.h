@@ -0,0 +1,587 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "BleMidi.h"
+#include "IngestSource.h"
+#include "Tracer.h"
+
+#include <array>
+#include <chrono>
+#include <random>
+#include <span>
+#include <thread>
+
+//======================================================================================================================
+namespace Simulation {
+
+struct DeviceSettings
+{
+    String name;
+    double midiMessagesPerSecond = 500.0;
+    double blePacketsPerSecond   = 200.0;
+    double jitter                = 0.1; // fraction of the nominal interval, uniformly distributed
+    int    blePayloadSize        = 20;
+    double sysExFraction         = 0.0; // share of MIDI messages that are SysEx
+    int    sysExSize             = 64;  // including F0 and F7
+    int    burstSize             = 1;   // events emitted back to back per wakeup; the average rate stays the same
+    double discoveryMillis       = 0.0; // BLE connect to first notification when GATT has to be discovered over the air
+    double cachedDiscoveryMillis = 0.0; // the same, for a device whose GATT handles are already known
+    double connectionIntervalMs  = 7.5; // how often the link gets to send, i.e. when written packets go out
+    int    packetsPerEvent       = 6;   // how many packets fit into one connection event
+    int    attMtu                = 185;
+};
+
+//======================================================================================================================
+/**
+    Produces a deterministic stream of MIDI messages: a cycle of note on, note off, controller and pitch bend on one
+    channel, with SysEx of a fixed size mixed in at the given fraction. Never allocates after construction.
+*/
+class MessageMix
+{
+public:
+    MessageMix(int midiChannel, double sysExFraction, int sysExSize)
+            : channel(static_cast<uint8_t>(midiChannel & 0x0f)),
+              fraction(jlimit(0.0, 1.0, sysExFraction)),
+              sysEx(static_cast<size_t>(jmax(2, sysExSize)), uint8_t{0x55})
+    {
+        sysEx.front() = 0xf0;
+        sysEx.back()  = 0xf7;
+    }
+
+    /** The returned bytes stay valid until the next call. */
+    std::span<const uint8_t> next()
+    {
+        if ((sysExDue += fraction) >= 1.0)
+        {
+            sysExDue -= 1.0;
+            return sysEx;
+        }
+
+        const auto n = step++ % 4;
+
+        const auto status = static_cast<uint8_t>(std::array<int, 4>{0x90, 0x80, 0xb0, 0xe0}[n] | channel);
+        const auto data1  = static_cast<uint8_t>(n == 2 ? 1 : 60);
+        const auto data2  = static_cast<uint8_t>(step & 0x7f);
+
+        shortMessage = {status, data1, data2};
+        return shortMessage;
+    }
+
+private:
+    const uint8_t          channel;
+    const double           fraction;
+    double                 sysExDue = 0.0;
+    uint32_t               step     = 0;
+    std::vector<uint8_t>   sysEx;
+    std::array<uint8_t, 3> shortMessage{};
+};
+
+/**
+    The README's observation, modelled: the most recently connected link streams at its nominal rate while every
+    older link only gets olderLinkShare of it. A share of 1 disables the effect.
+
+    With a connectionEventBudget, links are also limited by their connection parameters: each gets a connection event
+    every intervalMs of its ConnectionProfile, carrying up to eventsPerConnectionEvent of its MIDI messages and
+    notifications together, and if all the links' events add up to more than the central can schedule, every link
+    gets that much fewer. Without one, links carry whatever they're given.
+*/
+struct RadioSettings
+{
+    double olderLinkShare           = 1.0;
+    double connectionEventBudget    = 0.0; // per second, over all links; 0 leaves the links unlimited
+    double eventsPerConnectionEvent = 4.0;
+
+    std::array<double, Ingest::numConnectionProfiles> intervalMs{90.0, 30.0, 7.5};
+};
+
+//======================================================================================================================
+/**
+    Tracks the order in which the simulated devices' links come up, and what each of them can carry.
+
+    A link starts out balanced and changes profile the moment it's asked to, as if the peripheral accepted whatever
+    the central wanted; the stand-in for the platform's own policy.
+*/
+class Radio
+{
+public:
+    Radio(RadioSettings s, size_t numDevices) : settings(s), links(numDevices) {}
+
+    /** rate is what the emitter would produce on an unlimited link. */
+    void linkUp(int device, double rate)
+    {
+        const ScopedLock lock(linkChanges);
+
+        if (linkRefs[device]++ == 0)
+            newestLink.store(device);
+
+        links[static_cast<size_t>(device)].demand += rate;
+        updateCapacities();
+    }
+
+    void linkDown(int device, double rate)
+    {
+        const ScopedLock lock(linkChanges);
+
+        if (--linkRefs[device] == 0 && newestLink.load() == device)
+            newestLink.store(-1);
+
+        links[static_cast<size_t>(device)].demand -= rate;
+        updateCapacities();
+    }
+
+    void setConnectionProfile(int device, Ingest::ConnectionProfile profile)
+    {
+        const ScopedLock lock(linkChanges);
+
+        links[static_cast<size_t>(device)].profile.store(profile, std::memory_order_relaxed);
+        updateCapacities();
+    }
+
+    [[nodiscard]] Ingest::ConnectionProfile getConnectionProfile(int device) const
+    {
+        return links[static_cast<size_t>(device)].profile.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] double getRateScale(int device) const
+    {
+        const auto share = newestLink.load(std::memory_order_relaxed) == device ? 1.0 : settings.olderLinkShare;
+
+        return jmin(share, links[static_cast<size_t>(device)].capacityScale.load(std::memory_order_relaxed));
+    }
+
+    /** The connection events per second the links that are up ask for, against connectionEventBudget. */
+    [[nodiscard]] double getConnectionEventLoad() const { return connectionEventLoad.load(std::memory_order_relaxed); }
+
+private:
+    struct Link
+    {
+        double                                 demand = 0.0;
+        std::atomic<Ingest::ConnectionProfile> profile{Ingest::ConnectionProfile::balanced};
+        std::atomic<double>                    capacityScale{1.0}; // of the demand, that the link can carry
+    };
+
+    void updateCapacities()
+    {
+        if (settings.connectionEventBudget <= 0.0)
+            return;
+
+        const auto events_per_second = [this](const Link& l)
+        {
+            return 1000.0 / settings.intervalMs[static_cast<size_t>(l.profile.load(std::memory_order_relaxed))];
+        };
+
+        double total = 0.0;
+
+        for (const auto& [device, refs] : linkRefs)
+            if (refs > 0)
+                total += events_per_second(links[static_cast<size_t>(device)]);
+
+        const auto scheduled = total > settings.connectionEventBudget ? settings.connectionEventBudget / total : 1.0;
+
+        for (auto& l : links)
+        {
+            const auto capacity = events_per_second(l) * scheduled * settings.eventsPerConnectionEvent;
+            l.capacityScale.store(l.demand > capacity ? capacity / l.demand : 1.0, std::memory_order_relaxed);
+        }
+
+        connectionEventLoad.store(total, std::memory_order_relaxed);
+    }
+
+    const RadioSettings settings;
+
+    CriticalSection     linkChanges;
+    std::map<int, int>  linkRefs;
+    std::vector<Link>   links;
+    std::atomic<int>    newestLink{-1};
+    std::atomic<double> connectionEventLoad{0.0};
+};
+
+//======================================================================================================================
+/** Counters a simulated source keeps about itself, so the pipeline's share of the callback time can be measured. */
+struct SourceStats
+{
+    std::atomic<uint64_t> emitted{0};
+    std::atomic<uint64_t> callbackNanos{0};
+};
+
+/** Calls emit() at a nominal rate, scaled by the radio model, jittered per interval and optionally in bursts. */
+class Emitter : private Thread
+{
+public:
+    Emitter(const String& threadName, Radio& r, int deviceIndex, double ratePerSecond, const DeviceSettings& settings)
+            : Thread(threadName),
+              radio(r),
+              device(deviceIndex),
+              rate(ratePerSecond),
+              jitter(settings.jitter),
+              burstSize(jmax(1, settings.burstSize)),
+              random(static_cast<unsigned>(deviceIndex + 1))
+    {
+    }
+
+    ~Emitter() override { jassert(!isThreadRunning()); }
+
+    [[nodiscard]] const SourceStats& getStats() const { return stats; }
+
+protected:
+    using Clock = std::chrono::steady_clock;
+
+    virtual void emit() = 0;
+
+    /** The first event follows after the given delay, which is how a connect's setup time is modelled. */
+    void startEmitting(double delaySeconds = 0.0)
+    {
+        startDelay = delaySeconds;
+        radio.linkUp(device, rate);
+        startThread();
+    }
+
+    [[nodiscard]] Radio& getRadio() const { return radio; }
+    [[nodiscard]] int getDevice() const { return device; }
+
+    void stopEmitting()
+    {
+        stopThread(1000);
+        radio.linkDown(device, rate);
+    }
+
+private:
+    void run() override
+    {
+        std::uniform_real_distribution<double> spread(-jitter, jitter);
+
+        if (startDelay > 0.0 && wait(roundToInt(startDelay * 1000.0)))
+            return;
+
+        auto next = Clock::now();
+
+        while (!threadShouldExit())
+        {
+            const auto effective_rate = rate * radio.getRateScale(device);
+
+            if (effective_rate <= 0.0)
+            {
+                Thread::sleep(10);
+                next = Clock::now();
+                continue;
+            }
+
+            const auto interval = std::chrono::duration<double>(burstSize * (1.0 + spread(random)) / effective_rate);
+            next += std::chrono::duration_cast<Clock::duration>(interval);
+
+            // Falling far behind means the consumer is too slow; don't hide that behind a catch-up burst.
+            if (const auto now = Clock::now(); now - next > std::chrono::milliseconds(100))
+                next = now;
+
+            std::this_thread::sleep_until(next);
+
+            const auto start = Clock::now();
+
+            for (int i = 0; i < burstSize; ++i)
+                emit();
+
+            const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+
+            stats.callbackNanos.fetch_add(static_cast<uint64_t>(elapsed.count()), std::memory_order_relaxed);
+            stats.emitted.fetch_add(static_cast<uint64_t>(burstSize), std::memory_order_relaxed);
+        }
+    }
+
+    Radio&       radio;
+    const int    device;
+    const double rate, jitter;
+    const int    burstSize;
+    double       startDelay = 0.0;
+
+    std::minstd_rand random;
+    SourceStats      stats;
+};
+
+//======================================================================================================================
+class SimulatedMidiInput : public Ingest::MidiSource,
+                           public Emitter
+{
+public:
+    SimulatedMidiInput(String id, Radio& r, int deviceIndex, const DeviceSettings& settings,
+                       std::shared_ptr<Ingest::MidiChannel> ch, Ingest::SourceListener* listener)
+            : Emitter("Sim MIDI " + settings.name, r, deviceIndex, settings.midiMessagesPerSecond, settings),
+              identifier(std::move(id)),
+              mix(deviceIndex, settings.sysExFraction, settings.sysExSize),
+              channel(std::move(ch))
+    {
+        startEmitting();
+
+        // A simulated port opens instantly, so this is reported from inside Backend::openMidiInput()
+        if (listener != nullptr)
+            listener->midiSourceOpened(*this, true);
+    }
+
+    ~SimulatedMidiInput() override { stopEmitting(); }
+
+    [[nodiscard]] const String& getIdentifier() const override { return identifier; }
+
+private:
+    void emit() override
+    {
+        const auto host_time = Ingest::hostNanos();
+        const auto elapsed   = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started);
+        const auto bytes     = mix.next();
+
+        Ingest::TraceScope trace(Ingest::TracePoint::midiCallback, channel->getSourceIndex(), host_time);
+        trace.setArgs(static_cast<int64_t>(bytes.size()));
+
+        channel->push(bytes.data(), bytes.size(), host_time, elapsed.count());
+    }
+
+    const String            identifier;
+    const Clock::time_point started = Clock::now();
+    MessageMix              mix;
+
+    std::shared_ptr<Ingest::MidiChannel> channel;
+};
+
+//======================================================================================================================
+class SimulatedBleDevice : public Ingest::BlePacketSource,
+                           public Emitter
+{
+public:
+    SimulatedBleDevice(String id, Radio& r, int deviceIndex, const DeviceSettings& settings,
+                       std::shared_ptr<Ingest::BleChannel> ch, bool handlesCached)
+            : Emitter("Sim BLE " + settings.name, r, deviceIndex, settings.blePacketsPerSecond, settings),
+              identifier(std::move(id)),
+              payload(static_cast<size_t>(jlimit(1, static_cast<int>(Ingest::maxBlePayloadSize), settings.blePayloadSize))),
+              channel(std::move(ch))
+    {
+        startEmitting((handlesCached ? settings.cachedDiscoveryMillis : settings.discoveryMillis) * 0.001);
+    }
+
+    ~SimulatedBleDevice() override { stopEmitting(); }
+
+    [[nodiscard]] const String& getIdentifier() const override { return identifier; }
+
+    /** Always granted, straight away; see Radio. */
+    bool requestConnectionProfile(Ingest::ConnectionProfile profile) override
+    {
+        getRadio().setConnectionProfile(getDevice(), profile);
+        return true;
+    }
+
+private:
+    void emit() override
+    {
+        const auto host_time = Ingest::hostNanos();
+
+        Ingest::TraceScope trace(Ingest::TracePoint::bleCallback, channel->getSourceIndex(), host_time);
+        trace.setArgs(static_cast<int64_t>(payload.size()));
+
+        payload[0] = static_cast<uint8_t>(sequence++);
+
+        channel->push(payload.data(), payload.size(), host_time);
+    }
+
+    const String         identifier;
+    std::vector<uint8_t> payload;
+    uint32_t             sequence = 0;
+
+    std::shared_ptr<Ingest::BleChannel> channel;
+};
+
+//======================================================================================================================
+/**
+    The write side of a simulated BLE-MIDI link. Packets written are queued until the next connection event, every
+    connectionIntervalMs, which carries up to packetsPerEvent of them; the rest wait for the events after that.
+
+    Every delivered packet is decoded as the peripheral would decode it. If there's a loopback channel, the messages
+    go into it, stamped with the connection event's hostNanos() and the timestamp the packet carried, so what was
+    sent can be checked, and timed, on the other side.
+*/
+class SimulatedBleMidiOutput : public Ingest::BlePacketWriter,
+                               private Thread
+{
+public:
+    /** What the link has carried so far. */
+    struct LinkStats
+    {
+        std::atomic<uint64_t> connectionEvents{0}; // the ones that carried at least one packet
+        std::atomic<uint64_t> packets{0}, messages{0}, rejected{0};
+
+        Ingest::LatencyHistogram packetWait; // write() to the connection event that carried it
+    };
+
+    SimulatedBleMidiOutput(String id, const DeviceSettings& settings, std::shared_ptr<Ingest::MidiChannel> loopbackChannel)
+            : Thread("Sim BLE-MIDI out " + settings.name),
+              identifier(std::move(id)),
+              maxPacketSize(static_cast<size_t>(jlimit(23, 515, settings.attMtu) - 3)),
+              interval(static_cast<int64_t>(jmax(0.25, settings.connectionIntervalMs) * 1.0e6)),
+              packetsPerEvent(static_cast<size_t>(jmax(1, settings.packetsPerEvent))),
+              pool(queueSize, maxPacketSize),
+              queue(queueSize),
+              loopback(std::move(loopbackChannel))
+    {
+        startThread();
+    }
+
+    ~SimulatedBleMidiOutput() override { stopThread(1000); }
+
+    [[nodiscard]] const String& getIdentifier() const override { return identifier; }
+    [[nodiscard]] size_t getMaxPacketSize() const override { return maxPacketSize; }
+
+    bool write(std::span<const uint8_t> packet) override
+    {
+        auto view = queue.isFull() ? std::nullopt : pool.acquire(packet.data(), packet.size());
+
+        if (!view.has_value())
+        {
+            stats.rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        view->hostTime = Ingest::hostNanos();
+        queue.push(*view);
+        return true;
+    }
+
+    [[nodiscard]] const LinkStats& getStats() const { return stats; }
+
+private:
+    static constexpr size_t queueSize = 256;
+
+    void run() override
+    {
+        for (auto next = Ingest::hostNanos() + interval; !threadShouldExit(); next += interval)
+        {
+            const auto remaining = next - Ingest::hostNanos();
+
+            if (remaining > 0 && wait(static_cast<int>((remaining + 999999) / 1000000)))
+                return;
+
+            const auto now = Ingest::hostNanos();
+
+            const auto n = queue.drain([&](const Ingest::PacketView& p)
+            {
+                stats.packetWait.record(now - p.hostTime);
+
+                decoder.decode(p.bytes(), now, [&](std::span<const uint8_t> message, int64_t deviceTime)
+                {
+                    stats.messages.fetch_add(1, std::memory_order_relaxed);
+
+                    if (loopback != nullptr)
+                        loopback->push(message.data(), message.size(), now, deviceTime);
+                });
+
+                pool.release(p);
+            }, packetsPerEvent);
+
+            if (n > 0)
+            {
+                stats.connectionEvents.fetch_add(1, std::memory_order_relaxed);
+                stats.packets.fetch_add(n, std::memory_order_relaxed);
+            }
+
+            if (Ingest::hostNanos() - next > interval)
+                next = Ingest::hostNanos();
+        }
+    }
+
+    const String  identifier;
+    const size_t  maxPacketSize;
+    const int64_t interval;
+    const size_t  packetsPerEvent;
+
+    Ingest::PacketPool                   pool;
+    Ingest::SpscRing<Ingest::PacketView> queue;
+    Ingest::BleMidi::Decoder             decoder;
+
+    std::shared_ptr<Ingest::MidiChannel> loopback;
+    LinkStats                            stats;
+};
+
+//======================================================================================================================
+/**
+    Hands out virtual MIDI ports and GATT notifiers for a fixed list of devices.
+
+    Device i is reported with ContainerId "sim-container-i", MIDI port id "sim-midi-i" and BLE device id
+    "sim-ble-i"; those are the ids openMidiInput(), connectBleDevice() and openBleMidiOutput() accept. A BLE device
+    starts notifying discoveryMillis after its first connect, and cachedDiscoveryMillis after any later one.
+*/
+class SimulatedBackend : public Ingest::Backend
+{
+public:
+    explicit SimulatedBackend(std::vector<DeviceSettings> deviceSettings, RadioSettings radioSettings = {})
+            : devices(std::move(deviceSettings)),
+              discovered(devices.size()),
+              radio(radioSettings, devices.size())
+    {
+    }
+
+    [[nodiscard]] int getNumDevices() const { return static_cast<int>(devices.size()); }
+
+    [[nodiscard]] const DeviceSettings& getDeviceSettings(int index) const { return devices[static_cast<size_t>(index)]; }
+
+    [[nodiscard]] const Radio& getRadio() const { return radio; }
+
+    static String getContainerId(int index) { return "sim-container-" + String(index); }
+    static String getMidiPortId(int index) { return "sim-midi-" + String(index); }
+    static String getBleDeviceId(int index) { return "sim-ble-" + String(index); }
+
+    auto openMidiInput(const String& identifier, const String& portId, std::shared_ptr<Ingest::MidiChannel> channel,
+                       Ingest::SourceListener* listener) -> std::unique_ptr<Ingest::MidiSource> override
+    {
+        const auto index = findDevice(portId, &SimulatedBackend::getMidiPortId);
+
+        if (index < 0)
+            return nullptr;
+
+        return std::make_unique<SimulatedMidiInput>(identifier, radio, index, devices[static_cast<size_t>(index)],
+                                                    std::move(channel), listener);
+    }
+
+    auto connectBleDevice(const String& deviceId, std::shared_ptr<Ingest::BleChannel> channel)
+        -> std::unique_ptr<Ingest::BlePacketSource> override
+    {
+        const auto index = findDevice(deviceId, &SimulatedBackend::getBleDeviceId);
+
+        if (index < 0)
+            return nullptr;
+
+        // Like GattHandleCache, only the first connect to a device pays for the full discovery
+        const auto cached = discovered[static_cast<size_t>(index)].exchange(true);
+
+        return std::make_unique<SimulatedBleDevice>(deviceId, radio, index, devices[static_cast<size_t>(index)],
+                                                    std::move(channel), cached);
+    }
+
+    auto openBleMidiOutput(const String& deviceId) -> std::unique_ptr<Ingest::BlePacketWriter> override
+    {
+        return openBleMidiOutput(deviceId, nullptr);
+    }
+
+    /** With a loopback channel, every message the link delivers is pushed into it; see SimulatedBleMidiOutput. */
+    auto openBleMidiOutput(const String& deviceId, std::shared_ptr<Ingest::MidiChannel> loopback)
+        -> std::unique_ptr<Ingest::BlePacketWriter>
+    {
+        const auto index = findDevice(deviceId, &SimulatedBackend::getBleDeviceId);
+
+        if (index < 0)
+            return nullptr;
+
+        return std::make_unique<SimulatedBleMidiOutput>(deviceId, devices[static_cast<size_t>(index)], std::move(loopback));
+    }
+
+private:
+    [[nodiscard]] int findDevice(const String& id, String (*makeId)(int)) const
+    {
+        for (int i = 0; i < getNumDevices(); ++i)
+            if (makeId(i) == id)
+                return i;
+
+        jassertfalse;
+        return -1;
+    }
+
+    const std::vector<DeviceSettings> devices;
+    std::vector<std::atomic<bool>>    discovered;
+    Radio                             radio;
+};
+} // namespace Simulation
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+#include <new>
+
+//======================================================================================================================
+namespace Ingest {
+
+constexpr size_t cacheLineSize = 64;
+
+/**
+    Wait-free single-producer/single-consumer ring.
+
+    push() is only ever called from one thread (the device callback), pop()/drain() only from one other thread.
+    Neither side ever blocks: a full ring rejects the push and an empty ring returns nothing. The capacity is rounded
+    up to a power of two, and each side keeps a cached copy of the other side's index so the shared cache lines are
+    only touched when the cached view runs out.
+*/
+template<typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(size_t minCapacity)
+            : slots(roundUpToPowerOfTwo(minCapacity)),
+              mask(slots.size() - 1)
+    {
+    }
+
+    //==================================================================================================================
+    template<typename U>
+    bool push(U&& item)
+    {
+        if (isFull())
+            return false;
+
+        const auto h = head.load(std::memory_order_relaxed);
+
+        slots[h & mask] = std::forward<U>(item);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Producer side only. Once this returns false, the next push() is guaranteed to succeed. */
+    [[nodiscard]] bool isFull()
+    {
+        const auto h = head.load(std::memory_order_relaxed);
+
+        if (h - cachedTail == slots.size())
+            cachedTail = tail.load(std::memory_order_acquire);
+
+        return h - cachedTail == slots.size();
+    }
+
+    //==================================================================================================================
+    bool pop(T& out)
+    {
+        const auto t = tail.load(std::memory_order_relaxed);
+
+        if (t == cachedHead)
+        {
+            cachedHead = head.load(std::memory_order_acquire);
+
+            if (t == cachedHead)
+                return false;
+        }
+
+        out = std::move(slots[t & mask]);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Hands every ready item (up to maxItems) to fn in order, publishing the consumed slots once at the end. */
+    template<typename Fn>
+    size_t drain(Fn&& fn, size_t maxItems = std::numeric_limits<size_t>::max())
+    {
+        const auto t     = tail.load(std::memory_order_relaxed);
+        cachedHead       = head.load(std::memory_order_acquire);
+        const auto count = std::min(static_cast<size_t>(cachedHead - t), maxItems);
+
+        for (size_t i = 0; i < count; ++i)
+            fn(slots[(t + i) & mask]);
+
+        tail.store(t + count, std::memory_order_release);
+        return count;
+    }
+
+    //==================================================================================================================
+    [[nodiscard]] size_t getCapacity() const { return slots.size(); }
+
+    /** Only a snapshot; either side may move on immediately. */
+    [[nodiscard]] size_t getNumReady() const
+    {
+        return static_cast<size_t>(head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire));
+    }
+
+private:
+    static size_t roundUpToPowerOfTwo(size_t n)
+    {
+        size_t p = 1;
+        while (p < n)
+            p <<= 1;
+
+        return p;
+    }
+
+    std::vector<T> slots;
+    const size_t   mask;
+
+    alignas(cacheLineSize) std::atomic<size_t> head{0};
+    size_t cachedTail = 0; // producer only
+
+    alignas(cacheLineSize) std::atomic<size_t> tail{0};
+    size_t cachedHead = 0; // consumer only
+};
+} // namespace Ingest
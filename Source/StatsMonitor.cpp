@@ -0,0 +1,233 @@
+#include <JuceHeader.h>
+
+#include "ConnectionManager.h"
+#include "StatsSegment.h"
+
+#include <iostream>
+
+//======================================================================================================================
+// Prints what a running WinRTMidiTest publishes into its stats segment, once or as it changes. Only ever maps the
+// segment read-only, so watching costs the app nothing.
+namespace Monitor {
+
+static const char* getName(Ingest::PortState s)
+{
+    switch (s)
+    {
+        case Ingest::PortState::discovered: return "discovered";
+        case Ingest::PortState::opening:    return "opening";
+        case Ingest::PortState::open:       return "open";
+        case Ingest::PortState::closing:    return "closing";
+        case Ingest::PortState::absent:     break;
+    }
+
+    return "absent";
+}
+
+static String formatMillis(int64_t nanos) { return String(static_cast<double>(nanos) * 1.0e-6, 1); }
+
+static String formatPercentiles(const Ingest::Stats::Percentiles& p)
+{
+    return formatMillis(p.p50) + "/" + formatMillis(p.p99) + "/" + formatMillis(p.p999);
+}
+
+static var toVar(const Ingest::Stats::Percentiles& p)
+{
+    auto* o = new DynamicObject();
+    o->setProperty("p50_ns", static_cast<int64>(p.p50));
+    o->setProperty("p99_ns", static_cast<int64>(p.p99));
+    o->setProperty("p999_ns", static_cast<int64>(p.p999));
+    return var(o);
+}
+
+static var toVar(const Ingest::Stats::DeviceSnapshot& s, uint64_t version)
+{
+    const auto stream = [](uint64_t received, uint64_t dropped, double rate, double share, bool starved,
+                           const Ingest::Stats::Percentiles& gap, const Ingest::Stats::Percentiles& queueing)
+    {
+        auto* o = new DynamicObject();
+        o->setProperty("received", static_cast<int64>(received));
+        o->setProperty("dropped", static_cast<int64>(dropped));
+        o->setProperty("events_per_sec", rate);
+        o->setProperty("share", share);
+        o->setProperty("starved", starved);
+        o->setProperty("gap", toVar(gap));
+        o->setProperty("queueing", toVar(queueing));
+        return var(o);
+    };
+
+    auto* o = new DynamicObject();
+    o->setProperty("name", String(s.name));
+    o->setProperty("version", static_cast<int64>(version));
+    o->setProperty("updated_at_ms", static_cast<int64>(s.updatedAt));
+    o->setProperty("port", getName(static_cast<Ingest::PortState>(s.portState)));
+    o->setProperty("ble_connected", s.bleConnected != 0);
+    o->setProperty("connection_profile",
+                   Ingest::ConnectionManager::getName(static_cast<Ingest::ConnectionProfile>(s.connectionProfile)));
+    o->setProperty("midi", stream(s.midiReceived, s.midiDropped, s.midiRate, s.midiShare, (s.starved & 1) != 0,
+                                  s.midiGap, s.midiQueueing));
+    o->setProperty("ble", stream(s.bleReceived, s.bleDropped, s.bleRate, s.bleShare, (s.starved & 2) != 0,
+                                 s.bleGap, s.bleQueueing));
+    return var(o);
+}
+
+//======================================================================================================================
+/** One line per device under a header; or, as JSON, one line per publish with every device in it. */
+static void print(const Ingest::Stats::Reader& reader, bool json)
+{
+    const auto now   = Time::currentTimeMillis();
+    const auto age   = now - reader.getPublishTime();
+    const auto stale = reader.isWriterRunning() && age > 3 * jmax(1, reader.getPublishInterval());
+    const auto state = !reader.isWriterRunning() ? "stopped" : stale ? "stalled" : "running";
+
+    if (json)
+    {
+        auto* o = new DynamicObject();
+        o->setProperty("writer", state);
+        o->setProperty("started_at_ms", static_cast<int64>(reader.getStartTime()));
+        o->setProperty("heartbeat", static_cast<int64>(reader.getHeartbeat()));
+        o->setProperty("age_ms", static_cast<int64>(age));
+
+        var devices = Array<var>();
+
+        for (size_t i = 0; i < reader.getNumDevices(); ++i)
+        {
+            const auto version = reader.getVersion(i);
+
+            if (const auto s = reader.read(i); s.has_value())
+                devices.append(toVar(*s, version));
+            else
+                devices.append(var());
+        }
+
+        o->setProperty("devices", devices);
+        std::cout << JSON::toString(var(o), true) << std::endl;
+        return;
+    }
+
+    std::cout << "Writer " << state << ", heartbeat " << reader.getHeartbeat() << ", " << age << " ms ago\n";
+
+    const auto column = [](const String& s, int width) { return s.paddedRight(' ', width); };
+
+    std::cout << column("Name", 28) << column("Port", 12) << column("BLE", 22)
+              << column("Midi rx/drop", 18) << column("ev/s", 10) << column("gap p50/p99/p999 ms", 22)
+              << column("BLE rx/drop", 18) << column("ev/s", 10) << column("gap p50/p99/p999 ms", 22)
+              << "queueing p99 ms (Midi/BLE)\n";
+
+    for (size_t i = 0; i < reader.getNumDevices(); ++i)
+    {
+        const auto s = reader.read(i);
+
+        if (!s.has_value())
+        {
+            std::cout << "(slot " << i << " is being written)\n";
+            continue;
+        }
+
+        const auto profile    = static_cast<Ingest::ConnectionProfile>(s->connectionProfile);
+        const auto connection = s->bleConnected != 0
+                                ? String("connected, ") + Ingest::ConnectionManager::getName(profile)
+                                : String("disconnected");
+
+        const auto stream = [&](uint64_t received, uint64_t dropped, double rate, bool starved,
+                                const Ingest::Stats::Percentiles& gap)
+        {
+            return column(String(static_cast<int64>(received)) + "/" + String(static_cast<int64>(dropped)), 18)
+                   + column(String(rate, 0) + (starved ? "!" : ""), 10)
+                   + column(formatPercentiles(gap), 22);
+        };
+
+        std::cout << column(String(s->name), 28)
+                  << column(getName(static_cast<Ingest::PortState>(s->portState)), 12)
+                  << column(connection, 22)
+                  << stream(s->midiReceived, s->midiDropped, s->midiRate, (s->starved & 1) != 0, s->midiGap)
+                  << stream(s->bleReceived, s->bleDropped, s->bleRate, (s->starved & 2) != 0, s->bleGap)
+                  << formatMillis(s->midiQueueing.p99) << "/" << formatMillis(s->bleQueueing.p99) << "\n";
+    }
+
+    std::cout << std::flush;
+}
+} // namespace Monitor
+
+//======================================================================================================================
+int main(int argc, char* argv[])
+{
+    const ArgumentList args(argc, argv);
+
+    if (args.containsOption("--help|-h"))
+    {
+        std::cout << "Usage: " << args.executableName << " [--file=SEGMENT] [--follow] [--interval-ms=MS] [--json]\n\n"
+                     "Prints the per-device statistics a running WinRTMidiTest publishes. Without --file it reads\n"
+                     << Ingest::Stats::getDefaultFile().getFullPathName() << ".\n"
+                     "--follow keeps printing, whenever the statistics changed, until interrupted; a \"!\" after\n"
+                     "a rate marks a starved stream." << std::endl;
+        return 0;
+    }
+
+    const auto file   = args.containsOption("--file")
+                        ? File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--file"))
+                        : Ingest::Stats::getDefaultFile();
+    const auto follow = args.containsOption("--follow");
+    const auto json   = args.containsOption("--json");
+
+    auto reader = std::make_unique<Ingest::Stats::Reader>(file);
+
+    if (!follow)
+    {
+        if (!reader->isValid())
+        {
+            std::cerr << reader->getStatus().getErrorMessage() << std::endl;
+            return 1;
+        }
+
+        Monitor::print(*reader, json);
+        return 0;
+    }
+
+    const auto interval = args.containsOption("--interval-ms")
+                          ? jmax(10, args.getValueForOption("--interval-ms").getIntValue())
+                          : jmax(10, reader->isValid() ? reader->getPublishInterval() : 1000);
+
+    // Versions only ever go up, so their sum moves whenever any device's snapshot does
+    const auto changes = [](const Ingest::Stats::Reader& r)
+    {
+        uint64_t sum = r.getNumDevices();
+
+        for (size_t i = 0; i < r.getNumDevices(); ++i)
+            sum += r.getVersion(i);
+
+        return sum;
+    };
+
+    uint64_t printed_changes = 0;
+    int64_t  printed_start   = 0;
+    bool     printed_stop    = false;
+
+    for (;;)
+    {
+        // The app starts over with a new file every time it's launched, so look again for as long as this one's dead
+        if (!reader->isValid() || !reader->isWriterRunning())
+        {
+            if (auto fresh = std::make_unique<Ingest::Stats::Reader>(file);
+                fresh->isValid() && (!reader->isValid() || fresh->getStartTime() != reader->getStartTime()))
+                reader = std::move(fresh);
+        }
+
+        if (reader->isValid())
+        {
+            const auto changed = changes(*reader);
+            const auto stopped = !reader->isWriterRunning();
+
+            if (reader->getStartTime() != printed_start || changed != printed_changes || stopped != printed_stop)
+            {
+                Monitor::print(*reader, json);
+
+                printed_start   = reader->getStartTime();
+                printed_changes = changed;
+                printed_stop    = stopped;
+            }
+        }
+
+        Thread::sleep(interval);
+    }
+}
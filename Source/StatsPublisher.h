@@ -0,0 +1,140 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "ConnectionManager.h"
+#include "StatsSegment.h"
+
+#include <utility>
+
+//======================================================================================================================
+namespace Ingest {
+
+/**
+    Publishes every device's counts, rates, gap and queueing percentiles and connection state into a stats segment,
+    for Stats::Reader to pick up from another process (see WinRTMidiStats).
+
+    Everything it publishes has been counted or measured already: the channels' counters and latency histograms, the
+    FairnessAnalyzer's rates and the registry's states. So the ingest path pays nothing for it. The percentiles are
+    worked out here, at the publish rate, and only for devices whose counts moved. Only the slots that changed are
+    stored, and the heartbeat is bumped once per publish even if nothing changed.
+
+    Has no thread of its own: like ConnectionManager, update() is called by whoever owns the registry, with whatever
+    guards it held, and does nothing until the next publish is due.
+*/
+class StatsPublisher
+{
+public:
+    StatsPublisher(const DeviceRegistry& deviceRegistry, const FairnessAnalyzer& fairnessAnalyzer,
+                   const ConnectionManager& connectionManager, int publishRateHz = 4)
+            : registry(deviceRegistry),
+              fairness(fairnessAnalyzer),
+              connections(connectionManager),
+              publishInterval(1000000000 / jmax(1, publishRateHz)),
+              published(deviceRegistry.getCapacity()),
+              consumed(published.size())
+    {
+    }
+
+    Result open(const File& file = Stats::getDefaultFile())
+    {
+        return segment.open(file, published.size(), static_cast<int>(publishInterval / 1000000));
+    }
+
+    void close() { segment.close(); }
+
+    void update(int64_t now = hostNanos())
+    {
+        if (!segment.isOpen() || now < nextPublish)
+            return;
+
+        nextPublish = now + publishInterval;
+
+        const auto n = registry.size();
+
+        for (DeviceHandle h = 0; h < n; ++h)
+        {
+            auto s = published[h];
+
+            if (collect(h, s))
+            {
+                s.updatedAt = Time::currentTimeMillis();
+                segment.publish(h, s);
+                published[h] = s;
+                ++numStores;
+            }
+        }
+
+        segment.beat(n);
+    }
+
+    /** Slots stored so far; a publish in which nothing moved doesn't store any. */
+    [[nodiscard]] uint64_t getStoreCount() const { return numStores; }
+
+private:
+    /** Fills in s, which holds what was last published, and returns whether anything changed. */
+    bool collect(DeviceHandle h, Stats::DeviceSnapshot& s)
+    {
+        const auto previous = s;
+
+        const auto& midi      = *registry.midiChannels[h];
+        const auto& ble       = *registry.bleChannels[h];
+        const auto  midi_rate = fairness.getRates(h, StreamKind::midi);
+        const auto  ble_rate  = fairness.getRates(h, StreamKind::ble);
+
+        registry.names[h].copyToUTF8(s.name, sizeof(s.name));
+
+        s.midiReceived      = midi.getReceivedCount();
+        s.midiDropped       = midi.getDroppedCount();
+        s.bleReceived       = ble.getReceivedCount();
+        s.bleDropped        = ble.getDroppedCount();
+        s.midiRate          = midi_rate.eventsPerSecond;
+        s.bleRate           = ble_rate.eventsPerSecond;
+        s.midiShare         = midi_rate.share;
+        s.bleShare          = ble_rate.share;
+        s.portState         = static_cast<uint8_t>(registry.midiStates[h]);
+        s.bleConnected      = registry.bleConnected[h] ? 1 : 0;
+        s.connectionProfile = static_cast<uint8_t>(connections.getProfile(h));
+        s.starved           = static_cast<uint8_t>((midi_rate.starved ? 1 : 0) | (ble_rate.starved ? 2 : 0));
+
+        // Summing up a histogram is the expensive part, and with nothing new in it the summary can't have changed.
+        // Gaps are recorded as events arrive, queueing times as the consumer takes them.
+        if (s.midiReceived != previous.midiReceived)
+            s.midiGap = percentiles(midi.getLatencyStats().interArrival);
+
+        if (s.bleReceived != previous.bleReceived)
+            s.bleGap = percentiles(ble.getLatencyStats().interArrival);
+
+        if (const auto c = midi.getConsumedCount(); c != std::exchange(consumed[h].midi, c))
+            s.midiQueueing = percentiles(midi.getLatencyStats().queueing);
+
+        if (const auto c = ble.getConsumedCount(); c != std::exchange(consumed[h].ble, c))
+            s.bleQueueing = percentiles(ble.getLatencyStats().queueing);
+
+        return std::memcmp(&s, &previous, sizeof(s)) != 0;
+    }
+
+    static Stats::Percentiles percentiles(const LatencyHistogram& histogram)
+    {
+        const auto summary = histogram.getSummary();
+        return {summary.p50, summary.p99, summary.p999};
+    }
+
+    //==================================================================================================================
+    struct ConsumedCounts
+    {
+        uint64_t midi = 0, ble = 0;
+    };
+
+    const DeviceRegistry&    registry;
+    const FairnessAnalyzer&  fairness;
+    const ConnectionManager& connections;
+
+    Stats::Writer                      segment;
+    const int64_t                      publishInterval;
+    std::vector<Stats::DeviceSnapshot> published;
+    std::vector<ConsumedCounts>        consumed;
+    int64_t                            nextPublish = 0;
+    uint64_t                           numStores   = 0;
+};
+} // namespace Ingest
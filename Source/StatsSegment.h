@@ -0,0 +1,258 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "SeqLock.h"
+#include "SpscRing.h"
+
+#include <optional>
+#include <span>
+
+//======================================================================================================================
+namespace Ingest::Stats {
+
+/**
+    The layout of the live statistics segment: a file that the app keeps mapped and rewrites in place, so that other
+    processes can map it too and watch every device without a window or a socket.
+
+    The segment is a Header followed by capacity Slots. Each Slot is one device's DeviceSnapshot behind a SeqLock,
+    cache-line aligned, so a reader copies a device out consistently (or retries) without the writer ever waiting on
+    it. A slot's SeqLock version only moves when its snapshot changed.
+
+    A writer starts by deleting whatever was there and creating a new file, and writes the magic last, so a reader
+    either sees a complete header or none at all. One that has the previous file mapped keeps seeing that run, with
+    running cleared if it shut down cleanly, or with a heartbeat that has stopped if it didn't.
+
+    Everything is in host order, and the layout only changes along with layoutVersion.
+*/
+constexpr char     magic[8]      = {'W', 'R', 'M', 'S', 'T', 'A', 'T', 'S'};
+constexpr uint32_t layoutVersion = 1;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the SeqLocks are shared with other processes");
+
+struct Header
+{
+    char                  magic[8]          = {};
+    uint32_t              version           = 0;
+    uint32_t              headerSize        = 0;
+    uint32_t              slotSize          = 0;
+    uint32_t              capacity          = 0;
+    int64_t               startedAt         = 0; // milliseconds since 1970; tells one run of the writer from the next
+    std::atomic<uint32_t> numDevices{0};
+    std::atomic<uint32_t> running{0};
+    std::atomic<uint64_t> heartbeat{0};          // publishes so far
+    std::atomic<int64_t>  publishedAt{0};        // milliseconds since 1970
+    uint32_t              publishIntervalMs = 0; // how often the heartbeat is meant to move
+    uint32_t              reserved          = 0;
+};
+
+static_assert(sizeof(Header) == 64);
+
+/** Nanoseconds. */
+struct Percentiles
+{
+    int64_t p50 = 0, p99 = 0, p999 = 0;
+};
+
+/** One device, as last published. */
+struct DeviceSnapshot
+{
+    char        name[48]     = {}; // UTF-8, cut short if need be, always terminated
+    uint64_t    midiReceived = 0, midiDropped = 0;
+    uint64_t    bleReceived  = 0, bleDropped  = 0;
+    double      midiRate     = 0.0, bleRate = 0.0;   // events per second, over the fairness analyzer's window
+    double      midiShare    = 0.0, bleShare = 0.0;  // of all devices' events of the same kind
+    Percentiles midiGap, bleGap;                     // between consecutive callbacks
+    Percentiles midiQueueing, bleQueueing;           // from callback to consumer
+    int64_t     updatedAt         = 0;               // milliseconds since 1970
+    uint8_t     portState         = 0;               // a PortState
+    uint8_t     bleConnected      = 0;
+    uint8_t     connectionProfile = 0;               // a ConnectionProfile, as last asked for
+    uint8_t     starved           = 0;               // bit 0: the MIDI stream, bit 1: the BLE one
+    uint32_t    reserved          = 0;
+};
+
+static_assert(sizeof(DeviceSnapshot) == 224);
+
+struct alignas(cacheLineSize) Slot
+{
+    SeqLock<DeviceSnapshot> snapshot;
+};
+
+static_assert(sizeof(Slot) == 256);
+
+constexpr size_t getSegmentSize(size_t capacity) { return sizeof(Header) + capacity * sizeof(Slot); }
+
+/** Where the app publishes unless told otherwise: /dev/shm where there is one, so it never reaches a disk. */
+inline File getDefaultFile()
+{
+    const File shm("/dev/shm");
+    const auto dir = shm.isDirectory() ? shm : File::getSpecialLocation(File::tempDirectory);
+
+    return dir.getChildFile("WinRTMidiTest.stats");
+}
+
+//======================================================================================================================
+/** Creates the segment and publishes into it. Not thread safe: one thread publishes, as with a SeqLock. */
+class Writer
+{
+public:
+    ~Writer() { close(); }
+
+    Result open(const File& file, size_t capacity, int publishIntervalMs)
+    {
+        close();
+        file.deleteFile();
+
+        const auto size = getSegmentSize(capacity);
+
+        {
+            FileOutputStream out(file);
+
+            if (!out.openedOk() || !out.setPosition(static_cast<int64>(size) - 1) || !out.writeByte(0))
+                return Result::fail("Failed to create stats segment: " + file.getFullPathName());
+        }
+
+        segment = std::make_unique<MemoryMappedFile>(file, MemoryMappedFile::readWrite);
+
+        if (segment->getData() == nullptr || segment->getSize() < size)
+        {
+            segment.reset();
+            return Result::fail("Failed to map stats segment: " + file.getFullPathName());
+        }
+
+        auto* base = static_cast<uint8_t*>(segment->getData());
+
+        header = new (base) Header();
+        slots  = {reinterpret_cast<Slot*>(base + sizeof(Header)), capacity};
+
+        for (auto& slot : slots)
+            new (&slot) Slot();
+
+        header->version           = layoutVersion;
+        header->headerSize        = sizeof(Header);
+        header->slotSize          = sizeof(Slot);
+        header->capacity          = static_cast<uint32_t>(capacity);
+        header->startedAt         = Time::currentTimeMillis();
+        header->publishIntervalMs = static_cast<uint32_t>(publishIntervalMs);
+        header->running.store(1, std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(header->magic, magic, sizeof(magic));
+
+        return Result::ok();
+    }
+
+    /** Leaves the segment where it is, marked as no longer running. */
+    void close()
+    {
+        if (segment == nullptr)
+            return;
+
+        header->running.store(0, std::memory_order_release);
+        header = nullptr;
+        slots  = {};
+        segment.reset();
+    }
+
+    [[nodiscard]] bool isOpen() const { return segment != nullptr; }
+
+    [[nodiscard]] size_t getCapacity() const { return slots.size(); }
+
+    //==================================================================================================================
+    void publish(size_t index, const DeviceSnapshot& s) { slots[index].snapshot.store(s); }
+
+    /** Ends a publish: how many slots are in use, and that the writer is alive. */
+    void beat(size_t numDevices)
+    {
+        header->numDevices.store(static_cast<uint32_t>(numDevices), std::memory_order_relaxed);
+        header->publishedAt.store(Time::currentTimeMillis(), std::memory_order_relaxed);
+        header->heartbeat.fetch_add(1, std::memory_order_release);
+    }
+
+private:
+    std::unique_ptr<MemoryMappedFile> segment;
+    Header*                           header = nullptr;
+    std::span<Slot>                   slots;
+};
+
+//======================================================================================================================
+/** Maps a segment read-only, from this process or any other, and copies snapshots out of it. */
+class Reader
+{
+public:
+    explicit Reader(const File& file) : map(file, MemoryMappedFile::readOnly)
+    {
+        const auto* base = static_cast<const uint8_t*>(map.getData());
+
+        if (base == nullptr || map.getSize() < sizeof(Header))
+        {
+            status = Result::fail("No stats segment at " + file.getFullPathName());
+            return;
+        }
+
+        const auto* h = reinterpret_cast<const Header*>(base);
+
+        if (std::memcmp(h->magic, magic, sizeof(magic)) != 0)
+        {
+            status = Result::fail("Not a stats segment, or not written yet: " + file.getFullPathName());
+            return;
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (h->version != layoutVersion || h->headerSize != sizeof(Header) || h->slotSize != sizeof(Slot)
+            || map.getSize() < getSegmentSize(h->capacity))
+        {
+            status = Result::fail("Stats segment layout " + String(h->version) + " isn't supported");
+            return;
+        }
+
+        header = h;
+        slots  = {reinterpret_cast<const Slot*>(base + sizeof(Header)), h->capacity};
+    }
+
+    [[nodiscard]] const Result& getStatus() const { return status; }
+    [[nodiscard]] bool          isValid() const { return header != nullptr; }
+
+    //==================================================================================================================
+    [[nodiscard]] int64_t  getStartTime() const { return header->startedAt; }
+    [[nodiscard]] int      getPublishInterval() const { return static_cast<int>(header->publishIntervalMs); }
+    [[nodiscard]] bool     isWriterRunning() const { return header->running.load(std::memory_order_acquire) != 0; }
+    [[nodiscard]] uint64_t getHeartbeat() const { return header->heartbeat.load(std::memory_order_acquire); }
+    [[nodiscard]] int64_t  getPublishTime() const { return header->publishedAt.load(std::memory_order_relaxed); }
+
+    [[nodiscard]] size_t getNumDevices() const
+    {
+        return jmin(slots.size(), static_cast<size_t>(header->numDevices.load(std::memory_order_acquire)));
+    }
+
+    /** Changes whenever the device's snapshot does. */
+    [[nodiscard]] uint64_t getVersion(size_t index) const { return slots[index].snapshot.getVersion(); }
+
+    /**
+        Returns nothing if the writer was in the middle of that slot maxAttempts times running. That's only ever
+        likely if it died halfway through a store, which leaves the slot locked for good.
+    */
+    [[nodiscard]] std::optional<DeviceSnapshot> read(size_t index, int maxAttempts = 1000) const
+    {
+        DeviceSnapshot s;
+
+        for (int i = 0; i < maxAttempts; ++i)
+        {
+            if (slots[index].snapshot.tryLoad(s))
+                return s;
+
+            std::this_thread::yield();
+        }
+
+        return std::nullopt;
+    }
+
+private:
+    const MemoryMappedFile map;
+    Result                 status = Result::ok();
+    const Header*          header = nullptr;
+    std::span<const Slot>  slots;
+};
+} // namespace Ingest::Stats
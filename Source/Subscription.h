@@ -0,0 +1,141 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "IngestConsumer.h"
+
+//======================================================================================================================
+namespace Ingest {
+
+/**
+    Another consumer of every device's events, next to the IngestConsumer: a reader of its own on each channel (see
+    BroadcastRing), drained into an EventSink on a thread of its own.
+
+    Nothing is copied for it on the ingest path; the callback only has one more listener to tell. A lossless
+    subscription sees every event the primary consumer sees, and holds the callback back just as the primary one
+    does, so its sink has to keep up. A lossy one never holds anything back: what it was too slow for is skipped, and
+    counted in getDroppedCount().
+
+    Has to be created before any source is attached, and destroyed after they've all gone, since that's when the
+    channels take readers on and off. The sink is only ever called from the subscription's thread. That thread also
+    wakes up every idleWakeMs when nothing arrives, and tells the sink it drained, for sinks that hold events back.
+*/
+class Subscription : public ChannelListener,
+                     private Thread
+{
+public:
+    Subscription(DeviceRegistry& deviceRegistry, EventSink& eventSink, Delivery delivery, size_t batchSize = 256,
+                 int idleWakeMs = 100)
+            : Thread(delivery == Delivery::lossless ? "Lossless subscription" : "Lossy subscription"),
+              registry(deviceRegistry),
+              sink(eventSink),
+              reader(deviceRegistry.subscribe(delivery, this)),
+              batch(jmax(size_t{1}, batchSize)),
+              idleWake(jmax(1, idleWakeMs))
+    {
+    }
+
+    ~Subscription() override
+    {
+        stop();
+
+        if (reader > 0)
+            registry.unsubscribe(reader);
+    }
+
+    void start()
+    {
+        if (reader > 0)
+            startThread();
+    }
+
+    /** Drains what's left before it returns. */
+    void stop()
+    {
+        stopThread(1000);
+
+        if (reader > 0)
+        {
+            while (drainBatch()) {}
+
+            sink.drained();
+        }
+    }
+
+    //==================================================================================================================
+    /** What a lossy subscription missed, over every device. */
+    [[nodiscard]] uint64_t getDroppedCount() const
+    {
+        uint64_t total = 0;
+
+        for (DeviceHandle h = 0; reader > 0 && h < registry.size(); ++h)
+            total += registry.midiChannels[h]->getDroppedCount(reader)
+                   + registry.bleChannels[h]->getDroppedCount(reader);
+
+        return total;
+    }
+
+    [[nodiscard]] uint64_t getDeliveredCount() const { return delivered.load(std::memory_order_relaxed); }
+
+    void channelDataArrived(uint16_t) override
+    {
+        if (!pending.exchange(true, std::memory_order_acq_rel))
+            wakeUp.signal();
+    }
+
+private:
+    void run() override
+    {
+        bool more = false;
+
+        while (!threadShouldExit())
+        {
+            // Timed, so the last events of a burst aren't left waiting if a wake-up is missed
+            if (!more)
+                wakeUp.wait(idleWake);
+
+            pending.store(false, std::memory_order_release);
+            more = drainBatch();
+            sink.drained();
+        }
+    }
+
+    /** One batch from each device's channels; true if any of them had more than that. */
+    bool drainBatch()
+    {
+        const auto n    = registry.size();
+        bool       more = false;
+        size_t     sum  = 0;
+
+        for (DeviceHandle h = 0; h < n; ++h)
+        {
+            const auto midi = registry.midiChannels[h]->read(reader, [this, h](const MidiEvent& e)
+            {
+                sink.midiEvent(h, e);
+            }, batch);
+
+            const auto ble = registry.bleChannels[h]->read(reader, [this, h](const PacketView& p)
+            {
+                sink.blePacket(h, p);
+            }, batch);
+
+            more = more || midi == batch || ble == batch;
+            sum += midi + ble;
+        }
+
+        delivered.fetch_add(sum, std::memory_order_relaxed);
+        return more;
+    }
+
+    //==================================================================================================================
+    DeviceRegistry& registry;
+    EventSink&      sink;
+    const int       reader;
+    const size_t    batch;
+    const int       idleWake;
+
+    WaitableEvent         wakeUp;
+    std::atomic<bool>     pending{false};
+    std::atomic<uint64_t> delivered{0};
+};
+} // namespace Ingest
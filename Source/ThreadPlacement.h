@@ -0,0 +1,82 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#if JUCE_WINDOWS
+ #include <windows.h>
+ #include <avrt.h>
+#else
+ #include <pthread.h>
+ #include <sched.h>
+#endif
+
+//======================================================================================================================
+namespace Ingest {
+
+/** Restricts the calling thread to one core. Returns false, and leaves the thread alone, for a core that isn't there. */
+inline bool pinCurrentThreadToCore(int core)
+{
+    if (core < 0 || core >= jmin(32, SystemStats::getNumCpus()))
+        return false;
+
+    Thread::setCurrentThreadAffinityMask(uint32{1} << core);
+    return true;
+}
+
+//======================================================================================================================
+/**
+    Runs the calling thread at real-time priority for as long as the object lives: the MMCSS "Pro Audio" task on
+    Windows, SCHED_FIFO elsewhere.
+
+    Either can be refused (SCHED_FIFO usually needs CAP_SYS_NICE or an rtprio limit), in which case the thread just
+    carries on at its normal priority; isEngaged() tells which it got.
+*/
+class ScopedRealtimePriority
+{
+public:
+    ScopedRealtimePriority()
+    {
+       #if JUCE_WINDOWS
+        DWORD task_index = 0;
+        task = AvSetMmThreadCharacteristicsW(L"Pro Audio", &task_index);
+        engaged = task != nullptr;
+       #else
+        if (pthread_getschedparam(pthread_self(), &previousPolicy, &previousParam) != 0)
+            return;
+
+        sched_param param{};
+        param.sched_priority = jlimit(sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO), 50);
+        engaged = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+       #endif
+
+        if (!engaged)
+            DBG("Couldn't raise thread to real-time priority");
+    }
+
+    ~ScopedRealtimePriority()
+    {
+        if (!engaged)
+            return;
+
+       #if JUCE_WINDOWS
+        AvRevertMmThreadCharacteristics(task);
+       #else
+        pthread_setschedparam(pthread_self(), previousPolicy, &previousParam);
+       #endif
+    }
+
+    [[nodiscard]] bool isEngaged() const { return engaged; }
+
+private:
+    bool engaged = false;
+
+   #if JUCE_WINDOWS
+    HANDLE task = nullptr;
+   #else
+    int         previousPolicy = SCHED_OTHER;
+    sched_param previousParam{};
+   #endif
+
+    JUCE_DECLARE_NON_COPYABLE (ScopedRealtimePriority)
+};
+} // namespace Ingest
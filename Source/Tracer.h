@@ -0,0 +1,476 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "HostClock.h"
+
+#include <array>
+#include <atomic>
+#include <cstring>
+
+//======================================================================================================================
+namespace Ingest {
+
+/** Where a trace record was taken. Spans come first, then instants; what each one's args are is in tracePoints. */
+enum class TracePoint : uint16_t
+{
+    midiCallback,
+    bleCallback,
+    watcherCallback,
+    deviceBatch,
+    lockWait,
+    paint,
+
+    midiPortOpened,
+    bleConnected,
+    gattServicesFound,
+    gattServiceFound,
+    gattCharacteristicFound,
+    notificationsEnabled,
+    connectionRequested,
+    bleMidiOutputReady,
+    repaintRequested,
+    streamStarved,
+    streamRecovered,
+    connectionChanged
+};
+
+struct TracePointInfo
+{
+    const char*                name;
+    const char*                category;
+    std::array<const char*, 2> args; // nullptr for an arg the point doesn't use
+};
+
+/** In TracePoint order. */
+inline constexpr TracePointInfo tracePoints[] = {
+        {"midi callback",             "callback", {"bytes", nullptr}},
+        {"ble callback",              "callback", {"bytes", nullptr}},
+        {"watcher callback",          "callback", {"kind", nullptr}}, // a DeviceEventKind
+        {"device batch",              "devices",  {"events", "coalesced"}},
+        {"lock wait",                 "lock",     {nullptr, nullptr}},
+        {"paint",                     "ui",       {"rows", nullptr}},
+
+        {"midi port opened",          "async",    {"succeeded", nullptr}},
+        {"ble connected",             "async",    {"succeeded", nullptr}},
+        {"gatt services found",       "async",    {"succeeded", "uncached"}},
+        {"gatt service found",        "async",    {"succeeded", "uncached"}},
+        {"gatt characteristic found", "async",    {"succeeded", "uncached"}},
+        {"notifications enabled",     "async",    {"succeeded", "profile"}}, // into deviceProfiles
+        {"connection requested",      "async",    {"profile", "granted"}},   // a ConnectionProfile
+        {"ble midi output ready",     "async",    {"att_mtu", nullptr}},
+        {"repaint requested",         "ui",       {nullptr, nullptr}},
+        {"stream starved",            "fairness", {"ble", "events_per_sec"}},
+        {"stream recovered",          "fairness", {"ble", "events_per_sec"}},
+        {"connection changed",        "fairness", {"from", "to"}},
+};
+
+static_assert(std::size(tracePoints) == static_cast<size_t>(TracePoint::connectionChanged) + 1);
+
+/** For a record that isn't about any one device. */
+constexpr uint16_t noTraceDevice = std::numeric_limits<uint16_t>::max();
+
+//======================================================================================================================
+/** One fixed-size binary trace record. The thread isn't in it: every thread writes records into a buffer of its own. */
+struct TraceRecord
+{
+    int64_t                start    = 0; // hostNanos()
+    uint32_t               duration = 0; // nanoseconds, 0 for an instant; saturates a little over 4 s
+    TracePoint             point    = TracePoint::midiCallback;
+    uint16_t               device   = noTraceDevice; // a DeviceHandle
+    std::array<int64_t, 2> args{};
+};
+
+static_assert(sizeof(TraceRecord) == 32 && std::is_trivially_copyable_v<TraceRecord>);
+
+//======================================================================================================================
+/**
+    The last records one thread wrote, overwriting the oldest once it's full.
+
+    Only the owning thread writes. A reader copies the records out while the writer carries on, as a SeqLock reader
+    would: the records are kept as relaxed atomic words, and the writer announces each slot before it reuses it, so
+    whatever was overwritten during the copy is known afterwards, and dropped.
+*/
+class TraceBuffer
+{
+public:
+    TraceBuffer(uint32_t threadId, size_t minCapacity)
+            : id(threadId),
+              words(static_cast<size_t>(nextPowerOfTwo(static_cast<int>(minCapacity))) * wordsPerRecord),
+              capacity(words.size() / wordsPerRecord)
+    {
+    }
+
+    /** Owning thread only. */
+    void write(const TraceRecord& record)
+    {
+        const auto n = published.load(std::memory_order_relaxed);
+
+        claimed.store(n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        std::array<uint64_t, wordsPerRecord> w{};
+        std::memcpy(w.data(), &record, sizeof(TraceRecord));
+
+        auto* slot = words.data() + (n & (capacity - 1)) * wordsPerRecord;
+
+        for (size_t i = 0; i < wordsPerRecord; ++i)
+            slot[i].store(w[i], std::memory_order_relaxed);
+
+        published.store(n + 1, std::memory_order_release);
+    }
+
+    /** Forgets every record, for a new owner. Only while nobody writes to it or copies from it. */
+    void reset()
+    {
+        claimed.store(0, std::memory_order_relaxed);
+        published.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+        Appends the records that started at or after since, oldest first. Returns how many records had been
+        overwritten already, if the oldest one left is from after since (so some of them may have been too), or 0.
+    */
+    uint64_t copyTo(std::vector<TraceRecord>& out, int64_t since) const
+    {
+        const auto end   = published.load(std::memory_order_acquire);
+        const auto first = end > capacity ? end - capacity : 0;
+
+        std::vector<TraceRecord> copied(static_cast<size_t>(end - first));
+
+        for (auto n = first; n < end; ++n)
+        {
+            const auto* slot = words.data() + (n & (capacity - 1)) * wordsPerRecord;
+
+            std::array<uint64_t, wordsPerRecord> w{};
+
+            for (size_t i = 0; i < wordsPerRecord; ++i)
+                w[i] = slot[i].load(std::memory_order_relaxed);
+
+            std::memcpy(static_cast<void*>(&copied[static_cast<size_t>(n - first)]), w.data(), sizeof(TraceRecord));
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // Whatever the writer has claimed since may have gone under the copy
+        const auto reused = claimed.load(std::memory_order_relaxed);
+        const auto valid  = jmax(first, reused > capacity ? reused - capacity : uint64_t{0});
+
+        if (valid == end)
+            return valid;
+
+        for (auto n = valid; n < end; ++n)
+            if (const auto& r = copied[static_cast<size_t>(n - first)]; r.start >= since)
+                out.push_back(r);
+
+        return copied[static_cast<size_t>(valid - first)].start >= since ? valid : 0;
+    }
+
+    const uint32_t id;
+
+private:
+    static constexpr size_t wordsPerRecord = sizeof(TraceRecord) / sizeof(uint64_t);
+
+    std::vector<std::atomic<uint64_t>> words;
+    const uint64_t                     capacity;
+
+    std::atomic<uint64_t> claimed{0}, published{0};
+};
+
+//======================================================================================================================
+/** Every thread's records, as copied out by Tracer::dump(). */
+struct TraceDump
+{
+    struct TracedThread
+    {
+        uint32_t                 id = 0;
+        String                   name;
+        std::vector<TraceRecord> records;
+        uint64_t                 lost = 0; // at most; see TraceBuffer::copyTo()
+    };
+
+    std::vector<TracedThread> threads;
+
+    [[nodiscard]] size_t getNumRecords() const
+    {
+        size_t n = 0;
+
+        for (const auto& t : threads)
+            n += t.records.size();
+
+        return n;
+    }
+};
+
+//======================================================================================================================
+/**
+    A flight recorder for the callbacks, async completions, lock waits and repaints: cheap enough to leave compiled
+    into every build, and off until setEnabled().
+
+    Off, a trace point costs one relaxed load and a branch. On, it costs a hostNanos() and a 32 byte store into the
+    calling thread's own TraceBuffer, with no locks, no formatting and no allocation (except for the buffer itself,
+    the first time a thread traces, unless an exited thread left one behind). An exited thread's records stay in the
+    dump until a new thread takes its buffer over, so threads that come and go don't keep adding buffers. The
+    buffers only keep the last recordsPerThread records each, so it can stay on for as long as needed; dump() copies
+    out what's there without stopping anybody, and writeChromeTrace() turns that into JSON for chrome://tracing or
+    Perfetto, one row per thread.
+
+    Threads are named after their juce::Thread, if they have one; others (WinRT's thread pool, say) can name
+    themselves with nameCurrentThread(), or are numbered.
+*/
+class Tracer
+{
+public:
+    static constexpr size_t recordsPerThread = 16384;
+
+    static void setEnabled(bool shouldTrace) { enabled.store(shouldTrace, std::memory_order_relaxed); }
+
+    [[nodiscard]] static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    //==================================================================================================================
+    static void instant(TracePoint point, uint16_t device = noTraceDevice, int64_t arg0 = 0, int64_t arg1 = 0)
+    {
+        if (isEnabled())
+            getBuffer().write({hostNanos(), 0, point, device, {arg0, arg1}});
+    }
+
+    static void span(TracePoint point, int64_t start, int64_t end, uint16_t device = noTraceDevice, int64_t arg0 = 0,
+                     int64_t arg1 = 0)
+    {
+        if (!isEnabled())
+            return;
+
+        const auto longest  = static_cast<int64_t>(std::numeric_limits<uint32_t>::max());
+        const auto duration = static_cast<uint32_t>(jlimit<int64_t>(0, longest, end - start));
+        getBuffer().write({start, duration, point, device, {arg0, arg1}});
+    }
+
+    static void nameCurrentThread(const String& name)
+    {
+        auto& state = getState();
+        auto& b     = getBuffer();
+
+        const ScopedLock sl(state.lock);
+        state.names[b.id] = name;
+    }
+
+    //==================================================================================================================
+    /** Copies out every thread's records that started at or after since. Can be called from any thread, any time. */
+    [[nodiscard]] static TraceDump dump(int64_t since = 0)
+    {
+        auto& state = getState();
+
+        const ScopedLock sl(state.lock);
+
+        TraceDump d;
+
+        for (const auto& b : state.buffers)
+        {
+            auto& t = d.threads.emplace_back();
+            t.id    = b->id;
+            t.name  = state.names[b->id];
+            t.lost  = b->copyTo(t.records, since);
+        }
+
+        return d;
+    }
+
+    /**
+        Writes the dump as a Chrome trace: spans as complete events, the rest as instants, in microseconds from the
+        first record. Devices are shown by their name in deviceNames, where there is one, and by handle otherwise.
+    */
+    static void writeChromeTrace(const TraceDump& d, OutputStream& out, std::span<const String> deviceNames = {})
+    {
+        auto origin = std::numeric_limits<int64_t>::max();
+
+        for (const auto& t : d.threads)
+            if (!t.records.empty())
+                origin = jmin(origin, t.records.front().start);
+
+        const auto micros = [origin](int64_t nanos) { return String(static_cast<double>(nanos - origin) * 1.0e-3, 3); };
+
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+        auto separator = "";
+
+        for (const auto& t : d.threads)
+        {
+            out << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << String(t.id)
+                << ",\"args\":{\"name\":" << JSON::toString(var(t.name)) << "}}";
+            separator = ",\n";
+
+            for (const auto& r : t.records)
+            {
+                const auto& info = tracePoints[static_cast<size_t>(r.point)];
+
+                String e;
+                e << separator << "{\"name\":\"" << info.name << "\",\"cat\":\"" << info.category
+                  << "\",\"pid\":1,\"tid\":" << String(t.id) << ",\"ts\":" << micros(r.start);
+
+                if (r.duration > 0)
+                    e << ",\"ph\":\"X\",\"dur\":" << String(static_cast<double>(r.duration) * 1.0e-3, 3);
+                else
+                    e << ",\"ph\":\"i\",\"s\":\"t\"";
+
+                e << ",\"args\":{";
+
+                if (r.device == noTraceDevice)
+                    e << "\"device\":null";
+                else if (r.device < deviceNames.size() && deviceNames[r.device].isNotEmpty())
+                    e << "\"device\":" << JSON::toString(var(deviceNames[r.device]));
+                else
+                    e << "\"device\":" << String(static_cast<int>(r.device));
+
+                for (size_t i = 0; i < r.args.size(); ++i)
+                    if (info.args[i] != nullptr)
+                        e << ",\"" << info.args[i] << "\":" << String(static_cast<int64>(r.args[i]));
+
+                out << e << "}}";
+            }
+        }
+
+        out << "]}\n";
+    }
+
+    /** Replaces whatever is in the file. */
+    static Result writeChromeTrace(const TraceDump& d, const File& file, std::span<const String> deviceNames = {})
+    {
+        FileOutputStream out(file);
+
+        if (!out.openedOk() || !out.setPosition(0) || out.truncate().failed())
+            return Result::fail("Can't write trace to " + file.getFullPathName());
+
+        writeChromeTrace(d, out, deviceNames);
+        out.flush();
+        return Result::ok();
+    }
+
+private:
+    struct State
+    {
+        CriticalSection                           lock;
+        std::vector<std::unique_ptr<TraceBuffer>> buffers;
+        std::vector<String>                       names;   // by buffer id
+        std::vector<TraceBuffer*>                 unowned; // left behind by threads that have exited
+    };
+
+    /** Hands its thread's buffer back when the thread exits. */
+    struct BufferOwner
+    {
+        TraceBuffer* buffer = nullptr;
+
+        ~BufferOwner()
+        {
+            if (buffer == nullptr)
+                return;
+
+            auto& state = getState();
+
+            const ScopedLock sl(state.lock);
+            state.unowned.push_back(buffer);
+            buffer = nullptr;
+        }
+    };
+
+    /** Never destroyed: callbacks can still come in while statics are being torn down. */
+    static State& getState()
+    {
+        static auto* state = new State();
+        return *state;
+    }
+
+    static TraceBuffer& getBuffer()
+    {
+        thread_local BufferOwner owner;
+
+        if (owner.buffer == nullptr)
+        {
+            auto& state = getState();
+
+            const ScopedLock sl(state.lock);
+
+            if (!state.unowned.empty())
+            {
+                owner.buffer = state.unowned.back();
+                owner.buffer->reset();
+                state.unowned.pop_back();
+            }
+            else
+            {
+                const auto id = static_cast<uint32_t>(state.buffers.size());
+                owner.buffer  = state.buffers.emplace_back(std::make_unique<TraceBuffer>(id, recordsPerThread)).get();
+                state.names.emplace_back();
+            }
+
+            const auto  id = owner.buffer->id;
+            const auto* t  = Thread::getCurrentThread();
+            state.names[id] = t != nullptr ? t->getThreadName() : "Thread " + String(id);
+        }
+
+        return *owner.buffer;
+    }
+
+    static inline std::atomic<bool> enabled{false};
+};
+
+//======================================================================================================================
+/** Records a span from construction to destruction, if tracing was on at construction. */
+class TraceScope
+{
+public:
+    explicit TraceScope(TracePoint tracePoint, uint16_t device = noTraceDevice)
+            : point(tracePoint),
+              dev(device),
+              start(Tracer::isEnabled() ? hostNanos() : 0)
+    {
+    }
+
+    /** For a callback that has read the clock already. */
+    TraceScope(TracePoint tracePoint, uint16_t device, int64_t startTime)
+            : point(tracePoint),
+              dev(device),
+              start(Tracer::isEnabled() ? startTime : 0)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (start != 0)
+            Tracer::span(point, start, hostNanos(), dev, args[0], args[1]);
+    }
+
+    void setArgs(int64_t arg0, int64_t arg1 = 0) { args = {arg0, arg1}; }
+
+private:
+    const TracePoint       point;
+    const uint16_t         dev;
+    const int64_t          start;
+    std::array<int64_t, 2> args{};
+
+    JUCE_DECLARE_NON_COPYABLE (TraceScope)
+};
+
+/**
+    A ScopedLock that traces how long it waited, if it had to. An uncontended lock costs a tryEnter() and records
+    nothing, tracing or not.
+*/
+class TracedScopedLock
+{
+public:
+    explicit TracedScopedLock(const CriticalSection& criticalSection) : lock(criticalSection)
+    {
+        if (lock.tryEnter())
+            return;
+
+        const TraceScope wait(TracePoint::lockWait);
+        lock.enter();
+    }
+
+    ~TracedScopedLock() { lock.exit(); }
+
+private:
+    const CriticalSection& lock;
+
+    JUCE_DECLARE_NON_COPYABLE (TracedScopedLock)
+};
+} // namespace Ingest
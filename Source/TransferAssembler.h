@@ -0,0 +1,516 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "IngestConsumer.h"
+
+//======================================================================================================================
+namespace Ingest {
+
+/**
+    A fixed slab of equally sized chunks, which a transfer of any size is built up in a chunk at a time, so nothing
+    is ever concatenated or reallocated. The slab is allocated once, up front, and used from one thread.
+
+    Chunks are chained through an array of links next to the slab, and the free ones make up a chain of their own,
+    so giving back a whole transfer takes one step however long it was.
+*/
+class ChunkPool
+{
+public:
+    static constexpr uint32_t none = std::numeric_limits<uint32_t>::max();
+
+    ChunkPool(size_t numChunks, size_t chunkSizeBytes)
+            : chunkSize(jmax(size_t{1}, chunkSizeBytes)),
+              storage(numChunks * chunkSize),
+              links(numChunks)
+    {
+        jassert(numChunks < none);
+
+        for (size_t i = 0; i < numChunks; ++i)
+            links[i] = i + 1 < numChunks ? static_cast<uint32_t>(i + 1) : none;
+
+        freeChunks = numChunks > 0 ? 0 : none;
+        numFree    = numChunks;
+    }
+
+    /** A chunk of its own, linked to nothing, or none if they're all in use. */
+    uint32_t acquire()
+    {
+        const auto c = freeChunks;
+
+        if (c != none)
+        {
+            freeChunks = links[c];
+            links[c]   = none;
+            --numFree;
+        }
+
+        return c;
+    }
+
+    /** Gives back a chain of count chunks, first to last. */
+    void release(uint32_t first, uint32_t last, size_t count)
+    {
+        links[last] = freeChunks;
+        freeChunks  = first;
+        numFree    += count;
+    }
+
+    void link(uint32_t chunk, uint32_t next) { links[chunk] = next; }
+
+    //==================================================================================================================
+    [[nodiscard]] uint8_t*       getData(uint32_t chunk) { return storage.data() + chunk * chunkSize; }
+    [[nodiscard]] const uint8_t* getData(uint32_t chunk) const { return storage.data() + chunk * chunkSize; }
+    [[nodiscard]] uint32_t       getNext(uint32_t chunk) const { return links[chunk]; }
+
+    [[nodiscard]] size_t getChunkSize() const { return chunkSize; }
+    [[nodiscard]] size_t getNumChunks() const { return links.size(); }
+    [[nodiscard]] size_t getNumFree() const { return numFree; }
+
+private:
+    const size_t          chunkSize;
+    std::vector<uint8_t>  storage;
+    std::vector<uint32_t> links;
+    uint32_t              freeChunks = none;
+    size_t                numFree    = 0;
+};
+
+//======================================================================================================================
+/**
+    Bytes spread over a chain of pooled chunks, read where they lie: a segment per chunk, every one of them full but
+    the last. Only valid for as long as the chain is; for what a TransferSink is handed, the duration of the call.
+*/
+class ScatterView
+{
+public:
+    ScatterView() = default;
+
+    ScatterView(const ChunkPool& chunkPool, uint32_t firstChunk, size_t length)
+            : pool(&chunkPool),
+              first(firstChunk),
+              numBytes(length)
+    {
+    }
+
+    [[nodiscard]] size_t size() const { return numBytes; }
+    [[nodiscard]] bool   empty() const { return numBytes == 0; }
+
+    [[nodiscard]] size_t getNumSegments() const
+    {
+        return pool != nullptr ? (numBytes + pool->getChunkSize() - 1) / pool->getChunkSize() : 0;
+    }
+
+    /** Calls fn with each segment, as a std::span<const uint8_t>, in order. */
+    template<typename Fn>
+    void forEachSegment(Fn&& fn) const
+    {
+        auto left = numBytes;
+
+        for (auto c = first; left > 0; c = pool->getNext(c))
+        {
+            const auto n = std::min(left, pool->getChunkSize());
+
+            fn(std::span<const uint8_t>(pool->getData(c), n));
+            left -= n;
+        }
+    }
+
+    /** For a consumer that needs (some of) the bytes in one piece after all. Returns how many were copied. */
+    size_t copyTo(std::span<uint8_t> dest, size_t offset = 0) const
+    {
+        size_t copied = 0, position = 0;
+
+        forEachSegment([&](std::span<const uint8_t> segment)
+        {
+            const auto end = position + segment.size();
+
+            if (end > offset && copied < dest.size())
+            {
+                const auto from = offset > position ? offset - position : 0;
+                const auto n    = std::min(segment.size() - from, dest.size() - copied);
+
+                std::memcpy(dest.data() + copied, segment.data() + from, n);
+                copied += n;
+            }
+
+            position = end;
+        });
+
+        return copied;
+    }
+
+    /** Walks the chain up to the byte; fine for a look at the ends, not for reading the lot. */
+    [[nodiscard]] uint8_t operator[](size_t index) const
+    {
+        jassert(index < numBytes);
+
+        auto c = first;
+
+        for (auto skip = index / pool->getChunkSize(); skip > 0; --skip)
+            c = pool->getNext(c);
+
+        return pool->getData(c)[index % pool->getChunkSize()];
+    }
+
+private:
+    const ChunkPool* pool     = nullptr;
+    uint32_t         first    = ChunkPool::none;
+    size_t           numBytes = 0;
+};
+
+//======================================================================================================================
+enum class TransferKind : uint8_t
+{
+    sysEx, // a SysEx message too long for its MidiChannel's slots, which arrived as fragments
+    bulk   // a run of BLE packets announced with TransferAssembler::expectBulkTransfer()
+};
+
+/** A transfer as a TransferSink sees it: finished, cut short, or in progress. */
+struct Transfer
+{
+    DeviceHandle device       = 0;
+    TransferKind kind         = TransferKind::sysEx;
+    ScatterView  data;             // the bytes still held; in streaming mode, only those not yet passed on
+    uint64_t     size         = 0; // bytes so far
+    uint64_t     expectedSize = 0; // bulk transfers only
+    uint32_t     fragments    = 0;
+    int64_t      startTime    = 0; // host times of the first and the latest fragment
+    int64_t      lastTime     = 0;
+
+    /** From the first fragment's arrival to the latest one's, so 0 until there are two. */
+    [[nodiscard]] double getBytesPerSecond() const
+    {
+        return lastTime > startTime ? static_cast<double>(size) * 1.0e9 / static_cast<double>(lastTime - startTime)
+                                    : 0.0;
+    }
+};
+
+/** Is handed the transfers a TransferAssembler put together, on its thread. Must keep up and must not block. */
+struct TransferSink
+{
+    virtual ~TransferSink() = default;
+
+    /** A transfer arrived whole. In streaming mode data is empty: every byte went to transferProgressed() first. */
+    virtual void transferCompleted(const Transfer& transfer) = 0;
+
+    /** Streaming mode only: the next bytes, in order, in whole chunks but for the last piece. */
+    virtual void transferProgressed(const Transfer&, const ScatterView&) {}
+
+    /** Cut short, by what came next, a timeout, the size limit or the pool running out; data holds what arrived. */
+    virtual void transferAborted(const Transfer&) {}
+};
+
+/** One device's transfers of one kind, published as one value so a reader never sees half an update. */
+struct TransferStats
+{
+    uint64_t completed          = 0, aborted = 0;
+    uint64_t bytes              = 0;   // of completed transfers
+    double   lastBytesPerSecond = 0.0; // of the latest completed transfer, see Transfer::getBytesPerSecond()
+    double   peakBytesPerSecond = 0.0;
+};
+
+struct TransferSettings
+{
+    size_t  chunkSize       = 4096;
+    size_t  numChunks       = 1024;          // shared by every device; 4 MB at the default chunk size
+    size_t  maxTransferSize = 1024 * 1024;   // a longer one is aborted, so one device can't hold every chunk
+    bool    streaming       = false;         // pass chunks on as they fill, instead of whole transfers at the end
+    int64_t timeout         = 2'000'000'000; // a transfer that gets nothing for this long is aborted
+};
+
+//======================================================================================================================
+/**
+    Puts large transfers back together, in pooled chunks, next to the regular event path: an EventSink that passes
+    every other event straight on to another EventSink, and hands the transfers to a TransferSink.
+
+    There are two kinds. A SysEx message too long for its MidiChannel's slots comes in as a run of fragments, and
+    goes back together from them. A bulk transfer is whatever a device sends over its GATT characteristic after
+    expectBulkTransfer() announced it, up to the size given; its packets don't go on as events. Either way the bytes
+    are copied once, out of the channel into a chain of chunks from a ChunkPool shared by every device, and handed
+    on as a ScatterView over them, in one piece or, in streaming mode, a chunk at a time as they fill.
+
+    A transfer is aborted if anything else comes in the middle of it (for SysEx, any other message from the device
+    except system real-time, which MIDI lets into a SysEx message and which goes on as usual; for bulk, a new
+    announcement), if it outgrows maxTransferSize or the pool runs out, or if nothing more arrives
+    for timeout. Completed transfers' throughput is kept per device and kind in TransferStats, which can be read
+    from any thread.
+
+    None of this holds up the other events: a fragment costs a copy into a chunk that's already there, and
+    everything else goes on as it came, in order with the transfers around it. Like any EventSink, it's called from
+    one thread, a Subscription's or a single-worker IngestConsumer's; drained() is what notices timeouts.
+*/
+class TransferAssembler : public EventSink
+{
+public:
+    TransferAssembler(EventSink& downstream, TransferSink& transferSink, size_t numDevices,
+                      TransferSettings transferSettings = {})
+            : sink(downstream),
+              transfers(transferSink),
+              settings(transferSettings),
+              pool(settings.numChunks, settings.chunkSize),
+              assemblies(numDevices * 2),
+              expectedBulk(numDevices),
+              stats(numDevices * 2)
+    {
+    }
+
+    /**
+        From any thread: the device's BLE packets from its next one on, up to size bytes, are a bulk transfer. Call
+        it before asking the device to start, or its first packets go on as events.
+    */
+    void expectBulkTransfer(DeviceHandle device, uint64_t size)
+    {
+        expectedBulk[device].store(jmax(uint64_t{1}, size), std::memory_order_release);
+    }
+
+    //==================================================================================================================
+    void midiEvent(DeviceHandle device, const MidiEvent& event) override
+    {
+        auto&      a     = assemblies[getIndex(device, TransferKind::sysEx)];
+        const auto bytes = event.getBytes();
+
+        if (!event.isSysExFragment())
+        {
+            // Clock and the other real-time messages can come in the middle of a SysEx message without ending it
+            if (a.active && (bytes.empty() || bytes[0] < 0xf8))
+                abort(a);
+
+            sink.midiEvent(device, event);
+            return;
+        }
+
+        if (bytes[0] == 0xf0)
+        {
+            if (a.active)
+                abort(a);
+
+            begin(a, device, TransferKind::sysEx, event.hostTime);
+        }
+
+        // Otherwise it's the rest of one that was aborted, which goes with it
+        if (!a.active)
+            return;
+
+        append(a, bytes, event.hostTime);
+
+        if (a.active && bytes.back() == 0xf7)
+            complete(a);
+    }
+
+    void blePacket(DeviceHandle device, const PacketView& packet) override
+    {
+        auto& a = assemblies[getIndex(device, TransferKind::bulk)];
+
+        if (const auto size = expectedBulk[device].exchange(0, std::memory_order_acquire); size != 0)
+        {
+            if (a.active)
+                abort(a);
+
+            begin(a, device, TransferKind::bulk, packet.hostTime);
+            a.transfer.expectedSize = size;
+        }
+
+        if (!a.active)
+        {
+            sink.blePacket(device, packet);
+            return;
+        }
+
+        append(a, packet.bytes(), packet.hostTime);
+
+        if (a.active && a.transfer.size >= a.transfer.expectedSize)
+            complete(a);
+    }
+
+    void drained() override
+    {
+        if (numActive > 0)
+        {
+            const auto now = hostNanos();
+
+            for (auto& a : assemblies)
+                if (a.active && now - a.transfer.lastTime > settings.timeout)
+                    abort(a);
+        }
+
+        sink.drained();
+    }
+
+    //==================================================================================================================
+    /** From any thread. */
+    [[nodiscard]] TransferStats getStats(DeviceHandle device, TransferKind kind) const
+    {
+        return stats[getIndex(device, kind)].load();
+    }
+
+    /** From the assembler's thread, or once it's stopped. */
+    [[nodiscard]] size_t getActiveCount() const { return numActive; }
+    [[nodiscard]] size_t getFreeChunks() const { return pool.getNumFree(); }
+
+private:
+    /** One device's transfer of one kind, and the chain it's being put together in. */
+    struct Assembly
+    {
+        Transfer transfer;
+        bool     active    = false;
+        uint32_t first     = ChunkPool::none, last = ChunkPool::none;
+        size_t   numChunks = 0;
+        size_t   fill      = 0; // bytes in the last chunk
+    };
+
+    static size_t getIndex(DeviceHandle device, TransferKind kind)
+    {
+        return size_t{device} * 2 + static_cast<size_t>(kind);
+    }
+
+    void begin(Assembly& a, DeviceHandle device, TransferKind kind, int64_t hostTime)
+    {
+        a.transfer           = {};
+        a.transfer.device    = device;
+        a.transfer.kind      = kind;
+        a.transfer.startTime = hostTime;
+        a.transfer.lastTime  = hostTime;
+        a.active             = true;
+        ++numActive;
+    }
+
+    void append(Assembly& a, std::span<const uint8_t> bytes, int64_t hostTime)
+    {
+        if (a.transfer.size + bytes.size() > settings.maxTransferSize)
+        {
+            abort(a);
+            return;
+        }
+
+        const auto chunk_size = pool.getChunkSize();
+
+        while (!bytes.empty())
+        {
+            if (a.numChunks == 0 || a.fill == chunk_size)
+            {
+                const auto c = pool.acquire();
+
+                if (c == ChunkPool::none)
+                {
+                    abort(a);
+                    return;
+                }
+
+                if (a.numChunks == 0)
+                    a.first = c;
+                else
+                    pool.link(a.last, c);
+
+                a.last = c;
+                a.fill = 0;
+                ++a.numChunks;
+            }
+
+            const auto n = std::min(bytes.size(), chunk_size - a.fill);
+
+            std::memcpy(pool.getData(a.last) + a.fill, bytes.data(), n);
+            a.fill           += n;
+            a.transfer.size  += n;
+            bytes             = bytes.subspan(n);
+        }
+
+        ++a.transfer.fragments;
+        a.transfer.lastTime = hostTime;
+
+        if (settings.streaming)
+            passOn(a, a.fill == chunk_size ? a.numChunks : a.numChunks - 1);
+    }
+
+    /** Streaming mode: hands the first count chunks to the sink and gives them back. */
+    void passOn(Assembly& a, size_t count)
+    {
+        if (count == 0)
+            return;
+
+        const auto chunk_size = pool.getChunkSize();
+        const auto bytes      = count == a.numChunks ? (count - 1) * chunk_size + a.fill : count * chunk_size;
+
+        a.transfer.data = {};
+        transfers.transferProgressed(a.transfer, ScatterView(pool, a.first, bytes));
+
+        auto last = a.first;
+
+        for (size_t i = 1; i < count; ++i)
+            last = pool.getNext(last);
+
+        const auto next = pool.getNext(last);
+        pool.release(a.first, last, count);
+
+        a.numChunks -= count;
+        a.first      = a.numChunks > 0 ? next : ChunkPool::none;
+
+        if (a.numChunks == 0)
+        {
+            a.last = ChunkPool::none;
+            a.fill = 0;
+        }
+    }
+
+    void complete(Assembly& a)
+    {
+        if (settings.streaming)
+            passOn(a, a.numChunks);
+
+        a.transfer.data = ScatterView(pool, a.first, getHeldBytes(a));
+        transfers.transferCompleted(a.transfer);
+
+        auto& s = stats[getIndex(a.transfer.device, a.transfer.kind)];
+        auto  v = s.load();
+
+        ++v.completed;
+        v.bytes              += a.transfer.size;
+        v.lastBytesPerSecond  = a.transfer.getBytesPerSecond();
+        v.peakBytesPerSecond  = jmax(v.peakBytesPerSecond, v.lastBytesPerSecond);
+        s.store(v);
+
+        finish(a);
+    }
+
+    void abort(Assembly& a)
+    {
+        a.transfer.data = ScatterView(pool, a.first, getHeldBytes(a));
+        transfers.transferAborted(a.transfer);
+
+        auto& s = stats[getIndex(a.transfer.device, a.transfer.kind)];
+        auto  v = s.load();
+
+        ++v.aborted;
+        s.store(v);
+
+        finish(a);
+    }
+
+    void finish(Assembly& a)
+    {
+        if (a.numChunks > 0)
+            pool.release(a.first, a.last, a.numChunks);
+
+        a.first     = a.last = ChunkPool::none;
+        a.numChunks = 0;
+        a.fill      = 0;
+        a.active    = false;
+        --numActive;
+    }
+
+    size_t getHeldBytes(const Assembly& a) const
+    {
+        return a.numChunks > 0 ? (a.numChunks - 1) * pool.getChunkSize() + a.fill : 0;
+    }
+
+    //==================================================================================================================
+    EventSink&             sink;
+    TransferSink&          transfers;
+    const TransferSettings settings;
+
+    ChunkPool                           pool;
+    std::vector<Assembly>               assemblies; // by getIndex()
+    std::vector<std::atomic<uint64_t>>  expectedBulk;
+    std::vector<SeqLock<TransferStats>> stats;      // by getIndex()
+    size_t                              numActive = 0;
+};
+} // namespace Ingest
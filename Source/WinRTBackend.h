@@ -0,0 +1,690 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "BleMidi.h"
+#include "DeviceProfiles.h"
+#include "Guid128.h"
+#include "IngestSource.h"
+#include "Tracer.h"
+
+#include <unordered_map>
+
+#include <combaseapi.h>
+#include <winrt/Windows.Foundation.Collections.h>
+#include <winrt/Windows.Foundation.Metadata.h>
+#include <winrt/Windows.Storage.Streams.h>
+#include <winrt/Windows.Devices.Bluetooth.h>
+#include <winrt/Windows.Devices.Bluetooth.Advertisement.h>
+#include <winrt/Windows.Devices.Bluetooth.GenericAttributeProfile.h>
+#include <winrt/Windows.Devices.Enumeration.h>
+#include <winrt/Windows.Devices.Midi.h>
+
+using namespace winrt;
+using namespace winrt::Windows::Foundation;
+using namespace winrt::Windows::Storage;
+using namespace winrt::Windows::Devices;
+using namespace winrt::Windows::Devices::Enumeration;
+using namespace winrt::Windows::Devices::Radios;
+using namespace winrt::Windows::Devices::Midi;
+using namespace winrt::Windows::Devices::Bluetooth;
+using namespace winrt::Windows::Devices::Bluetooth::Advertisement;
+using namespace winrt::Windows::Devices::Bluetooth::GenericAttributeProfile;
+
+//======================================================================================================================
+namespace Util {
+using PropertyStore = Collections::IMapView<winrt::hstring, IInspectable>;
+
+/** One TryLookup, rather than HasKey and Lookup; a property that's there but empty reads as missing. */
+template<typename T>
+static auto getProperty(const PropertyStore& map, const winrt::hstring& key) -> std::optional<T>
+{
+    const auto value = map.TryLookup(key);
+
+    return value != nullptr
+           ? std::optional(winrt::unbox_value<T>(value))
+           : std::nullopt;
+}
+
+template<typename T>
+static auto getPropertyOr(const PropertyStore& map, const winrt::hstring& key, T def) -> T
+{
+    const auto p = getProperty<T>(map, key);
+
+    return p.has_value() ? *p : def;
+}
+
+inline Ingest::Guid128 toGuid128(const winrt::guid& g) { return Ingest::Guid128::fromFields(g.Data1, g.Data2, g.Data3, g.Data4); }
+
+inline winrt::guid toWinRTGuid(const Ingest::Guid128& g)
+{
+    winrt::guid r{};
+    r.Data1 = static_cast<uint32_t>(g.hi >> 32);
+    r.Data2 = static_cast<uint16_t>(g.hi >> 16);
+    r.Data3 = static_cast<uint16_t>(g.hi);
+
+    for (int i = 0; i < 8; ++i)
+        r.Data4[i] = static_cast<uint8_t>(g.lo >> (56 - 8 * i));
+
+    return r;
+}
+} // namespace Util
+
+//======================================================================================================================
+/**
+    What a WinRT source's completion handlers hold on to instead of the source, which can be destroyed while one of
+    its asynchronous steps is still in flight. Every handler runs under the lock and only while the source is alive;
+    the source's destructor calls end() before it releases anything the handlers use.
+*/
+struct AsyncLifetime
+{
+    CriticalSection lock;
+    bool            alive = true;
+    IAsyncInfo      pending{nullptr}; // the step in flight, for sources that only ever have one at a time
+
+    /** Under the lock: no handler does anything from here on, and the pending step, if any, is cancelled. */
+    void end()
+    {
+        alive = false;
+
+        if (pending != nullptr && pending.Status() == AsyncStatus::Started)
+            pending.Cancel();
+
+        pending = nullptr;
+    }
+};
+
+/** Makes op the lifetime's pending step, and calls fn(op, status) when it completes if the source is still alive. */
+template<typename Result, typename Fn>
+void whenCompleted(const std::shared_ptr<AsyncLifetime>& life, const IAsyncOperation<Result>& op, Fn fn)
+{
+    life->pending = op;
+
+    op.Completed([life, fn = std::move(fn)](const IAsyncOperation<Result>& sender, AsyncStatus status)
+    {
+        const ScopedLock sl(life->lock);
+
+        if (life->alive)
+            fn(sender, status);
+    });
+}
+
+//======================================================================================================================
+/**
+    A MIDI input port, opened asynchronously. The source can be destroyed while the port is still opening (a device
+    that goes away mid-connect), so the completion handler only touches the object under its lifetime lock, and the
+    destructor marks it gone, cancels the open and revokes the message handler before closing the port. The message
+    handler itself only holds on to the channel, never to the source.
+*/
+class WinRTMidiInput : public Ingest::MidiSource
+{
+public:
+    WinRTMidiInput(String id, const String& winrtId, std::shared_ptr<Ingest::MidiChannel> ch,
+                   Ingest::SourceListener* sourceListener)
+            : identifier(std::move(id)),
+              channel(std::move(ch)),
+              listener(sourceListener)
+    {
+        jassert(channel != nullptr);
+
+        opening = MidiInPort::FromIdAsync(winrt::to_hstring(winrtId.toStdString()));
+        opening.Completed(
+                [this, life = lifetime, winrtId](const IAsyncOperation<MidiInPort>& op, AsyncStatus status)
+                {
+                    const ScopedLock sl(life->lock);
+
+                    if (!life->alive)
+                    {
+                        if (status == AsyncStatus::Completed && op.GetResults() != nullptr)
+                            op.GetResults().Close();
+
+                        return;
+                    }
+
+                    if (status == AsyncStatus::Completed)
+                        port = op.GetResults();
+
+                    const auto device = channel->getSourceIndex();
+                    Ingest::Tracer::instant(Ingest::TracePoint::midiPortOpened, device, port != nullptr);
+
+                    if (port == nullptr)
+                    {
+                        DBG("Failed to open midi port: " << winrtId);
+
+                        if (listener != nullptr)
+                            listener->midiSourceOpened(*this, false);
+                    }
+                    else
+                    {
+                        received = port.MessageReceived(winrt::auto_revoke,
+                                [ch = channel, device](const MidiInPort&, const MidiMessageReceivedEventArgs& args)
+                                {
+                                    const auto host_time = Ingest::hostNanos();
+                                    const auto message   = args.Message();
+                                    const auto bytes     = message.RawData();
+
+                                    Ingest::TraceScope trace(Ingest::TracePoint::midiCallback, device, host_time);
+                                    trace.setArgs(bytes.Length());
+
+                                    // TimeSpan ticks are 100 ns
+                                    ch->push(bytes.data(), bytes.Length(), host_time, message.Timestamp().count() * 100);
+                                }
+                        );
+
+                        if (listener != nullptr)
+                            listener->midiSourceOpened(*this, true);
+                    }
+                }
+        );
+    }
+
+    ~WinRTMidiInput() override
+    {
+        const ScopedLock sl(lifetime->lock);
+        lifetime->alive = false;
+
+        if (opening.Status() == AsyncStatus::Started)
+            opening.Cancel();
+
+        received.revoke();
+
+        if (port != nullptr)
+            port.Close();
+    }
+
+    [[nodiscard]] const String& getIdentifier() const override { return identifier; }
+
+private:
+    const String identifier;
+
+    std::shared_ptr<AsyncLifetime>      lifetime = std::make_shared<AsyncLifetime>();
+    IAsyncOperation<MidiInPort>         opening{nullptr};
+    MidiInPort                          port{nullptr};
+    MidiInPort::MessageReceived_revoker received;
+
+    std::shared_ptr<Ingest::MidiChannel> channel;
+    Ingest::SourceListener*              listener;
+};
+
+//======================================================================================================================
+/**
+    Remembers, per BLE device id, which device profile a previous connect ended up subscribing to.
+
+    A reconnect then asks for exactly that service and characteristic, from the system's GATT cache, instead of
+    enumerating everything over the air. Entries are dropped as soon as they turn out to be stale.
+*/
+class GattHandleCache
+{
+public:
+    struct Entry
+    {
+        int profile = 0; // into Ingest::deviceProfiles
+    };
+
+    [[nodiscard]] auto find(const String& deviceId) const -> std::optional<Entry>
+    {
+        const ScopedLock sl(lock);
+
+        const auto it = entries.find(deviceId);
+        return it == entries.end() ? std::nullopt : std::optional(it->second);
+    }
+
+    void store(const String& deviceId, const Entry& entry)
+    {
+        const ScopedLock sl(lock);
+        entries.insert_or_assign(deviceId, entry);
+    }
+
+    void forget(const String& deviceId)
+    {
+        const ScopedLock sl(lock);
+        entries.erase(deviceId);
+    }
+
+private:
+    struct StringHash
+    {
+        size_t operator()(const String& s) const { return static_cast<size_t>(s.hashCode64()); }
+    };
+
+    CriticalSection                               lock;
+    std::unordered_map<String, Entry, StringHash> entries;
+};
+
+//======================================================================================================================
+/**
+    Connects to a BLE device and subscribes to the characteristic of the most preferred Ingest::DeviceProfile it has,
+    with notifications or indications as the profile says. The profile's PayloadHandler is picked right there, so
+    each value goes into the channel through code made for its format.
+
+    Discovery is cached-first: a device seen before goes straight for its remembered profile, and anything else
+    starts with BluetoothCacheMode::Cached. Only if that comes up empty does it go over the air with
+    BluetoothCacheMode::Uncached. UUIDs are compared as Guid128s.
+
+    Every step is asynchronous, so connects to any number of devices are in flight at the same time. The source is
+    destroyed on every disconnect, often mid-discovery, so each step's completion goes through whenCompleted(), and
+    the destructor ends the lifetime, which cancels the step in flight, before anything else.
+
+    Connection parameters are asked for with RequestPreferredConnectionParameters(), which needs Windows 11; the
+    request holds for as long as it's kept, so the latest one is kept until it's replaced or the device goes.
+*/
+class BleDevice : public Ingest::BlePacketSource
+{
+public:
+    BleDevice(const String& id, std::shared_ptr<Ingest::BleChannel> ch, GattHandleCache& handleCache)
+            : identifier(id),
+              channel(std::move(ch)),
+              cache(handleCache)
+    {
+        jassert(channel != nullptr);
+
+        whenCompleted(lifetime, BluetoothLEDevice::FromIdAsync(winrt::to_hstring(id.toStdString())),
+                [this, id](const IAsyncOperation<BluetoothLEDevice>& sender, AsyncStatus status)
+                {
+                    const auto succeeded = status == AsyncStatus::Completed && sender.GetResults() != nullptr;
+                    trace(Ingest::TracePoint::bleConnected, succeeded);
+
+                    if (!succeeded)
+                    {
+                        DBG("Failed to connect to device: " << id);
+                        return;
+                    }
+
+                    device = sender.GetResults();
+                    connected.store(true, std::memory_order_release);
+
+                    if (const auto cached = cache.find(identifier); cached.has_value())
+                        discoverProfile(cached->profile, BluetoothCacheMode::Cached);
+                    else
+                        discoverServices(BluetoothCacheMode::Cached);
+                }
+        );
+    }
+
+    ~BleDevice() override
+    {
+        const ScopedLock sl(lifetime->lock);
+        lifetime->end();
+        valueChanged.revoke();
+
+        if (parametersRequest != nullptr)
+            parametersRequest.Close();
+    }
+
+    [[nodiscard]] const String& getIdentifier() const override { return identifier; }
+
+    bool requestConnectionProfile(Ingest::ConnectionProfile profile) override
+    {
+        static const auto supported = Metadata::ApiInformation::IsMethodPresent(
+                L"Windows.Devices.Bluetooth.BluetoothLEDevice", L"RequestPreferredConnectionParameters");
+
+        if (!supported || !connected.load(std::memory_order_acquire))
+            return false;
+
+        const auto parameters = profile == Ingest::ConnectionProfile::throughput
+                              ? BluetoothLEPreferredConnectionParameters::ThroughputOptimized()
+                              : profile == Ingest::ConnectionProfile::power
+                              ? BluetoothLEPreferredConnectionParameters::PowerOptimized()
+                              : BluetoothLEPreferredConnectionParameters::Balanced();
+
+        auto       request = device.RequestPreferredConnectionParameters(parameters);
+        const auto granted = request.Status() == BluetoothLEPreferredConnectionParametersRequestStatus::Success;
+
+        trace(Ingest::TracePoint::connectionRequested, static_cast<int64_t>(profile), granted);
+
+        if (!granted)
+        {
+            DBG("Connection parameter request refused by " << identifier);
+            request.Close();
+            return false;
+        }
+
+        if (parametersRequest != nullptr)
+            parametersRequest.Close();
+
+        parametersRequest = request;
+        return true;
+    }
+
+private:
+    void trace(Ingest::TracePoint point, int64_t arg0, int64_t arg1 = 0) const
+    {
+        Ingest::Tracer::instant(point, channel->getSourceIndex(), arg0, arg1);
+    }
+
+    //==================================================================================================================
+    /** Cached lookups that come up empty get one more go over the air; uncached ones are final. */
+    void retryUncached(BluetoothCacheMode failedMode)
+    {
+        cache.forget(identifier);
+
+        if (failedMode == BluetoothCacheMode::Cached)
+            discoverServices(BluetoothCacheMode::Uncached);
+        else
+            DBG("No known GATT profile on device: " << identifier);
+    }
+
+    //==================================================================================================================
+    void discoverServices(BluetoothCacheMode mode)
+    {
+        whenCompleted(lifetime, device.GetGattServicesAsync(mode),
+                [this, mode](const IAsyncOperation<GattDeviceServicesResult>& sender, AsyncStatus status)
+                {
+                    const auto succeeded = status == AsyncStatus::Completed
+                                           && sender.GetResults().Status() == GattCommunicationStatus::Success;
+                    trace(Ingest::TracePoint::gattServicesFound, succeeded, mode == BluetoothCacheMode::Uncached);
+
+                    if (!succeeded)
+                    {
+                        DBG("Failed to get services");
+                        retryUncached(mode);
+                        return;
+                    }
+
+                    const auto services = sender.GetResults().Services();
+                    auto       best     = -1;
+
+                    // The most preferred profile wins, wherever its service comes in the device's list
+                    for (const auto& s : services)
+                    {
+                        const auto p = Ingest::findDeviceProfile(Util::toGuid128(s.Uuid()));
+
+                        if (p >= 0 && (best < 0 || p < best))
+                            best = p;
+                    }
+
+                    if (best >= 0)
+                    {
+                        discoverProfile(best, mode);
+                        return;
+                    }
+
+                    DBG("Failed to find service, available services: ");
+                    for (const auto& s : services)
+                        DBG("  " << Util::toGuid128(s.Uuid()).toString());
+
+                    retryUncached(mode);
+                }
+        );
+    }
+
+    void discoverProfile(int index, BluetoothCacheMode mode)
+    {
+        const auto& profile = Ingest::deviceProfiles[static_cast<size_t>(index)];
+
+        whenCompleted(lifetime, device.GetGattServicesForUuidAsync(Util::toWinRTGuid(profile.service), mode),
+                [this, index, &profile, mode](const IAsyncOperation<GattDeviceServicesResult>& sender, AsyncStatus status)
+                {
+                    const auto succeeded = status == AsyncStatus::Completed
+                                           && sender.GetResults().Status() == GattCommunicationStatus::Success
+                                           && sender.GetResults().Services().Size() > 0;
+                    trace(Ingest::TracePoint::gattServiceFound, succeeded, mode == BluetoothCacheMode::Uncached);
+
+                    if (!succeeded)
+                    {
+                        DBG("Failed to get service " << profile.service.toString());
+                        retryUncached(mode);
+                        return;
+                    }
+
+                    service = sender.GetResults().Services().GetAt(0);
+                    whenCompleted(lifetime,
+                            service.GetCharacteristicsForUuidAsync(Util::toWinRTGuid(profile.characteristic), mode),
+                            [this, index, &profile, mode](const IAsyncOperation<GattCharacteristicsResult>& op, AsyncStatus s)
+                            {
+                                const auto found = s == AsyncStatus::Completed
+                                                   && op.GetResults().Status() == GattCommunicationStatus::Success
+                                                   && op.GetResults().Characteristics().Size() > 0;
+                                trace(Ingest::TracePoint::gattCharacteristicFound, found,
+                                      mode == BluetoothCacheMode::Uncached);
+
+                                if (!found)
+                                {
+                                    DBG("Failed to find characteristic " << profile.characteristic.toString());
+                                    retryUncached(mode);
+                                    return;
+                                }
+
+                                subscribe(index, op.GetResults().Characteristics().GetAt(0));
+                            }
+                    );
+                }
+        );
+    }
+
+    void subscribe(int index, const GattCharacteristic& characteristic)
+    {
+        const auto& profile = Ingest::deviceProfiles[static_cast<size_t>(index)];
+
+        charact = characteristic;
+
+        Ingest::withPayloadHandler(profile.format, [this]<Ingest::PayloadFormat Format>()
+        {
+            // The handler keeps state (a BLE-MIDI decoder) across values, and the callbacks come one at a time. Like
+            // the MIDI input's, it only holds on to the channel, so a value that comes in late never sees the source.
+            valueChanged = charact.ValueChanged(winrt::auto_revoke,
+                    [ch = channel, handler = std::make_shared<Ingest::PayloadHandler<Format>>()]
+                    (const GattCharacteristic&, const GattValueChangedEventArgs& args)
+            {
+                const auto host_time     = Ingest::hostNanos();
+                const auto buf           = args.CharacteristicValue();
+                const auto platform_time = winrt::clock::to_sys(args.Timestamp()).time_since_epoch();
+
+                Ingest::TraceScope scope(Ingest::TracePoint::bleCallback, ch->getSourceIndex(), host_time);
+                scope.setArgs(buf.Length());
+
+                (*handler)(*ch, {buf.data(), buf.Length()}, host_time,
+                           std::chrono::duration_cast<std::chrono::nanoseconds>(platform_time).count());
+            });
+        });
+
+        const auto cccd = profile.delivery == Ingest::GattDelivery::indicate
+                        ? GattClientCharacteristicConfigurationDescriptorValue::Indicate
+                        : GattClientCharacteristicConfigurationDescriptorValue::Notify;
+
+        whenCompleted(lifetime, charact.WriteClientCharacteristicConfigurationDescriptorWithResultAsync(cccd),
+                [this, index, &profile](const IAsyncOperation<GattWriteResult>& sender, AsyncStatus status)
+                {
+                    const auto succeeded = status == AsyncStatus::Completed
+                                           && sender.GetResults().Status() == GattCommunicationStatus::Success;
+                    trace(Ingest::TracePoint::notificationsEnabled, succeeded, index);
+
+                    if (!succeeded)
+                    {
+                        DBG("Failed to enable notifications for " << profile.characteristic.toString());
+                        cache.forget(identifier);
+                        return;
+                    }
+
+                    cache.store(identifier, {index});
+                }
+        );
+    }
+
+    //==================================================================================================================
+    const String identifier;
+
+    std::shared_ptr<AsyncLifetime> lifetime = std::make_shared<AsyncLifetime>();
+
+    BluetoothLEDevice                        device{nullptr};
+    GattDeviceService                        service{nullptr};
+    GattCharacteristic                       charact{nullptr};
+    GattCharacteristic::ValueChanged_revoker valueChanged;
+    std::atomic<bool>                        connected{false};
+
+    BluetoothLEPreferredConnectionParametersRequest parametersRequest{nullptr}; // owner thread only
+
+    //==================================================================================================================
+    std::shared_ptr<Ingest::BleChannel> channel;
+    GattHandleCache&                    cache;
+};
+
+//======================================================================================================================
+/**
+    The MIDI over Bluetooth LE characteristic of a paired device, written without response.
+
+    The packet size follows the GATT session's negotiated MTU (MaxPduSize), which can still grow after the connect;
+    it reads as 0 until the characteristic has been found. Like BleDevice, discovery tries the system's GATT cache
+    before going over the air. Writes are fire and forget: the stack queues them for the next connection event.
+
+    The connect and discovery steps go through whenCompleted() and the MTU handler checks the same lifetime, so an
+    output closed mid-connect is never touched again.
+*/
+class BleMidiOutput : public Ingest::BlePacketWriter
+{
+public:
+    explicit BleMidiOutput(const String& id) : identifier(id)
+    {
+        whenCompleted(lifetime, BluetoothLEDevice::FromIdAsync(winrt::to_hstring(id.toStdString())),
+                [this, id](const IAsyncOperation<BluetoothLEDevice>& sender, AsyncStatus status)
+                {
+                    if (status != AsyncStatus::Completed || sender.GetResults() == nullptr)
+                    {
+                        DBG("Failed to connect to device for MIDI output: " << id);
+                        return;
+                    }
+
+                    device = sender.GetResults();
+
+                    whenCompleted(lifetime, GattSession::FromDeviceIdAsync(device.BluetoothDeviceId()),
+                            [this](const IAsyncOperation<GattSession>& op, AsyncStatus s)
+                            {
+                                if (s == AsyncStatus::Completed && op.GetResults() != nullptr)
+                                {
+                                    session = op.GetResults();
+                                    session.MaintainConnection(true);
+                                    attMtu.store(session.MaxPduSize(), std::memory_order_relaxed);
+
+                                    mtuChanged = session.MaxPduSizeChanged(winrt::auto_revoke,
+                                            [this, life = lifetime](const GattSession& changed, const IInspectable&)
+                                            {
+                                                const ScopedLock sl(life->lock);
+
+                                                if (life->alive)
+                                                    attMtu.store(changed.MaxPduSize(), std::memory_order_relaxed);
+                                            }
+                                    );
+                                }
+
+                                discover(BluetoothCacheMode::Cached);
+                            }
+                    );
+                }
+        );
+    }
+
+    ~BleMidiOutput() override
+    {
+        const ScopedLock sl(lifetime->lock);
+        lifetime->end();
+        mtuChanged.revoke();
+
+        if (session != nullptr)
+            session.Close();
+    }
+
+    [[nodiscard]] const String& getIdentifier() const override { return identifier; }
+
+    [[nodiscard]] size_t getMaxPacketSize() const override
+    {
+        return writable.load(std::memory_order_acquire) ? static_cast<size_t>(attMtu.load(std::memory_order_relaxed)) - 3 : 0;
+    }
+
+    bool write(std::span<const uint8_t> packet) override
+    {
+        if (!writable.load(std::memory_order_acquire))
+            return false;
+
+        Streams::Buffer buffer(static_cast<uint32_t>(packet.size()));
+        std::memcpy(buffer.data(), packet.data(), packet.size());
+        buffer.Length(static_cast<uint32_t>(packet.size()));
+
+        charact.WriteValueWithResultAsync(buffer, GattWriteOption::WriteWithoutResponse);
+        return true;
+    }
+
+private:
+    void discover(BluetoothCacheMode mode)
+    {
+        const auto retry = [this, mode]
+        {
+            if (mode == BluetoothCacheMode::Cached)
+                discover(BluetoothCacheMode::Uncached);
+            else
+                DBG("No BLE-MIDI characteristic on device: " << identifier);
+        };
+
+        whenCompleted(lifetime,
+                device.GetGattServicesForUuidAsync(Util::toWinRTGuid(Ingest::BleMidi::serviceUuid), mode),
+                [this, mode, retry](const IAsyncOperation<GattDeviceServicesResult>& sender, AsyncStatus status)
+                {
+                    if (status != AsyncStatus::Completed || sender.GetResults().Status() != GattCommunicationStatus::Success
+                        || sender.GetResults().Services().Size() == 0)
+                    {
+                        retry();
+                        return;
+                    }
+
+                    service = sender.GetResults().Services().GetAt(0);
+                    whenCompleted(lifetime,
+                            service.GetCharacteristicsForUuidAsync(
+                                    Util::toWinRTGuid(Ingest::BleMidi::characteristicUuid), mode),
+                            [this, retry](const IAsyncOperation<GattCharacteristicsResult>& op, AsyncStatus s)
+                            {
+                                if (s != AsyncStatus::Completed || op.GetResults().Status() != GattCommunicationStatus::Success
+                                    || op.GetResults().Characteristics().Size() == 0)
+                                {
+                                    retry();
+                                    return;
+                                }
+
+                                charact = op.GetResults().Characteristics().GetAt(0);
+                                writable.store(true, std::memory_order_release);
+
+                                Ingest::Tracer::instant(Ingest::TracePoint::bleMidiOutputReady, Ingest::noTraceDevice,
+                                                        attMtu.load(std::memory_order_relaxed));
+                            }
+                    );
+                }
+        );
+    }
+
+    //==================================================================================================================
+    const String identifier;
+
+    std::shared_ptr<AsyncLifetime> lifetime = std::make_shared<AsyncLifetime>();
+
+    BluetoothLEDevice                      device{nullptr};
+    GattSession                            session{nullptr};
+    GattSession::MaxPduSizeChanged_revoker mtuChanged;
+    GattDeviceService                      service{nullptr};
+    GattCharacteristic                     charact{nullptr};
+
+    std::atomic<uint16_t> attMtu{23};
+    std::atomic<bool>     writable{false};
+};
+
+//======================================================================================================================
+class WinRTBackend : public Ingest::Backend
+{
+public:
+    auto openMidiInput(const String& identifier, const String& portId, std::shared_ptr<Ingest::MidiChannel> channel,
+                       Ingest::SourceListener* listener) -> std::unique_ptr<Ingest::MidiSource> override
+    {
+        return std::make_unique<WinRTMidiInput>(identifier, portId, std::move(channel), listener);
+    }
+
+    auto connectBleDevice(const String& deviceId, std::shared_ptr<Ingest::BleChannel> channel)
+        -> std::unique_ptr<Ingest::BlePacketSource> override
+    {
+        return std::make_unique<BleDevice>(deviceId, std::move(channel), gattHandles);
+    }
+
+    auto openBleMidiOutput(const String& deviceId) -> std::unique_ptr<Ingest::BlePacketWriter> override
+    {
+        return std::make_unique<BleMidiOutput>(deviceId);
+    }
+
+private:
+    GattHandleCache gattHandles;
+};